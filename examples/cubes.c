@@ -44,6 +44,30 @@
  *     contain 36 entries to tell the GPU which vertices to connect.
  */
 
+/* Draw @cube_count copies of display list @cube spinning at time @t
+ * @matrices: room for @cube_count instance matrices
+ */
+static void draw_cubes(const b3d_list_t *cube,
+                       float *matrices,
+                       int cube_count,
+                       float t)
+{
+    for (int i = 0; i < cube_count; ++i) {
+        b3d_reset();
+        b3d_rotate_y(i * 0.1);
+        b3d_translate(1, 1, fmodf(i * 0.1, 100));
+        b3d_rotate_z(i + t);
+        b3d_get_model_matrix(&matrices[i * 16]);
+    }
+
+    /* The spin all cubes share comes before their own placement */
+    b3d_reset();
+    b3d_rotate_z(t);
+    b3d_rotate_y(t);
+    b3d_rotate_x(t);
+    b3d_draw_instanced(cube, matrices, cube_count);
+}
+
 /* Render multiple spinning cubes
  * @pixels:         output pixel buffer
  * @depth:          depth buffer
@@ -155,18 +179,19 @@ static void render_cubes(uint32_t *pixels,
         0xf6f4d2, 0xcbdfbd, 0xf19c79, 0xa44a3f, 0x5465ff, 0x788bff,
     };
 
-    for (int i = 0; i < cube_count; ++i) {
-        b3d_reset();
-        b3d_rotate_z(t);
-        b3d_rotate_y(t);
-        b3d_rotate_x(t);
-        b3d_rotate_y(i * 0.1);
-        b3d_translate(1, 1, fmodf(i * 0.1, 100));
-        b3d_rotate_z(i + t);
-
+    /* Record the cube once, then draw all copies in one call */
+    size_t list_size = b3d_list_arena_size(12);
+    void *list_arena = malloc(list_size);
+    float *matrices = malloc(cube_count * 16 * sizeof(float));
+    if (list_arena && matrices && b3d_list_begin(list_arena, list_size)) {
         for (int f = 0; f < 12; ++f)
             b3d_triangle(&cube_faces[f], cube_colors[f]);
+        const b3d_list_t *cube = b3d_list_end();
+        if (cube)
+            draw_cubes(cube, matrices, cube_count, t);
     }
+    free(matrices);
+    free(list_arena);
 }
 
 int main(int argc, char **argv)
@@ -179,7 +204,7 @@ int main(int argc, char **argv)
 
     if (snapshot) {
         render_cubes(pixel_buffer, depth_buffer, width, height, 100, 1.2f);
-        write_png(snapshot, pixel_buffer, width, height);
+        write_snapshot(snapshot, pixel_buffer, width, height);
         free(pixel_buffer);
         free(depth_buffer);
         return 0;
@@ -299,9 +324,21 @@ int main(int argc, char **argv)
     int have_enough_samples = 0;
 
     int cube_count = 100;
+    float *matrices = NULL;
+    int matrix_count = 0;
 
     b3d_set_camera(&(b3d_camera_t) {0, 0, -2, 0, 0, 0});
 
+    /* Record the cube once, all copies are instances of it */
+    size_t list_size = b3d_list_arena_size(12);
+    void *list_arena = malloc(list_size);
+    const b3d_list_t *cube = NULL;
+    if (list_arena && b3d_list_begin(list_arena, list_size)) {
+        for (int f = 0; f < 12; ++f)
+            b3d_triangle(&cube_faces[f], cube_colors[f]);
+        cube = b3d_list_end();
+    }
+
     int quit = 0;
     while (!quit) {
         uint64_t time_stamp = SDL_GetPerformanceCounter();
@@ -323,21 +360,16 @@ int main(int argc, char **argv)
 
         b3d_clear();
 
-        for (int i = 0; i < cube_count; ++i) {
-            /* Reset transformations back to the origin */
-            b3d_reset();
-
-            b3d_rotate_z(t);
-            b3d_rotate_y(t);
-            b3d_rotate_x(t);
-
-            b3d_rotate_y(i * 0.1);
-            b3d_translate(1, 1, fmodf(i * 0.1, 100));
-            b3d_rotate_z(i + t);
-
-            for (int f = 0; f < 12; ++f)
-                b3d_triangle(&cube_faces[f], cube_colors[f]);
+        if (cube_count > matrix_count) {
+            float *grown =
+                realloc(matrices, cube_count * 16 * sizeof(float));
+            if (grown) {
+                matrices = grown;
+                matrix_count = cube_count;
+            }
         }
+        if (cube && cube_count <= matrix_count)
+            draw_cubes(cube, matrices, cube_count, t);
 
         /* Display the pixel buffer on screen (using a streaming texture) */
         SDL_RenderClear(renderer);
@@ -366,6 +398,8 @@ int main(int argc, char **argv)
         }
     }
 
+    free(matrices);
+    free(list_arena);
     free(pixel_buffer);
     free(depth_buffer);
     SDL_DestroyTexture(texture);
@@ -24,8 +24,8 @@ static const uint32_t palette[] = {
 
 static uint32_t shade_color(float dot)
 {
-    if (dot < 0.0f)
-        dot = 0.0f;
+    /* Gentle gamma to reduce banding across palette steps */
+    dot = powf(fmaxf(dot, 0.0f), 0.8f);
     if (dot > 1.0f)
         dot = 1.0f;
     int idx = (int) (dot * (sizeof(palette) / sizeof(palette[0]) - 1));
@@ -55,8 +55,8 @@ static void render_frame(uint32_t *pixels,
 
     const float R = 2.0f; /* major radius */
     const float r = 0.7f; /* minor radius */
-    const int segU = 96;  /* higher tessellation for smoother surface */
-    const int segV = 64;
+    const int segU = 48; /* Gouraud shading keeps this coarse mesh smooth */
+    const int segV = 32;
     const float du = (2.0f * 3.14159265f) / segU;
     const float dv = (2.0f * 3.14159265f) / segV;
     float lx = 0.3f, ly = 0.8f, lz = -0.6f;
@@ -111,34 +111,24 @@ static void render_frame(uint32_t *pixels,
             float ny11 = su1 * cv1;
             float nz11 = sv1;
 
-            /* Two triangles per quad; average vertex normals for shading */
-            float dot0 =
-                (nx00 * lx + ny00 * ly + nz00 * lz + nx10 * lx + ny10 * ly +
-                 nz10 * lz + nx11 * lx + ny11 * ly + nz11 * lz) /
-                3.0f;
-            float dot1 =
-                (nx00 * lx + ny00 * ly + nz00 * lz + nx11 * lx + ny11 * ly +
-                 nz11 * lz + nx01 * lx + ny01 * ly + nz01 * lz) /
-                3.0f;
-            /* Gentle gamma to reduce banding across palette steps */
-            dot0 = powf(fmaxf(dot0, 0.0f), 0.8f);
-            dot1 = powf(fmaxf(dot1, 0.0f), 0.8f);
-
-            uint32_t c0 = shade_color(dot0);
-            uint32_t c1 = shade_color(dot1);
-
-            b3d_triangle(&(b3d_tri_t) {{
-                             {x00, y00, z00},
-                             {x10, y10, z10},
-                             {x11, y11, z11},
-                         }},
-                         c0);
-            b3d_triangle(&(b3d_tri_t) {{
-                             {x00, y00, z00},
-                             {x11, y11, z11},
-                             {x01, y01, z01},
-                         }},
-                         c1);
+            /* Two triangles per quad, colors interpolated per vertex */
+            uint32_t c00 = shade_color(nx00 * lx + ny00 * ly + nz00 * lz);
+            uint32_t c10 = shade_color(nx10 * lx + ny10 * ly + nz10 * lz);
+            uint32_t c01 = shade_color(nx01 * lx + ny01 * ly + nz01 * lz);
+            uint32_t c11 = shade_color(nx11 * lx + ny11 * ly + nz11 * lz);
+
+            b3d_triangle_ex(&(b3d_tri_t) {{
+                                {x00, y00, z00},
+                                {x10, y10, z10},
+                                {x11, y11, z11},
+                            }},
+                            &(b3d_attr_t) {{c00, c10, c11}, {{0}}});
+            b3d_triangle_ex(&(b3d_tri_t) {{
+                                {x00, y00, z00},
+                                {x11, y11, z11},
+                                {x01, y01, z01},
+                            }},
+                            &(b3d_attr_t) {{c00, c11, c01}, {{0}}});
         }
     }
 }
@@ -155,7 +145,7 @@ int main(int argc, char **argv)
 
     if (snapshot) {
         render_frame(pixels, depth, width, height, 1.4f);
-        write_png(snapshot, pixels, width, height);
+        write_snapshot(snapshot, pixels, width, height);
         free(pixels);
         free(depth);
         return 0;
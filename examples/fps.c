@@ -53,6 +53,9 @@ int main(int argument_count, char **arguments)
     } else if (err == 3) {
         printf("Invalid vertex index in OBJ file.\n");
         exit(1);
+    } else if (err == 4) {
+        printf("Line too long in OBJ file.\n");
+        exit(1);
     }
 
     float world_size = 20;
@@ -277,7 +280,7 @@ int main(int argument_count, char **arguments)
                 b3d_triangle(&pyramid_faces[f], pyramid_colors[f]);
         }
 
-        write_png(snapshot, pixels, width, height);
+        write_snapshot(snapshot, pixels, width, height);
         free(pixels);
         free(depth);
         b3d_free_mesh(&mesh);
@@ -316,6 +319,25 @@ int main(int argument_count, char **arguments)
     float head_radius = 0.5f;
     float head_confetti_y = 2.0f;
 
+    /* The border cubes never move: one recorded cube, placed per instance */
+    const int border_count = (int) world_size * 4;
+    float *border_matrices = malloc(border_count * 16 * sizeof(float));
+    size_t border_size = b3d_list_arena_size(12);
+    void *border_arena = malloc(border_size);
+    const b3d_list_t *border_cube = NULL;
+
+    /* Rasterize each frame on a second thread while the next one is set up */
+    uint32_t *back_pixels = malloc(width * height * sizeof(back_pixels[0]));
+    size_t bin_size = b3d_bin_arena_size(width, height, 8192);
+    size_t frame_size = b3d_frame_arena_size(width, height, 8192);
+    void *bin_arena = malloc(bin_size);
+    void *frame_arena = malloc(frame_size);
+    int pipelined = back_pixels && bin_arena && frame_arena &&
+                    b3d_set_binning(bin_arena, bin_size, 2) &&
+                    b3d_set_frames(back_pixels, frame_arena, frame_size);
+    if (!pipelined)
+        b3d_set_binning(NULL, 0, 0);
+
     SDL_SetWindowTitle(window, "Find The Golden Heads");
 
     int quit = 0;
@@ -356,6 +378,8 @@ int main(int argument_count, char **arguments)
         if (quit)
             break;
 
+        if (pipelined)
+            b3d_frame_begin();
         b3d_clear();
         float t = SDL_GetTicks() * 0.001f;
 
@@ -570,35 +594,46 @@ int main(int argument_count, char **arguments)
         static const uint32_t pyramid_colors[4] = {0x004749, 0x00535a, 0x00746b,
                                                    0x00945c};
 
-        /* Make a jagged border around the world using stretched cubes */
-        srand(seed);
-        for (int i = -world_size; i < world_size; i += 2) {
-            for (int j = 0; j < 4; ++j) {
-                float x = i, z = i;
-                switch (j) {
-                case 0:
-                    x = -world_size;
-                    break;
-                case 1:
-                    x = world_size;
-                    break;
-                case 2:
-                    z = -world_size;
-                    break;
-                case 3:
-                    z = world_size;
-                    break;
+        /* Make a jagged border around the world using stretched cubes,
+         * placed on the first frame and drawn in one call after that
+         */
+        if (!border_cube && border_matrices && border_arena &&
+            b3d_list_begin(border_arena, border_size)) {
+            for (int f = 0; f < 12; ++f)
+                b3d_triangle(&cube_faces[f], cube_colors[f]);
+            border_cube = b3d_list_end();
+
+            srand(seed);
+            int n = 0;
+            for (int i = -world_size; i < world_size; i += 2) {
+                for (int j = 0; j < 4; ++j) {
+                    float x = i, z = i;
+                    switch (j) {
+                    case 0:
+                        x = -world_size;
+                        break;
+                    case 1:
+                        x = world_size;
+                        break;
+                    case 2:
+                        z = -world_size;
+                        break;
+                    case 3:
+                        z = world_size;
+                        break;
+                    }
+                    b3d_reset();
+                    b3d_rotate_y(RND * 3.14159f);
+                    b3d_rotate_x(RND * 3.14159f);
+                    b3d_rotate_z(RND * 3.14159f);
+                    b3d_scale(1.0f + RND * 2, 1.0f + RND * 8, 1.0f + RND * 2);
+                    b3d_translate(x, 0.5, z);
+                    b3d_get_model_matrix(&border_matrices[n++ * 16]);
                 }
-                b3d_reset();
-                b3d_rotate_y(RND * 3.14159f);
-                b3d_rotate_x(RND * 3.14159f);
-                b3d_rotate_z(RND * 3.14159f);
-                b3d_scale(1.0f + RND * 2, 1.0f + RND * 8, 1.0f + RND * 2);
-                b3d_translate(x, 0.5, z);
-                for (int f = 0; f < 12; ++f)
-                    b3d_triangle(&cube_faces[f], cube_colors[f]);
             }
         }
+        b3d_reset();
+        b3d_draw_instanced(border_cube, border_matrices, border_count);
 
         /* Scatter some pyramids around in the world */
         srand(seed);
@@ -659,22 +694,38 @@ int main(int argument_count, char **arguments)
             }
         }
 
+        /* Show the previous frame while this one is rasterized */
+        uint32_t *frame = pixels;
+        if (pipelined) {
+            frame = b3d_frame_wait();
+            b3d_frame_submit();
+            if (!frame)
+                continue;
+        }
+
         /* Draw crosshair */
         int cx = width / 2, cy = height / 2;
-        pixels[(cx - 5) + cy * width] = 0xffffff;
-        pixels[cx + cy * width] = 0xffffff;
-        pixels[(cx + 5) + cy * width] = 0xffffff;
-        pixels[cx + (cy - 5) * width] = 0xffffff;
-        pixels[cx + (cy + 5) * width] = 0xffffff;
+        frame[(cx - 5) + cy * width] = 0xffffff;
+        frame[cx + cy * width] = 0xffffff;
+        frame[(cx + 5) + cy * width] = 0xffffff;
+        frame[cx + (cy - 5) * width] = 0xffffff;
+        frame[cx + (cy + 5) * width] = 0xffffff;
 
         /* Display the pixel buffer on the screen */
         SDL_Delay(1);
         SDL_RenderClear(renderer);
-        SDL_UpdateTexture(texture, NULL, pixels, width * sizeof(uint32_t));
+        SDL_UpdateTexture(texture, NULL, frame, width * sizeof(uint32_t));
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
     }
 
+    b3d_set_frames(NULL, NULL, 0);
+    b3d_set_binning(NULL, 0, 0);
+    free(frame_arena);
+    free(bin_arena);
+    free(back_pixels);
+    free(border_matrices);
+    free(border_arena);
     free(pixels);
     free(depth);
     b3d_free_mesh(&mesh);
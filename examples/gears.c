@@ -329,7 +329,7 @@ int main(int argc, char **argv)
     if (snapshot) {
         angle_deg = 45.0f; /* Static snapshot angle */
         render_frame(pixels, depth, width, height);
-        write_png(snapshot, pixels, width, height);
+        write_snapshot(snapshot, pixels, width, height);
         free(pixels);
         free(depth);
         return 0;
@@ -255,7 +255,7 @@ int main(int argc, char **argv)
     if (snapshot) {
         update_light();
         render(pixels, depth, 0.8f);
-        write_png(snapshot, pixels, WIDTH, HEIGHT);
+        write_snapshot(snapshot, pixels, WIDTH, HEIGHT);
         printf("Snapshot saved to %s\n", snapshot);
         free(pixels);
         free(depth);
@@ -4,18 +4,28 @@
  * a file (moai.obj) provided in this examples directory. It supports headless
  * snapshots with --snapshot=PATH or B3D_SNAPSHOT.
  *
- * Right now the '.obj' loading code will fail on models containing
- * non-triangular faces.
+ * Quads and other polygons are split into triangle fans by the loader.
+ * Binary '.b3dm' caches made by scripts/obj2b3dm.py are memory-mapped
+ * instead of parsed, which keeps start-up instant for large models.
  */
 
 #include <SDL.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "b3d-math.h"
 #include "b3d.h"
+#include "b3d_mesh.h"
 #include "b3d_obj.h"
 #include "utils.h"
 
+/* Check whether @path ends in @ext */
+static int has_extension(const char *path, const char *ext)
+{
+    size_t n = strlen(path), m = strlen(ext);
+    return n >= m && strcmp(path + n - m, ext) == 0;
+}
+
 /* Main function for OBJ loader example
  * @argument_count: number of command line arguments
  * @arguments:      array of command line argument strings
@@ -39,8 +49,26 @@ int main(int argument_count, char **arguments)
         }
     }
 
-    b3d_mesh_t mesh;
-    int err = b3d_load_obj(file_name, &mesh);
+    b3d_indexed_mesh_t obj = {0};
+    b3d_mapped_mesh_t cache = {0};
+    int err;
+    if (has_extension(file_name, ".b3dm")) {
+        err = b3d_mesh_map(file_name, &cache);
+    } else {
+        err = b3d_load_obj_indexed(file_name, &obj, NULL, 0);
+        cache.positions = obj.positions;
+        cache.indices = obj.indices;
+        cache.vertex_count = obj.vertex_count;
+        cache.index_count = obj.index_count;
+        for (int k = 0; !err && k < 3; k++) {
+            cache.min[k] = cache.max[k] = obj.positions[k];
+            for (int i = 1; i < obj.vertex_count; i++) {
+                float v = obj.positions[i * 3 + k];
+                cache.min[k] = v < cache.min[k] ? v : cache.min[k];
+                cache.max[k] = v > cache.max[k] ? v : cache.max[k];
+            }
+        }
+    }
     if (err == 1) {
         printf("Failed to load file '%s'.\n", file_name);
         exit(1);
@@ -48,16 +76,47 @@ int main(int argument_count, char **arguments)
         printf("Memory allocation failed.\n");
         exit(1);
     } else if (err == 3) {
-        printf("Invalid vertex index in OBJ file.\n");
+        printf("Invalid vertex index or mesh file.\n");
+        exit(1);
+    } else if (err == 4) {
+        printf("Line too long in OBJ file.\n");
+        exit(1);
+    } else if (cache.vertex_count == 0) {
+        printf("No vertices in file '%s'.\n", file_name);
         exit(1);
     }
 
-    printf("Loaded %d triangles from file '%s'.\n", mesh.triangle_count,
-           file_name);
+    int triangle_count = cache.index_count / 3;
+    printf("Loaded %d triangles from file '%s'.\n", triangle_count, file_name);
 
     /* Calculate mesh bounds for camera positioning */
-    float min_y, max_y, max_xz;
-    b3d_mesh_bounds(&mesh, &min_y, &max_y, &max_xz);
+    float min_y = cache.min[1], max_y = cache.max[1], max_xz = 0;
+    for (int k = 0; k < 3; k += 2) {
+        float lo = b3d_fabsf(cache.min[k]), hi = b3d_fabsf(cache.max[k]);
+        max_xz = lo > max_xz ? lo : max_xz;
+        max_xz = hi > max_xz ? hi : max_xz;
+    }
+
+    /* Shade each triangle by its average height, unless the cache has
+     * stored colors
+     */
+    uint32_t *shade = NULL;
+    const uint32_t *colors = cache.colors;
+    if (!colors) {
+        shade = malloc((size_t) (triangle_count ? triangle_count : 1) *
+                       sizeof(shade[0]));
+        for (int t = 0; shade && t < triangle_count; t++) {
+            const uint32_t *tri = &cache.indices[t * 3];
+            float avg_y = (cache.positions[tri[0] * 3 + 1] +
+                           cache.positions[tri[1] * 3 + 1] +
+                           cache.positions[tri[2] * 3 + 1]) /
+                          3;
+            float brightness = (avg_y - min_y) / max_y;
+            uint32_t c = (50 + (int) (brightness * 200)) & 0xff;
+            shade[t] = c << 16 | c << 8 | c;
+        }
+        colors = shade;
+    }
 
     /* Center the model along the y axis */
     float y_offset = (min_y + max_y) / 2;
@@ -73,26 +132,14 @@ int main(int argument_count, char **arguments)
         b3d_clear();
         b3d_reset();
         b3d_rotate_y(t * 0.3);
-
-        for (int i = 0; i < mesh.vertex_count; i += 9) {
-            float avg_y = (mesh.triangles[i + 1] + mesh.triangles[i + 4] +
-                           mesh.triangles[i + 7]) /
-                          3;
-            float brightness = (avg_y - min_y) / max_y;
-            uint32_t c = (50 + (int) (brightness * 200)) & 0xff;
-            b3d_triangle(
-                &(b3d_tri_t) {{{mesh.triangles[i + 0], mesh.triangles[i + 1],
-                                mesh.triangles[i + 2]},
-                               {mesh.triangles[i + 3], mesh.triangles[i + 4],
-                                mesh.triangles[i + 5]},
-                               {mesh.triangles[i + 6], mesh.triangles[i + 7],
-                                mesh.triangles[i + 8]}}},
-                (c << 16 | c << 8 | c));
-        }
-        write_png(snapshot, pixels, width, height);
+        b3d_draw_mesh(cache.positions, cache.vertex_count, cache.indices,
+                      cache.index_count, colors);
+        write_snapshot(snapshot, pixels, width, height);
         free(pixels);
         free(depth);
-        b3d_free_mesh(&mesh);
+        free(shade);
+        b3d_mesh_unmap(&cache);
+        b3d_free_indexed_mesh(&obj);
         return 0;
     }
 
@@ -122,21 +169,8 @@ int main(int argument_count, char **arguments)
         b3d_reset();
         b3d_rotate_y(t * 0.3);
 
-        for (int i = 0; i < mesh.vertex_count; i += 9) {
-            float avg_y = (mesh.triangles[i + 1] + mesh.triangles[i + 4] +
-                           mesh.triangles[i + 7]) /
-                          3;
-            float brightness = (avg_y - min_y) / max_y;
-            uint32_t c = (50 + (int) (brightness * 200)) & 0xff;
-            b3d_triangle(
-                &(b3d_tri_t) {{{mesh.triangles[i + 0], mesh.triangles[i + 1],
-                                mesh.triangles[i + 2]},
-                               {mesh.triangles[i + 3], mesh.triangles[i + 4],
-                                mesh.triangles[i + 5]},
-                               {mesh.triangles[i + 6], mesh.triangles[i + 7],
-                                mesh.triangles[i + 8]}}},
-                (c << 16 | c << 8 | c));
-        }
+        b3d_draw_mesh(cache.positions, cache.vertex_count, cache.indices,
+                      cache.index_count, colors);
 
         SDL_Delay(1);
         SDL_RenderClear(renderer);
@@ -147,7 +181,9 @@ int main(int argument_count, char **arguments)
 
     free(pixels);
     free(depth);
-    b3d_free_mesh(&mesh);
+    free(shade);
+    b3d_mesh_unmap(&cache);
+    b3d_free_indexed_mesh(&obj);
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
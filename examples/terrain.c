@@ -36,6 +36,32 @@ static uint32_t height_color(float h)
     return (r << 16) | (g << 8) | b;
 }
 
+#define GRID_TRIS ((GRID_SIZE - 1) * (GRID_SIZE - 1) * 2)
+
+/* Grid mesh: rebuilt positions/colors each frame, static topology */
+static float grid_positions[GRID_SIZE * GRID_SIZE * 3];
+static uint32_t grid_indices[GRID_TRIS * 3];
+static uint32_t grid_colors[GRID_TRIS];
+
+/* Build the triangle index list once (two triangles per cell) */
+static void build_grid_indices(void)
+{
+    uint32_t *idx = grid_indices;
+    for (int z = 0; z < GRID_SIZE - 1; ++z) {
+        for (int x = 0; x < GRID_SIZE - 1; ++x) {
+            uint32_t i00 = (uint32_t) (z * GRID_SIZE + x);
+            uint32_t i10 = i00 + 1;
+            uint32_t i01 = i00 + GRID_SIZE;
+            uint32_t i11 = i01 + 1;
+
+            /* Winding flipped so culling keeps the patch visible when tilted.
+             */
+            *idx++ = i00, *idx++ = i11, *idx++ = i10;
+            *idx++ = i00, *idx++ = i01, *idx++ = i11;
+        }
+    }
+}
+
 /* Render a heightmap terrain
  * @pixels: output pixel buffer
  * @depth:  depth buffer
@@ -61,33 +87,27 @@ static void render_heightmap(uint32_t *pixels,
     b3d_rotate_x(-0.55f);
     b3d_translate(0.0f, -1.4f, 12.0f);
 
-    for (int z = 0; z < GRID_SIZE - 1; ++z) {
-        for (int x = 0; x < GRID_SIZE - 1; ++x) {
-            float h00 = height_at(x, z, t);
-            float h10 = height_at(x + 1, z, t);
-            float h01 = height_at(x, z + 1, t);
-            float h11 = height_at(x + 1, z + 1, t);
-
-            float fx = (x * CELL_SIZE) - half_grid;
-            float fz = (z * CELL_SIZE);
-            float fx_next = fx + CELL_SIZE;
-            float fz_next = fz + CELL_SIZE;
-
-            uint32_t c0 = height_color((h00 + h10 + h11) / 3.0f);
-            uint32_t c1 = height_color((h00 + h11 + h01) / 3.0f);
-
-            /* Winding flipped so culling keeps the patch visible when tilted.
-             */
-            b3d_triangle(&(b3d_tri_t) {{{fx, h00, fz},
-                                        {fx_next, h11, fz_next},
-                                        {fx_next, h10, fz}}},
-                         c0);
-            b3d_triangle(&(b3d_tri_t) {{{fx, h00, fz},
-                                        {fx, h01, fz_next},
-                                        {fx_next, h11, fz_next}}},
-                         c1);
+    float *pos = grid_positions;
+    for (int z = 0; z < GRID_SIZE; ++z) {
+        for (int x = 0; x < GRID_SIZE; ++x) {
+            *pos++ = (x * CELL_SIZE) - half_grid;
+            *pos++ = height_at(x, z, t);
+            *pos++ = z * CELL_SIZE;
         }
     }
+
+    /* Shade each triangle by its average height */
+    for (int i = 0; i < GRID_TRIS; ++i) {
+        const uint32_t *tri = &grid_indices[i * 3];
+        float h = (grid_positions[tri[0] * 3 + 1] +
+                   grid_positions[tri[1] * 3 + 1] +
+                   grid_positions[tri[2] * 3 + 1]) /
+                  3.0f;
+        grid_colors[i] = height_color(h);
+    }
+
+    b3d_draw_mesh(grid_positions, GRID_SIZE * GRID_SIZE, grid_indices,
+                  GRID_TRIS * 3, grid_colors);
 }
 
 int main(int argc, char **argv)
@@ -95,13 +115,15 @@ int main(int argc, char **argv)
     int width = 800, height = 600;
     const char *snapshot = get_snapshot_path(argc, argv);
 
+    build_grid_indices();
+
     uint32_t *pixels = malloc(width * height * sizeof(pixels[0]));
     b3d_depth_t *depth = malloc(width * height * sizeof(depth[0]));
 
     /* Headless snapshot mode for CI/docs. */
     if (snapshot) {
         render_heightmap(pixels, depth, width, height, 1.0f);
-        write_png(snapshot, pixels, width, height);
+        write_snapshot(snapshot, pixels, width, height);
         free(pixels);
         free(depth);
         return 0;
@@ -9,7 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "pngwrite.h"
+#include "b3d_image.h"
 
 /* Get snapshot path from command line arguments or environment variable
  * Checks for B3D_SNAPSHOT environment variable first, then looks for
@@ -34,38 +34,30 @@ static inline const char *get_snapshot_path(int argc, char **argv)
     return NULL;
 }
 
-/* Write PNG image to file
- * Converts ARGB image data to RGBA format and writes as PNG.
+/* Write a snapshot of the framebuffer
+ * The extension of @path picks the format: .ppm, .raw (RGB24) or .y4m,
+ * PNG otherwise.
  * @path:   output file path
- * @rgba:   input RGBA pixel data
+ * @pixels: XRGB8888 framebuffer
  * @width:  image width
  * @height: image height
  */
-static inline void write_png(const char *path,
-                             const uint32_t *rgba,
-                             int width,
-                             int height)
+static inline void write_snapshot(const char *path,
+                                  const uint32_t *pixels,
+                                  int width,
+                                  int height)
 {
-    FILE *file = fopen(path, "wb");
-    if (!file)
-        return;
-
-    uint8_t *out = malloc((size_t) width * (size_t) height * 4);
-    if (!out) {
-        fclose(file);
-        return;
-    }
-    size_t idx = 0;
-    for (int i = 0; i < width * height; ++i) {
-        uint32_t p = rgba[i];
-        out[idx++] = (uint8_t) ((p >> 16) & 0xff);
-        out[idx++] = (uint8_t) ((p >> 8) & 0xff);
-        out[idx++] = (uint8_t) (p & 0xff);
-        out[idx++] = 0xff;
-    }
-    png_write(file, (unsigned) width, (unsigned) height, out, true);
-    free(out);
-    fclose(file);
+    const char *ext = strrchr(path, '.');
+    int type = B3D_IMAGE_PNG;
+    if (ext && !strcmp(ext, ".ppm"))
+        type = B3D_IMAGE_PPM;
+    else if (ext && !strcmp(ext, ".raw"))
+        type = B3D_IMAGE_RAW;
+    else if (ext && !strcmp(ext, ".y4m"))
+        type = B3D_IMAGE_Y4M;
+    if (b3d_write_frame(path, type, pixels, B3D_FORMAT_XRGB8888, 0, width,
+                        height))
+        fprintf(stderr, "Failed to write snapshot %s\n", path);
 }
 
 #endif /* UTILS_H */
@@ -15,6 +15,8 @@
  *   B3D_DEPTH_32BIT  : Default, 32-bit fixed-point depth (16.16)
  *   B3D_DEPTH_16BIT  : Optional, 16-bit depth buffer
  *   B3D_FLOAT_POINT  : Use floating-point math for comparisons
+ *   B3D_THREADS      : Rasterize binned tiles on a pthread worker pool
+ *   B3D_STATS        : Count per-stage work and time, see b3d_get_stats()
  */
 
 #ifndef B3D_DEPTH_16BIT
@@ -43,6 +45,9 @@ typedef int32_t b3d_depth_t;
 /* Matrix stack size for push/pop operations */
 #define B3D_MATRIX_STACK_SIZE 16
 
+/* Number of directional lights, see b3d_set_light() */
+#define B3D_MAX_LIGHTS 4
+
 /* Public API types for efficient parameter passing */
 
 /* 3D point/vertex */
@@ -61,7 +66,229 @@ typedef struct {
     float yaw, pitch, roll; /* orientation in radians */
 } b3d_camera_t;
 
-/* Initialization and clearing */
+/* Per-vertex attributes for b3d_triangle_ex(), in triangle vertex order */
+typedef struct {
+    uint32_t color[3]; /* 0xRRGGBB */
+    float uv[3][2];    /* texture coordinates, used while a texture is bound */
+} b3d_attr_t;
+
+/* Texture filters, see b3d_texture_t */
+#define B3D_FILTER_NEAREST 0  /* Nearest texel */
+#define B3D_FILTER_BILINEAR 1 /* Blend of the 4 nearest texels */
+
+/* Texture for b3d_triangle_ex(): 0xRRGGBB texels, @width x @height at full
+ * resolution. Both sizes are powers of two, at most 16384. Texture
+ * coordinates wrap: (0, 0) and (1, 1) are the top-left corner of the first
+ * texel.
+ *
+ * With @levels 0, @texels is a plain row-major image. b3d_texture_init()
+ * instead builds @levels mip levels, each half the size of the previous one
+ * and stored in a cache-friendly tiled order, and the rasterizer picks the
+ * level matching the on-screen texel density.
+ */
+typedef struct {
+    const uint32_t *texels;
+    int width, height;
+    int levels; /* mip levels in @texels, 0 for a row-major image */
+    int filter; /* B3D_FILTER_NEAREST or B3D_FILTER_BILINEAR */
+} b3d_texture_t;
+
+/* Post-transform vertex cache entries for b3d_draw_mesh() (power of two).
+ * Meshes with at most this many vertices are transformed exactly once per
+ * call; larger meshes reuse entries in a direct-mapped fashion.
+ */
+#ifndef B3D_VERTEX_CACHE_SIZE
+#define B3D_VERTEX_CACHE_SIZE 512
+#endif
+#if B3D_VERTEX_CACHE_SIZE <= 0 || \
+    (B3D_VERTEX_CACHE_SIZE & (B3D_VERTEX_CACHE_SIZE - 1))
+#error "B3D_VERTEX_CACHE_SIZE must be a power of two"
+#endif
+
+/* Tile binning: screen tile edge in pixels, and upper bound on the number of
+ * threads (including the caller) b3d_flush() rasterizes with.
+ */
+#ifndef B3D_TILE_SIZE
+#define B3D_TILE_SIZE 64
+#endif
+#ifndef B3D_MAX_THREADS
+#define B3D_MAX_THREADS 16
+#endif
+
+/* Hierarchical Z: edge in pixels of the tiles whose farthest depth is kept,
+ * see b3d_set_hiz(). Must divide B3D_TILE_SIZE.
+ */
+#ifndef B3D_HIZ_TILE
+#define B3D_HIZ_TILE 8
+#endif
+#if B3D_HIZ_TILE <= 0 || B3D_TILE_SIZE % B3D_HIZ_TILE
+#error "B3D_HIZ_TILE must divide B3D_TILE_SIZE"
+#endif
+
+/* Rasterizers, see b3d_set_rasterizer() */
+#define B3D_RASTER_SCANLINE 0 /* Scanline interpolation (default) */
+#define B3D_RASTER_EDGE 1     /* Edge functions over pixel blocks, SIMD */
+
+/* Pixel formats, see b3d_init_ex(). Colors are always given as 0xRRGGBB
+ * and truncated to the format's precision.
+ */
+#define B3D_FORMAT_XRGB8888 0 /* uint32_t 0x00RRGGBB (default) */
+#define B3D_FORMAT_RGB565 1   /* uint16_t RRRRRGGG GGGBBBBB */
+#define B3D_FORMAT_RGB332 2   /* uint8_t RRRGGGBB, for 8-bit palettes */
+
+/* Depth comparisons, see b3d_set_depth_func() */
+#define B3D_DEPTH_LESS 0   /* Pass if nearer than the stored depth (default) */
+#define B3D_DEPTH_ALWAYS 1 /* Always pass */
+#define B3D_DEPTH_EQUAL 2  /* Pass if at the stored depth, for a second pass */
+
+/* Tile binning state, lives in the caller-supplied arena */
+struct b3d_bins;
+
+/* Hierarchical Z state, lives in the caller-supplied buffer */
+struct b3d_hiz;
+
+/* Frame pipeline state, lives in the caller-supplied arena */
+struct b3d_frames;
+
+/* Depth-sorted render queue, lives in the caller-supplied arena */
+typedef struct b3d_queue b3d_queue_t;
+
+/* Recorded static geometry, lives in the caller-supplied arena */
+typedef struct b3d_list b3d_list_t;
+
+/* Tile diffing state, lives in the caller-supplied buffer */
+struct b3d_diff;
+
+/* Screen rectangle [x0, x1) x [y0, y1), see b3d_get_dirty_rects() */
+typedef struct {
+    int x0, y0, x1, y1;
+} b3d_rect_t;
+
+/* Render queue orders, see b3d_set_queue() */
+#define B3D_QUEUE_FRONT_TO_BACK 0 /* Nearest first: fewest pixel writes */
+#define B3D_QUEUE_BACK_TO_FRONT 1 /* Farthest first, for blending */
+
+/* Per-frame pipeline statistics, see b3d_get_stats().
+ * Triangle counts are per submitted triangle except where noted; in binning
+ * mode the rasterizer counts are per tile a triangle was queued into. Times
+ * are wall-clock nanoseconds; a binned flush is charged to raster_ns.
+ */
+typedef struct {
+    uint64_t triangles_submitted;      /* b3d_triangle() and mesh triangles */
+    uint64_t triangles_culled;         /* back-facing */
+    uint64_t triangles_frustum_culled; /* in display lists out of view */
+    uint64_t triangles_near_clipped;   /* crossing or behind the near plane */
+    uint64_t triangles_screen_clipped; /* needing the screen-edge clipper */
+    uint64_t screen_clip_outputs;      /* triangles the screen clipper made */
+    uint64_t triangles_hiz_rejected;   /* hidden by hierarchical Z */
+    uint64_t triangles_rasterized;     /* rasterizer invocations */
+    uint64_t triangles_aabb_rejected;  /* no pixel centers inside the clip */
+    uint64_t spans;                    /* rows (edge: block rows) shaded */
+    uint64_t pixels_tested;            /* depth tests */
+    uint64_t pixels_written;           /* depth tests passed */
+    uint64_t transform_ns, clip_ns, raster_ns;
+} b3d_stats_t;
+
+/* Transformed mesh vertex (internal, part of b3d_context_t) */
+typedef struct {
+    float cx, cy, cz, cw; /* clip-space position */
+    float sx, sy, sz;     /* screen-space position, valid if cw >= near plane */
+    uint32_t index;       /* source vertex index */
+    uint32_t gen;         /* draw call generation that filled this entry */
+} b3d_cached_vertex_t;
+
+/* Vector/matrix storage (shared with the internal math toolkit) */
+#ifndef B3D_MATH_TYPES_DEFINED
+typedef struct {
+    float x, y, z, w;
+} b3d_vec_t;
+
+typedef struct {
+    float m[4][4];
+} b3d_mat_t;
+#define B3D_MATH_TYPES_DEFINED
+#endif
+
+/* Renderer context.
+ *
+ * Holds all state of one renderer instance: framebuffer, transforms, camera,
+ * lighting and debug counters. Independent contexts can be used from
+ * different threads at the same time. The layout is public only so callers
+ * can allocate contexts statically or on the stack; treat all fields as
+ * private and use the b3d_ctx_* API.
+ */
+typedef struct {
+    /* Framebuffer */
+    int width, height;
+    void *pixels;          /* First pixel of the top row */
+    int pixel_format;      /* B3D_FORMAT_* */
+    size_t pixel_stride;   /* Bytes from one pixel row to the next */
+    b3d_depth_t *depth;
+    int rasterizer;        /* B3D_RASTER_* */
+    uint32_t raster_state; /* Depth func and write masks, 0 by default */
+    bool guard_band;       /* See b3d_set_guard_band() */
+    bool depth_epochs;     /* See b3d_set_depth_epochs() */
+    int32_t depth_epoch;   /* Current epoch, counts down */
+    b3d_texture_t texture; /* See b3d_set_texture(), texels NULL if unbound */
+
+    /* Transforms */
+    b3d_mat_t model, view, proj;
+    b3d_mat_t model_view;      /* Cached model * view, see model_view_dirty */
+    b3d_mat_t model_view_proj; /* Cached model * view * proj, likewise */
+    bool model_view_dirty;
+    b3d_mat_t matrix_stack[B3D_MATRIX_STACK_SIZE];
+    int matrix_stack_top;
+
+    /* Camera */
+    b3d_vec_t camera;
+    b3d_camera_t camera_params; /* Full camera state for queries */
+    float fov_degrees;          /* Current FOV for queries */
+
+    /* Lighting, light 0 is b3d_set_light_direction() */
+    b3d_vec_t light_dir[B3D_MAX_LIGHTS];
+    float light_intensity[B3D_MAX_LIGHTS]; /* 0 for lights that are off */
+    float ambient;
+
+    /* Cached screen-space clipping planes (updated when resolution changes) */
+    b3d_vec_t screen_planes[4][2];
+    int planes_cached_w, planes_cached_h;
+
+    /* Debug counters */
+    size_t clip_drop_count;
+    size_t hiz_reject_count;
+#ifdef B3D_STATS
+    b3d_stats_t stats;
+#endif
+
+    /* Post-transform cache for b3d_draw_mesh() */
+    b3d_cached_vertex_t vertex_cache[B3D_VERTEX_CACHE_SIZE];
+    uint32_t vertex_cache_gen;
+
+    /* Render queue, NULL when triangles are drawn as submitted */
+    b3d_queue_t *queue;
+
+    /* Display list being recorded, NULL when triangles are drawn */
+    b3d_list_t *list;
+
+    /* Tile binning state, NULL in immediate mode */
+    struct b3d_bins *bins;
+
+    /* Frame pipeline state, NULL when disabled */
+    struct b3d_frames *frames;
+
+    /* Tile diffing state, NULL when disabled */
+    struct b3d_diff *diff;
+
+    /* Hierarchical Z state, NULL when disabled */
+    struct b3d_hiz *hiz;
+} b3d_context_t;
+
+/* Initialization and clearing
+ *
+ * The functions below operate on a built-in default context. Every stateful
+ * function also has a b3d_ctx_* counterpart, declared at the end of this
+ * header, that takes an explicit context instead.
+ */
 
 /* Initialize the renderer with pixel/depth buffers and field of view (degrees).
  * @pixel_buffer: output pixel buffer (w * h * sizeof(uint32_t) bytes)
@@ -78,9 +305,72 @@ bool b3d_init(uint32_t *pixel_buffer,
               int h,
               float fov);
 
-/* Clear pixel buffer to black and depth buffer to far plane */
+/* Like b3d_init(), drawing into a pixel buffer of another layout, such as
+ * a display's scanout buffer.
+ * @pixel_buffer: @h rows of @w pixels, aligned to the pixel size
+ * @format:       B3D_FORMAT_*
+ * @stride:       bytes from the start of one row to the next, a multiple of
+ *                the pixel size; 0 for rows without padding
+ *
+ * The rasterizer writes pixels in @format directly: RGB565 and RGB332 take
+ * half and a quarter of the stores' memory traffic of XRGB8888. The depth
+ * buffer is the same as for b3d_init(). Returns false on an unknown format
+ * or a stride or alignment that does not fit, and otherwise as b3d_init().
+ */
+bool b3d_init_ex(void *pixel_buffer,
+                 int format,
+                 size_t stride,
+                 b3d_depth_t *depth_buffer,
+                 int w,
+                 int h,
+                 float fov);
+
+/* Draw into another pixel buffer of the current size and format, keeping
+ * all other state, e.g. to flip between the buffers of a display.
+ * @stride: as for b3d_init_ex()
+ *
+ * Binned triangles are drawn into the old buffer first. The new buffer
+ * keeps its contents; tile diffing redraws it whole at the next frame.
+ * Returns false if not initialized or the buffer does not fit.
+ */
+bool b3d_set_pixel_buffer(void *pixel_buffer, size_t stride);
+
+/* Clear pixel buffer to black and depth buffer to far plane. With tile
+ * diffing, see b3d_set_tile_diff(), only changed tiles are cleared, by the
+ * next b3d_flush().
+ */
 void b3d_clear(void);
 
+/* Fill the pixel buffer with @color and leave depth untouched. */
+void b3d_clear_color(uint32_t color);
+
+/* Reset the depth buffer to the far plane and leave pixels untouched. */
+void b3d_clear_depth(void);
+
+/* Fill pixels in [x0, x1) x [y0, y1) with @color and reset their depth, for
+ * redrawing only the dirty part of a frame. The rectangle is clipped to the
+ * framebuffer.
+ */
+void b3d_clear_rect(int x0, int y0, int x1, int y1, uint32_t color);
+
+/* Unlike b3d_clear(), the partial clears above keep queued binned triangles
+ * and the debug counters: pending work is flushed first.
+ */
+
+/* Enable depth epochs, so that clearing depth rarely touches the buffer.
+ *
+ * Depth values are stored with a frame counter in their high bits that
+ * b3d_clear() and b3d_clear_depth() decrement; a stale value thus always
+ * compares as farther than fresh ones. The buffer is only filled once
+ * every 2047 clears. Projected depth stays below 1.001 for anything in
+ * front of the camera and is clamped to [0, 16) to fit beneath the counter.
+ * Depth buffer contents include the epoch bits while enabled.
+ *
+ * Switching clears the depth buffer. Only available with the default 32-bit
+ * fixed-point depth buffer. Returns false otherwise or if not initialized.
+ */
+bool b3d_set_depth_epochs(bool enable);
+
 /* Calculate safe buffer size to avoid integer overflow.
  * @w:         buffer width in pixels
  * @h:         buffer height in pixels
@@ -185,6 +475,10 @@ void b3d_get_proj_matrix(float out[16]);
  * Coordinate space: Light direction and triangle normals are both expected
  * in MODEL SPACE. Lighting is computed before model-view transformation,
  * so shading rotates with the object (classic glxgears style).
+ *
+ * Up to B3D_MAX_LIGHTS directional lights add up, two-sided:
+ *   intensity = ambient + (1 - ambient) * sum(light_intensity * |N.L|)
+ * clamped to 1. Only light 0 is on by default.
  */
 
 /* Set light direction (auto-normalized).
@@ -200,6 +494,23 @@ void b3d_set_light_direction(float x, float y, float z);
  */
 void b3d_get_light_direction(float *x, float *y, float *z);
 
+/* Set directional light @index.
+ * @index:      0 to B3D_MAX_LIGHTS - 1; light 0 is b3d_set_light_direction()
+ * @x, @y, @z:  light direction (model space), auto-normalized
+ * @intensity:  clamped to [0, 1]; 0 switches the light off
+ *
+ * Returns false, keeping the light as it was, for an @index out of range,
+ * NaN/INF values or a zero-length direction. Lights survive b3d_init().
+ */
+bool b3d_set_light(int index, float x, float y, float z, float intensity);
+
+/* Get directional light @index.
+ * @x, @y, @z, @intensity: output pointers (NULL-safe)
+ *
+ * Returns false for an @index out of range.
+ */
+bool b3d_get_light(int index, float *x, float *y, float *z, float *intensity);
+
 /* Set ambient light level.
  * @ambient: ambient intensity clamped to [0, 1]
  *
@@ -238,6 +549,507 @@ bool b3d_triangle_lit(const b3d_tri_t *tri,
                       float nz,
                       uint32_t base_color);
 
+/* Render a triangle with per-vertex attributes.
+ * @tri:  pointer to triangle with 3 vertices
+ * @attr: vertex colors and texture coordinates
+ *
+ * Colors and texture coordinates are interpolated perspective-correctly
+ * across the triangle (Gouraud shading). While a texture is bound, every
+ * pixel is the filtered texel modulated by the interpolated color; use white
+ * vertices for the plain texture. Interpolation is done in float even in
+ * fixed-point builds. Without a texture, triangles with three equal colors
+ * are drawn exactly like b3d_triangle().
+ * Returns true if rendered, false if culled/clipped away.
+ */
+bool b3d_triangle_ex(const b3d_tri_t *tri, const b3d_attr_t *attr);
+
+/* Render a triangle lit per vertex.
+ * @tri:        pointer to triangle with 3 vertices
+ * @normals:    vertex normals in model space (will be normalized)
+ * @base_color: base color in 0xRRGGBB format
+ *
+ * Evaluates the b3d_triangle_lit() lighting at each vertex and interpolates
+ * the result like b3d_triangle_ex(). Never textured.
+ * Returns true if rendered, false if culled/clipped away.
+ */
+bool b3d_triangle_lit_ex(const b3d_tri_t *tri,
+                         const b3d_point_t normals[3],
+                         uint32_t base_color);
+
+/* Bind the texture b3d_triangle_ex() samples.
+ * @tex: texture to bind, copied; NULL unbinds. The texels themselves are not
+ *       copied and must stay valid until the triangles using them have been
+ *       rasterized, which in binning mode is the next b3d_flush().
+ *
+ * b3d_init() unbinds the texture.
+ * Returns false, keeping the current binding, if @tex has no texels, a size
+ * that is not a power of two, more levels than its size allows or an
+ * unknown filter.
+ */
+bool b3d_set_texture(const b3d_texture_t *tex);
+
+/* Buffer size b3d_texture_init() needs for a @w x @h image.
+ * Returns 0 on invalid arguments.
+ */
+size_t b3d_texture_size(int w, int h);
+
+/* Build a mipmapped texture from a row-major image.
+ * @tex:    texture to fill in, ready for b3d_set_texture()
+ * @buf:    texel storage, see b3d_texture_size(); @tex points into it
+ * @size:   size of @buf in bytes
+ * @image:  @w x @h row-major 0xRRGGBB texels, not referenced afterwards
+ * @filter: B3D_FILTER_NEAREST or B3D_FILTER_BILINEAR
+ *
+ * Each mip level averages 2x2 texels of the previous one, down to a level
+ * 1 texel high or wide. The filter applies within the selected level.
+ * Returns false if a size is not a power of two, @buf is too small or
+ * @filter is unknown.
+ */
+bool b3d_texture_init(b3d_texture_t *tex,
+                      void *buf,
+                      size_t size,
+                      const uint32_t *image,
+                      int w,
+                      int h,
+                      int filter);
+
+/* Render an indexed triangle mesh.
+ * @positions: vertex positions, 3 floats (x, y, z) per vertex
+ * @vcount:    number of vertices in @positions
+ * @indices:   vertex indices, 3 per triangle, counter-clockwise front faces
+ * @icount:    number of indices (a trailing partial triangle is ignored)
+ * @colors:    one 0xRRGGBB color per triangle, or NULL for white
+ *
+ * Equivalent to calling b3d_triangle() for every triangle, but each vertex
+ * is transformed and projected once and then shared by all triangles that
+ * reference it. Triangles with out-of-range indices are skipped.
+ * Returns the number of triangles that were rendered.
+ */
+int b3d_draw_mesh(const float *positions,
+                  int vcount,
+                  const uint32_t *indices,
+                  int icount,
+                  const uint32_t *colors);
+
+/* Render an indexed triangle mesh lit per face.
+ * @positions:  as for b3d_draw_mesh()
+ * @vcount:     number of vertices in @positions
+ * @indices:    as for b3d_draw_mesh()
+ * @icount:     number of indices
+ * @normals:    one unit normal per triangle, 3 floats each in model space,
+ *              e.g. from b3d_mesh_save(..., true) or obj2b3dm.py --normals
+ * @base_color: base color in 0xRRGGBB format
+ *
+ * Lights every triangle that survives back-face culling with all lights,
+ * as b3d_triangle_lit() would, but without normalizing: the intensity is
+ * quantized to 256 levels that index a table of @base_color shades built
+ * once per call. Fixed-point builds light with integer arithmetic only.
+ * Colors come within one step per channel of b3d_triangle_lit().
+ * Returns the number of triangles that were rendered.
+ */
+int b3d_draw_mesh_lit(const float *positions,
+                      int vcount,
+                      const uint32_t *indices,
+                      int icount,
+                      const float *normals,
+                      uint32_t base_color);
+
+/* Transform @n points by @m, each as the row vector (x, y, z, 1) times @m.
+ * @xs, @ys, @zs: coordinates, one array per axis
+ * @out:          @n results
+ *
+ * Works through several points per iteration, for code that keeps vertices
+ * as separate arrays. Results match transforming one point at a time.
+ */
+void b3d_transform_points(const b3d_mat_t *m,
+                          const float *xs,
+                          const float *ys,
+                          const float *zs,
+                          int n,
+                          b3d_vec_t *out);
+
+/* Select the rasterizer.
+ * @mode: B3D_RASTER_SCANLINE (default) or B3D_RASTER_EDGE
+ *
+ * B3D_RASTER_EDGE walks blocks of pixels with incremental edge functions at
+ * 1/16 pixel precision and a top-left fill rule. Depth test and writes use
+ * the vector kernels of b3d_get_backend_name() (scalar for 16-bit depth).
+ * Output is deterministic for a given build but differs slightly from
+ * scanline mode along triangle edges. Triangles too large for 32-bit edge
+ * functions are drawn with scanlines. The choice survives b3d_init().
+ * Returns false for an unknown @mode.
+ */
+bool b3d_set_rasterizer(int mode);
+
+/* Get the current rasterizer, B3D_RASTER_* */
+int b3d_get_rasterizer(void);
+
+/* Name of the active kernel set: "avx2", "sse2", "neon" or "scalar".
+ *
+ * Clears, edge-function blocks and mesh vertex transforms run one of
+ * several kernel sets compiled into the library. The first b3d_init() or
+ * b3d_ctx_init() picks the best one the CPU supports; on x86 with GCC or
+ * Clang that includes AVX2 even if the compiler does not target it.
+ * B3D_NO_SIMD leaves only "scalar". Every set draws the same image.
+ */
+const char *b3d_get_backend_name(void);
+
+/* Use kernel set @name for all contexts, e.g. "scalar" to compare against.
+ * Call it while no context is drawing; the choice survives b3d_init().
+ * Returns false if this build or CPU lacks @name.
+ */
+bool b3d_set_backend(const char *name);
+
+/* Select the depth comparison.
+ * @func: B3D_DEPTH_LESS (default), B3D_DEPTH_ALWAYS or B3D_DEPTH_EQUAL
+ *
+ * Both rasterizers compile one inner loop per combination of depth
+ * comparison and write masks, and pick it per triangle; the default state
+ * runs the same code as before. B3D_DEPTH_ALWAYS also skips hierarchical Z
+ * culling. The choice survives b3d_init().
+ *
+ * B3D_DEPTH_EQUAL passes where the stored depth is exactly what the
+ * triangle would write, as after the same triangle, with the same transform
+ * and rasterizer, won the depth test in an earlier pass. A depth prepass
+ * with b3d_set_color_write(false), then the same draws with
+ * B3D_DEPTH_EQUAL and depth writes off, shades each pixel once whatever the
+ * overdraw.
+ * Returns false for an unknown @func.
+ */
+bool b3d_set_depth_func(int func);
+
+/* Get the current depth comparison, B3D_DEPTH_* */
+int b3d_get_depth_func(void);
+
+/* Enable or disable depth writes (enabled by default). Triangles drawn with
+ * writes disabled are still depth tested. The choice survives b3d_init().
+ */
+void b3d_set_depth_write(bool enable);
+
+/* Whether depth writes are enabled */
+bool b3d_get_depth_write(void);
+
+/* Enable or disable color writes (enabled by default). Triangles drawn with
+ * writes disabled only update the depth buffer and are not shaded. The
+ * choice survives b3d_init().
+ */
+void b3d_set_color_write(bool enable);
+
+/* Whether color writes are enabled */
+bool b3d_get_color_write(void);
+
+/* Clip against a guard band instead of the screen edges.
+ *
+ * Triangles are then only clipped against the near plane and, rarely, a
+ * band 16000 pixels either side of the screen center, the widest range the
+ * fixed-point rasterizer can address. Everything between the screen edges
+ * and the band is scissored per span while rasterizing, so large triangles
+ * such as ground planes are no longer split into many pieces, and the
+ * clipping buffers cannot overflow. Triangles wholly on screen are drawn
+ * exactly as without a guard band; ones reaching past the edges are walked
+ * with exact per-row edge positions and may differ slightly along their
+ * edges from the split version. The choice survives b3d_init().
+ */
+void b3d_set_guard_band(bool enable);
+
+/* Whether the guard band is enabled */
+bool b3d_get_guard_band(void);
+
+/* Tile binning
+ *
+ * In binning mode, triangles are transformed, clipped and set up as usual
+ * but only queued into B3D_TILE_SIZE x B3D_TILE_SIZE screen tiles, in
+ * submission order. b3d_flush() then rasterizes each tile with its color and
+ * depth working set kept in cache, in parallel when built with B3D_THREADS.
+ * The result is pixel-identical to immediate mode. The framebuffer is only
+ * up to date after b3d_flush(); b3d_clear() discards queued triangles.
+ *
+ * All memory comes from a caller-supplied arena. When it fills up, the queued
+ * triangles are flushed early, so any size that fits the tile table works.
+ */
+
+/* Enable binning mode.
+ * @arena:   binning memory, must stay valid until binning is disabled;
+ *           NULL flushes pending work and returns to immediate mode
+ * @size:    size of @arena in bytes, see b3d_bin_arena_size()
+ * @threads: rasterizer threads including the caller, clamped to
+ *           [1, B3D_MAX_THREADS]; ignored without B3D_THREADS
+ *
+ * The tile layout follows the current framebuffer size; b3d_init() keeps
+ * binning enabled if the arena still fits the new size.
+ * Returns false if not initialized or @arena is too small for the tile table.
+ */
+bool b3d_set_binning(void *arena, size_t size, int threads);
+
+/* Arena size that holds @max_tris queued triangles for a @w x @h framebuffer
+ * without an intermediate flush (assuming each triangle covers a few tiles).
+ * Returns 0 on invalid arguments or overflow.
+ */
+size_t b3d_bin_arena_size(int w, int h, int max_tris);
+
+/* Rasterize all queued triangles, those of the render queue first.
+ * No-op in immediate mode.
+ */
+void b3d_flush(void);
+
+/* Frame pipeline
+ *
+ * Overlaps the geometry of one frame with the rasterization of the one
+ * before. On top of binning, each frame is recorded into one of two tile
+ * arenas and framebuffers: b3d_frame_submit() hands it to a rasterizer
+ * thread and returns, so the next frame can be transformed and binned
+ * meanwhile; b3d_frame_wait() returns the finished framebuffer:
+ *
+ *     for (;;) {
+ *         b3d_frame_begin();
+ *         b3d_clear();
+ *         draw();                          // overlaps the previous frame
+ *         void *done = b3d_frame_wait();   // NULL on the first frame
+ *         if (done)
+ *             present(done);
+ *         b3d_frame_submit();
+ *     }
+ *
+ * Frames are rasterized in submission order with the state set when they
+ * were submitted. Calls that read or write the framebuffer directly, as well
+ * as state changes with triangles already binned, first wait for the
+ * previous frame. Triangles and b3d_clear() outside a frame are ignored.
+ * Frames alternate between the buffers, so one that does not start with
+ * b3d_clear() draws over the frame before last. Textures a frame uses must
+ * stay valid until b3d_frame_wait() returns it, which is also when its
+ * rasterizer statistics are counted. Without B3D_THREADS,
+ * b3d_frame_submit() rasterizes the frame before it returns.
+ */
+
+/* Enable the frame pipeline.
+ * @pixel_buffer: second framebuffer, same size, format and stride as the
+ *                one passed to b3d_init(); NULL drops a frame being
+ *                recorded, waits for the submitted ones and returns to
+ *                drawing into the first
+ * @arena:        tile arena of the second buffer, must stay valid until
+ *                the pipeline is disabled
+ * @size:         size of @arena in bytes, see b3d_frame_arena_size()
+ *
+ * The first frame records into the framebuffer and binning arena already
+ * set, using the same number of threads. b3d_init() and b3d_set_binning()
+ * disable the pipeline.
+ * Returns false if binning is not enabled, tile diffing is, or either
+ * arena cannot hold one triangle covering the whole framebuffer (any size
+ * from b3d_bin_arena_size() or b3d_frame_arena_size() can).
+ */
+bool b3d_set_frames(void *pixel_buffer, void *arena, size_t size);
+
+/* Arena size for b3d_set_frames(), see b3d_bin_arena_size().
+ * Returns 0 on invalid arguments or overflow.
+ */
+size_t b3d_frame_arena_size(int w, int h, int max_tris);
+
+/* Start recording a frame into the next framebuffer.
+ * Returns false if the pipeline is disabled, a frame is being recorded, or
+ * both framebuffers hold frames not yet returned by b3d_frame_wait().
+ */
+bool b3d_frame_begin(void);
+
+/* Queue the recorded frame for rasterization.
+ * Returns false if no frame is being recorded.
+ */
+bool b3d_frame_submit(void);
+
+/* Wait for the oldest submitted frame not returned yet.
+ * Returns its framebuffer, which stays untouched until the b3d_frame_begin()
+ * after next, or NULL if there is none.
+ */
+void *b3d_frame_wait(void);
+
+/* Render queue
+ *
+ * With a render queue set, b3d_triangle(), b3d_triangle_lit() and
+ * b3d_draw_mesh() triangles are transformed and back-face culled, then
+ * recorded with their color instead of drawn. b3d_queue_flush() sorts them
+ * by view depth and draws them, through binning if enabled, nearest first
+ * so that the depth test rejects as many hidden pixels as possible.
+ * Triangles at nearly the same depth keep their submission order. Triangles
+ * with attributes, see b3d_triangle_ex(), are still drawn right away.
+ *
+ * All memory comes from a caller-supplied arena. When it is full, the
+ * queued triangles are flushed early. Like binned triangles, queued ones
+ * are drawn before anything reads or clears part of the framebuffer, and
+ * discarded by b3d_clear(); b3d_flush() flushes the queue as well.
+ */
+
+/* Enable the render queue.
+ * @arena: queue memory, must stay valid until the queue is disabled; NULL
+ *         draws pending triangles and returns to drawing as submitted
+ * @size:  size of @arena in bytes, see b3d_queue_arena_size()
+ * @order: B3D_QUEUE_FRONT_TO_BACK or B3D_QUEUE_BACK_TO_FRONT
+ *
+ * b3d_init() keeps the queue.
+ * Returns false if not initialized, @order is unknown or @arena cannot hold
+ * a single triangle.
+ */
+bool b3d_set_queue(void *arena, size_t size, int order);
+
+/* Arena size that holds @max_tris queued triangles without an intermediate
+ * flush. Returns 0 on invalid arguments or overflow.
+ */
+size_t b3d_queue_arena_size(int max_tris);
+
+/* Sort and draw all triangles in the render queue. No-op without one. */
+void b3d_queue_flush(void);
+
+/* Display lists
+ *
+ * Geometry that does not change between frames can be recorded once and
+ * drawn many times. Between b3d_list_begin() and b3d_list_end(),
+ * b3d_triangle() and the flat cases of b3d_triangle_lit() and
+ * b3d_triangle_ex() append their vertices and color to the list instead of
+ * drawing; triangles with varying attributes are refused. b3d_draw_mesh()
+ * and b3d_draw_mesh_lit() append every triangle with valid indices, back
+ * faces included, and return how many were appended. Vertices are kept as
+ * given, in object space, so the transforms in effect when the list is
+ * drawn apply, while lit colors are those of the recording. Recording also
+ * stores the plane of every face and a bounding sphere of the list.
+ *
+ * b3d_list_draw() skips a list whose sphere is outside the view frustum,
+ * culls back faces against their stored planes before transforming
+ * anything and transforms the remaining vertices in batches. Apart from
+ * triangles seen nearly edge-on, it draws what b3d_triangle() would for
+ * every recorded triangle, through the render queue and binning if set.
+ */
+
+/* Start recording a display list.
+ * @arena: list memory, see b3d_list_arena_size(); the list lives in it and
+ *         must stay valid while it is used
+ * @size:  size of @arena in bytes
+ *
+ * Returns false if not initialized, already recording or @arena cannot hold
+ * a single triangle.
+ */
+bool b3d_list_begin(void *arena, size_t size);
+
+/* Finish recording. Returns the list, or NULL if not recording or some
+ * triangles did not fit in the arena.
+ */
+b3d_list_t *b3d_list_end(void);
+
+/* Arena size that holds a display list of @max_tris triangles.
+ * Returns 0 on invalid arguments or overflow.
+ */
+size_t b3d_list_arena_size(int max_tris);
+
+/* Draw display list @list with the current transforms.
+ * Returns the number of triangles drawn, 0 while recording.
+ */
+int b3d_list_draw(const b3d_list_t *list);
+
+/* Draw display list @list once per instance.
+ * @instance_matrices: @count row-major 4x4 matrices, 16 floats each, laid
+ *                     out like b3d_get_model_matrix()
+ * @count:             number of instances
+ *
+ * Instance i is drawn as b3d_list_draw() would after applying matrix i on
+ * top of the current model transforms, which are left unchanged: shared
+ * motion goes in the model matrix, placements in the instances. Each
+ * instance is frustum and back-face culled on its own.
+ * Returns the number of triangles drawn, 0 while recording.
+ */
+int b3d_draw_instanced(const b3d_list_t *list,
+                       const float *instance_matrices,
+                       int count);
+
+/* Tile diffing
+ *
+ * For frames that mostly repeat the previous one. While binning is enabled,
+ * every tile hashes the triangles queued into it since b3d_clear(), which
+ * then leaves the framebuffer as it is. The next b3d_flush() clears and
+ * redraws only the tiles whose triangles changed since the previous frame;
+ * the others still show exactly what they would be redrawn to. Dirty
+ * rectangles then tell which parts of the frame need to be sent on.
+ *
+ * Triangles are compared after clipping and set-up, so moving the camera
+ * redraws everything. Textures are compared by address: after changing
+ * texels in place, or writing to the framebuffer directly, call
+ * b3d_invalidate_tiles(). Partial clears and drawing in immediate mode do
+ * so themselves.
+ */
+
+/* Enable tile diffing.
+ * @buf:  diff memory, at least b3d_tile_diff_size() bytes, must stay valid
+ *        until diffing is disabled; NULL disables diffing
+ * @size: size of @buf in bytes
+ *
+ * The first frame after enabling redraws every tile. b3d_init() keeps
+ * diffing enabled if @buf still fits the new size.
+ * Returns false if not initialized or @buf is too small.
+ */
+bool b3d_set_tile_diff(void *buf, size_t size);
+
+/* Bytes of diff memory for a @w x @h framebuffer, 0 on invalid arguments */
+size_t b3d_tile_diff_size(int w, int h);
+
+/* Rectangles covering the tiles redrawn since b3d_clear(), valid after
+ * b3d_flush(). Runs of adjacent tiles along a tile row are merged; at most
+ * @max rectangles are stored to @rects, in row-major order.
+ * Returns the total number of rectangles, 0 with diffing disabled.
+ */
+int b3d_get_dirty_rects(b3d_rect_t *rects, int max);
+
+/* Redraw every tile in the next frame */
+void b3d_invalidate_tiles(void);
+
+/* Hierarchical Z
+ *
+ * Keeps the farthest stored depth of every B3D_HIZ_TILE x B3D_HIZ_TILE
+ * block of the depth buffer. A triangle whose nearest vertex is behind the
+ * farthest depth of every block its bounding box touches cannot pass the
+ * depth test and is dropped before rasterization; otherwise rasterization is
+ * limited to the blocks it may still be visible in. Blocks written to are
+ * re-scanned lazily the next time they are tested. With B3D_RASTER_EDGE the
+ * image does not change. Scanline spans at thin triangle tips can round their
+ * depth in front of the nearest vertex; such stray pixels are dropped too.
+ */
+
+/* Enable hierarchical Z.
+ * @buf:  tile memory, must stay valid until disabled; NULL disables
+ * @size: size of @buf in bytes, see b3d_hiz_size()
+ *
+ * b3d_init() keeps hierarchical Z enabled if @buf still fits the new size.
+ * Returns false if not initialized or @buf is too small.
+ */
+bool b3d_set_hiz(void *buf, size_t size);
+
+/* Buffer size b3d_set_hiz() needs for a @w x @h framebuffer.
+ * Returns 0 on invalid arguments or overflow.
+ */
+size_t b3d_hiz_size(int w, int h);
+
+/* Occlusion queries
+ *
+ * Test a bounding volume against the depth buffer without drawing anything,
+ * so that hidden objects can be skipped before their triangles are
+ * submitted. Answers are conservative: a query may report a hidden volume as
+ * visible, never the reverse. Pending binned triangles are flushed first.
+ * Uses hierarchical Z, when enabled, to settle most blocks without reading
+ * the depth buffer.
+ */
+
+/* Test whether any part of an axis-aligned box could be visible.
+ * @min, @max: opposite box corners (x, y, z) in model space, transformed by
+ *             the current model matrix like b3d_triangle() input
+ *
+ * Returns true if a fragment at the box's nearest projected depth would
+ * pass the depth test anywhere under its screen rectangle, or if the box
+ * reaches the near plane. Returns false if the box is hidden or off screen.
+ */
+bool b3d_occlusion_test_box(const float min[3], const float max[3]);
+
+/* Test whether a fragment at depth @z would pass the depth test anywhere in
+ * the screen rectangle [x0, x1) x [y0, y1).
+ * @z: depth in the range b3d_triangle() writes (0 near plane, 1 far plane)
+ * Returns false if the rectangle is hidden or off screen.
+ */
+bool b3d_occlusion_test_rect(int x0, int y0, int x1, int y1, float z);
+
 /* Utility functions */
 
 /* Project world coordinate to screen coordinate.
@@ -254,6 +1066,23 @@ bool b3d_to_screen(float x, float y, float z, int *sx, int *sy);
  */
 size_t b3d_get_clip_drop_count(void);
 
+/* Number of triangles rejected whole by hierarchical Z (reset by b3d_clear).
+ * In binning mode, triangles only rejected per tile during b3d_flush() are
+ * not counted.
+ */
+size_t b3d_get_hiz_reject_count(void);
+
+/* Copy the statistics gathered since the last b3d_clear() or
+ * b3d_reset_stats() to @out. Rasterizer counts of binned triangles only
+ * arrive with b3d_flush().
+ *
+ * Returns false, zeroing @out, if built without B3D_STATS.
+ */
+bool b3d_get_stats(b3d_stats_t *out);
+
+/* Zero the statistics without clearing the framebuffer */
+void b3d_reset_stats(void);
+
 /* State query functions */
 
 /* Check if renderer is initialized and ready */
@@ -265,4 +1094,176 @@ int b3d_get_width(void);
 /* Get current framebuffer height in pixels */
 int b3d_get_height(void);
 
+/* Context API
+ *
+ * Each b3d_ctx_* function behaves exactly like the global function of the
+ * same name, but operates on @ctx instead of the default context. A context
+ * must be set up with b3d_ctx_init() before any other call; unlike b3d_init(),
+ * b3d_ctx_init() also resets lighting to its defaults and must not be called
+ * while binning, the frame pipeline or hierarchical Z is enabled on @ctx.
+ * Calls on distinct contexts may run concurrently; calls on one context must
+ * be serialized.
+ */
+
+/* Get the default context used by the global API. */
+b3d_context_t *b3d_get_default_context(void);
+
+bool b3d_ctx_init(b3d_context_t *ctx,
+                  uint32_t *pixel_buffer,
+                  b3d_depth_t *depth_buffer,
+                  int w,
+                  int h,
+                  float fov);
+bool b3d_ctx_init_ex(b3d_context_t *ctx,
+                     void *pixel_buffer,
+                     int format,
+                     size_t stride,
+                     b3d_depth_t *depth_buffer,
+                     int w,
+                     int h,
+                     float fov);
+bool b3d_ctx_set_pixel_buffer(b3d_context_t *ctx,
+                              void *pixel_buffer,
+                              size_t stride);
+void b3d_ctx_clear(b3d_context_t *ctx);
+void b3d_ctx_clear_color(b3d_context_t *ctx, uint32_t color);
+void b3d_ctx_clear_depth(b3d_context_t *ctx);
+void b3d_ctx_clear_rect(b3d_context_t *ctx,
+                        int x0,
+                        int y0,
+                        int x1,
+                        int y1,
+                        uint32_t color);
+bool b3d_ctx_set_depth_epochs(b3d_context_t *ctx, bool enable);
+
+void b3d_ctx_reset(b3d_context_t *ctx);
+void b3d_ctx_translate(b3d_context_t *ctx, float x, float y, float z);
+void b3d_ctx_rotate_x(b3d_context_t *ctx, float angle);
+void b3d_ctx_rotate_y(b3d_context_t *ctx, float angle);
+void b3d_ctx_rotate_z(b3d_context_t *ctx, float angle);
+void b3d_ctx_scale(b3d_context_t *ctx, float x, float y, float z);
+bool b3d_ctx_push_matrix(b3d_context_t *ctx);
+bool b3d_ctx_pop_matrix(b3d_context_t *ctx);
+void b3d_ctx_get_model_matrix(const b3d_context_t *ctx, float out[16]);
+void b3d_ctx_set_model_matrix(b3d_context_t *ctx, const float m[16]);
+
+void b3d_ctx_set_camera(b3d_context_t *ctx, const b3d_camera_t *cam);
+void b3d_ctx_look_at(b3d_context_t *ctx, float x, float y, float z);
+void b3d_ctx_set_fov(b3d_context_t *ctx, float fov_in_degrees);
+void b3d_ctx_get_camera(const b3d_context_t *ctx, b3d_camera_t *out);
+float b3d_ctx_get_fov(const b3d_context_t *ctx);
+void b3d_ctx_get_view_matrix(const b3d_context_t *ctx, float out[16]);
+void b3d_ctx_get_proj_matrix(const b3d_context_t *ctx, float out[16]);
+
+void b3d_ctx_set_light_direction(b3d_context_t *ctx, float x, float y, float z);
+void b3d_ctx_get_light_direction(const b3d_context_t *ctx,
+                                 float *x,
+                                 float *y,
+                                 float *z);
+bool b3d_ctx_set_light(b3d_context_t *ctx,
+                       int index,
+                       float x,
+                       float y,
+                       float z,
+                       float intensity);
+bool b3d_ctx_get_light(const b3d_context_t *ctx,
+                       int index,
+                       float *x,
+                       float *y,
+                       float *z,
+                       float *intensity);
+void b3d_ctx_set_ambient(b3d_context_t *ctx, float ambient);
+float b3d_ctx_get_ambient(const b3d_context_t *ctx);
+
+bool b3d_ctx_triangle(b3d_context_t *ctx, const b3d_tri_t *tri, uint32_t c);
+bool b3d_ctx_triangle_lit(b3d_context_t *ctx,
+                          const b3d_tri_t *tri,
+                          float nx,
+                          float ny,
+                          float nz,
+                          uint32_t base_color);
+bool b3d_ctx_triangle_ex(b3d_context_t *ctx,
+                         const b3d_tri_t *tri,
+                         const b3d_attr_t *attr);
+bool b3d_ctx_triangle_lit_ex(b3d_context_t *ctx,
+                             const b3d_tri_t *tri,
+                             const b3d_point_t normals[3],
+                             uint32_t base_color);
+bool b3d_ctx_set_texture(b3d_context_t *ctx, const b3d_texture_t *tex);
+
+int b3d_ctx_draw_mesh(b3d_context_t *ctx,
+                      const float *positions,
+                      int vcount,
+                      const uint32_t *indices,
+                      int icount,
+                      const uint32_t *colors);
+int b3d_ctx_draw_mesh_lit(b3d_context_t *ctx,
+                          const float *positions,
+                          int vcount,
+                          const uint32_t *indices,
+                          int icount,
+                          const float *normals,
+                          uint32_t base_color);
+
+bool b3d_ctx_set_rasterizer(b3d_context_t *ctx, int mode);
+int b3d_ctx_get_rasterizer(const b3d_context_t *ctx);
+bool b3d_ctx_set_depth_func(b3d_context_t *ctx, int func);
+int b3d_ctx_get_depth_func(const b3d_context_t *ctx);
+void b3d_ctx_set_depth_write(b3d_context_t *ctx, bool enable);
+bool b3d_ctx_get_depth_write(const b3d_context_t *ctx);
+void b3d_ctx_set_color_write(b3d_context_t *ctx, bool enable);
+bool b3d_ctx_get_color_write(const b3d_context_t *ctx);
+void b3d_ctx_set_guard_band(b3d_context_t *ctx, bool enable);
+bool b3d_ctx_get_guard_band(const b3d_context_t *ctx);
+bool b3d_ctx_set_binning(b3d_context_t *ctx,
+                         void *arena,
+                         size_t size,
+                         int threads);
+void b3d_ctx_flush(b3d_context_t *ctx);
+bool b3d_ctx_set_frames(b3d_context_t *ctx,
+                        void *pixel_buffer,
+                        void *arena,
+                        size_t size);
+bool b3d_ctx_frame_begin(b3d_context_t *ctx);
+bool b3d_ctx_frame_submit(b3d_context_t *ctx);
+void *b3d_ctx_frame_wait(b3d_context_t *ctx);
+bool b3d_ctx_set_queue(b3d_context_t *ctx, void *arena, size_t size, int order);
+void b3d_ctx_queue_flush(b3d_context_t *ctx);
+bool b3d_ctx_list_begin(b3d_context_t *ctx, void *arena, size_t size);
+b3d_list_t *b3d_ctx_list_end(b3d_context_t *ctx);
+int b3d_ctx_list_draw(b3d_context_t *ctx, const b3d_list_t *list);
+int b3d_ctx_draw_instanced(b3d_context_t *ctx,
+                           const b3d_list_t *list,
+                           const float *instance_matrices,
+                           int count);
+bool b3d_ctx_set_tile_diff(b3d_context_t *ctx, void *buf, size_t size);
+int b3d_ctx_get_dirty_rects(const b3d_context_t *ctx,
+                            b3d_rect_t *rects,
+                            int max);
+void b3d_ctx_invalidate_tiles(b3d_context_t *ctx);
+bool b3d_ctx_set_hiz(b3d_context_t *ctx, void *buf, size_t size);
+bool b3d_ctx_occlusion_test_box(b3d_context_t *ctx,
+                                const float min[3],
+                                const float max[3]);
+bool b3d_ctx_occlusion_test_rect(b3d_context_t *ctx,
+                                 int x0,
+                                 int y0,
+                                 int x1,
+                                 int y1,
+                                 float z);
+
+bool b3d_ctx_to_screen(const b3d_context_t *ctx,
+                       float x,
+                       float y,
+                       float z,
+                       int *sx,
+                       int *sy);
+size_t b3d_ctx_get_clip_drop_count(const b3d_context_t *ctx);
+size_t b3d_ctx_get_hiz_reject_count(const b3d_context_t *ctx);
+bool b3d_ctx_get_stats(const b3d_context_t *ctx, b3d_stats_t *out);
+void b3d_ctx_reset_stats(b3d_context_t *ctx);
+bool b3d_ctx_is_initialized(const b3d_context_t *ctx);
+int b3d_ctx_get_width(const b3d_context_t *ctx);
+int b3d_ctx_get_height(const b3d_context_t *ctx);
+
 #endif /* B3D_H */
@@ -0,0 +1,488 @@
+/*
+ * B3D is freely redistributable under the MIT License. See the file
+ * "LICENSE" for information on usage and redistribution of this file.
+ */
+
+/*
+ * Frame-time controller: adaptive resolution and level of detail
+ *
+ * b3d_adapt_t holds a frame time target for the default context and turns
+ * two knobs to meet it. One is the internal resolution: frames are drawn
+ * at 1/scale of the output size and b3d_adapt_end() enlarges them with an
+ * integer pixel-repeat upscale. The other is a level of detail (LOD) index
+ * that the caller passes to b3d_lod_draw() for meshes registered in a
+ * b3d_lod_t, from finest to coarsest.
+ *
+ * Over budget, the controller lowers the resolution when rasterization takes
+ * most of the frame and the LOD when transform and clipping do; it learns the
+ * split from b3d_get_stats() in B3D_STATS builds and otherwise lowers the
+ * resolution first. Under budget, it raises whichever knob is predicted to
+ * still fit. It changes at most one step per B3D_ADAPT_SETTLE frames, so a
+ * few slow frames do not make it swing.
+ *
+ *   b3d_adapt_init(&a, output, B3D_FORMAT_XRGB8888, 0, scratch, depth,
+ *                  w, h, fov, 16.7f, 4, lods);
+ *   for (;;) {
+ *       b3d_adapt_begin(&a);  // may re-initialize: camera after this
+ *       b3d_clear();
+ *       b3d_set_camera(&cam);
+ *       b3d_lod_draw(&ship, a.lod);
+ *       b3d_adapt_end(&a, 0); // or the measured time of the last frame
+ *       present(output);
+ *   }
+ *
+ * b3d_lod_simplify() makes coarser levels from a loaded mesh by vertex
+ * clustering.
+ */
+
+#ifndef B3D_ADAPT_H
+#define B3D_ADAPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "b3d.h"
+
+#define B3D_ADAPT_MAX_SCALE 8    /* Largest resolution divisor */
+#define B3D_ADAPT_MAX_LODS 8     /* Levels per b3d_lod_t */
+#define B3D_ADAPT_SETTLE 8       /* Frames between two changes */
+#define B3D_ADAPT_HEADROOM 0.9f  /* Raise a knob only if it fits this share */
+#define B3D_ADAPT_LOD_COST 2.0f  /* Assumed cost ratio of neighbouring LODs */
+
+typedef struct {
+    /* Output, set by b3d_adapt_init() */
+    void *output;
+    int format;
+    size_t stride;
+    int width, height;
+    void *scratch;      /* Internal frames below full resolution */
+    b3d_depth_t *depth; /* Full-resolution depth buffer */
+    float fov;
+
+    /* Controller */
+    float target_ms; /* Frame time to hold */
+    int max_scale;   /* Largest @scale allowed */
+    int lod_count;   /* Levels @lod may take */
+    int scale;       /* Internal resolution is 1/scale of the output */
+    int lod;         /* Level of detail, 0 for the finest */
+    float avg_ms;    /* Smoothed frame time since the last change */
+    int frames;      /* Frames since the last change */
+    int bound;       /* Scale the context was initialized for, 0 if none */
+    double start_ms; /* Time of b3d_adapt_begin() */
+} b3d_adapt_t;
+
+/* One level of a b3d_lod_t, see b3d_draw_mesh() */
+typedef struct {
+    const float *positions;
+    const uint32_t *indices;
+    const uint32_t *colors;
+    int vertex_count, index_count;
+} b3d_lod_level_t;
+
+typedef struct {
+    b3d_lod_level_t levels[B3D_ADAPT_MAX_LODS]; /* Finest first */
+    int count;
+} b3d_lod_t;
+
+/* Bytes per pixel of a B3D_FORMAT_* */
+static inline size_t b3d_adapt_bpp(int format)
+{
+    return format == B3D_FORMAT_XRGB8888 ? 4
+           : format == B3D_FORMAT_RGB565 ? 2
+                                         : 1;
+}
+
+/* Internal size along an output dimension of @n pixels at @scale */
+static inline int b3d_adapt_size(int n, int scale)
+{
+    return (n + scale - 1) / scale;
+}
+
+/* Milliseconds on a monotonic clock, 0 where there is none */
+static inline double b3d_adapt_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+#else
+    return 0.0;
+#endif
+}
+
+/* Enlarge @src, the frame drawn at @scale, into @w x @h pixels at @dst by
+ * repeating each pixel @scale times along both axes. @src has
+ * b3d_adapt_size(@w, @scale) x b3d_adapt_size(@h, @scale) pixels; the last
+ * column and row are cut off where the output size is not a multiple of
+ * @scale. Strides are in bytes; both buffers are in @format.
+ */
+static inline void b3d_adapt_upscale(void *dst,
+                                     size_t dst_stride,
+                                     const void *src,
+                                     size_t src_stride,
+                                     int format,
+                                     int w,
+                                     int h,
+                                     int scale)
+{
+    if (!dst || !src || w <= 0 || h <= 0 || scale < 1)
+        return;
+
+    const size_t bpp = b3d_adapt_bpp(format), row = (size_t) w * bpp;
+    const int sw = b3d_adapt_size(w, scale);
+    unsigned char *out = (unsigned char *) dst;
+    const unsigned char *in = (const unsigned char *) src;
+    for (int y = 0; y < h; y += scale, in += src_stride) {
+        /* Widen one row, then copy it down the rows it covers */
+        unsigned char *first = out;
+        if (bpp == 4) {
+            const uint32_t *s = (const uint32_t *) in;
+            uint32_t *d = (uint32_t *) first;
+            for (int x = 0; x < sw - 1; x++, d += scale) {
+                for (int k = 0; k < scale; k++)
+                    d[k] = s[x];
+            }
+            for (int x = (sw - 1) * scale; x < w; x++)
+                *d++ = s[sw - 1];
+        } else if (bpp == 2) {
+            const uint16_t *s = (const uint16_t *) in;
+            uint16_t *d = (uint16_t *) first;
+            for (int x = 0; x < sw - 1; x++, d += scale) {
+                for (int k = 0; k < scale; k++)
+                    d[k] = s[x];
+            }
+            for (int x = (sw - 1) * scale; x < w; x++)
+                *d++ = s[sw - 1];
+        } else {
+            unsigned char *d = first;
+            for (int x = 0; x < sw - 1; x++, d += scale)
+                memset(d, in[x], (size_t) scale);
+            memset(d, in[sw - 1], (size_t) (w - (sw - 1) * scale));
+        }
+        out += dst_stride;
+        for (int k = 1; k < scale && y + k < h; k++, out += dst_stride)
+            memcpy(out, first, row);
+    }
+}
+
+/* Set up @a to draw @w x @h frames into @output in @format (stride in bytes,
+ * 0 for packed rows), holding @target_ms per frame with resolution divisors
+ * up to @max_scale and @lod_count levels of detail. @scratch takes frames
+ * drawn below full resolution and needs room for @w * @h packed pixels
+ * (NULL if @max_scale is 1); @depth has @w * @h entries. The context is
+ * initialized by the first b3d_adapt_begin().
+ */
+static inline bool b3d_adapt_init(b3d_adapt_t *a,
+                                  void *output,
+                                  int format,
+                                  size_t stride,
+                                  void *scratch,
+                                  b3d_depth_t *depth,
+                                  int w,
+                                  int h,
+                                  float fov,
+                                  float target_ms,
+                                  int max_scale,
+                                  int lod_count)
+{
+    if (!a || !output || !depth || w <= 0 || h <= 0 ||
+        format < B3D_FORMAT_XRGB8888 || format > B3D_FORMAT_RGB332 ||
+        !(target_ms > 0.0f) || max_scale < 1 ||
+        max_scale > B3D_ADAPT_MAX_SCALE || (max_scale > 1 && !scratch) ||
+        lod_count < 1 || lod_count > B3D_ADAPT_MAX_LODS)
+        return false;
+
+    memset(a, 0, sizeof(*a));
+    a->output = output;
+    a->format = format;
+    a->stride = stride ? stride : (size_t) w * b3d_adapt_bpp(format);
+    a->width = w;
+    a->height = h;
+    a->scratch = scratch;
+    a->depth = depth;
+    a->fov = fov;
+    a->target_ms = target_ms;
+    a->max_scale = max_scale;
+    a->lod_count = lod_count;
+    a->scale = 1;
+    return true;
+}
+
+/* Feed the controller one frame of @frame_ms milliseconds; @stats, if not
+ * NULL, splits it into geometry and raster work. Returns true if @a->scale
+ * or @a->lod changed.
+ */
+static inline bool b3d_adapt_update(b3d_adapt_t *a,
+                                    float frame_ms,
+                                    const b3d_stats_t *stats)
+{
+    if (!a || !(frame_ms > 0.0f))
+        return false;
+    a->avg_ms = a->frames ? a->avg_ms + (frame_ms - a->avg_ms) * 0.125f
+                          : frame_ms;
+    if (++a->frames < B3D_ADAPT_SETTLE)
+        return false;
+
+    /* Shares of the frame that follow the pixel count and the triangle
+     * count. Without statistics, assume either could be all of it: that
+     * lowers the resolution first and raises nothing that might not fit.
+     */
+    float pixels = 1.0f, geometry = 1.0f;
+    if (stats) {
+        uint64_t geo = stats->transform_ns + stats->clip_ns;
+        uint64_t total = geo + stats->raster_ns;
+        if (total > 0) {
+            geometry = (float) geo / (float) total;
+            pixels = 1.0f - geometry;
+        }
+    }
+
+    if (a->avg_ms > a->target_ms) {
+        if (pixels >= geometry && a->scale < a->max_scale)
+            a->scale++;
+        else if (a->lod < a->lod_count - 1)
+            a->lod++;
+        else if (a->scale < a->max_scale)
+            a->scale++;
+        else
+            return false;
+    } else {
+        float s = (float) a->scale, grow = s * s / ((s - 1.0f) * (s - 1.0f));
+        float budget = a->target_ms * B3D_ADAPT_HEADROOM;
+        if (a->scale > 1 && a->avg_ms * (1.0f + pixels * (grow - 1.0f)) <
+                                budget)
+            a->scale--;
+        else if (a->lod > 0 &&
+                 a->avg_ms * (1.0f + geometry * (B3D_ADAPT_LOD_COST - 1.0f)) <
+                     budget)
+            a->lod--;
+        else
+            return false;
+    }
+    a->frames = 0;
+    return true;
+}
+
+/* Prepare the default context for a frame at the current scale: straight
+ * into the output at full resolution, otherwise into the scratch buffer.
+ * Re-initializing on a scale change resets the camera and transforms, so
+ * set them after this call. Returns false if the context cannot be set up.
+ */
+static inline bool b3d_adapt_begin(b3d_adapt_t *a)
+{
+    if (!a)
+        return false;
+    a->start_ms = b3d_adapt_now();
+    if (a->bound == a->scale)
+        return true;
+
+    int w = b3d_adapt_size(a->width, a->scale);
+    int h = b3d_adapt_size(a->height, a->scale);
+    bool ok = a->scale == 1
+                  ? b3d_init_ex(a->output, a->format, a->stride, a->depth,
+                                w, h, a->fov)
+                  : b3d_init_ex(a->scratch, a->format, 0, a->depth, w, h,
+                                a->fov);
+    a->bound = ok ? a->scale : 0;
+    return ok;
+}
+
+/* Finish the frame begun by b3d_adapt_begin(): flush, upscale into the
+ * output if needed and feed the controller @frame_ms, the caller's measure
+ * of a whole frame. With 0, the time since b3d_adapt_begin() is used.
+ * Returns true if the scale or LOD changed for the next frame.
+ */
+static inline bool b3d_adapt_end(b3d_adapt_t *a, float frame_ms)
+{
+    if (!a || !a->bound)
+        return false;
+    b3d_flush();
+    if (a->bound > 1) {
+        b3d_adapt_upscale(a->output, a->stride, a->scratch,
+                          (size_t) b3d_adapt_size(a->width, a->bound) *
+                              b3d_adapt_bpp(a->format),
+                          a->format, a->width, a->height, a->bound);
+    }
+    if (!(frame_ms > 0.0f) && a->start_ms > 0.0)
+        frame_ms = (float) (b3d_adapt_now() - a->start_ms);
+
+    b3d_stats_t stats;
+    return b3d_adapt_update(a, frame_ms,
+                            b3d_get_stats(&stats) ? &stats : NULL);
+}
+
+/* Register the next coarser level of @lod; arrays are referenced, not
+ * copied. Returns false once B3D_ADAPT_MAX_LODS levels are registered.
+ */
+static inline bool b3d_lod_add(b3d_lod_t *lod,
+                               const float *positions,
+                               int vcount,
+                               const uint32_t *indices,
+                               int icount,
+                               const uint32_t *colors)
+{
+    if (!lod || lod->count >= B3D_ADAPT_MAX_LODS || !positions ||
+        vcount <= 0 || !indices || icount <= 0)
+        return false;
+    lod->levels[lod->count++] = (b3d_lod_level_t) {
+        positions, indices, colors, vcount, icount,
+    };
+    return true;
+}
+
+/* Draw level @level of @lod, or its coarsest if it has fewer; returns the
+ * number of triangles drawn
+ */
+static inline int b3d_lod_draw(const b3d_lod_t *lod, int level)
+{
+    if (!lod || lod->count == 0)
+        return 0;
+    level = level < 0 ? 0 : level >= lod->count ? lod->count - 1 : level;
+    const b3d_lod_level_t *l = &lod->levels[level];
+    return b3d_draw_mesh(l->positions, l->vertex_count, l->indices,
+                         l->index_count, l->colors);
+}
+
+/* Simplify a mesh by vertex clustering: a grid of cubes, @cells of them
+ * along the longest side of the bounds, merges the vertices in each cube
+ * into their average. Triangles whose corners fall into fewer than three
+ * cells are dropped, and so are repeats of one with the same corners and
+ * winding; the first one's color is kept.
+ * @indices may be NULL for a triangle soup such as b3d_mesh_t, with
+ * @vcount vertices and @icount equal to it; shared corners are welded.
+ * @out_positions has room for @vcount vertices, @out_indices for @icount
+ * indices and @out_colors, used if @colors is set, for @icount / 3 colors.
+ *
+ * Returns the number of indices written, with the vertex count in
+ * @out_vcount, or -1 on invalid input or allocation failure.
+ */
+static inline int b3d_lod_simplify(const float *positions,
+                                   int vcount,
+                                   const uint32_t *indices,
+                                   int icount,
+                                   const uint32_t *colors,
+                                   int cells,
+                                   float *out_positions,
+                                   int *out_vcount,
+                                   uint32_t *out_indices,
+                                   uint32_t *out_colors)
+{
+    if (!positions || vcount <= 0 || icount <= 0 || icount % 3 ||
+        (!indices && icount != vcount) || cells < 1 || cells > 1024 ||
+        !out_positions || !out_vcount || !out_indices ||
+        (colors && !out_colors))
+        return -1;
+
+    float min[3], max[3], extent = 0.0f;
+    for (int k = 0; k < 3; k++)
+        min[k] = max[k] = positions[k];
+    for (int i = 1; i < vcount; i++) {
+        for (int k = 0; k < 3; k++) {
+            float v = positions[(size_t) i * 3 + k];
+            min[k] = v < min[k] ? v : min[k];
+            max[k] = v > max[k] ? v : max[k];
+        }
+    }
+    for (int k = 0; k < 3; k++)
+        extent = max[k] - min[k] > extent ? max[k] - min[k] : extent;
+    const float step = extent > 0.0f ? (float) cells / extent : 0.0f;
+
+    /* Open-addressed table from cell key to output vertex, then the output
+     * vertex of every input vertex and a count for the averages. The table
+     * is reused for the triangles later, so it covers both.
+     */
+    size_t slots = 16;
+    while (slots < (size_t) vcount * 2 || slots < (size_t) icount / 3 * 2)
+        slots *= 2;
+    uint64_t *keys = (uint64_t *) malloc(slots * sizeof(uint64_t));
+    int *vals = (int *) malloc(slots * sizeof(int));
+    uint32_t *remap = (uint32_t *) malloc((size_t) vcount * sizeof(uint32_t));
+    int *weight = (int *) calloc((size_t) vcount, sizeof(int));
+    if (!keys || !vals || !remap || !weight) {
+        free(keys);
+        free(vals);
+        free(remap);
+        free(weight);
+        return -1;
+    }
+    memset(vals, 0xff, slots * sizeof(int));
+
+    int n = 0;
+    for (int i = 0; i < vcount; i++) {
+        const float *p = &positions[(size_t) i * 3];
+        uint64_t key = 0;
+        for (int k = 0; k < 3; k++) {
+            int c = (int) ((p[k] - min[k]) * step);
+            c = c < 0 ? 0 : c >= cells ? cells - 1 : c;
+            key = key << 10 | (uint64_t) c;
+        }
+        size_t slot = (size_t) ((key * 0x9E3779B97F4A7C15ull) >> 32) &
+                      (slots - 1);
+        while (vals[slot] >= 0 && keys[slot] != key)
+            slot = (slot + 1) & (slots - 1);
+        if (vals[slot] < 0) {
+            keys[slot] = key;
+            vals[slot] = n;
+            memset(&out_positions[(size_t) n * 3], 0, 3 * sizeof(float));
+            n++;
+        }
+        int v = vals[slot];
+        remap[i] = (uint32_t) v;
+        weight[v]++;
+        for (int k = 0; k < 3; k++)
+            out_positions[(size_t) v * 3 + k] += p[k];
+    }
+    for (int v = 0; v < n; v++) {
+        for (int k = 0; k < 3; k++)
+            out_positions[(size_t) v * 3 + k] /= (float) weight[v];
+    }
+
+    /* Triangles, rotated to start at their lowest corner so that repeats
+     * have equal keys; @vals now holds the index of a kept triangle
+     */
+    memset(vals, 0xff, slots * sizeof(int));
+    int out = 0;
+    for (int t = 0; t < icount; t += 3) {
+        uint32_t c[3];
+        bool ok = true;
+        for (int j = 0; j < 3; j++) {
+            uint32_t i = indices ? indices[t + j] : (uint32_t) (t + j);
+            ok = ok && i < (uint32_t) vcount;
+            c[j] = ok ? remap[i] : 0;
+        }
+        if (!ok || c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+            continue;
+        while (c[0] > c[1] || c[0] > c[2]) {
+            uint32_t r = c[0];
+            c[0] = c[1];
+            c[1] = c[2];
+            c[2] = r;
+        }
+        uint64_t key = (uint64_t) c[0] << 42 ^ (uint64_t) c[1] << 21 ^ c[2];
+        size_t slot = (size_t) ((key * 0x9E3779B97F4A7C15ull) >> 32) &
+                      (slots - 1);
+        while (vals[slot] >= 0 && memcmp(&out_indices[vals[slot]], c,
+                                         sizeof(c)) != 0)
+            slot = (slot + 1) & (slots - 1);
+        if (vals[slot] >= 0)
+            continue;
+        vals[slot] = out;
+        if (colors)
+            out_colors[out / 3] = colors[t / 3];
+        memcpy(&out_indices[out], c, sizeof(c));
+        out += 3;
+    }
+
+    free(keys);
+    free(vals);
+    free(remap);
+    free(weight);
+    *out_vcount = n;
+    return out;
+}
+
+#endif /* B3D_ADAPT_H */
@@ -0,0 +1,633 @@
+/*
+ * B3D is freely redistributable under the MIT License. See the file
+ * "LICENSE" for information on usage and redistribution of this file.
+ */
+
+/*
+ * Frame output for snapshots and offline rendering
+ *
+ * b3d_write_frame() stores one framebuffer, in any B3D_FORMAT_*, as:
+ *   PNG  8-bit RGB with stored (uncompressed) deflate blocks. Files are as
+ *        large as the pixels, but encoding is a copy plus a checksum pass;
+ *        recompress offline where size matters.
+ *   PPM  binary P6.
+ *   RAW  packed RGB24 rows without a header (ffmpeg: -f rawvideo
+ *        -pix_fmt rgb24 -s WxH).
+ *   Y4M  YUV4MPEG2, 4:2:0 with BT.601 limited-range luma and 2x2 averaged
+ *        chroma, which video encoders read without a conversion step.
+ *
+ * For sequences, b3d_stream_open() preallocates a RAW or Y4M file for a
+ * maximum number of frames and memory-maps it; b3d_stream_write() encodes
+ * each frame straight into the mapping, and b3d_stream_close() trims the
+ * file to the frames written. Define B3D_IMAGE_NO_MMAP to write frames
+ * through stdio instead.
+ */
+
+#ifndef B3D_IMAGE_H
+#define B3D_IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "b3d.h"
+
+#if !defined(B3D_IMAGE_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define B3D_IMAGE_MMAP 1
+#endif
+
+/* Output types */
+#define B3D_IMAGE_PNG 0 /* RGB PNG, stored deflate */
+#define B3D_IMAGE_PPM 1 /* Binary PPM (P6) */
+#define B3D_IMAGE_RAW 2 /* Packed RGB24 rows, no header */
+#define B3D_IMAGE_Y4M 3 /* YUV4MPEG2 4:2:0, BT.601 limited range */
+
+#define B3D_IMAGE_CHUNK 256 /* Pixels unpacked to RGB24 at a time */
+
+/* Check output type, pixel format and dimensions */
+static inline bool b3d_image_ok(int type, int format, int w, int h)
+{
+    if (type < B3D_IMAGE_PNG || type > B3D_IMAGE_Y4M)
+        return false;
+    if (format < B3D_FORMAT_XRGB8888 || format > B3D_FORMAT_RGB332)
+        return false;
+    if (w <= 0 || h <= 0 || w > 0x7fffff || h > 0x7fffff)
+        return false;
+    return (size_t) w * (size_t) h <= SIZE_MAX / 8;
+}
+
+/* Bytes per pixel of a B3D_FORMAT_* */
+static inline size_t b3d_image_bpp(int format)
+{
+    return format == B3D_FORMAT_XRGB8888 ? 4
+           : format == B3D_FORMAT_RGB565 ? 2
+                                         : 1;
+}
+
+/* Unpack @n pixels of @row, starting at @x, to RGB24 at @rgb */
+static inline void b3d_image_unpack(uint8_t *rgb,
+                                    const void *row,
+                                    int format,
+                                    int x,
+                                    int n)
+{
+    if (format == B3D_FORMAT_XRGB8888) {
+        const uint32_t *src = (const uint32_t *) row + x;
+        for (int i = 0; i < n; i++, rgb += 3) {
+            uint32_t p = src[i];
+            rgb[0] = (uint8_t) (p >> 16);
+            rgb[1] = (uint8_t) (p >> 8);
+            rgb[2] = (uint8_t) p;
+        }
+    } else if (format == B3D_FORMAT_RGB565) {
+        const uint16_t *src = (const uint16_t *) row + x;
+        for (int i = 0; i < n; i++, rgb += 3) {
+            unsigned p = src[i];
+            unsigned r = p >> 11, g = (p >> 5) & 63, b = p & 31;
+            rgb[0] = (uint8_t) (r << 3 | r >> 2);
+            rgb[1] = (uint8_t) (g << 2 | g >> 4);
+            rgb[2] = (uint8_t) (b << 3 | b >> 2);
+        }
+    } else {
+        const uint8_t *src = (const uint8_t *) row + x;
+        for (int i = 0; i < n; i++, rgb += 3) {
+            unsigned p = src[i];
+            unsigned r = p >> 5, g = (p >> 2) & 7, b = p & 3;
+            rgb[0] = (uint8_t) (r << 5 | r << 2 | r >> 1);
+            rgb[1] = (uint8_t) (g << 5 | g << 2 | g >> 1);
+            rgb[2] = (uint8_t) (b * 0x55);
+        }
+    }
+}
+
+/* Bytes of the Y4M plane data of one frame */
+static inline size_t b3d_image_yuv_size(int w, int h)
+{
+    size_t cw = (size_t) (w + 1) / 2, ch = (size_t) (h + 1) / 2;
+    return (size_t) w * (size_t) h + 2 * cw * ch;
+}
+
+/* BT.601 limited-range luma of an RGB24 pixel */
+static inline uint8_t b3d_image_luma(const uint8_t *p)
+{
+    return (uint8_t) (((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+}
+
+/* Convert a frame to Y4M planes at @out: Y, then U and V at half size */
+static inline void b3d_image_yuv(uint8_t *out,
+                                 const void *pixels,
+                                 int format,
+                                 size_t stride,
+                                 int w,
+                                 int h)
+{
+    uint8_t rgb[2][B3D_IMAGE_CHUNK * 3];
+    size_t cw = (size_t) (w + 1) / 2, ch = (size_t) (h + 1) / 2;
+    uint8_t *yp = out, *up = out + (size_t) w * (size_t) h, *vp = up + cw * ch;
+
+    for (int y = 0; y < h; y += 2) {
+        const uint8_t *row0 = (const uint8_t *) pixels + (size_t) y * stride;
+        const uint8_t *row1 = y + 1 < h ? row0 + stride : row0;
+        uint8_t *y0 = yp + (size_t) y * (size_t) w;
+        uint8_t *y1 = y + 1 < h ? y0 + w : NULL;
+        uint8_t *u = up + (size_t) (y / 2) * cw;
+        uint8_t *v = vp + (size_t) (y / 2) * cw;
+
+        /* Chunks hold an even number of pixels, so 2x2 blocks never span */
+        for (int x0 = 0; x0 < w; x0 += B3D_IMAGE_CHUNK) {
+            int n = w - x0 < B3D_IMAGE_CHUNK ? w - x0 : B3D_IMAGE_CHUNK;
+            b3d_image_unpack(rgb[0], row0, format, x0, n);
+            b3d_image_unpack(rgb[1], row1, format, x0, n);
+            for (int i = 0; i < n; i += 2) {
+                /* An odd last column repeats into its 2x2 block */
+                const uint8_t *q[4] = {
+                    &rgb[0][i * 3],
+                    &rgb[0][(i + 1 < n ? i + 1 : i) * 3],
+                    &rgb[1][i * 3],
+                    &rgb[1][(i + 1 < n ? i + 1 : i) * 3],
+                };
+                y0[x0 + i] = b3d_image_luma(q[0]);
+                if (i + 1 < n)
+                    y0[x0 + i + 1] = b3d_image_luma(q[1]);
+                if (y1) {
+                    y1[x0 + i] = b3d_image_luma(q[2]);
+                    if (i + 1 < n)
+                        y1[x0 + i + 1] = b3d_image_luma(q[3]);
+                }
+                int r = q[0][0] + q[1][0] + q[2][0] + q[3][0];
+                int g = q[0][1] + q[1][1] + q[2][1] + q[3][1];
+                int b = q[0][2] + q[1][2] + q[2][2] + q[3][2];
+                /* Sums of four, so the shift also takes the average */
+                u[(x0 + i) / 2] =
+                    (uint8_t) (((-38 * r - 74 * g + 112 * b + 512) >> 10) +
+                               128);
+                v[(x0 + i) / 2] =
+                    (uint8_t) (((112 * r - 94 * g - 18 * b + 512) >> 10) +
+                               128);
+            }
+        }
+    }
+}
+
+/* PNG stored-deflate writer: splits the zlib payload into blocks of at most
+ * 65535 bytes and keeps its Adler-32
+ */
+typedef struct {
+    uint8_t *out;
+    size_t total; /* Payload bytes of the whole stream */
+    size_t done;  /* Payload bytes written so far */
+    size_t left;  /* Bytes left in the current block */
+    uint32_t a, b;
+} b3d_png_deflate_t;
+
+static inline void b3d_png_put(b3d_png_deflate_t *z,
+                               const uint8_t *src,
+                               size_t n)
+{
+    while (n) {
+        if (!z->left) {
+            size_t len = z->total - z->done;
+            if (len > 65535)
+                len = 65535;
+            z->out[0] = z->done + len == z->total; /* BFINAL, BTYPE=00 */
+            z->out[1] = (uint8_t) len;
+            z->out[2] = (uint8_t) (len >> 8);
+            z->out[3] = (uint8_t) ~len;
+            z->out[4] = (uint8_t) (~len >> 8);
+            z->out += 5;
+            z->left = len;
+        }
+        size_t m = n < z->left ? n : z->left;
+        memcpy(z->out, src, m);
+
+        /* 5552 bytes is the most that cannot overflow @b before reducing */
+        uint32_t a = z->a, b = z->b;
+        for (size_t i = 0; i < m;) {
+            size_t end = m - i > 5552 ? i + 5552 : m;
+            for (; i < end; i++) {
+                a += src[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        z->a = a, z->b = b;
+        z->out += m, z->done += m, z->left -= m;
+        src += m, n -= m;
+    }
+}
+
+static inline void b3d_png_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+/* CRC-32 of @n bytes, as required after every PNG chunk. Four bytes per
+ * step through the tables of b3d_png_crc_init() ("slicing by 4").
+ */
+static inline uint32_t b3d_png_crc(const uint32_t *t,
+                                   const uint8_t *p,
+                                   size_t n)
+{
+    uint32_t c = ~0u;
+    for (; n >= 4; n -= 4, p += 4) {
+        c ^= (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 |
+             (uint32_t) p[3] << 24;
+        c = t[768 + (c & 0xff)] ^ t[512 + ((c >> 8) & 0xff)] ^
+            t[256 + ((c >> 16) & 0xff)] ^ t[c >> 24];
+    }
+    for (; n; n--)
+        c = t[(c ^ *p++) & 0xff] ^ (c >> 8);
+    return ~c;
+}
+
+/* Fill @t[k * 256 + b] with the CRC of byte @b and @k zero bytes after it */
+static inline void b3d_png_crc_init(uint32_t *t)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        t[i] = c;
+    }
+    for (int i = 256; i < 4 * 256; i++)
+        t[i] = t[t[i - 256] & 0xff] ^ (t[i - 256] >> 8);
+}
+
+/* Bytes of the zlib payload of a PNG: a filter byte plus RGB24 per row */
+static inline size_t b3d_png_payload(int w, int h)
+{
+    return (size_t) h * (1 + 3 * (size_t) w);
+}
+
+/* Bytes of an encoded single-frame file.
+ * @type: B3D_IMAGE_*
+ *
+ * Returns 0 for an unknown type or dimensions out of range.
+ */
+static inline size_t b3d_image_size(int type, int w, int h)
+{
+    if (!b3d_image_ok(type, B3D_FORMAT_XRGB8888, w, h))
+        return 0;
+    size_t rgb = (size_t) w * (size_t) h * 3;
+    switch (type) {
+    case B3D_IMAGE_PNG: {
+        size_t payload = b3d_png_payload(w, h);
+        size_t blocks = (payload + 65534) / 65535;
+        /* Chunk lengths are limited to 31 bits */
+        if (payload > 0x7fffffff - 6 - blocks * 5)
+            return 0;
+        /* Signature, IHDR, IDAT around zlib header, blocks and Adler, IEND */
+        return 8 + 25 + 12 + 2 + blocks * 5 + payload + 4 + 12;
+    }
+    case B3D_IMAGE_PPM:
+        return (size_t) snprintf(NULL, 0, "P6\n%d %d\n255\n", w, h) + rgb;
+    case B3D_IMAGE_RAW:
+        return rgb;
+    default:
+        return (size_t) snprintf(NULL, 0,
+                                 "YUV4MPEG2 W%d H%d F1:1 Ip A1:1 C420jpeg\n"
+                                 "FRAME\n",
+                                 w, h) +
+               b3d_image_yuv_size(w, h);
+    }
+}
+
+/* Convert a frame to packed RGB24 rows at @out */
+static inline void b3d_image_rgb(uint8_t *out,
+                                 const void *pixels,
+                                 int format,
+                                 size_t stride,
+                                 int w,
+                                 int h)
+{
+    for (int y = 0; y < h; y++, out += (size_t) w * 3)
+        b3d_image_unpack(out, (const uint8_t *) pixels + (size_t) y * stride,
+                         format, 0, w);
+}
+
+/* Encode a PNG into @out of b3d_image_size() bytes */
+static inline void b3d_image_png(uint8_t *out,
+                                 const void *pixels,
+                                 int format,
+                                 size_t stride,
+                                 int w,
+                                 int h)
+{
+    uint32_t table[4 * 256];
+    b3d_png_crc_init(table);
+
+    memcpy(out, "\x89PNG\r\n\32\n", 8);
+    uint8_t *ihdr = out + 8;
+    b3d_png_u32(ihdr, 13);
+    memcpy(ihdr + 4, "IHDR", 4);
+    b3d_png_u32(ihdr + 8, (uint32_t) w);
+    b3d_png_u32(ihdr + 12, (uint32_t) h);
+    /* 8-bit truecolor, deflate, no filter, no interlace */
+    memcpy(ihdr + 16, "\10\2\0\0\0", 5);
+    b3d_png_u32(ihdr + 21, b3d_png_crc(table, ihdr + 4, 17));
+
+    size_t payload = b3d_png_payload(w, h);
+    size_t blocks = (payload + 65534) / 65535;
+    size_t idat_len = 2 + blocks * 5 + payload + 4;
+    uint8_t *idat = ihdr + 25;
+    b3d_png_u32(idat, (uint32_t) idat_len);
+    memcpy(idat + 4, "IDAT", 4);
+    idat[8] = 0x78, idat[9] = 0x01; /* zlib: deflate, 32K window, no dict */
+
+    b3d_png_deflate_t z = {idat + 10, payload, 0, 0, 1, 0};
+    static const uint8_t filter = 0;
+    uint8_t rgb[B3D_IMAGE_CHUNK * 3];
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = (const uint8_t *) pixels + (size_t) y * stride;
+        b3d_png_put(&z, &filter, 1);
+        for (int x = 0; x < w; x += B3D_IMAGE_CHUNK) {
+            int n = w - x < B3D_IMAGE_CHUNK ? w - x : B3D_IMAGE_CHUNK;
+            b3d_image_unpack(rgb, row, format, x, n);
+            b3d_png_put(&z, rgb, (size_t) n * 3);
+        }
+    }
+    b3d_png_u32(z.out, z.b << 16 | z.a);
+    b3d_png_u32(z.out + 4, b3d_png_crc(table, idat + 4, 4 + idat_len));
+
+    uint8_t *iend = z.out + 8;
+    b3d_png_u32(iend, 0);
+    memcpy(iend + 4, "IEND", 4);
+    b3d_png_u32(iend + 8, b3d_png_crc(table, iend + 4, 4));
+}
+
+/* Encode a frame as a complete file.
+ * @out:     b3d_image_size(@type, @w, @h) bytes
+ * @type:    B3D_IMAGE_*
+ * @pixels:  @h rows of @w pixels in @format
+ * @format:  B3D_FORMAT_*
+ * @stride:  bytes from the start of one row to the next; 0 for rows
+ *           without padding
+ *
+ * Returns the number of bytes written, 0 on invalid parameters.
+ */
+static inline size_t b3d_image_encode(void *out,
+                                      int type,
+                                      const void *pixels,
+                                      int format,
+                                      size_t stride,
+                                      int w,
+                                      int h)
+{
+    if (!out || !pixels || !b3d_image_ok(type, format, w, h))
+        return 0;
+    if (!stride)
+        stride = (size_t) w * b3d_image_bpp(format);
+    if (stride < (size_t) w * b3d_image_bpp(format))
+        return 0;
+
+    uint8_t *p = out;
+    size_t size = b3d_image_size(type, w, h);
+    if (!size)
+        return 0;
+    switch (type) {
+    case B3D_IMAGE_PNG:
+        b3d_image_png(p, pixels, format, stride, w, h);
+        break;
+    case B3D_IMAGE_PPM: {
+        char head[48];
+        int n = snprintf(head, sizeof(head), "P6\n%d %d\n255\n", w, h);
+        memcpy(p, head, (size_t) n);
+        b3d_image_rgb(p + n, pixels, format, stride, w, h);
+        break;
+    }
+    case B3D_IMAGE_RAW:
+        b3d_image_rgb(p, pixels, format, stride, w, h);
+        break;
+    default: {
+        char head[80];
+        int n = snprintf(head, sizeof(head),
+                         "YUV4MPEG2 W%d H%d F1:1 Ip A1:1 C420jpeg\nFRAME\n",
+                         w, h);
+        memcpy(p, head, (size_t) n);
+        b3d_image_yuv(p + n, pixels, format, stride, w, h);
+        break;
+    }
+    }
+    return size;
+}
+
+/* Write one frame to a file.
+ * @path:    output path
+ * @type:    B3D_IMAGE_*
+ * @pixels:  @h rows of @w pixels in @format, e.g. the b3d_init() buffer
+ * @format:  B3D_FORMAT_*
+ * @stride:  bytes from the start of one row to the next; 0 for rows
+ *           without padding
+ *
+ * Returns 0 on success, non-zero on error (1 = file cannot be written,
+ * 2 = memory allocation failed, 3 = invalid parameters).
+ */
+static inline int b3d_write_frame(const char *path,
+                                  int type,
+                                  const void *pixels,
+                                  int format,
+                                  size_t stride,
+                                  int w,
+                                  int h)
+{
+    if (!path || !pixels || !b3d_image_ok(type, format, w, h))
+        return 3;
+    size_t size = b3d_image_size(type, w, h);
+    if (!size)
+        return 3;
+    uint8_t *buf = malloc(size);
+    if (!buf)
+        return 2;
+    if (!b3d_image_encode(buf, type, pixels, format, stride, w, h)) {
+        free(buf);
+        return 3;
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        free(buf);
+        return 1;
+    }
+    bool ok = fwrite(buf, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    free(buf);
+    return ok ? 0 : 1;
+}
+
+typedef struct {
+    int type;          /* B3D_IMAGE_RAW or B3D_IMAGE_Y4M */
+    int w, h;          /* Frame size */
+    int frames;        /* Frames written */
+    int max_frames;    /* Frames the file was preallocated for */
+    size_t header;     /* Bytes of the stream header */
+    size_t frame_size; /* Bytes per frame, including Y4M's FRAME line */
+    uint8_t *base;     /* Mapping of the whole file, or one frame buffer */
+    size_t size;       /* Bytes of @base */
+    bool mapped;       /* @base is a mapping rather than heap memory */
+    int fd;            /* With a mapping */
+    FILE *file;        /* Without one */
+} b3d_stream_t;
+
+/* Open a file to stream frames into.
+ * @s:          stream to initialize
+ * @path:       output path, truncated
+ * @type:       B3D_IMAGE_RAW or B3D_IMAGE_Y4M
+ * @w, @h:      frame size
+ * @fps:        frame rate written to the Y4M header
+ * @max_frames: frames to preallocate the file for
+ *
+ * Returns 0 on success, non-zero on error (1 = file cannot be created or
+ * sized, 2 = mapping or memory allocation failed, 3 = invalid parameters).
+ */
+static inline int b3d_stream_open(b3d_stream_t *s,
+                                  const char *path,
+                                  int type,
+                                  int w,
+                                  int h,
+                                  int fps,
+                                  int max_frames)
+{
+    if (!s)
+        return 3;
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    if (!path || (type != B3D_IMAGE_RAW && type != B3D_IMAGE_Y4M) ||
+        !b3d_image_ok(type, B3D_FORMAT_XRGB8888, w, h) || fps <= 0 ||
+        max_frames <= 0)
+        return 3;
+
+    char head[80];
+    int n = 0;
+    if (type == B3D_IMAGE_Y4M)
+        n = snprintf(head, sizeof(head),
+                     "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, fps);
+    s->type = type, s->w = w, s->h = h;
+    s->max_frames = max_frames;
+    s->header = (size_t) n;
+    s->frame_size = type == B3D_IMAGE_Y4M ? 6 + b3d_image_yuv_size(w, h)
+                                          : (size_t) w * (size_t) h * 3;
+    if (s->frame_size > (SIZE_MAX - s->header) / (size_t) max_frames)
+        return 3;
+
+#ifdef B3D_IMAGE_MMAP
+    size_t size = s->header + s->frame_size * (size_t) max_frames;
+    if ((uintmax_t) size > (uintmax_t) INTMAX_MAX)
+        return 3;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return 1;
+    /* Reserve the blocks up front: running out of space while storing into
+     * a sparse mapping raises SIGBUS instead of an error
+     */
+#ifdef __linux__
+    int err = posix_fallocate(fd, 0, (off_t) size);
+#else
+    int err = ftruncate(fd, (off_t) size);
+#endif
+    if (err) {
+        close(fd);
+        return 1;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return 2;
+    }
+    memcpy(base, head, s->header);
+    s->base = base;
+    s->size = size;
+    s->mapped = true;
+    s->fd = fd;
+#else
+    s->base = malloc(s->frame_size);
+    if (!s->base)
+        return 2;
+    s->size = s->frame_size;
+    s->file = fopen(path, "wb");
+    if (!s->file || fwrite(head, 1, s->header, s->file) != s->header) {
+        if (s->file)
+            fclose(s->file);
+        free(s->base);
+        memset(s, 0, sizeof(*s));
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/* Append a frame to a stream.
+ * @s:       stream from b3d_stream_open()
+ * @pixels:  rows of the stream's size in @format
+ * @format:  B3D_FORMAT_*
+ * @stride:  bytes from the start of one row to the next; 0 for rows
+ *           without padding
+ *
+ * Returns 0 on success, 1 if the frame cannot be written, 3 on invalid
+ * parameters or once the stream holds max_frames frames.
+ */
+static inline int b3d_stream_write(b3d_stream_t *s,
+                                   const void *pixels,
+                                   int format,
+                                   size_t stride)
+{
+    if (!s || !s->base || !pixels || s->frames >= s->max_frames ||
+        !b3d_image_ok(s->type, format, s->w, s->h))
+        return 3;
+    size_t min = (size_t) s->w * b3d_image_bpp(format);
+    if (!stride)
+        stride = min;
+    if (stride < min)
+        return 3;
+
+    uint8_t *p = s->base;
+    if (s->mapped)
+        p += s->header + s->frame_size * (size_t) s->frames;
+    if (s->type == B3D_IMAGE_Y4M) {
+        memcpy(p, "FRAME\n", 6);
+        b3d_image_yuv(p + 6, pixels, format, stride, s->w, s->h);
+    } else {
+        b3d_image_rgb(p, pixels, format, stride, s->w, s->h);
+    }
+    if (!s->mapped &&
+        fwrite(s->base, 1, s->frame_size, s->file) != s->frame_size)
+        return 1;
+    s->frames++;
+    return 0;
+}
+
+/* Close a stream, trimming the file to the frames written.
+ *
+ * Returns 0 on success, 1 if the file could not be completed.
+ */
+static inline int b3d_stream_close(b3d_stream_t *s)
+{
+    if (!s || !s->base)
+        return 1;
+    bool ok = true;
+#ifdef B3D_IMAGE_MMAP
+    if (s->mapped) {
+        size_t used = s->header + s->frame_size * (size_t) s->frames;
+        ok = munmap(s->base, s->size) == 0;
+        ok = ftruncate(s->fd, (off_t) used) == 0 && ok;
+        ok = close(s->fd) == 0 && ok;
+    } else
+#endif
+    {
+        ok = fclose(s->file) == 0;
+        free(s->base);
+    }
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    return ok ? 0 : 1;
+}
+
+#endif /* B3D_IMAGE_H */
@@ -0,0 +1,350 @@
+/*
+ * B3D is freely redistributable under the MIT License. See the file
+ * "LICENSE" for information on usage and redistribution of this file.
+ */
+
+/*
+ * Binary mesh cache (.b3dm)
+ *
+ * A .b3dm file is a b3d_mesh_header_t followed by 16-byte aligned blobs in
+ * native (little-endian) byte order: xyz float positions, uint32_t indices
+ * (3 per triangle) and optionally one color and one unit face normal per
+ * triangle. b3d_mesh_map() memory-maps a file and points straight into the
+ * mapping, so loading costs a page-table update instead of a parse; the
+ * arrays feed b3d_draw_mesh() as they are. Define B3D_MESH_NO_MMAP to read
+ * files into a heap block instead.
+ *
+ * Write files with b3d_mesh_save() or convert OBJ files offline with
+ * scripts/obj2b3dm.py.
+ */
+
+#ifndef B3D_MESH_H
+#define B3D_MESH_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "b3d-math.h"
+
+#if !defined(B3D_MESH_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define B3D_MESH_MMAP 1
+#endif
+
+#define B3D_MESH_VERSION 1
+#define B3D_MESH_HAS_COLORS 0x1u  /* Header flag: colors blob present */
+#define B3D_MESH_HAS_NORMALS 0x2u /* Header flag: normals blob present */
+#define B3D_MESH_ALIGN 16         /* Alignment of every blob in the file */
+
+typedef struct {
+    char magic[4];         /* "B3DM" */
+    uint32_t version;      /* B3D_MESH_VERSION */
+    uint32_t flags;        /* B3D_MESH_HAS_* */
+    uint32_t vertex_count; /* Number of positions */
+    uint32_t index_count;  /* Number of indices (triangles * 3) */
+    uint32_t reserved;     /* Zero */
+    float min[3], max[3];  /* Bounds of all positions */
+    uint64_t positions;    /* Blob offsets from the start of the file, */
+    uint64_t indices;      /* 0 for absent blobs */
+    uint64_t colors;
+    uint64_t normals;
+} b3d_mesh_header_t;
+
+/* The layout is part of the format */
+typedef char b3d_mesh_header_check[(sizeof(b3d_mesh_header_t) == 80) * 2 - 1];
+
+typedef struct {
+    const float *positions;  /* 3 floats per vertex */
+    const uint32_t *indices; /* 3 per triangle; checked by b3d_draw_mesh() */
+    const uint32_t *colors;  /* 1 per triangle, or NULL */
+    const float *normals;    /* 3 floats per triangle, or NULL */
+    int vertex_count;        /* Number of positions */
+    int index_count;         /* Number of indices (triangles * 3) */
+    float min[3], max[3];    /* Bounds of all positions */
+    void *base;              /* File contents */
+    size_t size;             /* File size in bytes */
+    bool mapped;             /* @base is a mapping rather than heap memory */
+} b3d_mapped_mesh_t;
+
+/* Check that a blob of @count elements of @elem bytes at @offset lies within
+ * a file of @size bytes
+ */
+static inline bool b3d_mesh_blob_ok(uint64_t offset,
+                                    uint64_t count,
+                                    uint64_t elem,
+                                    size_t size)
+{
+    if (offset == 0)
+        return false;
+    if (offset % B3D_MESH_ALIGN || offset > size)
+        return false;
+    return count <= (size - offset) / elem;
+}
+
+/* Point @mesh into the file contents at @base */
+static inline int b3d_mesh_attach(b3d_mapped_mesh_t *mesh,
+                                  void *base,
+                                  size_t size)
+{
+    b3d_mesh_header_t h;
+    if (size < sizeof(h))
+        return 3;
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, "B3DM", 4) != 0 || h.version != B3D_MESH_VERSION)
+        return 3;
+    if (h.vertex_count > INT_MAX || h.index_count > INT_MAX ||
+        h.index_count % 3)
+        return 3;
+
+    uint64_t tris = h.index_count / 3;
+    bool has_colors = h.flags & B3D_MESH_HAS_COLORS;
+    bool has_normals = h.flags & B3D_MESH_HAS_NORMALS;
+    if (!b3d_mesh_blob_ok(h.positions, h.vertex_count, 3 * sizeof(float),
+                          size) ||
+        !b3d_mesh_blob_ok(h.indices, h.index_count, sizeof(uint32_t), size) ||
+        (has_colors &&
+         !b3d_mesh_blob_ok(h.colors, tris, sizeof(uint32_t), size)) ||
+        (has_normals &&
+         !b3d_mesh_blob_ok(h.normals, tris, 3 * sizeof(float), size)))
+        return 3;
+
+    unsigned char *p = base;
+    mesh->positions = (const float *) (p + h.positions);
+    mesh->indices = (const uint32_t *) (p + h.indices);
+    mesh->colors = has_colors ? (const uint32_t *) (p + h.colors) : NULL;
+    mesh->normals = has_normals ? (const float *) (p + h.normals) : NULL;
+    mesh->vertex_count = (int) h.vertex_count;
+    mesh->index_count = (int) h.index_count;
+    memcpy(mesh->min, h.min, sizeof(h.min));
+    memcpy(mesh->max, h.max, sizeof(h.max));
+    return 0;
+}
+
+/* Map a .b3dm file without copying it.
+ * @path:    path to the .b3dm file
+ * @mesh:    pointer to mesh structure to fill
+ *
+ * Returns 0 on success, non-zero on error (1 = file not found or unreadable,
+ * 2 = memory allocation failed, 3 = not a valid .b3dm file). Where mmap is
+ * unavailable the file is read into one heap block instead. The arrays stay
+ * valid until b3d_mesh_unmap().
+ */
+static inline int b3d_mesh_map(const char *path, b3d_mapped_mesh_t *mesh)
+{
+    if (!path || !mesh)
+        return 1;
+    memset(mesh, 0, sizeof(*mesh));
+
+#ifdef B3D_MESH_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 1;
+    }
+    if ((uintmax_t) st.st_size < sizeof(b3d_mesh_header_t) ||
+        (uintmax_t) st.st_size > SIZE_MAX) {
+        close(fd);
+        return 3;
+    }
+    size_t size = (size_t) st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return 2;
+    int err = b3d_mesh_attach(mesh, base, size);
+    if (err) {
+        munmap(base, size);
+        memset(mesh, 0, sizeof(*mesh));
+        return err;
+    }
+    mesh->mapped = true;
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 1;
+    long end = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        end = ftell(file);
+    if (end < (long) sizeof(b3d_mesh_header_t) || fseek(file, 0, SEEK_SET)) {
+        fclose(file);
+        return end < 0 ? 1 : 3;
+    }
+    size_t size = (size_t) end;
+    void *base = malloc(size);
+    if (!base) {
+        fclose(file);
+        return 2;
+    }
+    bool read_ok = fread(base, 1, size, file) == size;
+    fclose(file);
+    int err = read_ok ? b3d_mesh_attach(mesh, base, size) : 1;
+    if (err) {
+        free(base);
+        memset(mesh, 0, sizeof(*mesh));
+        return err;
+    }
+#endif
+    mesh->base = base;
+    mesh->size = size;
+    return 0;
+}
+
+/* Release a mesh returned by b3d_mesh_map() */
+static inline void b3d_mesh_unmap(b3d_mapped_mesh_t *mesh)
+{
+    if (!mesh || !mesh->base)
+        return;
+#ifdef B3D_MESH_MMAP
+    if (mesh->mapped)
+        munmap(mesh->base, mesh->size);
+    else
+#endif
+        free(mesh->base);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+/* Write zero padding up to the next multiple of B3D_MESH_ALIGN */
+static inline bool b3d_mesh_pad(FILE *file, uint64_t *offset)
+{
+    static const unsigned char zero[B3D_MESH_ALIGN];
+    size_t pad = (size_t) (-*offset % B3D_MESH_ALIGN);
+    *offset += pad;
+    return fwrite(zero, 1, pad, file) == pad;
+}
+
+/* Unit normal of triangle @t, facing the side it is visible from */
+static inline void b3d_mesh_face_normal(const float *positions,
+                                        const uint32_t *t,
+                                        float n[3])
+{
+    const float *a = positions + (size_t) t[0] * 3;
+    const float *b = positions + (size_t) t[1] * 3;
+    const float *c = positions + (size_t) t[2] * 3;
+    float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+
+    /* Scale by the largest component first, tiny triangles would otherwise
+     * vanish below the fixed-point resolution of b3d_sqrtf()
+     */
+    float m = b3d_fabsf(n[0]);
+    if (b3d_fabsf(n[1]) > m)
+        m = b3d_fabsf(n[1]);
+    if (b3d_fabsf(n[2]) > m)
+        m = b3d_fabsf(n[2]);
+    if (m == 0.0f)
+        return;
+    for (int k = 0; k < 3; k++)
+        n[k] /= m;
+    float len = b3d_sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int k = 0; k < 3; k++)
+        n[k] /= len;
+}
+
+/* Write a mesh to a .b3dm file.
+ * @path:         path to write
+ * @positions:    xyz floats, 3 per vertex
+ * @vcount:       number of vertices
+ * @indices:      3 vertex indices per triangle
+ * @icount:       number of indices (multiple of 3)
+ * @colors:       one color per triangle, or NULL for none
+ * @normals:      also store face normals
+ *
+ * Returns 0 on success, 1 if the file cannot be written, 3 for an invalid
+ * mesh (NULL arrays or an index out of range).
+ */
+static inline int b3d_mesh_save(const char *path,
+                                const float *positions,
+                                int vcount,
+                                const uint32_t *indices,
+                                int icount,
+                                const uint32_t *colors,
+                                bool normals)
+{
+    if (!path || !positions || !indices || vcount <= 0 || icount < 0 ||
+        icount % 3)
+        return 3;
+    for (int i = 0; i < icount; i++)
+        if (indices[i] >= (uint32_t) vcount)
+            return 3;
+
+    b3d_mesh_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "B3DM", 4);
+    h.version = B3D_MESH_VERSION;
+    h.flags = (colors ? B3D_MESH_HAS_COLORS : 0) |
+              (normals ? B3D_MESH_HAS_NORMALS : 0);
+    h.vertex_count = (uint32_t) vcount;
+    h.index_count = (uint32_t) icount;
+    for (int k = 0; k < 3; k++)
+        h.min[k] = h.max[k] = positions[k];
+    for (int i = 1; i < vcount; i++) {
+        for (int k = 0; k < 3; k++) {
+            float v = positions[(size_t) i * 3 + k];
+            if (v < h.min[k])
+                h.min[k] = v;
+            if (v > h.max[k])
+                h.max[k] = v;
+        }
+    }
+
+    size_t tris = (size_t) icount / 3;
+    uint64_t offset = sizeof(h);
+    h.positions = offset;
+    offset += (uint64_t) vcount * 3 * sizeof(float);
+    offset += -offset % B3D_MESH_ALIGN;
+    h.indices = offset;
+    offset += (uint64_t) icount * sizeof(uint32_t);
+    offset += -offset % B3D_MESH_ALIGN;
+    if (colors) {
+        h.colors = offset;
+        offset += (uint64_t) tris * sizeof(uint32_t);
+        offset += -offset % B3D_MESH_ALIGN;
+    }
+    if (normals)
+        h.normals = offset;
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 1;
+    offset = sizeof(h);
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1;
+    ok = ok && fwrite(positions, 3 * sizeof(float), (size_t) vcount, file) ==
+                   (size_t) vcount;
+    offset += (uint64_t) vcount * 3 * sizeof(float);
+    ok = ok && b3d_mesh_pad(file, &offset);
+    ok = ok && fwrite(indices, sizeof(uint32_t), (size_t) icount, file) ==
+                   (size_t) icount;
+    offset += (uint64_t) icount * sizeof(uint32_t);
+    ok = ok && b3d_mesh_pad(file, &offset);
+    if (colors) {
+        ok = ok && fwrite(colors, sizeof(uint32_t), tris, file) == tris;
+        offset += (uint64_t) tris * sizeof(uint32_t);
+        ok = ok && b3d_mesh_pad(file, &offset);
+    }
+    if (normals) {
+        for (size_t t = 0; ok && t < tris; t++) {
+            float n[3] = {0, 0, 0};
+            b3d_mesh_face_normal(positions, indices + t * 3, n);
+            ok = fwrite(n, sizeof(n), 1, file) == 1;
+        }
+        offset += (uint64_t) tris * 3 * sizeof(float);
+        ok = ok && b3d_mesh_pad(file, &offset);
+    }
+    ok = fclose(file) == 0 && ok;
+    return ok ? 0 : 1;
+}
+
+#endif /* B3D_MESH_H */
@@ -6,31 +6,460 @@
 /*
  * Wavefront .obj file loader
  *
- * A simple .obj file loader that extracts triangle data.
- * Only supports triangulated meshes (no quads or n-gons).
+ * Reads vertex positions ("v") and faces ("f") in a single pass; texture
+ * coordinates, normals, groups and materials are ignored. Polygons are split
+ * into triangle fans. Files are memory-mapped where available and read in
+ * B3D_OBJ_BUFFER_SIZE chunks otherwise (or when B3D_OBJ_NO_MMAP is defined).
+ *
+ * b3d_load_obj_indexed() produces unique positions and 32-bit indices ready
+ * for b3d_draw_mesh(), either on the heap or in a caller-provided arena.
+ * b3d_load_obj() expands them into a flat triangle list.
  */
 
 #ifndef B3D_OBJ_H
 #define B3D_OBJ_H
 
 #include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(B3D_OBJ_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define B3D_OBJ_MMAP 1
+#endif
+
+/* Chunk size of the buffered-read path, also its longest supported line */
+#ifndef B3D_OBJ_BUFFER_SIZE
+#define B3D_OBJ_BUFFER_SIZE 65536
+#endif
+
 typedef struct {
     float *triangles;   /* Triangle vertices: 9 floats per tri (ax,ay,az,...) */
     int triangle_count; /* Number of triangles */
     int vertex_count;   /* Total vertex components (triangle_count * 9) */
 } b3d_mesh_t;
 
+typedef struct {
+    float *positions;   /* Unique positions: 3 floats per vertex */
+    uint32_t *indices;  /* 3 zero-based position indices per triangle */
+    int vertex_count;   /* Number of positions */
+    int index_count;    /* Number of indices (triangles * 3) */
+    bool heap;          /* Arrays were allocated by the loader */
+} b3d_indexed_mesh_t;
+
+/* Parser state, positions and indices grow geometrically on the heap or from
+ * both ends of the arena towards each other (indices in reverse order).
+ */
+typedef struct {
+    float *pos;
+    uint32_t *idx;
+    size_t npos, nidx; /* Floats and indices stored */
+    size_t pos_cap, idx_cap;
+    unsigned char *arena;
+    size_t arena_size;
+    uint32_t max_index;
+    int err;
+} b3d_obj_parser_t;
+
+static inline bool b3d_obj_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool b3d_obj_digit(char c)
+{
+    return (unsigned) (c - '0') < 10u;
+}
+
+/* Parse a decimal float ("-1.5", "2e-3", ".5") from [@s, @e). Returns the end
+ * of the number or NULL if there is none. Up to 19 significant digits are
+ * kept, which rounds correctly for anything a modeling tool writes.
+ */
+static inline const char *b3d_obj_float(const char *s,
+                                        const char *e,
+                                        float *out)
+{
+    static const double scale[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+    bool neg = false;
+    if (s < e && (*s == '-' || *s == '+'))
+        neg = *s++ == '-';
+
+    uint64_t m = 0;
+    int digits = 0, exp = 0, any = 0;
+    for (; s < e && b3d_obj_digit(*s); s++, any++) {
+        if (digits < 19) {
+            m = m * 10 + (uint64_t) (*s - '0');
+            digits += m != 0;
+        } else {
+            exp++;
+        }
+    }
+    if (s < e && *s == '.') {
+        for (s++; s < e && b3d_obj_digit(*s); s++, any++) {
+            if (digits < 19) {
+                m = m * 10 + (uint64_t) (*s - '0');
+                digits += m != 0;
+                exp--;
+            }
+        }
+    }
+    if (!any)
+        return NULL;
+
+    if (s < e && (*s == 'e' || *s == 'E')) {
+        const char *t = s + 1;
+        bool eneg = false;
+        if (t < e && (*t == '-' || *t == '+'))
+            eneg = *t++ == '-';
+        if (t < e && b3d_obj_digit(*t)) {
+            int x = 0;
+            for (; t < e && b3d_obj_digit(*t); t++)
+                if (x < 10000)
+                    x = x * 10 + (*t - '0');
+            exp += eneg ? -x : x;
+            s = t;
+        }
+    }
+
+    double v = (double) m;
+    if (m != 0) {
+        for (; exp > 22; exp -= 22)
+            v *= 1e22;
+        for (; exp < -22; exp += 22)
+            v /= 1e22;
+        v = exp < 0 ? v / scale[-exp] : v * scale[exp];
+    }
+    *out = (float) (neg ? -v : v);
+    return s;
+}
+
+/* Make room for @n more floats and @k more indices */
+static inline bool b3d_obj_reserve(b3d_obj_parser_t *p, size_t n, size_t k)
+{
+    if (p->arena) {
+        size_t used = (p->npos + n) * sizeof(float) +
+                      (p->nidx + k) * sizeof(uint32_t);
+        return used <= p->arena_size;
+    }
+    if (p->npos + n > p->pos_cap) {
+        size_t cap = p->pos_cap ? p->pos_cap : 3072;
+        while (cap < p->npos + n)
+            cap *= 2;
+        float *temp = realloc(p->pos, cap * sizeof(float));
+        if (!temp)
+            return false;
+        p->pos = temp;
+        p->pos_cap = cap;
+    }
+    if (p->nidx + k > p->idx_cap) {
+        size_t cap = p->idx_cap ? p->idx_cap : 6144;
+        while (cap < p->nidx + k)
+            cap *= 2;
+        uint32_t *temp = realloc(p->idx, cap * sizeof(uint32_t));
+        if (!temp)
+            return false;
+        p->idx = temp;
+        p->idx_cap = cap;
+    }
+    return true;
+}
+
+static inline void b3d_obj_push_index(b3d_obj_parser_t *p, uint32_t i)
+{
+    if (p->arena)
+        p->idx[-(ptrdiff_t) ++p->nidx] = i;
+    else
+        p->idx[p->nidx++] = i;
+    if (i > p->max_index)
+        p->max_index = i;
+}
+
+/* Parse a face vertex reference ("7", "-1", "7/1/3", "7//3") into a
+ * zero-based position index. Relative indices count back from the last
+ * position read so far. Returns the end of the reference or NULL.
+ */
+static inline const char *b3d_obj_ref(b3d_obj_parser_t *p,
+                                      const char *s,
+                                      const char *e,
+                                      uint32_t *out)
+{
+    bool neg = s < e && *s == '-';
+    if (neg)
+        s++;
+    if (s >= e || !b3d_obj_digit(*s))
+        return NULL;
+    int64_t r = 0;
+    for (; s < e && b3d_obj_digit(*s); s++)
+        if (r <= UINT32_MAX)
+            r = r * 10 + (*s - '0');
+    while (s < e && !b3d_obj_space(*s))
+        s++;
+
+    int64_t count = (int64_t) (p->npos / 3);
+    r = neg ? count - r : r - 1;
+    if (r < 0 || r >= UINT32_MAX) {
+        p->err = 3;
+        return NULL;
+    }
+    *out = (uint32_t) r;
+    return s;
+}
+
+/* Parse one line [@s, @e), without the newline */
+static inline void b3d_obj_line(b3d_obj_parser_t *p,
+                                const char *s,
+                                const char *e)
+{
+    while (s < e && b3d_obj_space(*s))
+        s++;
+    if (e - s < 2 || !b3d_obj_space(s[1]))
+        return;
+
+    if (s[0] == 'v') {
+        float v[3];
+        s += 2;
+        for (int k = 0; k < 3; k++) {
+            while (s < e && b3d_obj_space(*s))
+                s++;
+            s = b3d_obj_float(s, e, &v[k]);
+            if (!s || (s < e && !b3d_obj_space(*s)))
+                return; /* Malformed vertices are skipped */
+        }
+        if (!b3d_obj_reserve(p, 3, 0)) {
+            p->err = 2;
+            return;
+        }
+        memcpy(p->pos + p->npos, v, sizeof(v));
+        p->npos += 3;
+    } else if (s[0] == 'f') {
+        uint32_t first = 0, prev = 0, cur;
+        int n = 0;
+        for (s += 2;; n++) {
+            while (s < e && b3d_obj_space(*s))
+                s++;
+            if (s >= e || !(s = b3d_obj_ref(p, s, e, &cur)))
+                break;
+            if (n == 0) {
+                first = cur;
+            } else if (n >= 2) {
+                if (!b3d_obj_reserve(p, 0, 3)) {
+                    p->err = 2;
+                    return;
+                }
+                b3d_obj_push_index(p, first);
+                b3d_obj_push_index(p, prev);
+                b3d_obj_push_index(p, cur);
+            }
+            prev = cur;
+        }
+    }
+}
+
+/* Parse all complete lines of [@s, @e). Returns the start of the trailing
+ * partial line, or @e if @last is set and that line was parsed too.
+ */
+static inline const char *b3d_obj_lines(b3d_obj_parser_t *p,
+                                        const char *s,
+                                        const char *e,
+                                        bool last)
+{
+    while (s < e && !p->err) {
+        const char *nl = memchr(s, '\n', (size_t) (e - s));
+        if (!nl) {
+            if (!last)
+                return s;
+            nl = e;
+        }
+        b3d_obj_line(p, s, nl);
+        s = nl < e ? nl + 1 : e;
+    }
+    return s;
+}
+
+static inline void b3d_obj_begin(b3d_obj_parser_t *p,
+                                 void *arena,
+                                 size_t size)
+{
+    memset(p, 0, sizeof(*p));
+    if (arena) {
+        /* Align the arena for float and uint32_t access */
+        size_t pad = (size_t) (-(uintptr_t) arena & (sizeof(float) - 1));
+        size = size > pad ? (size - pad) & ~(sizeof(float) - 1) : 0;
+        p->arena = (unsigned char *) arena + pad;
+        p->arena_size = size;
+        p->pos = (float *) p->arena;
+        p->idx = (uint32_t *) (p->arena + size);
+    }
+}
+
+/* Validate indices and hand the arrays over to @mesh */
+static inline int b3d_obj_end(b3d_obj_parser_t *p, b3d_indexed_mesh_t *mesh)
+{
+    size_t vcount = p->npos / 3;
+    if (!p->err && vcount > INT_MAX)
+        p->err = 2;
+    if (!p->err && p->nidx > INT_MAX)
+        p->err = 2;
+    if (!p->err && p->nidx && p->max_index >= vcount)
+        p->err = 3;
+    if (p->err) {
+        if (!p->arena) {
+            free(p->pos);
+            free(p->idx);
+        }
+        return p->err;
+    }
+
+    if (p->arena) {
+        /* Indices were stored backwards from the end of the arena */
+        uint32_t *idx = p->idx - p->nidx;
+        for (size_t i = 0, j = p->nidx; i + 1 < j; i++, j--) {
+            uint32_t t = idx[i];
+            idx[i] = idx[j - 1];
+            idx[j - 1] = t;
+        }
+        p->idx = memmove(p->pos + p->npos, idx, p->nidx * sizeof(uint32_t));
+    }
+
+    mesh->positions = p->pos;
+    mesh->indices = p->idx;
+    mesh->vertex_count = (int) vcount;
+    mesh->index_count = (int) p->nidx;
+    mesh->heap = !p->arena;
+    return 0;
+}
+
+/* Parse OBJ text already in memory.
+ * @text:    file contents, need not be NUL-terminated
+ * @len:     length of @text in bytes
+ * @mesh:    pointer to mesh structure to fill
+ * @arena:   memory for positions and indices, or NULL to allocate them
+ * @size:    size of @arena in bytes
+ *
+ * Returns 0 on success, 2 if memory allocation failed or @arena is too
+ * small, or 3 if a face refers to a vertex that does not exist.
+ * Free with b3d_free_indexed_mesh().
+ */
+static inline int b3d_parse_obj(const char *text,
+                                size_t len,
+                                b3d_indexed_mesh_t *mesh,
+                                void *arena,
+                                size_t size)
+{
+    if (!mesh || (!text && len))
+        return 1;
+    memset(mesh, 0, sizeof(*mesh));
+
+    b3d_obj_parser_t p;
+    b3d_obj_begin(&p, arena, size);
+    if (len)
+        b3d_obj_lines(&p, text, text + len, true);
+    return b3d_obj_end(&p, mesh);
+}
+
+/* Load an indexed mesh from an OBJ file.
+ * @path:    path to the .obj file
+ * @mesh:    pointer to mesh structure to fill
+ * @arena:   memory for positions and indices, or NULL to allocate them
+ * @size:    size of @arena in bytes
+ *
+ * Returns 0 on success, non-zero on error (1 = file not found, 2 = memory
+ * allocation failed or @arena too small, 3 = invalid vertex index, 4 = line
+ * longer than B3D_OBJ_BUFFER_SIZE). The result feeds b3d_draw_mesh()
+ * directly. Free with b3d_free_indexed_mesh().
+ */
+static inline int b3d_load_obj_indexed(const char *path,
+                                       b3d_indexed_mesh_t *mesh,
+                                       void *arena,
+                                       size_t size)
+{
+    if (!path || !mesh)
+        return 1;
+    memset(mesh, 0, sizeof(*mesh));
+
+#ifdef B3D_OBJ_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (uintmax_t) st.st_size <= SIZE_MAX) {
+        size_t len = (size_t) st.st_size;
+        void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+#ifdef MADV_SEQUENTIAL
+            madvise(map, len, MADV_SEQUENTIAL);
+#endif
+            int err = b3d_parse_obj(map, len, mesh, arena, size);
+            munmap(map, len);
+            return err;
+        }
+    }
+    close(fd);
+#endif
+
+    /* Buffered fallback, carrying partial lines over to the next chunk */
+    FILE *obj_file = fopen(path, "rb");
+    if (!obj_file)
+        return 1;
+
+    char *buf = malloc(B3D_OBJ_BUFFER_SIZE);
+    if (!buf) {
+        fclose(obj_file);
+        return 2;
+    }
+    b3d_obj_parser_t p;
+    b3d_obj_begin(&p, arena, size);
+    size_t have = 0;
+    while (!p.err) {
+        size_t n = fread(buf + have, 1, B3D_OBJ_BUFFER_SIZE - have, obj_file);
+        bool last = n == 0;
+        const char *rest = b3d_obj_lines(&p, buf, buf + have + n, last);
+        have = (size_t) (buf + have + n - rest);
+        if (last)
+            break;
+        if (have == B3D_OBJ_BUFFER_SIZE)
+            p.err = 4;
+        memmove(buf, rest, have);
+    }
+    free(buf);
+    fclose(obj_file);
+    return b3d_obj_end(&p, mesh);
+}
+
+/* Free a mesh loaded with b3d_load_obj_indexed() or b3d_parse_obj(); arena
+ * memory is left to its owner.
+ */
+static inline void b3d_free_indexed_mesh(b3d_indexed_mesh_t *mesh)
+{
+    if (!mesh)
+        return;
+
+    if (mesh->heap) {
+        free(mesh->positions);
+        free(mesh->indices);
+    }
+    memset(mesh, 0, sizeof(*mesh));
+}
+
 /* Load a mesh from an OBJ file.
  * @path:    path to the .obj file
  * @mesh:    pointer to mesh structure to fill
  *
  * Returns 0 on success, non-zero on error (1 = file not found,
- * 2 = memory allocation failed, 3 = invalid vertex index).
- * Only triangulated faces are supported. Free with b3d_free_mesh().
+ * 2 = memory allocation failed, 3 = invalid vertex index, 4 = line too
+ * long). Free with b3d_free_mesh().
  */
 static inline int b3d_load_obj(const char *path, b3d_mesh_t *mesh)
 {
@@ -41,105 +470,26 @@ static inline int b3d_load_obj(const char *path, b3d_mesh_t *mesh)
     mesh->triangle_count = 0;
     mesh->vertex_count = 0;
 
-    FILE *obj_file = fopen(path, "r");
-    if (!obj_file)
-        return 1;
+    b3d_indexed_mesh_t im;
+    int err = b3d_load_obj_indexed(path, &im, NULL, 0);
+    if (err)
+        return err;
 
-    int vi = 0, ti = 0;
-    float *vertices = NULL;
-    float *triangles = NULL;
-    char line[1024];
-    float x, y, z;
-
-    /* First pass: read vertices */
-    while (fgets(line, sizeof(line), obj_file)) {
-        if (line[0] == 'v' && line[1] == ' ' &&
-            sscanf(line, " v %f %f %f ", &x, &y, &z) == 3) {
-            /* Check for integer overflow before realloc */
-            if (vi > INT_MAX - 3) {
-                fclose(obj_file);
-                free(vertices);
-                return 2;
-            }
-            float *temp = realloc(vertices, (vi + 3) * sizeof(vertices[0]));
-            if (!temp) {
-                fclose(obj_file);
-                free(vertices);
-                return 2;
-            }
-            vertices = temp;
-            vertices[vi++] = x;
-            vertices[vi++] = y;
-            vertices[vi++] = z;
-        }
+    /* Index count is at most INT_MAX, so 3 floats per index may not fit */
+    if (im.index_count > INT_MAX / 3) {
+        b3d_free_indexed_mesh(&im);
+        return 2;
     }
-
-    rewind(obj_file);
-
-    /* Second pass: read faces */
-    int a, b, c;
-    while (fgets(line, sizeof(line), obj_file)) {
-        if (line[0] == 'f') {
-            /* Erase texture and normal indices (e.g., "1/2/3" -> "1") */
-            for (size_t i = 0; i < sizeof(line) && line[i] != '\0'; ++i) {
-                if (line[i] == '/') {
-                    while (i < sizeof(line) && line[i] != '\0' &&
-                           line[i] != ' ' && line[i] != '\n') {
-                        line[i++] = ' ';
-                    }
-                }
-            }
-            if (sscanf(line, " f %d %d %d ", &a, &b, &c) == 3) {
-                /* Validate vertex indices (OBJ uses 1-based indexing) */
-                if (a <= 0 || b <= 0 || c <= 0 || a > vi / 3 || b > vi / 3 ||
-                    c > vi / 3) {
-                    fclose(obj_file);
-                    free(vertices);
-                    free(triangles);
-                    return 3;
-                }
-                a--;
-                b--;
-                c--;
-                /* Check for integer overflow before realloc */
-                if (ti > INT_MAX - 9) {
-                    fclose(obj_file);
-                    free(vertices);
-                    free(triangles);
-                    return 2;
-                }
-                float *temp =
-                    realloc(triangles, (ti + 9) * sizeof(triangles[0]));
-                if (!temp) {
-                    fclose(obj_file);
-                    free(vertices);
-                    free(triangles);
-                    return 2;
-                }
-                triangles = temp;
-                /* Bounds check for vertex array access */
-                if ((a * 3 + 2) >= vi || (b * 3 + 2) >= vi ||
-                    (c * 3 + 2) >= vi) {
-                    fclose(obj_file);
-                    free(vertices);
-                    free(triangles);
-                    return 3;
-                }
-                triangles[ti++] = vertices[(a * 3) + 0];
-                triangles[ti++] = vertices[(a * 3) + 1];
-                triangles[ti++] = vertices[(a * 3) + 2];
-                triangles[ti++] = vertices[(b * 3) + 0];
-                triangles[ti++] = vertices[(b * 3) + 1];
-                triangles[ti++] = vertices[(b * 3) + 2];
-                triangles[ti++] = vertices[(c * 3) + 0];
-                triangles[ti++] = vertices[(c * 3) + 1];
-                triangles[ti++] = vertices[(c * 3) + 2];
-            }
-        }
+    int ti = im.index_count * 3;
+    float *triangles = ti ? malloc((size_t) ti * sizeof(float)) : NULL;
+    if (ti && !triangles) {
+        b3d_free_indexed_mesh(&im);
+        return 2;
     }
-
-    fclose(obj_file);
-    free(vertices);
+    for (int i = 0; i < im.index_count; i++)
+        memcpy(triangles + i * 3, im.positions + (size_t) im.indices[i] * 3,
+               3 * sizeof(float));
+    b3d_free_indexed_mesh(&im);
 
     mesh->triangles = triangles;
     mesh->vertex_count = ti;
@@ -210,4 +560,30 @@ static inline void b3d_mesh_bounds(const b3d_mesh_t *mesh,
         *max_xz = maxxz;
 }
 
+/* Calculate the axis-aligned bounding box of a mesh, e.g. for
+ * b3d_occlusion_test_box().
+ * @mesh:       The mesh to analyze
+ * @min:        Output: smallest x, y, z
+ * @max:        Output: largest x, y, z
+ */
+static inline void b3d_mesh_box(const b3d_mesh_t *mesh,
+                                float min[3],
+                                float max[3])
+{
+    if (!mesh || !mesh->triangles || mesh->vertex_count < 3 || !min || !max)
+        return;
+
+    for (int k = 0; k < 3; k++)
+        min[k] = max[k] = mesh->triangles[k];
+    for (int i = 3; i + 2 < mesh->vertex_count; i += 3) {
+        for (int k = 0; k < 3; k++) {
+            float v = mesh->triangles[i + k];
+            if (v < min[k])
+                min[k] = v;
+            if (v > max[k])
+                max[k] = v;
+        }
+    }
+}
+
 #endif /* B3D_OBJ_H */
@@ -0,0 +1,546 @@
+/*
+ * B3D is freely redistributable under the MIT License. See the file
+ * "LICENSE" for information on usage and redistribution of this file.
+ */
+
+/*
+ * Scene graph with frustum culling
+ *
+ * A scene is a flat array of nodes in caller memory. Each node has a local
+ * transform relative to an earlier parent node, an axis-aligned box around
+ * its geometry in local space, and either a display list or an indexed mesh
+ * to draw. Nodes without geometry group their children.
+ *
+ * b3d_scene_build() computes every world transform and box and builds a
+ * bounding-volume hierarchy (BVH) over the static nodes. b3d_scene_draw()
+ * walks it against the frustum planes of the current camera: a subtree
+ * outside one plane is dropped with a single box test, and one inside all
+ * planes is drawn without testing its nodes, so the cost of a frame follows
+ * the visible part of the world rather than its size. Dynamic nodes are
+ * refreshed by b3d_scene_update() and tested one by one.
+ *
+ *   static unsigned char arena[...];   // b3d_scene_size(max_nodes)
+ *   b3d_scene_t scene;
+ *   b3d_scene_init(&scene, arena, sizeof(arena), max_nodes);
+ *   int n = b3d_scene_add(&scene, -1, placement, B3D_SCENE_STATIC);
+ *   b3d_scene_set_mesh(&scene, n, positions, vcount, indices, icount, NULL);
+ *   b3d_scene_build(&scene);
+ *   ...
+ *   b3d_scene_draw(&scene);            // every frame
+ */
+
+#ifndef B3D_SCENE_H
+#define B3D_SCENE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "b3d.h"
+
+/* Node flags */
+#define B3D_SCENE_STATIC 0x1u /* Fixed placement, kept in the BVH */
+#define B3D_SCENE_HIDDEN 0x2u /* Skipped with its children */
+
+#define B3D_SCENE_LEAF 4   /* Nodes per BVH leaf */
+#define B3D_SCENE_DEPTH 64 /* Traversal stack; median splits need log2(n) */
+
+/* Frustum planes: near, the four sides and the draw distance. The renderer
+ * itself does not clip at a far plane, so the last one is only tested when
+ * the scene sets a draw distance.
+ */
+#define B3D_SCENE_PLANES 6
+#define B3D_SCENE_ALL_PLANES ((1u << B3D_SCENE_PLANES) - 1)
+#define B3D_SCENE_NEAR_PLANES ((1u << (B3D_SCENE_PLANES - 1)) - 1)
+
+typedef struct {
+    float local[16];         /* Transform relative to the parent */
+    float world[16];         /* Set by b3d_scene_build()/_update() */
+    float min[3], max[3];    /* Box around the geometry in local space */
+    float wmin[3], wmax[3];  /* The same box in world space */
+    int parent;              /* Index of an earlier node, or -1 */
+    uint32_t flags;          /* B3D_SCENE_* */
+    const b3d_list_t *list;  /* Geometry: a display list, */
+    const float *positions;  /* or an indexed mesh for b3d_draw_mesh() */
+    const uint32_t *indices;
+    const uint32_t *colors;
+    int vertex_count, index_count;
+    void *user;              /* Free for the caller */
+} b3d_scene_node_t;
+
+/* BVH node: a leaf covers order[first ... first + count - 1]; an inner node
+ * (count 0) has its children at the next index and at @first
+ */
+typedef struct {
+    float min[3], max[3];
+    int first, count;
+} b3d_scene_bvh_t;
+
+typedef struct {
+    b3d_scene_node_t *nodes;
+    b3d_scene_bvh_t *bvh;
+    int *order;   /* Static nodes with geometry, in BVH leaf order */
+    int *dynamic; /* Other nodes with geometry */
+    int count, capacity, bvh_count, static_count, dynamic_count;
+    float far;    /* Draw distance along the view axis, 0 for none */
+    int visible;  /* Nodes drawn by the last b3d_scene_draw() */
+} b3d_scene_t;
+
+/* Bytes of one arena block, rounded up to 16 */
+static inline size_t b3d_scene_block(size_t n, size_t elem)
+{
+    return (n * elem + 15) & ~(size_t) 15;
+}
+
+/* Arena size for b3d_scene_init(); 0 if @max_nodes is out of range */
+static inline size_t b3d_scene_size(int max_nodes)
+{
+    if (max_nodes <= 0 || max_nodes > (1 << 24))
+        return 0;
+    size_t n = (size_t) max_nodes;
+    return 15 + b3d_scene_block(n, sizeof(b3d_scene_node_t)) +
+           b3d_scene_block(2 * n, sizeof(b3d_scene_bvh_t)) +
+           2 * b3d_scene_block(n, sizeof(int));
+}
+
+/* Set up an empty scene of up to @max_nodes nodes in @arena, which must
+ * outlive it. Returns false if @size is below b3d_scene_size(@max_nodes).
+ */
+static inline bool b3d_scene_init(b3d_scene_t *scene,
+                                  void *arena,
+                                  size_t size,
+                                  int max_nodes)
+{
+    size_t need = b3d_scene_size(max_nodes);
+    if (!scene || !arena || need == 0 || size < need)
+        return false;
+
+    size_t n = (size_t) max_nodes;
+    unsigned char *p =
+        (unsigned char *) (((uintptr_t) arena + 15) & ~(uintptr_t) 15);
+    memset(scene, 0, sizeof(*scene));
+    scene->nodes = (b3d_scene_node_t *) p;
+    p += b3d_scene_block(n, sizeof(b3d_scene_node_t));
+    scene->bvh = (b3d_scene_bvh_t *) p;
+    p += b3d_scene_block(2 * n, sizeof(b3d_scene_bvh_t));
+    scene->order = (int *) p;
+    p += b3d_scene_block(n, sizeof(int));
+    scene->dynamic = (int *) p;
+    scene->capacity = max_nodes;
+    return true;
+}
+
+/* Add a node under @parent (-1 for the root) with transform @local (NULL
+ * for identity) and B3D_SCENE_* @flags. A node under a dynamic parent moves
+ * with it, so it is made dynamic as well. Returns the node index, or -1 if
+ * the scene is full or @parent is not a node.
+ */
+static inline int b3d_scene_add(b3d_scene_t *scene,
+                                int parent,
+                                const float local[16],
+                                uint32_t flags)
+{
+    if (!scene || scene->count == scene->capacity || parent < -1 ||
+        parent >= scene->count)
+        return -1;
+
+    int index = scene->count++;
+    b3d_scene_node_t *node = &scene->nodes[index];
+    memset(node, 0, sizeof(*node));
+    for (int i = 0; i < 16; i++)
+        node->local[i] = local ? local[i] : (i % 5 == 0 ? 1.0f : 0.0f);
+    memcpy(node->world, node->local, sizeof(node->world));
+    node->min[0] = node->min[1] = node->min[2] = 1.0f; /* empty box */
+    node->parent = parent;
+    if (parent >= 0 && !(scene->nodes[parent].flags & B3D_SCENE_STATIC))
+        flags &= ~B3D_SCENE_STATIC;
+    node->flags = flags;
+    return index;
+}
+
+/* Draw an indexed mesh at @node (see b3d_draw_mesh()); its box is taken from
+ * the positions. The arrays are referenced, not copied.
+ */
+static inline bool b3d_scene_set_mesh(b3d_scene_t *scene,
+                                      int node,
+                                      const float *positions,
+                                      int vcount,
+                                      const uint32_t *indices,
+                                      int icount,
+                                      const uint32_t *colors)
+{
+    if (!scene || node < 0 || node >= scene->count || !positions ||
+        vcount <= 0 || !indices || icount <= 0)
+        return false;
+
+    b3d_scene_node_t *n = &scene->nodes[node];
+    n->list = NULL;
+    n->positions = positions;
+    n->vertex_count = vcount;
+    n->indices = indices;
+    n->index_count = icount;
+    n->colors = colors;
+    for (int k = 0; k < 3; k++)
+        n->min[k] = n->max[k] = positions[k];
+    for (int i = 1; i < vcount; i++) {
+        for (int k = 0; k < 3; k++) {
+            float v = positions[(size_t) i * 3 + k];
+            n->min[k] = v < n->min[k] ? v : n->min[k];
+            n->max[k] = v > n->max[k] ? v : n->max[k];
+        }
+    }
+    return true;
+}
+
+/* Draw display list @list at @node; @min and @max bound its vertices */
+static inline bool b3d_scene_set_list(b3d_scene_t *scene,
+                                      int node,
+                                      const b3d_list_t *list,
+                                      const float min[3],
+                                      const float max[3])
+{
+    if (!scene || node < 0 || node >= scene->count || !list || !min || !max)
+        return false;
+
+    b3d_scene_node_t *n = &scene->nodes[node];
+    n->positions = NULL;
+    n->indices = NULL;
+    n->colors = NULL;
+    n->list = list;
+    memcpy(n->min, min, sizeof(n->min));
+    memcpy(n->max, max, sizeof(n->max));
+    return true;
+}
+
+/* Replace the local transform of @node. Takes effect for dynamic nodes on
+ * the next b3d_scene_update() and for static ones on b3d_scene_build().
+ */
+static inline bool b3d_scene_set_transform(b3d_scene_t *scene,
+                                           int node,
+                                           const float local[16])
+{
+    if (!scene || node < 0 || node >= scene->count || !local)
+        return false;
+    memcpy(scene->nodes[node].local, local, sizeof(scene->nodes[node].local));
+    return true;
+}
+
+/* Whether @node has geometry to draw */
+static inline bool b3d_scene_drawable(const b3d_scene_node_t *node)
+{
+    return (node->list || node->positions) && node->min[0] <= node->max[0] &&
+           node->min[1] <= node->max[1] && node->min[2] <= node->max[2];
+}
+
+/* World transform and world box of @node from its parent, which must be up
+ * to date. The box is the tightest one around the transformed local box.
+ */
+static inline void b3d_scene_place(b3d_scene_t *scene, int node)
+{
+    b3d_scene_node_t *n = &scene->nodes[node];
+    if (n->parent >= 0) {
+        /* Row vectors: world = local * parent world */
+        const float *a = n->local, *b = scene->nodes[n->parent].world;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                n->world[i * 4 + j] =
+                    a[i * 4] * b[j] + a[i * 4 + 1] * b[4 + j] +
+                    a[i * 4 + 2] * b[8 + j] + a[i * 4 + 3] * b[12 + j];
+            }
+        }
+    } else {
+        memcpy(n->world, n->local, sizeof(n->world));
+    }
+
+    const float *m = n->world;
+    for (int j = 0; j < 3; j++) {
+        float lo = m[12 + j], hi = m[12 + j];
+        for (int i = 0; i < 3; i++) {
+            float e = m[i * 4 + j] * n->min[i], f = m[i * 4 + j] * n->max[i];
+            lo += e < f ? e : f;
+            hi += e < f ? f : e;
+        }
+        n->wmin[j] = lo;
+        n->wmax[j] = hi;
+    }
+}
+
+/* Reorder @order[0 ... n - 1] so that the node at @k has the median center
+ * along @axis, with smaller ones before it and larger ones after
+ */
+static inline void b3d_scene_select(const b3d_scene_t *scene,
+                                    int *order,
+                                    int n,
+                                    int k,
+                                    int axis)
+{
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        const b3d_scene_node_t *p = &scene->nodes[order[(lo + hi) / 2]];
+        float pivot = p->wmin[axis] + p->wmax[axis];
+        int i = lo, j = hi;
+        while (i <= j) {
+            const b3d_scene_node_t *a = &scene->nodes[order[i]];
+            const b3d_scene_node_t *b = &scene->nodes[order[j]];
+            if (a->wmin[axis] + a->wmax[axis] < pivot) {
+                i++;
+            } else if (b->wmin[axis] + b->wmax[axis] > pivot) {
+                j--;
+            } else {
+                int t = order[i];
+                order[i++] = order[j];
+                order[j--] = t;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+/* Build the BVH node at @index over order[first ... first + n - 1]; returns
+ * the next free index
+ */
+static inline int b3d_scene_split(b3d_scene_t *scene,
+                                  int index,
+                                  int first,
+                                  int n)
+{
+    b3d_scene_bvh_t *bvh = &scene->bvh[index];
+    const b3d_scene_node_t *node = &scene->nodes[scene->order[first]];
+    float cmin[3], cmax[3];
+    for (int k = 0; k < 3; k++) {
+        bvh->min[k] = node->wmin[k];
+        bvh->max[k] = node->wmax[k];
+        cmin[k] = cmax[k] = node->wmin[k] + node->wmax[k];
+    }
+    for (int i = 1; i < n; i++) {
+        node = &scene->nodes[scene->order[first + i]];
+        for (int k = 0; k < 3; k++) {
+            float c = node->wmin[k] + node->wmax[k];
+            bvh->min[k] = node->wmin[k] < bvh->min[k] ? node->wmin[k]
+                                                      : bvh->min[k];
+            bvh->max[k] = node->wmax[k] > bvh->max[k] ? node->wmax[k]
+                                                      : bvh->max[k];
+            cmin[k] = c < cmin[k] ? c : cmin[k];
+            cmax[k] = c > cmax[k] ? c : cmax[k];
+        }
+    }
+    if (n <= B3D_SCENE_LEAF) {
+        bvh->first = first;
+        bvh->count = n;
+        return index + 1;
+    }
+
+    /* Halve along the axis over which the node centers spread the most */
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis])
+            axis = k;
+    }
+    int half = n / 2;
+    b3d_scene_select(scene, scene->order + first, n, half, axis);
+    int next = b3d_scene_split(scene, index + 1, first, half);
+    bvh = &scene->bvh[index];
+    bvh->first = next;
+    bvh->count = 0;
+    return b3d_scene_split(scene, next, first + half, n - half);
+}
+
+/* Compute all world transforms and boxes and rebuild the BVH. Call after
+ * adding nodes or changing static ones.
+ */
+static inline void b3d_scene_build(b3d_scene_t *scene)
+{
+    if (!scene)
+        return;
+    scene->static_count = scene->dynamic_count = 0;
+    for (int i = 0; i < scene->count; i++) {
+        b3d_scene_place(scene, i);
+        if (!b3d_scene_drawable(&scene->nodes[i]))
+            continue;
+        if (scene->nodes[i].flags & B3D_SCENE_STATIC)
+            scene->order[scene->static_count++] = i;
+        else
+            scene->dynamic[scene->dynamic_count++] = i;
+    }
+    scene->bvh_count =
+        scene->static_count
+            ? b3d_scene_split(scene, 0, 0, scene->static_count)
+            : 0;
+}
+
+/* Recompute the world transforms and boxes of the dynamic nodes, after
+ * b3d_scene_set_transform() on them
+ */
+static inline void b3d_scene_update(b3d_scene_t *scene)
+{
+    if (!scene)
+        return;
+    for (int i = 0; i < scene->count; i++) {
+        if (!(scene->nodes[i].flags & B3D_SCENE_STATIC))
+            b3d_scene_place(scene, i);
+    }
+}
+
+/* World-space frustum planes of @ctx, with the far one at view distance
+ * @far: a point p is inside when dot(p, plane.xyz) + plane.w >= 0 for all
+ */
+static inline void b3d_scene_frustum(b3d_context_t *ctx,
+                                     float far,
+                                     float planes[B3D_SCENE_PLANES][4])
+{
+    float v[16], p[16], m[16];
+    b3d_ctx_get_view_matrix(ctx, v);
+    b3d_ctx_get_proj_matrix(ctx, p);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            m[i * 4 + j] = v[i * 4] * p[j] + v[i * 4 + 1] * p[4 + j] +
+                           v[i * 4 + 2] * p[8 + j] + v[i * 4 + 3] * p[12 + j];
+        }
+    }
+
+    /* Clip space is x, y in [-w, w] with w the view distance, which has to
+     * reach the near plane; the projection puts it at -p32 / p22
+     */
+    float near = p[10] != 0.0f ? -p[14] / p[10] : 0.0f;
+    for (int i = 0; i < 4; i++) {
+        float w = m[i * 4 + 3], x = m[i * 4], y = m[i * 4 + 1];
+        planes[0][i] = w;
+        planes[1][i] = w + x;
+        planes[2][i] = w - x;
+        planes[3][i] = w + y;
+        planes[4][i] = w - y;
+        planes[5][i] = -w;
+    }
+    planes[0][3] -= near;
+    planes[5][3] += far;
+}
+
+/* Test a world box against the planes in @mask. Returns -1 if it is outside
+ * one of them, otherwise the planes it still crosses.
+ */
+static inline int b3d_scene_cull(float planes[B3D_SCENE_PLANES][4],
+                                 const float min[3],
+                                 const float max[3],
+                                 unsigned mask)
+{
+    unsigned crossed = 0;
+    for (int i = 0; i < B3D_SCENE_PLANES; i++) {
+        if (!(mask & (1u << i)))
+            continue;
+        const float *pl = planes[i];
+        /* Corner farthest along the normal, then the one farthest back */
+        float far = pl[3], back = pl[3];
+        for (int k = 0; k < 3; k++) {
+            float a = pl[k] * min[k], b = pl[k] * max[k];
+            far += a > b ? a : b;
+            back += a > b ? b : a;
+        }
+        if (far < 0.0f)
+            return -1;
+        if (back < 0.0f)
+            crossed |= 1u << i;
+    }
+    return (int) crossed;
+}
+
+/* Draw @node with its world transform; returns the triangles drawn */
+static inline int b3d_scene_draw_node(b3d_context_t *ctx,
+                                      const b3d_scene_node_t *node)
+{
+    b3d_ctx_set_model_matrix(ctx, node->world);
+    if (node->list)
+        return b3d_ctx_list_draw(ctx, node->list);
+    return b3d_ctx_draw_mesh(ctx, node->positions, node->vertex_count,
+                             node->indices, node->index_count, node->colors);
+}
+
+/* Whether @node or one of its parents is hidden */
+static inline bool b3d_scene_hidden(const b3d_scene_t *scene, int node)
+{
+    for (; node >= 0; node = scene->nodes[node].parent) {
+        if (scene->nodes[node].flags & B3D_SCENE_HIDDEN)
+            return true;
+    }
+    return false;
+}
+
+/* Draw the nodes of @scene that may be in view of @ctx, each with its world
+ * transform in place of the model matrix, which is restored afterwards.
+ * Nodes beyond @scene->far, when set, are skipped as well. Returns the
+ * number of triangles drawn; @scene->visible counts the nodes.
+ */
+static inline int b3d_ctx_scene_draw(b3d_context_t *ctx, b3d_scene_t *scene)
+{
+    if (!ctx || !scene)
+        return 0;
+
+    float planes[B3D_SCENE_PLANES][4], model[16];
+    unsigned all =
+        scene->far > 0.0f ? B3D_SCENE_ALL_PLANES : B3D_SCENE_NEAR_PLANES;
+    b3d_scene_frustum(ctx, scene->far, planes);
+    b3d_ctx_get_model_matrix(ctx, model);
+    int drawn = 0;
+    scene->visible = 0;
+
+    int stack[B3D_SCENE_DEPTH];
+    unsigned masks[B3D_SCENE_DEPTH];
+    int top = 0;
+    if (scene->bvh_count > 0) {
+        stack[top] = 0;
+        masks[top++] = all;
+    }
+    while (top > 0) {
+        const b3d_scene_bvh_t *bvh = &scene->bvh[stack[--top]];
+        unsigned mask = masks[top];
+        if (mask) {
+            int crossed = b3d_scene_cull(planes, bvh->min, bvh->max, mask);
+            if (crossed < 0)
+                continue;
+            mask = (unsigned) crossed;
+        }
+        if (bvh->count == 0) {
+            stack[top] = bvh->first;
+            masks[top++] = mask;
+            stack[top] = (int) (bvh - scene->bvh) + 1;
+            masks[top++] = mask;
+            continue;
+        }
+        for (int i = 0; i < bvh->count; i++) {
+            int index = scene->order[bvh->first + i];
+            const b3d_scene_node_t *node = &scene->nodes[index];
+            if ((mask && b3d_scene_cull(planes, node->wmin, node->wmax,
+                                        mask) < 0) ||
+                b3d_scene_hidden(scene, index))
+                continue;
+            drawn += b3d_scene_draw_node(ctx, node);
+            scene->visible++;
+        }
+    }
+
+    for (int i = 0; i < scene->dynamic_count; i++) {
+        int index = scene->dynamic[i];
+        const b3d_scene_node_t *node = &scene->nodes[index];
+        if (b3d_scene_cull(planes, node->wmin, node->wmax, all) < 0 ||
+            b3d_scene_hidden(scene, index))
+            continue;
+        drawn += b3d_scene_draw_node(ctx, node);
+        scene->visible++;
+    }
+
+    b3d_ctx_set_model_matrix(ctx, model);
+    return drawn;
+}
+
+/* b3d_ctx_scene_draw() on the default context */
+static inline int b3d_scene_draw(b3d_scene_t *scene)
+{
+    return b3d_ctx_scene_draw(b3d_get_default_context(), scene);
+}
+
+#endif /* B3D_SCENE_H */
@@ -19,6 +19,16 @@ ifeq ($(SANITIZE), 1)
     LDFLAGS += -fsanitize=address,undefined
 endif
 
+# Multithreaded tile binning (b3d_set_binning with threads > 1)
+ifeq ($(THREADS), 1)
+    CFLAGS += -DB3D_THREADS -pthread
+endif
+
+# Per-stage pipeline statistics (b3d_get_stats)
+ifeq ($(STATS), 1)
+    CFLAGS += -DB3D_STATS
+endif
+
 # Directory structure
 INCLUDE_DIR := include
 SRC_DIR := src
@@ -20,7 +20,7 @@ ALL_EXAMPLES_CLEAN := $(SDL2_EXAMPLES_ALL)
 $(foreach ex,$(ALL_EXAMPLES_CLEAN),$(eval $(ex)_SRC := $(EXAMPLES_DIR)/$(ex).c))
 
 # Extra dependencies (header-only libs, assets, etc.)
-obj_DEPS := $(INCLUDE_DIR)/b3d_obj.h
+obj_DEPS := $(INCLUDE_DIR)/b3d_obj.h $(INCLUDE_DIR)/b3d_mesh.h
 
 # Per-example CFLAGS (if needed)
 # fps_CFLAGS := -DFPS_DEBUG
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+Run the scene benchmarks in every build variant and gate on regressions.
+
+Each tests/bench-scene* binary is one configuration we ship (default,
+B3D_FLOAT_POINT, B3D_DEPTH_16BIT, B3D_NO_CULLING). Every binary renders the
+same fixed set of scenes and prints one JSON object per run; the collected
+list is written to --out. With --baseline, median frame times are compared
+against a stored run and any that got slower by more than --threshold fail
+the script. --update stores the current run as the baseline instead.
+
+Usage:
+    python3 scripts/bench-compare.py [--out results.json]
+        [--baseline base.json [--update]] [--threshold 0.10] [--frames N]
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+VARIANTS = [
+    "tests/bench-scene",
+    "tests/bench-scene-float",
+    "tests/bench-scene-depth16",
+    "tests/bench-scene-nocull",
+]
+
+# name, scene arguments
+SCENES = [
+    ("grid", ["--tris=20000"]),
+    ("grid-edge", ["--tris=20000", "--raster=edge"]),
+    ("overdraw", ["--tris=2048", "--overdraw=8"]),
+    ("binned", ["--tris=20000", "--bin=1"]),
+    ("moai", ["--mesh=assets/moai.obj", "--overdraw=2"]),
+]
+
+
+def key(result):
+    """Identify a result across runs: scene and build configuration."""
+    return (result["name"], result["math"], result["depth_bits"],
+            result["culling"])
+
+
+def variant_label(result):
+    label = f'{result["math"]}/{result["depth_bits"]}'
+    return label if result["culling"] else label + "/nocull"
+
+
+def run(frames):
+    results = []
+    for binary in VARIANTS:
+        if not os.access(binary, os.X_OK):
+            sys.exit(f"{binary}: not built, run 'make bench-compare'")
+        for name, args in SCENES:
+            cmd = [binary, f"--name={name}", f"--frames={frames}", "--json"]
+            out = subprocess.run(cmd + args, check=True, capture_output=True,
+                                 text=True).stdout
+            results.append(json.loads(out))
+    return results
+
+
+def compare(results, baseline, threshold):
+    """Print a table against @baseline, return the number of regressions."""
+    base = {key(r): r for r in baseline}
+    regressions = 0
+    print(f'{"scene":<12} {"variant":<16} {"median ms":>10} {"base ms":>10} '
+          f'{"change":>8}')
+    for r in results:
+        b = base.get(key(r))
+        if not b:
+            print(f'{r["name"]:<12} {variant_label(r):<16} '
+                  f'{r["median_ms"]:>10.3f} {"-":>10} {"new":>8}')
+            continue
+        change = r["median_ms"] / b["median_ms"] - 1.0
+        flag = ""
+        if change > threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f'{r["name"]:<12} {variant_label(r):<16} '
+              f'{r["median_ms"]:>10.3f} {b["median_ms"]:>10.3f} '
+              f'{change:>+8.1%}{flag}')
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("--out", help="write all results to this JSON file")
+    parser.add_argument("--baseline", help="baseline JSON file")
+    parser.add_argument("--update", action="store_true",
+                        help="store this run as the baseline")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="allowed median slow-down (default 0.10)")
+    parser.add_argument("--frames", type=int, default=200,
+                        help="timed frames per scene (default 200)")
+    args = parser.parse_args()
+
+    results = run(args.frames)
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(results, f, indent=1)
+            f.write("\n")
+
+    if not args.baseline:
+        json.dump(results, sys.stdout, indent=1)
+        print()
+        return 0
+    if args.update:
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=1)
+            f.write("\n")
+        print(f"{args.baseline}: stored {len(results)} results")
+        return 0
+    if not os.path.exists(args.baseline):
+        sys.exit(f"{args.baseline}: no baseline, run 'make bench-baseline'")
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    regressions = compare(results, baseline, args.threshold)
+    if regressions:
+        print(f"{regressions} regression(s) over {args.threshold:.0%}")
+        return 1
+    print("No regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
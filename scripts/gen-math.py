@@ -1431,6 +1431,57 @@ class CodeGen:
 
         return "(b3d_vec_t){" + ", ".join(elements) + "}"
 
+    # Functions that also get a structure-of-arrays batch form:
+    # func_name -> (matrix param, streamed vector param)
+    SOA_BATCH_FUNCS = {
+        "mat_mul_vec": ("M", "v"),
+    }
+
+    def emit_soa_batch(self, func: FuncDef) -> str:
+        """Emit the SoA batch form of a matrix-vector function.
+
+        The streamed vector comes from separate x/y/z arrays with w = 1 and
+        the matrix is passed by pointer. Each element keeps the scalar
+        expression, so batch and single-vector results are bit-identical.
+        """
+        mat, vec = self.SOA_BATCH_FUNCS[func.name]
+        body = func.body
+        if not isinstance(body, VectorExpr) or len(body.elements) != 4:
+            raise ValueError(f"{func.name}: SoA batch needs a 4-vector body")
+
+        def lane(code: str, idx: str) -> str:
+            code = re.sub(rf"\b{mat}\.m\b", f"{mat}->m", code)
+            for comp in "xyz":
+                code = re.sub(rf"\b{vec}\.{comp}\b", f"{comp}s[{idx}]", code)
+            return re.sub(rf"\b{vec}\.w\b", "1.0f", code)
+
+        elems = [self.emit_expr(e) for e in body.elements]
+        name = f"b3d_{func.name}_soa{self.suffix}"
+        outs = ["ox", "oy", "oz", "ow"]
+        vec_lanes = "\n".join(
+            f"            {o}[l] = {lane(e, 'k + l')};" for o, e in zip(outs, elems)
+        )
+        tail = ", ".join(lane(e, "k") for e in elems)
+        return f"""/* {func.name} over @n points given as x/y/z arrays (w = 1), written to @out.
+ * B3D_SOA_LANES points per iteration so the compiler can vectorize the lanes.
+ */
+static inline void {name}(const b3d_mat_t *{mat},
+    const float *xs, const float *ys, const float *zs, int n, b3d_vec_t *out)
+{{
+    int k = 0;
+    for (; k + B3D_SOA_LANES <= n; k += B3D_SOA_LANES) {{
+        float ox[B3D_SOA_LANES], oy[B3D_SOA_LANES];
+        float oz[B3D_SOA_LANES], ow[B3D_SOA_LANES];
+        for (int l = 0; l < B3D_SOA_LANES; l++) {{
+{vec_lanes}
+        }}
+        for (int l = 0; l < B3D_SOA_LANES; l++)
+            out[k + l] = (b3d_vec_t){{ox[l], oy[l], oz[l], ow[l]}};
+    }}
+    for (; k < n; k++)
+        out[k] = (b3d_vec_t){{{tail}}};
+}}"""
+
     def parse_range(self, range_str: str) -> list[str]:
         if range_str == "xyz":
             return ["x", "y", "z"]
@@ -1480,10 +1531,23 @@ def generate_c(funcs: list[FuncDef], mode: Mode, suffix: str = "") -> str:
     lines.append(f" */")
     lines.append("")
 
+    lines.append("/* Points per iteration of the SoA batch forms */")
+    lines.append("#ifndef B3D_SOA_LANES")
+    lines.append("#ifdef __AVX__")
+    lines.append("#define B3D_SOA_LANES 8")
+    lines.append("#else")
+    lines.append("#define B3D_SOA_LANES 4")
+    lines.append("#endif")
+    lines.append("#endif")
+    lines.append("")
+
     gen = CodeGen(mode, suffix)
     for func in funcs:
         lines.append(gen.emit_func(func))
         lines.append("")
+        if func.name in CodeGen.SOA_BATCH_FUNCS:
+            lines.append(gen.emit_soa_batch(func))
+            lines.append("")
 
     return "\n".join(lines)
 
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+Convert Wavefront .obj files to the B3D binary mesh cache (.b3dm).
+
+The output layout matches include/b3d_mesh.h: an 80-byte header followed by
+16-byte aligned position, index, color and normal blobs, little-endian.
+Faces are triangulated as fans and relative indices are resolved, as in
+b3d_load_obj_indexed().
+
+Usage:
+    python3 scripts/obj2b3dm.py model.obj [-o model.b3dm] [--shade] [--normals]
+
+--shade stores gray per-triangle colors by average height, the way the obj
+example shades models. --normals stores unit face normals.
+"""
+
+import argparse
+import math
+import struct
+import sys
+from array import array
+
+VERSION = 1
+HAS_COLORS = 0x1
+HAS_NORMALS = 0x2
+ALIGN = 16
+HEADER = struct.Struct("<4s5I6f4Q")
+
+
+def parse_obj(path):
+    """Return (positions, indices) as flat float and uint32 arrays."""
+    positions = array("f")
+    indices = array("I")
+    with open(path, "rb") as f:
+        for lineno, raw in enumerate(f, 1):
+            parts = raw.split()
+            if not parts:
+                continue
+            if parts[0] == b"v":
+                try:
+                    xyz = [float(p) for p in parts[1:4]]
+                except ValueError:
+                    continue  # Malformed vertices are skipped
+                if len(xyz) == 3:
+                    positions.extend(xyz)
+            elif parts[0] == b"f":
+                count = len(positions) // 3
+                face = []
+                for ref in parts[1:]:
+                    try:
+                        i = int(ref.split(b"/")[0])
+                    except ValueError:
+                        break
+                    i = count + i if i < 0 else i - 1
+                    if i < 0:
+                        sys.exit(f"{path}:{lineno}: invalid vertex index")
+                    face.append(i)
+                for k in range(2, len(face)):
+                    indices.extend((face[0], face[k - 1], face[k]))
+    if indices and max(indices) >= len(positions) // 3:
+        sys.exit(f"{path}: face refers to a missing vertex")
+    return positions, indices
+
+
+def shade_colors(positions, indices):
+    """Gray level by average triangle height, as in examples/obj.c."""
+    ys = positions[1::3]
+    min_y, max_y = min(ys), max(ys)
+    colors = array("I")
+    for t in range(0, len(indices), 3):
+        avg_y = sum(positions[indices[t + k] * 3 + 1] for k in range(3)) / 3
+        brightness = (avg_y - min_y) / max_y if max_y else 0.0
+        c = (50 + int(brightness * 200)) & 0xFF
+        colors.append(c << 16 | c << 8 | c)
+    return colors
+
+
+def face_normals(positions, indices):
+    """Unit normals of cross(b - a, c - a), facing the visible side."""
+    normals = array("f")
+    for t in range(0, len(indices), 3):
+        a, b, c = (positions[indices[t + k] * 3 : indices[t + k] * 3 + 3]
+                   for k in range(3))
+        u = [b[k] - a[k] for k in range(3)]
+        v = [c[k] - a[k] for k in range(3)]
+        n = [u[1] * v[2] - u[2] * v[1],
+             u[2] * v[0] - u[0] * v[2],
+             u[0] * v[1] - u[1] * v[0]]
+        length = math.sqrt(sum(x * x for x in n))
+        normals.extend([x / length for x in n] if length else [0.0] * 3)
+    return normals
+
+
+def write_b3dm(path, positions, indices, colors, normals):
+    blobs = (positions, indices, colors, normals)
+    offsets = [0] * 4
+    offset = HEADER.size
+    for slot, blob in enumerate(blobs):
+        if blob is not None:
+            offsets[slot] = offset
+            offset += len(blob) * blob.itemsize
+            offset += -offset % ALIGN
+
+    bounds = [min(positions[k::3]) for k in range(3)]
+    bounds += [max(positions[k::3]) for k in range(3)]
+    flags = (HAS_COLORS if colors is not None else 0) | \
+            (HAS_NORMALS if normals is not None else 0)
+
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(b"B3DM", VERSION, flags, len(positions) // 3,
+                            len(indices), 0, *bounds, *offsets))
+        for blob in (b for b in blobs if b is not None):
+            if sys.byteorder != "little":
+                blob = array(blob.typecode, blob)
+                blob.byteswap()
+            blob.tofile(f)
+            f.write(b"\0" * (-f.tell() % ALIGN))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("obj", help="input .obj file")
+    parser.add_argument("-o", "--output", help="output .b3dm file")
+    parser.add_argument("--shade", action="store_true",
+                        help="store per-triangle colors shaded by height")
+    parser.add_argument("--normals", action="store_true",
+                        help="store unit face normals")
+    args = parser.parse_args()
+
+    positions, indices = parse_obj(args.obj)
+    if not positions:
+        sys.exit(f"{args.obj}: no vertices")
+    colors = shade_colors(positions, indices) if args.shade else None
+    normals = face_normals(positions, indices) if args.normals else None
+
+    output = args.output or args.obj.rsplit(".", 1)[0] + ".b3dm"
+    write_b3dm(output, positions, indices, colors, normals)
+    print(f"{output}: {len(positions) // 3} vertices, "
+          f"{len(indices) // 3} triangles")
+
+
+if __name__ == "__main__":
+    main()
@@ -5,74 +5,180 @@
 
 #include <stdbool.h>
 #include <string.h>
+#ifdef B3D_THREADS
+#include <pthread.h>
+#endif
+#ifdef B3D_STATS
+#include <time.h>
+#endif
 
 #include "b3d.h"
 #include "math-toolkit.h"
 
-/* Global state */
-int b3d_width, b3d_height;
-uint32_t *b3d_pixels;
-b3d_depth_t *b3d_depth;
+/* Vector instruction sets
+ *
+ * Kernels are compiled for every instruction set the compiler targets, and
+ * on x86 with GCC or Clang also for AVX2 through function attributes, so
+ * that one binary can pick the best set at run time (see b3d_kernels_t).
+ * B3D_NO_SIMD leaves only the scalar kernels.
+ */
+#ifndef B3D_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64)
+#define B3D_SIMD_SSE2 1
+#if defined(__AVX2__)
+#define B3D_SIMD_AVX2 1
+#elif defined(__GNUC__)
+#define B3D_SIMD_AVX2 1
+#define B3D_CPU_DISPATCH 1 /* AVX2 only if the CPU has it */
+#endif
+#endif
+#if defined(B3D_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(B3D_SIMD_SSE2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define B3D_SIMD_NEON 1
+#endif
+#endif
+
+/* Mark functions using AVX2 beyond the compiler's baseline */
+#ifdef B3D_CPU_DISPATCH
+#define B3D_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define B3D_TARGET_AVX2
+#endif
 
-static b3d_mat_t b3d_model, b3d_view, b3d_proj;
-static b3d_vec_t b3d_camera;
-static b3d_camera_t b3d_camera_params; /* Full camera state for queries */
-static float b3d_fov_degrees;          /* Current FOV for queries */
+/* Vector kernels for the edge-function rasterizer; 16-bit depth builds use
+ * the scalar kernel.
+ */
+#ifndef B3D_DEPTH_16BIT
+#ifdef B3D_SIMD_AVX2
+#define B3D_EDGE_AVX2 1
+#endif
+#ifdef B3D_SIMD_SSE2
+#define B3D_EDGE_SSE2 1
+#endif
+#ifdef B3D_SIMD_NEON
+#define B3D_EDGE_NEON 1
+#endif
+#endif
 
-/* Matrix stack for push/pop operations */
-static b3d_mat_t b3d_matrix_stack[B3D_MATRIX_STACK_SIZE];
-static int b3d_matrix_stack_top = 0;
+/* Depth epochs need the 32-bit fixed-point depth buffer */
+#if !defined(B3D_FLOAT_POINT) && !defined(B3D_DEPTH_16BIT)
+#define B3D_DEPTH_EPOCHS 1
+#endif
 
-/* Lazy matrix computation state */
-#ifdef B3D_NO_CULLING
-static b3d_mat_t b3d_model_view; /* Cached model*view matrix */
+/* Widest edge-function block of any compiled kernel */
+#ifdef B3D_EDGE_AVX2
+#define B3D_EDGE_LANES_MAX 8
+#else
+#define B3D_EDGE_LANES_MAX 4
 #endif
 
-/* Dirty flag for matrix recomputation */
-static bool b3d_model_view_dirty = true;
+/* Pipeline statistics
+ *
+ * Without B3D_STATS the macros below expand to nothing and their arguments
+ * are never evaluated, so counting costs nothing in regular builds. Stage
+ * timers charge the time between laps to one field of b3d_stats_t, less any
+ * time nested calls charged to raster_ns meanwhile, so that the stage times
+ * add up to the time spent in the pipeline.
+ */
+#ifdef B3D_STATS
+typedef struct {
+    uint64_t t;      /* time of the last lap */
+    uint64_t raster; /* raster_ns at the last lap */
+} b3d_stats_timer_t;
+
+static inline uint64_t b3d_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static inline void b3d_stats_lap(b3d_stats_t *st,
+                                 uint64_t *ns,
+                                 b3d_stats_timer_t *tm)
+{
+    uint64_t now = b3d_stats_now(), nested = st->raster_ns - tm->raster;
+    *ns += now - tm->t - nested;
+    tm->t = now;
+    tm->raster = st->raster_ns;
+}
 
-/* Debug counters */
-static size_t b3d_clip_drop_count = 0;
+/* Number of set bits in a lane mask */
+static inline int b3d_popcount(unsigned m)
+{
+    int n = 0;
+    for (; m; m &= m - 1)
+        ++n;
+    return n;
+}
 
-/* Lighting state */
-static b3d_vec_t b3d_light_dir = {0.0f, 0.0f, 1.0f, 0.0f}; /* Default: +Z */
-static float b3d_ambient = 0.2f;                           /* Default: 20% */
+#define B3D_STAT(st, field, n) ((st)->field += (uint64_t) (n))
+#define B3D_STAT_TIMER(st, tm) \
+    b3d_stats_timer_t tm = {b3d_stats_now(), (st)->raster_ns}
+#define B3D_STAT_LAP(st, field, tm) b3d_stats_lap((st), &(st)->field, &(tm))
+#else
+#define B3D_STAT(st, field, n) ((void) 0)
+#define B3D_STAT_TIMER(st, tm) ((void) 0)
+#define B3D_STAT_LAP(st, field, tm) ((void) 0)
+#endif
 
-/* Cached screen-space clipping planes (updated when resolution changes) */
-static b3d_vec_t b3d_screen_planes[4][2];
-static int b3d_planes_cached_w = 0, b3d_planes_cached_h = 0;
+/* Default context backing the global API */
+static b3d_context_t b3d_default_ctx = {
+    .model_view_dirty = true,
+    .light_dir = {{0.0f, 0.0f, 1.0f, 0.0f}}, /* Default: light 0 from +Z */
+    .light_intensity = {1.0f},
+    .ambient = 0.2f, /* Default: 20% */
+};
 
-#ifdef B3D_NO_CULLING
-/* Update cached model*view matrix if dirty (lazy matrix computation) */
-static void b3d_update_model_view(void)
+/* Update cached model*view and model*view*proj matrices if dirty (lazy matrix
+ * computation). Anything that changes model, view or proj sets the flag.
+ */
+static void b3d_update_model_view(b3d_context_t *ctx)
 {
-    if (b3d_model_view_dirty) {
-        b3d_model_view = b3d_mat_mul(b3d_view, b3d_model);
-        b3d_model_view_dirty = false;
+    if (ctx->model_view_dirty) {
+        ctx->model_view = b3d_mat_mul(ctx->model, ctx->view);
+        ctx->model_view_proj = b3d_mat_mul(ctx->model_view, ctx->proj);
+        ctx->model_view_dirty = false;
     }
 }
-#endif
 
-static void b3d_update_screen_planes(void)
+static void b3d_update_screen_planes(b3d_context_t *ctx)
 {
-    if (b3d_planes_cached_w == b3d_width && b3d_planes_cached_h == b3d_height)
+    if (ctx->planes_cached_w == ctx->width &&
+        ctx->planes_cached_h == ctx->height)
         return;
 
+    /* The screen edges, or the guard band centered on the screen */
+    float x0 = 0.5f, y0 = 0.5f;
+    float x1 = (float) ctx->width, y1 = (float) ctx->height;
+    if (ctx->guard_band && x1 < 2 * B3D_GUARD_BAND &&
+        y1 < 2 * B3D_GUARD_BAND) {
+        x0 = x1 * 0.5f - B3D_GUARD_BAND;
+        y0 = y1 * 0.5f - B3D_GUARD_BAND;
+        x1 = x1 * 0.5f + B3D_GUARD_BAND;
+        y1 = y1 * 0.5f + B3D_GUARD_BAND;
+    }
+
+    b3d_vec_t(*planes)[2] = ctx->screen_planes;
     /* Top edge */
-    b3d_screen_planes[0][0] = (b3d_vec_t) {0, 0.5f, 0, 1};
-    b3d_screen_planes[0][1] = (b3d_vec_t) {0, 1, 0, 1};
+    planes[0][0] = (b3d_vec_t) {0, y0, 0, 1};
+    planes[0][1] = (b3d_vec_t) {0, 1, 0, 1};
     /* Bottom edge */
-    b3d_screen_planes[1][0] = (b3d_vec_t) {0, (float) b3d_height, 0, 1};
-    b3d_screen_planes[1][1] = (b3d_vec_t) {0, -1, 0, 1};
+    planes[1][0] = (b3d_vec_t) {0, y1, 0, 1};
+    planes[1][1] = (b3d_vec_t) {0, -1, 0, 1};
     /* Left edge */
-    b3d_screen_planes[2][0] = (b3d_vec_t) {0.5f, 0, 0, 1};
-    b3d_screen_planes[2][1] = (b3d_vec_t) {1, 0, 0, 1};
+    planes[2][0] = (b3d_vec_t) {x0, 0, 0, 1};
+    planes[2][1] = (b3d_vec_t) {1, 0, 0, 1};
     /* Right edge */
-    b3d_screen_planes[3][0] = (b3d_vec_t) {(float) b3d_width, 0, 0, 1};
-    b3d_screen_planes[3][1] = (b3d_vec_t) {-1, 0, 0, 1};
+    planes[3][0] = (b3d_vec_t) {x1, 0, 0, 1};
+    planes[3][1] = (b3d_vec_t) {-1, 0, 0, 1};
 
-    b3d_planes_cached_w = b3d_width;
-    b3d_planes_cached_h = b3d_height;
+    ctx->planes_cached_w = ctx->width;
+    ctx->planes_cached_h = ctx->height;
 }
 
 static inline b3d_scalar_t b3d_depth_load(b3d_depth_t v)
@@ -108,6 +214,37 @@ static inline b3d_depth_t b3d_depth_store(b3d_scalar_t v)
 #endif
 }
 
+/* Depth epochs
+ *
+ * The fixed-point depth of a vertex is clamped to [0, 16) and offset by
+ * (epoch << B3D_EPOCH_BITS). Epochs count down, so whatever an earlier frame
+ * left in the buffer compares as farther than any fragment of the current
+ * one, and clearing depth only takes a decrement. The buffer is filled for
+ * real once every B3D_EPOCH_MAX + 1 clears.
+ *
+ * Projected depth never exceeds 1.001, the wide span leaves headroom for the
+ * scanline walk overshooting at sliver tips without reaching into a
+ * neighbouring epoch.
+ */
+#define B3D_EPOCH_BITS 20
+#define B3D_EPOCH_MAX ((INT32_MAX >> B3D_EPOCH_BITS) - 1)
+
+/* Depth buffer value of a fragment at projected depth @z */
+static inline b3d_scalar_t b3d_ctx_depth(const b3d_context_t *ctx, float z)
+{
+    b3d_scalar_t d = B3D_FLOAT_TO_FP(z);
+#ifdef B3D_DEPTH_EPOCHS
+    if (ctx->depth_epochs) {
+        const b3d_scalar_t span = (b3d_scalar_t) 1 << B3D_EPOCH_BITS;
+        d = d < 0 ? 0 : d >= span ? span - 1 : d;
+        d += (b3d_scalar_t) ctx->depth_epoch << B3D_EPOCH_BITS;
+    }
+#else
+    (void) ctx;
+#endif
+    return d;
+}
+
 static inline b3d_scalar_t b3d_fp_min(b3d_scalar_t a, b3d_scalar_t b)
 {
     return a < b ? a : b;
@@ -178,36 +315,715 @@ static inline int b3d_clamp_int(int v, int lo, int hi)
     return v;
 }
 
-/* Pixel write macro for scanline unrolling */
-#define PUT_PIXEL(i)                     \
-    do {                                 \
-        if (d < b3d_depth_load(dp[i])) { \
-            dp[i] = b3d_depth_store(d);  \
-            pp[i] = c;                   \
-        }                                \
-        d = B3D_FP_ADD(d, depth_step);   \
-    } while (0)
-
 /* Edge interpolation state for rasterizer */
 typedef struct {
     b3d_scalar_t x, z;   /* start position */
     b3d_scalar_t dx, dz; /* delta per scanline */
     b3d_scalar_t t;      /* interpolation parameter [0, 1] */
     b3d_scalar_t t_step; /* step per scanline */
+    int64_t t_fine;      /* t_step with 16 more bits, see b3d_edge_fine() */
+    int row;             /* first scanline, where t = 0 */
 } raster_edge_t;
 
+/* Screen-space vertex for rasterization */
+typedef struct {
+    b3d_scalar_t x, y, z;
+} raster_vertex_t;
+
+/* Pixel rectangle [x0, x1) x [y0, y1) a triangle is rasterized into: the
+ * whole screen in immediate mode, a single tile when flushing bins.
+ */
+typedef struct {
+    int x0, y0, x1, y1;
+#ifdef B3D_STATS
+    b3d_stats_t *stats; /* rasterizer counters, tile-local when flushing */
+#endif
+} raster_clip_t;
+
+/* Rasterizer variants
+ *
+ * The depth comparison and the depth and color write masks are per-draw
+ * state, packed into the state word ctx->raster_state; b3d_kernel_state()
+ * adds the pixel format of the framebuffer. Every span and block kernel is
+ * written once as a B3D_TEMPLATE function taking that word as its last
+ * argument; B3D_SPECIALIZE() instantiates it for each valid word, which the
+ * compiler then folds into the inner loop, and B3D_DISPATCH() picks the
+ * variant once per span. The default word 0 calls the template inline, so
+ * the common case does not pay for the indirection.
+ */
+#define B3D_STATE_FUNC 0x3           /* B3D_DEPTH_* comparison */
+#define B3D_STATE_NO_DEPTH_WRITE 0x4 /* leave the depth buffer untouched */
+#define B3D_STATE_NO_COLOR_WRITE 0x8 /* leave the color buffer untouched */
+#define B3D_STATE_FORMAT 0x30        /* B3D_FORMAT_* of the pixels */
+#define B3D_STATE_FORMAT_SHIFT 4
+#define B3D_STATE_COUNT 48
+
+/* Expand @X with the given arguments for every valid state word */
+#define B3D_RASTER_STATES(X, ...)                            \
+    X(__VA_ARGS__, 0) X(__VA_ARGS__, 1) X(__VA_ARGS__, 2)    \
+    X(__VA_ARGS__, 4) X(__VA_ARGS__, 5) X(__VA_ARGS__, 6)    \
+    X(__VA_ARGS__, 8) X(__VA_ARGS__, 9) X(__VA_ARGS__, 10)   \
+    X(__VA_ARGS__, 12) X(__VA_ARGS__, 13) X(__VA_ARGS__, 14) \
+    X(__VA_ARGS__, 16) X(__VA_ARGS__, 17) X(__VA_ARGS__, 18) \
+    X(__VA_ARGS__, 20) X(__VA_ARGS__, 21) X(__VA_ARGS__, 22) \
+    X(__VA_ARGS__, 24) X(__VA_ARGS__, 25) X(__VA_ARGS__, 26) \
+    X(__VA_ARGS__, 28) X(__VA_ARGS__, 29) X(__VA_ARGS__, 30) \
+    X(__VA_ARGS__, 32) X(__VA_ARGS__, 33) X(__VA_ARGS__, 34) \
+    X(__VA_ARGS__, 36) X(__VA_ARGS__, 37) X(__VA_ARGS__, 38) \
+    X(__VA_ARGS__, 40) X(__VA_ARGS__, 41) X(__VA_ARGS__, 42) \
+    X(__VA_ARGS__, 44) X(__VA_ARGS__, 45) X(__VA_ARGS__, 46)
+
+#if defined(__GNUC__)
+#define B3D_TEMPLATE inline __attribute__((always_inline))
+#else
+#define B3D_TEMPLATE inline
+#endif
+
+#define B3D_STRIP(...) __VA_ARGS__
+#define B3D_VARIANT(kernel, target, params, args, st) \
+    static target void kernel##_##st(B3D_STRIP params) \
+    {                                                  \
+        kernel(B3D_STRIP args, st);                    \
+    }
+#define B3D_VARIANT_ENTRY(kernel, target, params, args, st) \
+    [st] = kernel##_##st,
+
+/* Instantiate @kernel(@params..., unsigned state) as kernel_variants[],
+ * compiled with function attributes @target
+ */
+#define B3D_SPECIALIZE_TARGET(kernel, target, params, args)               \
+    B3D_RASTER_STATES(B3D_VARIANT, kernel, target, params, args)          \
+    static void (*const kernel##_variants[B3D_STATE_COUNT])(              \
+        B3D_STRIP params) = {                                             \
+        B3D_RASTER_STATES(B3D_VARIANT_ENTRY, kernel, target, params, args)}
+#define B3D_SPECIALIZE(kernel, params, args) \
+    B3D_SPECIALIZE_TARGET(kernel, , params, args)
+
+/* Run @kernel for state word @state */
+#define B3D_DISPATCH(kernel, state, ...)                \
+    ((state) ? kernel##_variants[state](__VA_ARGS__) \
+             : kernel(__VA_ARGS__, 0))
+
+/* Depth comparison of state word @state, B3D_DEPTH_* */
+static inline int b3d_depth_func(unsigned state)
+{
+    return (int) (state & B3D_STATE_FUNC);
+}
+
+/* Whether a fragment at depth @z passes against stored depth @stored. Equal
+ * compares stored values, so that it matches whatever a previous pass over
+ * the same triangle wrote at any depth precision.
+ */
+static inline bool b3d_depth_pass(unsigned state,
+                                  b3d_scalar_t z,
+                                  b3d_depth_t stored)
+{
+    switch (b3d_depth_func(state)) {
+    case B3D_DEPTH_ALWAYS:
+        return true;
+    case B3D_DEPTH_EQUAL:
+        return b3d_depth_store(z) == stored;
+    default:
+        return z < b3d_depth_load(stored);
+    }
+}
+
+/* Pixel format of state word @state, B3D_FORMAT_* */
+static inline int b3d_pixel_format(unsigned state)
+{
+    return (int) ((state & B3D_STATE_FORMAT) >> B3D_STATE_FORMAT_SHIFT);
+}
+
+/* Bytes per pixel in format @format */
+static inline size_t b3d_format_bytes(int format)
+{
+    switch (format) {
+    case B3D_FORMAT_RGB565:
+        return 2;
+    case B3D_FORMAT_RGB332:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+/* Color @c (0xRRGGBB) encoded in format @format, truncating each channel */
+static inline uint32_t b3d_pack_color(int format, uint32_t c)
+{
+    switch (format) {
+    case B3D_FORMAT_RGB565:
+        return ((c >> 8) & 0xF800) | ((c >> 5) & 0x07E0) | ((c >> 3) & 0x1F);
+    case B3D_FORMAT_RGB332:
+        return ((c >> 16) & 0xE0) | ((c >> 11) & 0x1C) | ((c >> 6) & 0x03);
+    default:
+        return c;
+    }
+}
+
+/* State word of the kernels drawing into @ctx */
+static inline unsigned b3d_kernel_state(const b3d_context_t *ctx)
+{
+    return ctx->raster_state |
+           (unsigned) ctx->pixel_format << B3D_STATE_FORMAT_SHIFT;
+}
+
+/* Address of pixel (@x, @y) of the framebuffer of @ctx */
+static inline unsigned char *b3d_pixel_addr(const b3d_context_t *ctx,
+                                            int x,
+                                            int y)
+{
+    return (unsigned char *) ctx->pixels +
+           (size_t) y * ctx->pixel_stride +
+           (size_t) x * b3d_format_bytes(ctx->pixel_format);
+}
+
+/* Store @c, encoded by b3d_pack_color() for @state, as pixel @i of @pp */
+static inline void b3d_put_color(unsigned state,
+                                 unsigned char *pp,
+                                 int i,
+                                 uint32_t c)
+{
+    switch (b3d_pixel_format(state)) {
+    case B3D_FORMAT_RGB565:
+        ((uint16_t *) (void *) pp)[i] = (uint16_t) c;
+        break;
+    case B3D_FORMAT_RGB332:
+        pp[i] = (unsigned char) c;
+        break;
+    default:
+        ((uint32_t *) (void *) pp)[i] = c;
+        break;
+    }
+}
+
+/* Pixel write macro for scanline unrolling */
+#define PUT_PIXEL(i)                                  \
+    do {                                              \
+        if (b3d_depth_pass(state, d, dp[i])) {        \
+            if (!(state & B3D_STATE_NO_DEPTH_WRITE))  \
+                dp[i] = b3d_depth_store(d);           \
+            if (!(state & B3D_STATE_NO_COLOR_WRITE))  \
+                b3d_put_color(state, pp, i, c);       \
+            B3D_STAT(clip->stats, pixels_written, 1); \
+        }                                             \
+        d = B3D_FP_ADD(d, depth_step);                \
+    } while (0)
+
+/* Depth test and fill @n pixels with @c, depths stepping from @d */
+static B3D_TEMPLATE void b3d_span_flat(const raster_clip_t *clip,
+                                       b3d_depth_t *dp,
+                                       unsigned char *pp,
+                                       int n,
+                                       b3d_scalar_t d,
+                                       b3d_scalar_t depth_step,
+                                       uint32_t c,
+                                       unsigned state)
+{
+    (void) clip; /* only needed for statistics */
+    const size_t bpp = b3d_format_bytes(b3d_pixel_format(state));
+    c = b3d_pack_color(b3d_pixel_format(state), c);
+    while (n >= 4) {
+        PUT_PIXEL(0);
+        PUT_PIXEL(1);
+        PUT_PIXEL(2);
+        PUT_PIXEL(3);
+        dp += 4, pp += 4 * bpp;
+        n -= 4;
+    }
+    while (n-- > 0) {
+        PUT_PIXEL(0);
+        dp++, pp += bpp;
+    }
+}
+
+#undef PUT_PIXEL
+
+B3D_SPECIALIZE(b3d_span_flat,
+               (const raster_clip_t *clip, b3d_depth_t *dp, unsigned char *pp,
+                int n, b3d_scalar_t d, b3d_scalar_t depth_step, uint32_t c),
+               (clip, dp, pp, n, d, depth_step, c));
+
+/* Advance span depth @d by @n pixels exactly as @n PUT_PIXEL steps would */
+static inline b3d_scalar_t b3d_depth_skip(b3d_scalar_t d,
+                                          b3d_scalar_t step,
+                                          int n)
+{
+#ifdef B3D_FLOAT_POINT
+    /* Float addition is not associative: repeat it to stay bit-exact */
+    while (n-- > 0)
+        d = B3D_FP_ADD(d, step);
+    return d;
+#else
+    return (b3d_scalar_t) (d + (int64_t) step * n);
+#endif
+}
+
+/* Step of t along an edge of height @dy, 1 / @dy. Vertex rows are whole
+ * pixels, so in fixed point this is a 32-bit divide instead of
+ * B3D_FP_DIV()'s 64-bit one, with the same result.
+ */
+static inline b3d_scalar_t b3d_edge_step(b3d_scalar_t dy)
+{
+#ifdef B3D_FLOAT_POINT
+    return 1.0f / dy;
+#else
+    return (1 << B3D_FP_BITS) / B3D_FP_TO_INT(dy);
+#endif
+}
+
+/* Step of t along an edge of height @dy, with 16 more fraction bits in
+ * fixed point so that exact edges can multiply it by the row count
+ */
+static inline int64_t b3d_edge_fine(b3d_scalar_t dy)
+{
+#ifdef B3D_FLOAT_POINT
+    (void) dy;
+    return 0;
+#else
+    return B3D_FP_ONE * B3D_FP_ONE * B3D_FP_ONE / dy;
+#endif
+}
+
+/* Parameter t of edge @e on scanline @y, computed without accumulation */
+static inline b3d_scalar_t b3d_edge_param(const raster_edge_t *e, int y)
+{
+#ifdef B3D_FLOAT_POINT
+    return (float) (y - e->row) * e->t_step;
+#else
+    return (b3d_scalar_t) (((int64_t) (y - e->row) * e->t_fine) >>
+                           B3D_FP_BITS);
+#endif
+}
+
+/* Depth step per pixel of a triangle: the x gradient of the plane through
+ * its vertices @a, @b, @c, computed once so that spans need no divide. In
+ * fixed point it also sets @fine to the step with 16 more fraction bits.
+ * Vertex x and y are whole pixels. Zero area gives a zero step; such
+ * triangles only cover slivers.
+ */
+static inline b3d_scalar_t b3d_plane_dzdx(const raster_vertex_t *a,
+                                          const raster_vertex_t *b,
+                                          const raster_vertex_t *c,
+                                          int64_t *fine)
+{
+#ifdef B3D_FLOAT_POINT
+    float area = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+    *fine = 0;
+    if (area == 0.0f)
+        return 0.0f;
+    return ((b->z - a->z) * (c->y - a->y) - (c->z - a->z) * (b->y - a->y)) /
+           area;
+#else
+    int64_t dx1 = B3D_FP_TO_INT(b->x - a->x), dy1 = B3D_FP_TO_INT(b->y - a->y);
+    int64_t dx2 = B3D_FP_TO_INT(c->x - a->x), dy2 = B3D_FP_TO_INT(c->y - a->y);
+    int64_t area = dx1 * dy2 - dx2 * dy1;
+    if (area == 0) {
+        *fine = 0;
+        return 0;
+    }
+    int64_t num = (int64_t) (b->z - a->z) * dy2 - (int64_t) (c->z - a->z) * dy1;
+    *fine = num * B3D_FP_ONE / area;
+    return (b3d_scalar_t) (*fine / B3D_FP_ONE);
+#endif
+}
+
+/* Depth @off pixels right of a span start of depth @sz, for a triangle
+ * whose depth changes by @step per pixel, @fine with 16 more fraction bits
+ * in fixed point so that a start far off screen costs no precision.
+ */
+static inline b3d_scalar_t b3d_span_depth(b3d_scalar_t sz,
+                                          b3d_scalar_t step,
+                                          int64_t fine,
+                                          b3d_scalar_t off)
+{
+#ifdef B3D_FLOAT_POINT
+    (void) fine;
+    return sz + step * off;
+#else
+    (void) step;
+    return (b3d_scalar_t) (sz + ((fine * off) >> (2 * B3D_FP_BITS)));
+#endif
+}
+
+/* Perspective-correct attributes
+ *
+ * Triangles drawn with b3d_triangle_ex() carry 1/w and their color and
+ * texture coordinates divided by w. Each of these is a plane over the pixel
+ * grid, set up once from the unclipped clip-space vertices: clipping thus
+ * interpolates nothing extra, and all pieces of a clipped triangle and both
+ * rasterizers sample the very same planes at pixel centers. A pixel divides
+ * by the interpolated 1/w to recover its attributes. Flat triangles carry
+ * no planes and keep the plain PUT_PIXEL loops.
+ */
+
+#define B3D_VARYINGS 6 /* 1/w, r/w, g/w, b/w, u/w, v/w */
+
+typedef struct {
+    float q[B3D_VARYINGS];  /* value at the center of pixel (0, 0) */
+    float dx[B3D_VARYINGS]; /* step per pixel */
+    float dy[B3D_VARYINGS]; /* step per row */
+    b3d_texture_t tex;      /* texels NULL if untextured */
+    int wbits, hbits;       /* log2 of the texture size */
+} raster_attr_t;
+
+/* Set up the planes of @attr over the clip-space triangle @t.
+ * Returns false if @t is degenerate, in which case it may just as well be
+ * drawn flat.
+ */
+static bool b3d_attr_setup(const b3d_context_t *ctx,
+                           const b3d_triangle_t *t,
+                           const b3d_attr_t *attr,
+                           const b3d_texture_t *tex,
+                           raster_attr_t *out)
+{
+    /* Rows (x, y, w) of the vertices: (X, Y, 1) * inverse(M) * value is
+     * value / w at NDC position (X, Y), and the inverse is adj(M) / det(M).
+     * Column i of the adjugate is row i + 1 cross row i + 2.
+     */
+    b3d_vec_t r[3], adj[3];
+    for (int i = 0; i < 3; ++i)
+        r[i] = (b3d_vec_t) {t->p[i].x, t->p[i].y, t->p[i].w, 0};
+    for (int i = 0; i < 3; ++i)
+        adj[i] = b3d_vec_cross(r[(i + 1) % 3], r[(i + 2) % 3]);
+    float det = b3d_vec_dot(r[0], adj[0]);
+    if (!(fabsf(det) > 0.0f))
+        return false;
+
+    float value[3][B3D_VARYINGS];
+    for (int i = 0; i < 3; ++i) {
+        uint32_t c = attr->color[i];
+        value[i][0] = 1.0f;
+        value[i][1] = (float) ((c >> 16) & 0xFF);
+        value[i][2] = (float) ((c >> 8) & 0xFF);
+        value[i][3] = (float) (c & 0xFF);
+        value[i][4] = attr->uv[i][0];
+        value[i][5] = attr->uv[i][1];
+    }
+
+    /* NDC to pixels: X = px / xs - 1, Y = 1 - py / ys */
+    const float xs = ctx->width * 0.5f, ys = ctx->height * 0.5f;
+    const float inv_det = 1.0f / det;
+    for (int k = 0; k < B3D_VARYINGS; ++k) {
+        float a = 0, b = 0, c = 0;
+        for (int i = 0; i < 3; ++i) {
+            a += value[i][k] * adj[i].x;
+            b += value[i][k] * adj[i].y;
+            c += value[i][k] * adj[i].z;
+        }
+        a *= inv_det, b *= inv_det, c *= inv_det;
+        out->dx[k] = a / xs;
+        out->dy[k] = -b / ys;
+        out->q[k] = c - a + b + 0.5f * (out->dx[k] + out->dy[k]);
+        if (!isfinite(out->q[k]) || !isfinite(out->dx[k]) ||
+            !isfinite(out->dy[k]))
+            return false;
+    }
+    out->tex = tex ? *tex : (b3d_texture_t) {0};
+    out->wbits = out->hbits = 0;
+    while ((1 << out->wbits) < out->tex.width)
+        out->wbits++;
+    while ((1 << out->hbits) < out->tex.height)
+        out->hbits++;
+    return true;
+}
+
+/* Clamp a color channel to [0, 255], NaN to 0 */
+static inline uint32_t b3d_channel(float v)
+{
+    return v > 0.0f ? (v < 255.0f ? (uint32_t) (v + 0.5f) : 255u) : 0u;
+}
+
+/* Texture sampling
+ *
+ * Textures made by b3d_texture_init() store each mip level in Morton order
+ * within square blocks, so that the 2x2 texels a bilinear sample reads are
+ * usually in the same cache line. The mip level is chosen once per run of
+ * B3D_TEX_RUN pixels, aligned to absolute screen columns, from the texel
+ * footprint at the run's center: every pixel gets the same level however
+ * its row is split into spans, blocks or tiles.
+ */
+
+#define B3D_TEX_RUN 16
+
+/* Texture level being sampled. A texel index is the sum of a part taken
+ * from x and one taken from y, which occupy the bits @mx and @my.
+ */
+typedef struct {
+    const uint32_t *texels;
+    uint32_t mx, my;
+    float su, sv; /* texture coordinate to 8.8 fixed-point texels */
+    int wbits;    /* log2 of the level width */
+    int bbits;    /* log2 of the Morton block size, -1 row-major */
+    int bilinear;
+} b3d_sampler_t;
+
+/* Interleave the low 16 bits of @v with zeros */
+static inline uint32_t b3d_morton_spread(uint32_t v)
+{
+    v &= 0xFFFF;
+    v = (v | v << 8) & 0x00FF00FF;
+    v = (v | v << 4) & 0x0F0F0F0F;
+    v = (v | v << 2) & 0x33333333;
+    return (v | v << 1) & 0x55555555;
+}
+
+/* Index of texel (@x, @y) in a level whose Morton blocks are 2^@bbits
+ * texels wide; blocks follow each other along the longer side.
+ */
+static inline size_t b3d_morton_index(uint32_t x, uint32_t y, int bbits)
+{
+    uint32_t m = (1u << bbits) - 1;
+    return (size_t) ((x >> bbits | y >> bbits) << (2 * bbits)) |
+           b3d_morton_spread(x & m) | b3d_morton_spread(y & m) << 1;
+}
+
+/* Index parts of column @x and row @y, wrapping */
+static inline uint32_t b3d_sampler_x(const b3d_sampler_t *s, uint32_t x)
+{
+    if (s->bbits < 0)
+        return x & s->mx;
+    uint32_t m = (1u << s->bbits) - 1;
+    return (b3d_morton_spread(x & m) | (x >> s->bbits) << (2 * s->bbits)) &
+           s->mx;
+}
+
+static inline uint32_t b3d_sampler_y(const b3d_sampler_t *s, uint32_t y)
+{
+    if (s->bbits < 0)
+        return (y << s->wbits) & s->my;
+    uint32_t m = (1u << s->bbits) - 1;
+    return (b3d_morton_spread(y & m) << 1 |
+            (y >> s->bbits) << (2 * s->bbits)) &
+           s->my;
+}
+
+/* Index part of the next column or row: carries skip the other part's bits */
+static inline uint32_t b3d_sampler_step(uint32_t part, uint32_t mask)
+{
+    return ((part | ~mask) + 1) & mask;
+}
+
+/* floor(@v) for any float; out-of-range values and NaN saturate */
+static inline int32_t b3d_floor_int(float v)
+{
+    v = v < 1e9f ? (v > -1e9f ? v : -1e9f) : 1e9f;
+    int32_t i = (int32_t) v;
+    return i - (v < (float) i);
+}
+
+/* Blend 0xAARRGGBB @a towards @b by @f / 256 */
+static inline uint32_t b3d_lerp_texel(uint32_t a, uint32_t b, uint32_t f)
+{
+    uint32_t g = 256 - f;
+    uint32_t rb = ((a & 0xFF00FF) * g + (b & 0xFF00FF) * f) >> 8 & 0xFF00FF;
+    uint32_t ag = ((a >> 8 & 0xFF00FF) * g + (b >> 8 & 0xFF00FF) * f) &
+                  0xFF00FF00;
+    return rb | ag;
+}
+
+/* Texel at texture coordinates (@u, @v), wrapping */
+static inline uint32_t b3d_sample(const b3d_sampler_t *s, float u, float v)
+{
+    if (!s->bilinear) {
+        uint32_t x = (uint32_t) b3d_floor_int(u * s->su) >> 8;
+        uint32_t y = (uint32_t) b3d_floor_int(v * s->sv) >> 8;
+        return s->texels[b3d_sampler_x(s, x) + b3d_sampler_y(s, y)];
+    }
+    /* Relative to texel centers; unsigned shifts wrap negative values */
+    uint32_t fu = (uint32_t) b3d_floor_int(u * s->su - 128.0f);
+    uint32_t fv = (uint32_t) b3d_floor_int(v * s->sv - 128.0f);
+    uint32_t x0 = b3d_sampler_x(s, fu >> 8), x1 = b3d_sampler_step(x0, s->mx);
+    uint32_t y0 = b3d_sampler_y(s, fv >> 8), y1 = b3d_sampler_step(y0, s->my);
+    const uint32_t *t = s->texels;
+    uint32_t top = b3d_lerp_texel(t[x0 + y0], t[x1 + y0], fu & 255);
+    uint32_t bottom = b3d_lerp_texel(t[x0 + y1], t[x1 + y1], fu & 255);
+    return b3d_lerp_texel(top, bottom, fv & 255);
+}
+
+/* Varyings at the center of pixel (@x, @y) */
+static inline void b3d_attr_at(const raster_attr_t *a,
+                               int x,
+                               int y,
+                               float q[B3D_VARYINGS])
+{
+    for (int k = 0; k < B3D_VARYINGS; ++k)
+        q[k] = a->q[k] + a->dx[k] * (float) x + a->dy[k] * (float) y;
+}
+
+/* Point @s at the mip level for the B3D_TEX_RUN-pixel run of row @y that
+ * contains column @x.
+ */
+static void b3d_sampler_select(const raster_attr_t *a,
+                               int x,
+                               int y,
+                               b3d_sampler_t *s)
+{
+    const b3d_texture_t *tex = &a->tex;
+    int level = 0;
+    if (tex->levels > 1) {
+        /* Derivatives of u = (u/w) / (1/w) by the quotient rule, in texels */
+        int cx = (x & ~(B3D_TEX_RUN - 1)) + B3D_TEX_RUN / 2;
+        float q0 = a->q[0] + a->dx[0] * (float) cx + a->dy[0] * (float) y;
+        float qu = a->q[4] + a->dx[4] * (float) cx + a->dy[4] * (float) y;
+        float qv = a->q[5] + a->dx[5] * (float) cx + a->dy[5] * (float) y;
+        float w = 1.0f / fmaxf(q0, 1e-6f);
+        float u = qu * w, v = qv * w;
+        float ws = w * (float) tex->width, hs = w * (float) tex->height;
+        float ux = (a->dx[4] - u * a->dx[0]) * ws;
+        float vx = (a->dx[5] - v * a->dx[0]) * hs;
+        float uy = (a->dy[4] - u * a->dy[0]) * ws;
+        float vy = (a->dy[5] - v * a->dy[0]) * hs;
+        float rho2 = fmaxf(ux * ux + vx * vx, uy * uy + vy * vy);
+
+        /* round(log2(rho)) = (floor(log2(rho^2)) + 1) / 2, exactly */
+        uint32_t bits;
+        memcpy(&bits, &rho2, sizeof(bits));
+        int e = (int) (bits >> 23 & 0xFF) - 127;
+        level = e < 0 ? 0 : (e + 1) / 2;
+        if (level >= tex->levels || !(rho2 == rho2))
+            level = tex->levels - 1;
+    }
+
+    int wbits = a->wbits - level, hbits = a->hbits - level;
+    size_t n0 = (size_t) tex->width * (size_t) tex->height;
+    /* Levels before @level hold 4/3 (n0 - n0 / 4^level) texels */
+    s->texels = tex->texels + (n0 - (n0 >> (2 * level))) / 3 * 4;
+    s->su = (float) (256 << wbits);
+    s->sv = (float) (256 << hbits);
+    s->wbits = wbits;
+    s->bilinear = tex->filter == B3D_FILTER_BILINEAR;
+    if (!tex->levels) {
+        s->bbits = -1;
+        s->mx = (1u << wbits) - 1;
+        s->my = ((1u << hbits) - 1) << wbits;
+        return;
+    }
+    /* Interleaved bits of the blocks, then the block number */
+    int b = wbits < hbits ? wbits : hbits;
+    uint32_t low = (1u << (2 * b)) - 1;
+    s->bbits = b;
+    s->mx = (0x55555555u & low) | ((1u << wbits) - 1) >> b << (2 * b);
+    s->my = (0xAAAAAAAAu & low) | ((1u << hbits) - 1) >> b << (2 * b);
+}
+
+/* Color of a pixel whose varyings are @q, sampling @s if textured */
+static inline uint32_t b3d_attr_shade(const raster_attr_t *a,
+                                      const b3d_sampler_t *s,
+                                      const float q[B3D_VARYINGS])
+{
+    /* Pixel centers just outside the triangle extrapolate; keep w finite */
+    float w = 1.0f / fmaxf(q[0], 1e-6f);
+    float r = q[1] * w, g = q[2] * w, b = q[3] * w;
+    if (a->tex.texels) {
+        uint32_t t = b3d_sample(s, q[4] * w, q[5] * w);
+        const float k = 1.0f / 255.0f;
+        r *= (float) ((t >> 16) & 0xFF) * k;
+        g *= (float) ((t >> 8) & 0xFF) * k;
+        b *= (float) (t & 0xFF) * k;
+    }
+    return b3d_channel(r) << 16 | b3d_channel(g) << 8 | b3d_channel(b);
+}
+
+/* Start shading at pixel @x of row @y: varyings in @q, level in @s */
+static inline void b3d_attr_begin(const raster_attr_t *a,
+                                  int x,
+                                  int y,
+                                  float q[B3D_VARYINGS],
+                                  b3d_sampler_t *s)
+{
+    b3d_attr_at(a, x, y, q);
+    if (a->tex.texels)
+        b3d_sampler_select(a, x, y, s);
+}
+
+/* Advance @q to the next pixel, @x, entering a new run there when needed */
+static inline void b3d_attr_next(const raster_attr_t *a,
+                                 int x,
+                                 int y,
+                                 float q[B3D_VARYINGS],
+                                 b3d_sampler_t *s)
+{
+    for (int k = 0; k < B3D_VARYINGS; ++k)
+        q[k] += a->dx[k];
+    if (a->tex.levels > 1 && !(x & (B3D_TEX_RUN - 1)))
+        b3d_sampler_select(a, x, y, s);
+}
+
+/* Depth test and shade @n pixels from (@x, @y) on, with the depths of @n
+ * PUT_PIXEL steps from @d.
+ */
+static B3D_TEMPLATE void b3d_attr_span(const raster_clip_t *clip,
+                                       const raster_attr_t *a,
+                                       b3d_depth_t *dp,
+                                       unsigned char *pp,
+                                       int x,
+                                       int y,
+                                       int n,
+                                       b3d_scalar_t d,
+                                       b3d_scalar_t depth_step,
+                                       unsigned state)
+{
+    (void) clip; /* only needed for statistics */
+    float q[B3D_VARYINGS];
+    b3d_sampler_t s;
+    b3d_attr_begin(a, x, y, q, &s);
+    for (int i = 0; i < n; ++i) {
+        if (b3d_depth_pass(state, d, dp[i])) {
+            if (!(state & B3D_STATE_NO_DEPTH_WRITE))
+                dp[i] = b3d_depth_store(d);
+            if (!(state & B3D_STATE_NO_COLOR_WRITE))
+                b3d_put_color(state, pp, i,
+                              b3d_pack_color(b3d_pixel_format(state),
+                                             b3d_attr_shade(a, &s, q)));
+            B3D_STAT(clip->stats, pixels_written, 1);
+        }
+        d = B3D_FP_ADD(d, depth_step);
+        b3d_attr_next(a, x + i + 1, y, q, &s);
+    }
+}
+
+B3D_SPECIALIZE(b3d_attr_span,
+               (const raster_clip_t *clip, const raster_attr_t *a,
+                b3d_depth_t *dp, unsigned char *pp, int x, int y, int n,
+                b3d_scalar_t d, b3d_scalar_t depth_step),
+               (clip, a, dp, pp, x, y, n, d, depth_step));
+
 /* Rasterize one half of a triangle (top or bottom).
- * Left/right edges interpolate from (x,z) along (dx,dz) with parameter t.
+ * Left/right edges interpolate from (x,z) along (dx,dz) with parameter t,
+ * and depth steps by the triangle's constant @dzdx (@fine, see
+ * b3d_plane_dzdx()) along each span. Only pixels inside @clip are touched;
+ * every pixel gets the same depth it would get with a full-screen @clip,
+ * which keeps binning pixel-identical. With @exact, t and the depth at each
+ * span start are computed afresh per row: accumulated rounding would grow
+ * with the size of guard-band triangles reaching far off screen. Spans of
+ * triangles with @attr are shaded by b3d_attr_span() instead of filled
+ * with @c.
  */
-static void raster_half(int y_start,
+static void raster_half(b3d_context_t *ctx,
+                        const raster_clip_t *clip,
+                        int y_start,
                         int y_end,
                         raster_edge_t *left,
                         raster_edge_t *right,
-                        uint32_t c)
+                        b3d_scalar_t dzdx,
+                        int64_t fine,
+                        uint32_t c,
+                        const raster_attr_t *attr,
+                        bool exact)
 {
+    const int width = ctx->width, height = ctx->height;
+    const unsigned state = b3d_kernel_state(ctx);
     b3d_scalar_t tmp = 0;
+    if (exact && y_start < clip->y0)
+        y_start = clip->y0;
     for (int y = y_start; y < y_end; y++) {
-        if (y < 0 || y >= b3d_height) {
+        /* Rows below @clip cannot be drawn by this or the following half */
+        if (y >= clip->y1)
+            break;
+        if (exact) {
+            left->t = b3d_edge_param(left, y);
+            right->t = b3d_edge_param(right, y);
+        } else if (y < clip->y0) {
             left->t += left->t_step;
             right->t += right->t_step;
             continue;
@@ -226,22 +1042,34 @@ static void raster_half(int y_start,
             continue;
         }
 
-        b3d_scalar_t depth_start = sz;
-        b3d_scalar_t depth_step = B3D_FP_DIV(ez - sz, dx);
-
         int start = B3D_FP_TO_INT(sx), end = B3D_FP_TO_INT(ex);
-        start = b3d_clamp_int(start, 0, b3d_width);
-        end = b3d_clamp_int(end, 0, b3d_width);
+        start = b3d_clamp_int(start, 0, width);
+        end = b3d_clamp_int(end, 0, width);
+        if (start >= end) {
+            left->t += left->t_step;
+            right->t += right->t_step;
+            continue;
+        }
+
+        b3d_scalar_t d, off = B3D_INT_TO_FP(start) - sx;
+        if (exact)
+            d = b3d_span_depth(sz, dzdx, fine, off);
+        else
+            d = sz + B3D_FP_MUL(dzdx, off);
+        if (start < clip->x0) {
+            d = b3d_depth_skip(d, dzdx, clip->x0 - start);
+            start = clip->x0;
+        }
+        if (end > clip->x1)
+            end = clip->x1;
         if (start >= end) {
             left->t += left->t_step;
             right->t += right->t_step;
             continue;
         }
 
-        b3d_scalar_t d =
-            depth_start + B3D_FP_MUL(depth_step, B3D_INT_TO_FP(start) - sx);
-        size_t row_base = (size_t) y * (size_t) b3d_width;
-        size_t buf_size = (size_t) b3d_height * (size_t) b3d_width;
+        size_t row_base = (size_t) y * (size_t) width;
+        size_t buf_size = (size_t) height * (size_t) width;
 
         if (row_base >= buf_size || (size_t) end > buf_size - row_base) {
             left->t += left->t_step;
@@ -249,49 +1077,1188 @@ static void raster_half(int y_start,
             continue;
         }
 
-        b3d_depth_t *dp = b3d_depth + row_base + start;
-        uint32_t *pp = b3d_pixels + row_base + start;
+        b3d_depth_t *dp = ctx->depth + row_base + start;
+        unsigned char *pp = b3d_pixel_addr(ctx, start, y);
         int n = end - start;
-        while (n >= 4) {
-            PUT_PIXEL(0);
-            PUT_PIXEL(1);
-            PUT_PIXEL(2);
-            PUT_PIXEL(3);
-            dp += 4, pp += 4;
-            n -= 4;
-        }
-        while (n-- > 0) {
-            PUT_PIXEL(0);
-            dp++, pp++;
-        }
+        B3D_STAT(clip->stats, spans, 1);
+        B3D_STAT(clip->stats, pixels_tested, n);
+        if (attr)
+            B3D_DISPATCH(b3d_attr_span, state, clip, attr, dp, pp, start, y,
+                         n, d, dzdx);
+        else
+            B3D_DISPATCH(b3d_span_flat, state, clip, dp, pp, n, d, dzdx, c);
 
         left->t += left->t_step;
         right->t += right->t_step;
     }
 }
 
-/* Screen-space vertex for rasterization */
+/* Edge-function rasterizer
+ *
+ * Vertices are snapped to 1/16 pixel and every edge becomes an integer
+ * function E(x, y) that is non-negative inside the triangle. Pixel centers
+ * are visited in blocks of kernel lanes x B3D_EDGE_BLOCK_H; blocks wholly
+ * outside an edge are skipped and the rest is shaded a block row at a time,
+ * with coverage, depth test and writes done for all lanes at once. Pixels
+ * exactly on an edge belong to the triangle only if it is a top or left edge,
+ * so triangles sharing an edge never both draw (or both miss) a pixel.
+ */
+
+#define B3D_EDGE_SUBPIXEL_BITS 4
+#define B3D_EDGE_ONE (1 << B3D_EDGE_SUBPIXEL_BITS) /* one pixel */
+#define B3D_EDGE_BLOCK_H 4
+
+/* Per-triangle constants shared by all block rows */
 typedef struct {
-    b3d_scalar_t x, y, z;
-} raster_vertex_t;
+    int32_t a[3];      /* edge function step per pixel */
+    int32_t b[3];      /* edge function step per row */
+    int32_t hi[3];     /* largest edge value change within a block */
+    int32_t lo[3];     /* smallest edge value change within a block */
+    b3d_scalar_t dzdx; /* depth step per pixel */
+    uint32_t c;
+    const raster_attr_t *attr; /* NULL for flat triangles */
+    /* Lane offsets: i * a[e] and i * dzdx for lane i */
+    int32_t a_lane[3][B3D_EDGE_LANES_MAX];
+    b3d_scalar_t z_lane[B3D_EDGE_LANES_MAX];
+#ifdef B3D_STATS
+    b3d_stats_t *stats;
+#endif
+} raster_setup_t;
 
-/* Internal rasterization function */
-static void b3d_rasterize(const raster_vertex_t v[3], uint32_t c)
+/* Snap a screen coordinate to B3D_EDGE_SUBPIXEL_BITS fractional bits */
+static inline int32_t b3d_edge_snap(b3d_scalar_t v)
 {
-    /* Copy and floor vertices */
-    raster_vertex_t a = {B3D_FP_FLOOR(v[0].x), B3D_FP_FLOOR(v[0].y), v[0].z};
-    raster_vertex_t b = {B3D_FP_FLOOR(v[1].x), B3D_FP_FLOOR(v[1].y), v[1].z};
-    raster_vertex_t cv = {B3D_FP_FLOOR(v[2].x), B3D_FP_FLOOR(v[2].y), v[2].z};
-
-    /* Screen-space AABB early-out */
-    b3d_scalar_t min_x = b3d_fp_min(b3d_fp_min(a.x, b.x), cv.x);
-    b3d_scalar_t max_x = b3d_fp_max(b3d_fp_max(a.x, b.x), cv.x);
-    b3d_scalar_t min_y = b3d_fp_min(b3d_fp_min(a.y, b.y), cv.y);
-    b3d_scalar_t max_y = b3d_fp_max(b3d_fp_max(a.y, b.y), cv.y);
-    if (max_x < 0 || min_x >= B3D_INT_TO_FP(b3d_width) || max_y < 0 ||
-        min_y >= B3D_INT_TO_FP(b3d_height)) {
-        return;
-    }
+#ifdef B3D_FLOAT_POINT
+    return (int32_t) floorf(v * (float) B3D_EDGE_ONE + 0.5f);
+#else
+    const int shift = B3D_FP_BITS - B3D_EDGE_SUBPIXEL_BITS;
+    return (int32_t) ((v + (1 << (shift - 1))) >> shift);
+#endif
+}
+
+/* Depth of the pixel @ix to the right of a row start of depth @zrow */
+static inline b3d_scalar_t b3d_edge_z(b3d_scalar_t zrow,
+                                      int ix,
+                                      b3d_scalar_t dzdx)
+{
+#ifdef B3D_FLOAT_POINT
+    return zrow + (float) ix * dzdx;
+#else
+    /* Wrapping arithmetic: exact wherever the plane depth is in range */
+    return (b3d_scalar_t) ((uint32_t) zrow + (uint32_t) ix * (uint32_t) dzdx);
+#endif
+}
+
+/* Shade @n pixels of a block row one by one (scalar kernel).
+ * @w:    edge function values at the first pixel
+ * @zrow: depth @ix pixels left of the first pixel
+ */
+static B3D_TEMPLATE void b3d_edge_span(const raster_setup_t *s,
+                                       b3d_depth_t *dp,
+                                       unsigned char *pp,
+                                       const int32_t w[3],
+                                       b3d_scalar_t zrow,
+                                       int ix,
+                                       int n,
+                                       unsigned state)
+{
+    int32_t w0 = w[0], w1 = w[1], w2 = w[2];
+    const uint32_t c = b3d_pack_color(b3d_pixel_format(state), s->c);
+    B3D_STAT(s->stats, spans, 1);
+    for (int i = 0; i < n; ++i) {
+        if ((w0 | w1 | w2) >= 0) {
+            b3d_scalar_t z = b3d_edge_z(zrow, ix + i, s->dzdx);
+            B3D_STAT(s->stats, pixels_tested, 1);
+            if (b3d_depth_pass(state, z, dp[i])) {
+                if (!(state & B3D_STATE_NO_DEPTH_WRITE))
+                    dp[i] = b3d_depth_store(z);
+                if (!(state & B3D_STATE_NO_COLOR_WRITE))
+                    b3d_put_color(state, pp, i, c);
+                B3D_STAT(s->stats, pixels_written, 1);
+            }
+        }
+        w0 += s->a[0], w1 += s->a[1], w2 += s->a[2];
+    }
+}
+
+B3D_SPECIALIZE(b3d_edge_span,
+               (const raster_setup_t *s, b3d_depth_t *dp, unsigned char *pp,
+                const int32_t w[3], b3d_scalar_t zrow, int ix, int n),
+               (s, dp, pp, w, zrow, ix, n));
+
+/* b3d_edge_span() for a triangle with attributes, the first pixel being
+ * (@x, @y)
+ */
+static B3D_TEMPLATE void b3d_edge_span_attr(const raster_setup_t *s,
+                                            b3d_depth_t *dp,
+                                            unsigned char *pp,
+                                            const int32_t w[3],
+                                            b3d_scalar_t zrow,
+                                            int ix,
+                                            int n,
+                                            int x,
+                                            int y,
+                                            unsigned state)
+{
+    int32_t w0 = w[0], w1 = w[1], w2 = w[2];
+    float q[B3D_VARYINGS];
+    b3d_sampler_t smp;
+    b3d_attr_begin(s->attr, x, y, q, &smp);
+    B3D_STAT(s->stats, spans, 1);
+    for (int i = 0; i < n; ++i) {
+        if ((w0 | w1 | w2) >= 0) {
+            b3d_scalar_t z = b3d_edge_z(zrow, ix + i, s->dzdx);
+            B3D_STAT(s->stats, pixels_tested, 1);
+            if (b3d_depth_pass(state, z, dp[i])) {
+                if (!(state & B3D_STATE_NO_DEPTH_WRITE))
+                    dp[i] = b3d_depth_store(z);
+                if (!(state & B3D_STATE_NO_COLOR_WRITE))
+                    b3d_put_color(
+                        state, pp, i,
+                        b3d_pack_color(b3d_pixel_format(state),
+                                       b3d_attr_shade(s->attr, &smp, q)));
+                B3D_STAT(s->stats, pixels_written, 1);
+            }
+        }
+        w0 += s->a[0], w1 += s->a[1], w2 += s->a[2];
+        b3d_attr_next(s->attr, x + i + 1, y, q, &smp);
+    }
+}
+
+B3D_SPECIALIZE(b3d_edge_span_attr,
+               (const raster_setup_t *s, b3d_depth_t *dp, unsigned char *pp,
+                const int32_t w[3], b3d_scalar_t zrow, int ix, int n, int x,
+                int y),
+               (s, dp, pp, w, zrow, ix, n, x, y));
+
+/* Whether a block whose first pixel has edge function values @w may cover
+ * any pixel; sets @covered if it lies inside all edges.
+ */
+static inline bool b3d_edge_visible(const raster_setup_t *s,
+                                    const int32_t w[3],
+                                    bool *covered)
+{
+    *covered = w[0] + s->lo[0] >= 0 && w[1] + s->lo[1] >= 0 &&
+               w[2] + s->lo[2] >= 0;
+    return w[0] + s->hi[0] >= 0 && w[1] + s->hi[1] >= 0 &&
+           w[2] + s->hi[2] >= 0;
+}
+
+/* Store @c, encoded for @state, to the pixels of @pp whose bit is set in
+ * @mask: vector kernels write formats narrower than their lanes this way
+ */
+static inline void b3d_put_lanes(unsigned state,
+                                 unsigned char *pp,
+                                 unsigned mask,
+                                 uint32_t c)
+{
+    for (int i = 0; mask; ++i, mask >>= 1) {
+        if (mask & 1)
+            b3d_put_color(state, pp, i, c);
+    }
+}
+
+/* Shade a block of @rows rows, one pixel per lane each, with the same
+ * result as b3d_edge_span() on every row. @covered skips the edge tests for
+ * blocks known to lie inside the triangle.
+ * @dp, @pp: first pixel of the block, depth rows are @stride values and
+ *           pixel rows @pixel_stride bytes apart
+ * @w:       edge function values at the first pixel
+ * @zrow:    depth of each row, @ix pixels left of the block
+ *
+ * There is one kernel per instruction set. B3D_EDGE_BLOCKS() wraps each in
+ * a loop over a row of blocks, so that b3d_kernels_t can pick one at run
+ * time for the cost of one indirect call per block row.
+ */
+#define B3D_EDGE_BLOCKS_PARAMS                                               \
+    (const raster_setup_t *s, b3d_depth_t *dp, unsigned char *pp,             \
+     size_t stride, size_t pixel_stride, const int32_t w[3],                  \
+     const b3d_scalar_t *zrow, int ix, int rows, int n)
+
+/* Instantiate b3d_edge_blocks_@set(): b3d_edge_block_@set(), @lanes pixels
+ * wide, on the blocks of the next @n pixels (a multiple of @lanes) left to
+ * right, skipping those outside the triangle
+ */
+#define B3D_EDGE_BLOCKS(set, lanes, target)                                  \
+    static B3D_TEMPLATE target void b3d_edge_blocks_##set(                   \
+        const raster_setup_t *s, b3d_depth_t *dp, unsigned char *pp,         \
+        size_t stride, size_t pixel_stride, const int32_t w[3],              \
+        const b3d_scalar_t *zrow, int ix, int rows, int n, unsigned state)   \
+    {                                                                        \
+        const size_t bpp = b3d_format_bytes(b3d_pixel_format(state));        \
+        int32_t wb[3] = {w[0], w[1], w[2]};                                  \
+        for (int i = 0; i < n; i += lanes) {                                 \
+            bool covered;                                                    \
+            if (b3d_edge_visible(s, wb, &covered))                           \
+                b3d_edge_block_##set(s, dp + i, pp + i * bpp, stride,        \
+                                     pixel_stride, wb, zrow, ix + i, rows,   \
+                                     covered, state);                        \
+            for (int e = 0; e < 3; ++e)                                      \
+                wb[e] += s->a[e] * lanes;                                    \
+        }                                                                    \
+    }                                                                        \
+    B3D_SPECIALIZE_TARGET(                                                   \
+        b3d_edge_blocks_##set, target, B3D_EDGE_BLOCKS_PARAMS,               \
+        (s, dp, pp, stride, pixel_stride, w, zrow, ix, rows, n))
+
+#ifdef B3D_EDGE_SSE2
+static B3D_TEMPLATE void b3d_edge_block_sse2(const raster_setup_t *s,
+                                             b3d_depth_t *dp,
+                                             unsigned char *pp,
+                                             size_t stride,
+                                             size_t pixel_stride,
+                                             const int32_t w[3],
+                                             const b3d_scalar_t *zrow,
+                                             int ix,
+                                             int rows,
+                                             bool covered,
+                                             unsigned state)
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    const __m128i color = _mm_set1_epi32((int32_t) s->c);
+    const uint32_t c = b3d_pack_color(b3d_pixel_format(state), s->c);
+    const __m128i b0 = _mm_set1_epi32(s->b[0]);
+    const __m128i b1 = _mm_set1_epi32(s->b[1]);
+    const __m128i b2 = _mm_set1_epi32(s->b[2]);
+    __m128i w0 = _mm_add_epi32(_mm_set1_epi32(w[0]),
+                               _mm_loadu_si128((const void *) s->a_lane[0]));
+    __m128i w1 = _mm_add_epi32(_mm_set1_epi32(w[1]),
+                               _mm_loadu_si128((const void *) s->a_lane[1]));
+    __m128i w2 = _mm_add_epi32(_mm_set1_epi32(w[2]),
+                               _mm_loadu_si128((const void *) s->a_lane[2]));
+#ifdef B3D_FLOAT_POINT
+    const __m128 zoff = _mm_mul_ps(
+        _mm_cvtepi32_ps(
+            _mm_add_epi32(_mm_set1_epi32(ix), _mm_set_epi32(3, 2, 1, 0))),
+        _mm_set1_ps(s->dzdx));
+#else
+    const __m128i zoff = _mm_loadu_si128((const void *) s->z_lane);
+#endif
+
+    for (int r = 0; r < rows; ++r, dp += stride, pp += pixel_stride) {
+        __m128i inside = ones;
+        if (!covered) {
+            inside = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(w0, w1), w2),
+                                     ones);
+            w0 = _mm_add_epi32(w0, b0);
+            w1 = _mm_add_epi32(w1, b1);
+            w2 = _mm_add_epi32(w2, b2);
+            if (!_mm_movemask_epi8(inside))
+                continue;
+        }
+#ifdef B3D_FLOAT_POINT
+        __m128 z = _mm_add_ps(_mm_set1_ps(zrow[r]), zoff);
+        __m128 d = _mm_loadu_ps(dp);
+        __m128i m = inside;
+        if (b3d_depth_func(state) == B3D_DEPTH_LESS)
+            m = _mm_and_si128(m, _mm_castps_si128(_mm_cmplt_ps(z, d)));
+        else if (b3d_depth_func(state) == B3D_DEPTH_EQUAL)
+            m = _mm_and_si128(m, _mm_castps_si128(_mm_cmpeq_ps(z, d)));
+        __m128i zi = _mm_castps_si128(z), di = _mm_castps_si128(d);
+#else
+        __m128i zi = _mm_add_epi32(
+            _mm_set1_epi32(b3d_edge_z(zrow[r], ix, s->dzdx)), zoff);
+        __m128i di = _mm_loadu_si128((const void *) dp);
+        __m128i m = inside;
+        if (b3d_depth_func(state) == B3D_DEPTH_LESS)
+            m = _mm_and_si128(m, _mm_cmplt_epi32(zi, di));
+        else if (b3d_depth_func(state) == B3D_DEPTH_EQUAL)
+            m = _mm_and_si128(m, _mm_cmpeq_epi32(zi, di));
+#endif
+        B3D_STAT(s->stats, spans, 1);
+        B3D_STAT(s->stats, pixels_tested,
+                 b3d_popcount(_mm_movemask_ps(_mm_castsi128_ps(inside))));
+        B3D_STAT(s->stats, pixels_written,
+                 b3d_popcount(_mm_movemask_ps(_mm_castsi128_ps(m))));
+        /* Leave untouched cache lines clean */
+        if (!_mm_movemask_epi8(m))
+            continue;
+        if (!(state & B3D_STATE_NO_DEPTH_WRITE))
+            _mm_storeu_si128((void *) dp,
+                             _mm_or_si128(_mm_and_si128(m, zi),
+                                          _mm_andnot_si128(m, di)));
+        if (state & B3D_STATE_NO_COLOR_WRITE)
+            continue;
+        if (b3d_pixel_format(state) != B3D_FORMAT_XRGB8888) {
+            b3d_put_lanes(state, pp,
+                          (unsigned) _mm_movemask_ps(_mm_castsi128_ps(m)), c);
+        } else {
+            __m128i p = _mm_loadu_si128((const void *) pp);
+            _mm_storeu_si128((void *) pp,
+                             _mm_or_si128(_mm_and_si128(m, color),
+                                          _mm_andnot_si128(m, p)));
+        }
+    }
+}
+
+B3D_EDGE_BLOCKS(sse2, 4, );
+#endif
+
+#ifdef B3D_EDGE_AVX2
+static B3D_TEMPLATE B3D_TARGET_AVX2 void b3d_edge_block_avx2(
+    const raster_setup_t *s,
+    b3d_depth_t *dp,
+    unsigned char *pp,
+    size_t stride,
+    size_t pixel_stride,
+    const int32_t w[3],
+    const b3d_scalar_t *zrow,
+    int ix,
+    int rows,
+    bool covered,
+    unsigned state)
+{
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i color = _mm256_set1_epi32((int32_t) s->c);
+    const uint32_t c = b3d_pack_color(b3d_pixel_format(state), s->c);
+    const __m256i b0 = _mm256_set1_epi32(s->b[0]);
+    const __m256i b1 = _mm256_set1_epi32(s->b[1]);
+    const __m256i b2 = _mm256_set1_epi32(s->b[2]);
+    __m256i w0 =
+        _mm256_add_epi32(_mm256_set1_epi32(w[0]),
+                         _mm256_loadu_si256((const void *) s->a_lane[0]));
+    __m256i w1 =
+        _mm256_add_epi32(_mm256_set1_epi32(w[1]),
+                         _mm256_loadu_si256((const void *) s->a_lane[1]));
+    __m256i w2 =
+        _mm256_add_epi32(_mm256_set1_epi32(w[2]),
+                         _mm256_loadu_si256((const void *) s->a_lane[2]));
+#ifdef B3D_FLOAT_POINT
+    const __m256 zoff = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_add_epi32(
+            _mm256_set1_epi32(ix), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0))),
+        _mm256_set1_ps(s->dzdx));
+#else
+    const __m256i zoff = _mm256_loadu_si256((const void *) s->z_lane);
+#endif
+
+    for (int r = 0; r < rows; ++r, dp += stride, pp += pixel_stride) {
+        __m256i inside = ones;
+        if (!covered) {
+            inside = _mm256_cmpgt_epi32(
+                _mm256_or_si256(_mm256_or_si256(w0, w1), w2), ones);
+            w0 = _mm256_add_epi32(w0, b0);
+            w1 = _mm256_add_epi32(w1, b1);
+            w2 = _mm256_add_epi32(w2, b2);
+            if (!_mm256_movemask_epi8(inside))
+                continue;
+        }
+#ifdef B3D_FLOAT_POINT
+        __m256 z = _mm256_add_ps(_mm256_set1_ps(zrow[r]), zoff);
+        __m256 d = _mm256_loadu_ps(dp);
+        __m256i m = inside;
+        if (b3d_depth_func(state) == B3D_DEPTH_LESS)
+            m = _mm256_and_si256(
+                m, _mm256_castps_si256(_mm256_cmp_ps(z, d, _CMP_LT_OQ)));
+        else if (b3d_depth_func(state) == B3D_DEPTH_EQUAL)
+            m = _mm256_and_si256(
+                m, _mm256_castps_si256(_mm256_cmp_ps(z, d, _CMP_EQ_OQ)));
+        __m256i zi = _mm256_castps_si256(z), di = _mm256_castps_si256(d);
+#else
+        __m256i zi = _mm256_add_epi32(
+            _mm256_set1_epi32(b3d_edge_z(zrow[r], ix, s->dzdx)), zoff);
+        __m256i di = _mm256_loadu_si256((const void *) dp);
+        __m256i m = inside;
+        if (b3d_depth_func(state) == B3D_DEPTH_LESS)
+            m = _mm256_and_si256(m, _mm256_cmpgt_epi32(di, zi));
+        else if (b3d_depth_func(state) == B3D_DEPTH_EQUAL)
+            m = _mm256_and_si256(m, _mm256_cmpeq_epi32(di, zi));
+#endif
+        B3D_STAT(s->stats, spans, 1);
+        B3D_STAT(s->stats, pixels_tested,
+                 b3d_popcount(
+                     _mm256_movemask_ps(_mm256_castsi256_ps(inside))));
+        B3D_STAT(s->stats, pixels_written,
+                 b3d_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m))));
+        /* Leave untouched cache lines clean */
+        if (!_mm256_movemask_epi8(m))
+            continue;
+        if (!(state & B3D_STATE_NO_DEPTH_WRITE))
+            _mm256_storeu_si256((void *) dp, _mm256_blendv_epi8(di, zi, m));
+        if (state & B3D_STATE_NO_COLOR_WRITE)
+            continue;
+        if (b3d_pixel_format(state) != B3D_FORMAT_XRGB8888) {
+            b3d_put_lanes(
+                state, pp,
+                (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(m)), c);
+        } else {
+            __m256i p = _mm256_loadu_si256((const void *) pp);
+            _mm256_storeu_si256((void *) pp, _mm256_blendv_epi8(p, color, m));
+        }
+    }
+}
+
+B3D_EDGE_BLOCKS(avx2, 8, B3D_TARGET_AVX2);
+#endif
+
+#ifdef B3D_EDGE_NEON
+#ifdef B3D_STATS
+/* Number of set lanes in mask @m */
+static inline int b3d_edge_count(uint32x4_t m)
+{
+    uint32x4_t one = vshrq_n_u32(m, 31);
+    uint32x2_t sum = vadd_u32(vget_low_u32(one), vget_high_u32(one));
+    return (int) (vget_lane_u32(sum, 0) + vget_lane_u32(sum, 1));
+}
+#endif
+
+static B3D_TEMPLATE void b3d_edge_block_neon(const raster_setup_t *s,
+                                             b3d_depth_t *dp,
+                                             unsigned char *pp,
+                                             size_t stride,
+                                             size_t pixel_stride,
+                                             const int32_t w[3],
+                                             const b3d_scalar_t *zrow,
+                                             int ix,
+                                             int rows,
+                                             bool covered,
+                                             unsigned state)
+{
+    const uint32x4_t color = vdupq_n_u32(s->c);
+    const uint32_t c = b3d_pack_color(b3d_pixel_format(state), s->c);
+    const int32x4_t b0 = vdupq_n_s32(s->b[0]);
+    const int32x4_t b1 = vdupq_n_s32(s->b[1]);
+    const int32x4_t b2 = vdupq_n_s32(s->b[2]);
+    int32x4_t w0 = vaddq_s32(vdupq_n_s32(w[0]), vld1q_s32(s->a_lane[0]));
+    int32x4_t w1 = vaddq_s32(vdupq_n_s32(w[1]), vld1q_s32(s->a_lane[1]));
+    int32x4_t w2 = vaddq_s32(vdupq_n_s32(w[2]), vld1q_s32(s->a_lane[2]));
+#ifdef B3D_FLOAT_POINT
+    static const int32_t lanes[4] = {0, 1, 2, 3};
+    const float32x4_t zoff =
+        vmulq_f32(vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(ix), vld1q_s32(lanes))),
+                  vdupq_n_f32(s->dzdx));
+#else
+    const int32x4_t zoff = vld1q_s32(s->z_lane);
+#endif
+
+    for (int r = 0; r < rows; ++r, dp += stride, pp += pixel_stride) {
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        if (!covered) {
+            inside =
+                vcgeq_s32(vorrq_s32(vorrq_s32(w0, w1), w2), vdupq_n_s32(0));
+            w0 = vaddq_s32(w0, b0);
+            w1 = vaddq_s32(w1, b1);
+            w2 = vaddq_s32(w2, b2);
+        }
+#ifdef B3D_FLOAT_POINT
+        float32x4_t z = vaddq_f32(vdupq_n_f32(zrow[r]), zoff);
+        float32x4_t d = vld1q_f32(dp);
+        uint32x4_t m = inside;
+        if (b3d_depth_func(state) == B3D_DEPTH_LESS)
+            m = vandq_u32(m, vcltq_f32(z, d));
+        else if (b3d_depth_func(state) == B3D_DEPTH_EQUAL)
+            m = vandq_u32(m, vceqq_f32(z, d));
+#else
+        int32x4_t z = vaddq_s32(
+            vdupq_n_s32(b3d_edge_z(zrow[r], ix, s->dzdx)), zoff);
+        int32x4_t d = vld1q_s32(dp);
+        uint32x4_t m = inside;
+        if (b3d_depth_func(state) == B3D_DEPTH_LESS)
+            m = vandq_u32(m, vcltq_s32(z, d));
+        else if (b3d_depth_func(state) == B3D_DEPTH_EQUAL)
+            m = vandq_u32(m, vceqq_s32(z, d));
+#endif
+        B3D_STAT(s->stats, spans, 1);
+        B3D_STAT(s->stats, pixels_tested, b3d_edge_count(inside));
+        B3D_STAT(s->stats, pixels_written, b3d_edge_count(m));
+        /* Leave untouched cache lines clean */
+        uint32x2_t any = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+        if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) == 0)
+            continue;
+        if (!(state & B3D_STATE_NO_DEPTH_WRITE)) {
+#ifdef B3D_FLOAT_POINT
+            vst1q_f32(dp, vbslq_f32(m, z, d));
+#else
+            vst1q_s32(dp, vbslq_s32(m, z, d));
+#endif
+        }
+        if (state & B3D_STATE_NO_COLOR_WRITE)
+            continue;
+        if (b3d_pixel_format(state) != B3D_FORMAT_XRGB8888) {
+            uint32_t bits[4];
+            vst1q_u32(bits, m);
+            b3d_put_lanes(state, pp,
+                          (bits[0] & 1) | (bits[1] & 2) | (bits[2] & 4) |
+                              (bits[3] & 8),
+                          c);
+        } else {
+            uint32_t *p32 = (uint32_t *) (void *) pp;
+            vst1q_u32(p32, vbslq_u32(m, color, vld1q_u32(p32)));
+        }
+    }
+}
+
+B3D_EDGE_BLOCKS(neon, 4, );
+#endif
+
+/* Scalar blocks are 4 pixels wide */
+static B3D_TEMPLATE void b3d_edge_block_scalar(const raster_setup_t *s,
+                                               b3d_depth_t *dp,
+                                               unsigned char *pp,
+                                               size_t stride,
+                                               size_t pixel_stride,
+                                               const int32_t w[3],
+                                               const b3d_scalar_t *zrow,
+                                               int ix,
+                                               int rows,
+                                               bool covered,
+                                               unsigned state)
+{
+    (void) covered;
+    int32_t wr[3] = {w[0], w[1], w[2]};
+    for (int r = 0; r < rows; ++r, dp += stride, pp += pixel_stride) {
+        b3d_edge_span(s, dp, pp, wr, zrow[r], ix, 4, state);
+        wr[0] += s->b[0], wr[1] += s->b[1], wr[2] += s->b[2];
+    }
+}
+
+B3D_EDGE_BLOCKS(scalar, 4, );
+
+/* Kernel sets
+ *
+ * The clear, edge block and vertex transform kernels come in one version
+ * per instruction set, collected in a b3d_kernels_t. All contexts share the
+ * active set, the best one the compiler targets until the first
+ * b3d_ctx_init() checks the CPU for better ones. All sets produce the same
+ * pixels and depth.
+ */
+
+/* Store @n copies of the 32-bit pattern @v at @dst */
+static void b3d_fill32_scalar(void *dst, uint32_t v, size_t n)
+{
+    unsigned char *p = dst;
+    for (size_t i = 0; i < n; ++i)
+        memcpy(p + i * 4, &v, 4);
+}
+
+/* Transform @n points, 3 floats each at @pos, by @m into @out (w = 1) */
+static void b3d_transform_scalar(const b3d_mat_t *m,
+                                 const float *pos,
+                                 int n,
+                                 b3d_vec_t *out)
+{
+    for (int i = 0; i < n; ++i, pos += 3)
+        out[i] = b3d_mat_mul_vec(*m, (b3d_vec_t) {pos[0], pos[1], pos[2], 1});
+}
+
+/* The vector transforms add the same products in the same order as
+ * b3d_mat_mul_vec(), so every set computes bit-identical positions.
+ */
+#ifdef B3D_SIMD_SSE2
+static void b3d_fill32_sse2(void *dst, uint32_t v, size_t n)
+{
+    unsigned char *p = dst;
+    const __m128i x = _mm_set1_epi32((int32_t) v);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((void *) (p + i * 4), x);
+        _mm_storeu_si128((void *) (p + i * 4 + 16), x);
+    }
+    b3d_fill32_scalar(p + i * 4, v, n - i);
+}
+
+static void b3d_transform_sse2(const b3d_mat_t *m,
+                               const float *pos,
+                               int n,
+                               b3d_vec_t *out)
+{
+    const __m128 r0 = _mm_loadu_ps(m->m[0]), r1 = _mm_loadu_ps(m->m[1]);
+    const __m128 r2 = _mm_loadu_ps(m->m[2]), r3 = _mm_loadu_ps(m->m[3]);
+    for (int i = 0; i < n; ++i, pos += 3) {
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pos[0]), r0),
+                              _mm_mul_ps(_mm_set1_ps(pos[1]), r1));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(pos[2]), r2));
+        _mm_storeu_ps(&out[i].x, _mm_add_ps(v, r3));
+    }
+}
+#endif
+
+#ifdef B3D_SIMD_AVX2
+static B3D_TARGET_AVX2 void b3d_fill32_avx2(void *dst, uint32_t v, size_t n)
+{
+    unsigned char *p = dst;
+    const __m256i x = _mm256_set1_epi32((int32_t) v);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm256_storeu_si256((void *) (p + i * 4), x);
+        _mm256_storeu_si256((void *) (p + i * 4 + 32), x);
+    }
+    b3d_fill32_scalar(p + i * 4, v, n - i);
+}
+
+/* Two points per iteration, one in each 128-bit half */
+static B3D_TARGET_AVX2 void b3d_transform_avx2(const b3d_mat_t *m,
+                                               const float *pos,
+                                               int n,
+                                               b3d_vec_t *out)
+{
+    const __m256 r0 = _mm256_broadcast_ps((const __m128 *) m->m[0]);
+    const __m256 r1 = _mm256_broadcast_ps((const __m128 *) m->m[1]);
+    const __m256 r2 = _mm256_broadcast_ps((const __m128 *) m->m[2]);
+    const __m256 r3 = _mm256_broadcast_ps((const __m128 *) m->m[3]);
+    int i = 0;
+    for (; i + 2 <= n; i += 2, pos += 6) {
+        __m256 x = _mm256_setr_ps(pos[0], pos[0], pos[0], pos[0], pos[3],
+                                  pos[3], pos[3], pos[3]);
+        __m256 y = _mm256_setr_ps(pos[1], pos[1], pos[1], pos[1], pos[4],
+                                  pos[4], pos[4], pos[4]);
+        __m256 z = _mm256_setr_ps(pos[2], pos[2], pos[2], pos[2], pos[5],
+                                  pos[5], pos[5], pos[5]);
+        __m256 v =
+            _mm256_add_ps(_mm256_mul_ps(x, r0), _mm256_mul_ps(y, r1));
+        v = _mm256_add_ps(v, _mm256_mul_ps(z, r2));
+        _mm256_storeu_ps(&out[i].x, _mm256_add_ps(v, r3));
+    }
+    /* The tail is a plain call into SSE code: clear the dirty upper halves
+     * first or every later non-VEX instruction pays a transition penalty.
+     */
+    _mm256_zeroupper();
+    b3d_transform_scalar(m, pos, n - i, out + i);
+}
+#endif
+
+#ifdef B3D_SIMD_NEON
+static void b3d_fill32_neon(void *dst, uint32_t v, size_t n)
+{
+    unsigned char *p = dst;
+    const uint32x4_t x = vdupq_n_u32(v);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u8(p + i * 4, vreinterpretq_u8_u32(x));
+        vst1q_u8(p + i * 4 + 16, vreinterpretq_u8_u32(x));
+    }
+    b3d_fill32_scalar(p + i * 4, v, n - i);
+}
+
+static void b3d_transform_neon(const b3d_mat_t *m,
+                               const float *pos,
+                               int n,
+                               b3d_vec_t *out)
+{
+    const float32x4_t r0 = vld1q_f32(m->m[0]), r1 = vld1q_f32(m->m[1]);
+    const float32x4_t r2 = vld1q_f32(m->m[2]), r3 = vld1q_f32(m->m[3]);
+    for (int i = 0; i < n; ++i, pos += 3) {
+        float32x4_t v =
+            vaddq_f32(vmulq_n_f32(r0, pos[0]), vmulq_n_f32(r1, pos[1]));
+        v = vaddq_f32(v, vmulq_n_f32(r2, pos[2]));
+        vst1q_f32(&out[i].x, vaddq_f32(v, r3));
+    }
+}
+#endif
+
+typedef struct {
+    const char *name; /* see b3d_get_backend_name() */
+    int lanes;        /* pixels per edge block row */
+    void (*const *edge_blocks) B3D_EDGE_BLOCKS_PARAMS; /* per state word */
+    void (*fill32)(void *dst, uint32_t v, size_t n);
+    void (*transform)(const b3d_mat_t *m,
+                      const float *pos,
+                      int n,
+                      b3d_vec_t *out);
+} b3d_kernels_t;
+
+/* Edge block kernel of set @set, @n lanes wide */
+#ifdef B3D_DEPTH_16BIT
+#define B3D_EDGE_KERNEL(set, n) \
+    .lanes = 4, .edge_blocks = b3d_edge_blocks_scalar_variants
+#else
+#define B3D_EDGE_KERNEL(set, n) \
+    .lanes = n, .edge_blocks = b3d_edge_blocks_##set##_variants
+#endif
+
+/* Every set of this build, best first */
+static const b3d_kernels_t b3d_kernel_sets[] = {
+#ifdef B3D_SIMD_AVX2
+    {"avx2", B3D_EDGE_KERNEL(avx2, 8), .fill32 = b3d_fill32_avx2,
+     .transform = b3d_transform_avx2},
+#endif
+#ifdef B3D_SIMD_SSE2
+    {"sse2", B3D_EDGE_KERNEL(sse2, 4), .fill32 = b3d_fill32_sse2,
+     .transform = b3d_transform_sse2},
+#endif
+#ifdef B3D_SIMD_NEON
+    {"neon", B3D_EDGE_KERNEL(neon, 4), .fill32 = b3d_fill32_neon,
+     .transform = b3d_transform_neon},
+#endif
+    {"scalar", .lanes = 4, .edge_blocks = b3d_edge_blocks_scalar_variants,
+     .fill32 = b3d_fill32_scalar, .transform = b3d_transform_scalar},
+};
+
+#define B3D_KERNEL_SETS \
+    ((int) (sizeof(b3d_kernel_sets) / sizeof(b3d_kernel_sets[0])))
+
+/* Whether this CPU runs set @k */
+static bool b3d_kernels_supported(const b3d_kernels_t *k)
+{
+#ifdef B3D_CPU_DISPATCH
+    if (!strcmp(k->name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+#endif
+    (void) k;
+    return true;
+}
+
+/* Active set. Without B3D_CPU_DISPATCH every compiled set runs and the first
+ * is the best one; with it the set is picked once when the library is
+ * loaded, before any thread can initialize a context, so no init writes it.
+ */
+#ifdef B3D_CPU_DISPATCH
+static const b3d_kernels_t *b3d_kernels = &b3d_kernel_sets[1];
+
+__attribute__((constructor)) static void b3d_detect_kernels(void)
+{
+    /* Constructors may run before the one that fills in the CPU model */
+    __builtin_cpu_init();
+    for (int i = 0; i < B3D_KERNEL_SETS; ++i) {
+        if (b3d_kernels_supported(&b3d_kernel_sets[i])) {
+            b3d_kernels = &b3d_kernel_sets[i];
+            break;
+        }
+    }
+}
+#else
+static const b3d_kernels_t *b3d_kernels = &b3d_kernel_sets[0];
+#endif
+
+const char *b3d_get_backend_name(void)
+{
+    return b3d_kernels->name;
+}
+
+bool b3d_set_backend(const char *name)
+{
+    for (int i = 0; name && i < B3D_KERNEL_SETS; ++i) {
+        const b3d_kernels_t *k = &b3d_kernel_sets[i];
+        if (!strcmp(k->name, name) && b3d_kernels_supported(k)) {
+            b3d_kernels = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Rasterize a triangle with edge functions.
+ * Returns false, leaving the framebuffer untouched, if the triangle is too
+ * large for 32-bit edge functions; the caller falls back to scanlines.
+ */
+static bool b3d_rasterize_edge(b3d_context_t *ctx,
+                               const raster_clip_t *clip,
+                               const raster_vertex_t v[3],
+                               uint32_t c,
+                               const raster_attr_t *attr)
+{
+    const b3d_kernels_t *k = b3d_kernels;
+    const int lanes = k->lanes;
+    int32_t X[3], Y[3];
+    b3d_scalar_t Z[3];
+    for (int i = 0; i < 3; ++i) {
+        X[i] = b3d_edge_snap(v[i].x);
+        Y[i] = b3d_edge_snap(v[i].y);
+        Z[i] = v[i].z;
+    }
+
+    /* Make the winding consistent: positive area, interior E >= 0 */
+    int64_t area = (int64_t) (X[1] - X[0]) * (Y[2] - Y[0]) -
+                   (int64_t) (X[2] - X[0]) * (Y[1] - Y[0]);
+    if (area == 0)
+        return true;
+    if (area < 0) {
+        int32_t ti = X[1];
+        X[1] = X[2], X[2] = ti;
+        ti = Y[1], Y[1] = Y[2], Y[2] = ti;
+        b3d_scalar_t tz = Z[1];
+        Z[1] = Z[2], Z[2] = tz;
+        area = -area;
+    }
+
+    /* Pixels whose centers fall inside the bounding box, within @clip */
+    int32_t min_x = X[0], max_x = X[0], min_y = Y[0], max_y = Y[0];
+    for (int i = 1; i < 3; ++i) {
+        min_x = X[i] < min_x ? X[i] : min_x;
+        max_x = X[i] > max_x ? X[i] : max_x;
+        min_y = Y[i] < min_y ? Y[i] : min_y;
+        max_y = Y[i] > max_y ? Y[i] : max_y;
+    }
+    const int half = B3D_EDGE_ONE / 2;
+    int x_lo = (min_x - half + B3D_EDGE_ONE - 1) >> B3D_EDGE_SUBPIXEL_BITS;
+    int x_hi = ((max_x - half) >> B3D_EDGE_SUBPIXEL_BITS) + 1;
+    int y_lo = (min_y - half + B3D_EDGE_ONE - 1) >> B3D_EDGE_SUBPIXEL_BITS;
+    int y_hi = ((max_y - half) >> B3D_EDGE_SUBPIXEL_BITS) + 1;
+    /* Depth is anchored at the unclipped box so that neither the tile nor
+     * the lane count changes any depth value. Off-screen corners of
+     * guard-band triangles are moved onto the screen edge: the per-pixel
+     * step is rounded, and walking it far would add up the error.
+     */
+    const int ox = x_lo > 0 ? x_lo : 0, oy = y_lo > 0 ? y_lo : 0;
+    x_lo = x_lo > clip->x0 ? x_lo : clip->x0;
+    x_hi = x_hi < clip->x1 ? x_hi : clip->x1;
+    y_lo = y_lo > clip->y0 ? y_lo : clip->y0;
+    y_hi = y_hi < clip->y1 ? y_hi : clip->y1;
+    if (x_lo >= x_hi || y_lo >= y_hi) {
+        B3D_STAT(clip->stats, triangles_aabb_rejected, 1);
+        return true;
+    }
+
+    /* Every sampled edge value, including block padding, must fit 31 bits */
+    int64_t ext_x = (int64_t) (max_x - min_x) + (lanes + 2) * B3D_EDGE_ONE;
+    int64_t ext_y =
+        (int64_t) (max_y - min_y) + (B3D_EDGE_BLOCK_H + 2) * B3D_EDGE_ONE;
+    if (ext_x * ext_y * 2 >= ((int64_t) 1 << 30))
+        return false;
+
+    /* Edge e runs from vertex e to vertex e + 1, sampled at pixel centers
+     * starting from the lane-aligned block column left of x_lo.
+     */
+    raster_setup_t s;
+    int bx0 = x_lo & ~(lanes - 1);
+    int64_t px = (int64_t) bx0 * B3D_EDGE_ONE + half;
+    int64_t py = (int64_t) y_lo * B3D_EDGE_ONE + half;
+    int64_t ozx = (int64_t) ox * B3D_EDGE_ONE + half - X[0];
+    int64_t ozy = (int64_t) oy * B3D_EDGE_ONE + half - Y[0];
+    int32_t w_row[3];
+    for (int e = 0; e < 3; ++e) {
+        int j = e, k = e == 2 ? 0 : e + 1;
+        int32_t dx = X[k] - X[j], dy = Y[k] - Y[j];
+        bool top_left = dy < 0 || (dy == 0 && dx > 0);
+        s.a[e] = -dy * B3D_EDGE_ONE;
+        s.b[e] = dx * B3D_EDGE_ONE;
+        w_row[e] = (int32_t) (dx * (py - Y[j]) - dy * (px - X[j])) -
+                   (top_left ? 0 : 1);
+        for (int i = 0; i < B3D_EDGE_LANES_MAX; ++i)
+            s.a_lane[e][i] = s.a[e] * i;
+        int32_t bx = s.a[e] * (lanes - 1);
+        int32_t by = s.b[e] * (B3D_EDGE_BLOCK_H - 1);
+        s.hi[e] = (bx > 0 ? bx : 0) + (by > 0 ? by : 0);
+        s.lo[e] = (bx < 0 ? bx : 0) + (by < 0 ? by : 0);
+    }
+    s.c = c;
+    s.attr = attr;
+#ifdef B3D_STATS
+    s.stats = clip->stats;
+#endif
+
+    /* Depth plane z = Z0 + (za * (x - X0) + zb * (y - Y0)) / area, evaluated
+     * at the center of pixel (ox, oy) and stepped per pixel and row from there
+     */
+    b3d_scalar_t z_org, dzdy;
+#ifdef B3D_FLOAT_POINT
+    float za = (Z[1] - Z[0]) * (float) (Y[2] - Y[0]) -
+               (Z[2] - Z[0]) * (float) (Y[1] - Y[0]);
+    float zb = (Z[2] - Z[0]) * (float) (X[1] - X[0]) -
+               (Z[1] - Z[0]) * (float) (X[2] - X[0]);
+    za /= (float) area;
+    zb /= (float) area;
+    z_org = Z[0] + za * (float) ozx + zb * (float) ozy;
+    s.dzdx = za * (float) B3D_EDGE_ONE;
+    dzdy = zb * (float) B3D_EDGE_ONE;
+    for (int i = 0; i < B3D_EDGE_LANES_MAX; ++i)
+        s.z_lane[i] = s.dzdx * (float) i;
+#else
+    int64_t za = (int64_t) (Z[1] - Z[0]) * (Y[2] - Y[0]) -
+                 (int64_t) (Z[2] - Z[0]) * (Y[1] - Y[0]);
+    int64_t zb = (int64_t) (Z[2] - Z[0]) * (X[1] - X[0]) -
+                 (int64_t) (Z[1] - Z[0]) * (X[2] - X[0]);
+    z_org = Z[0] + (b3d_scalar_t) ((za * ozx + zb * ozy) / area);
+    s.dzdx = (b3d_scalar_t) (za * B3D_EDGE_ONE / area);
+    dzdy = (b3d_scalar_t) (zb * B3D_EDGE_ONE / area);
+    for (int i = 0; i < B3D_EDGE_LANES_MAX; ++i)
+        s.z_lane[i] = (b3d_scalar_t) ((uint32_t) s.dzdx * (uint32_t) i);
+#endif
+
+    b3d_depth_t *depth = ctx->depth;
+    const size_t width = (size_t) ctx->width;
+    const unsigned state = b3d_kernel_state(ctx);
+    for (int by = y_lo; by < y_hi; by += B3D_EDGE_BLOCK_H) {
+        int rows = y_hi - by < B3D_EDGE_BLOCK_H ? y_hi - by : B3D_EDGE_BLOCK_H;
+
+        /* Depth at column ox of each row */
+        b3d_scalar_t zrow[B3D_EDGE_BLOCK_H];
+        for (int r = 0; r < rows; ++r)
+            zrow[r] = b3d_edge_z(z_org, by + r - oy, dzdy);
+
+        int32_t w_blk[3] = {w_row[0], w_row[1], w_row[2]};
+        const size_t base = (size_t) by * width;
+        for (int bx = bx0; bx < x_hi;) {
+            /* Blocks wholly inside @clip go to the vector kernel, which
+             * skips those entirely outside one edge and drops the edge
+             * tests for those entirely inside all of them
+             */
+            int run = 0;
+            if (!attr && bx >= clip->x0) {
+                int fit = clip->x1 & ~(lanes - 1);
+                run = (x_hi + lanes - 1) & ~(lanes - 1);
+                run = (run < fit ? run : fit) - bx;
+            }
+            if (run > 0) {
+                k->edge_blocks[state](&s, depth + base + bx,
+                                      b3d_pixel_addr(ctx, bx, by), width,
+                                      ctx->pixel_stride, w_blk, zrow, bx - ox,
+                                      rows, run);
+                bx += run;
+                for (int e = 0; e < 3; ++e)
+                    w_blk[e] += s.a[e] * run;
+                continue;
+            }
+
+            bool covered;
+            if (b3d_edge_visible(&s, w_blk, &covered)) {
+                /* Block straddles @clip, or needs attributes: shade its
+                 * inside part pixel by pixel
+                 */
+                int x_start = bx > x_lo ? bx : x_lo;
+                int x_end = bx + lanes < x_hi ? bx + lanes : x_hi;
+                int skip = x_start - bx;
+                int32_t w[3] = {w_blk[0] + s.a[0] * skip,
+                                w_blk[1] + s.a[1] * skip,
+                                w_blk[2] + s.a[2] * skip};
+                for (int r = 0; r < rows; ++r) {
+                    size_t row = base + (size_t) r * width + x_start;
+                    unsigned char *pp = b3d_pixel_addr(ctx, x_start, by + r);
+                    if (attr)
+                        B3D_DISPATCH(b3d_edge_span_attr, state, &s,
+                                     depth + row, pp, w, zrow[r],
+                                     x_start - ox, x_end - x_start, x_start,
+                                     by + r);
+                    else
+                        B3D_DISPATCH(b3d_edge_span, state, &s, depth + row,
+                                     pp, w, zrow[r], x_start - ox,
+                                     x_end - x_start);
+                    for (int e = 0; e < 3; ++e)
+                        w[e] += s.b[e];
+                }
+            }
+
+            bx += lanes;
+            for (int e = 0; e < 3; ++e)
+                w_blk[e] += s.a[e] * lanes;
+        }
+
+        for (int e = 0; e < 3; ++e)
+            w_row[e] += s.b[e] * B3D_EDGE_BLOCK_H;
+    }
+    return true;
+}
+
+/* Hierarchical Z
+ *
+ * One farthest-depth value and one dirty flag per B3D_HIZ_TILE block, in a
+ * caller buffer. Rasterizing only ever lowers stored depth, so a stale
+ * maximum is still an upper bound: drawing just flags the blocks a triangle
+ * may touch, and flagged blocks are re-scanned when next tested. Binned
+ * tiles are made of whole blocks, so flush workers never share one.
+ */
+
+/* Alignment of the structures placed in caller memory */
+#define B3D_ARENA_ALIGN 16
+
+#define B3D_ALIGN_UP(n) \
+    (((n) + (B3D_ARENA_ALIGN - 1)) & ~(size_t) (B3D_ARENA_ALIGN - 1))
+
+struct b3d_hiz {
+    size_t size; /* bytes of caller memory from the start of this struct */
+    int tiles_x, tiles_y;
+    b3d_scalar_t *max; /* farthest depth per block */
+    uint8_t *dirty;    /* written since @max was computed */
+};
+
+/* Lay out the block tables for a @w x @h framebuffer and flag every block.
+ * Returns false if they do not fit.
+ */
+static bool b3d_hiz_layout(struct b3d_hiz *hiz, int w, int h)
+{
+    int tx = (w - 1) / B3D_HIZ_TILE + 1, ty = (h - 1) / B3D_HIZ_TILE + 1;
+    size_t count = (size_t) tx * (size_t) ty;
+    size_t header = B3D_ALIGN_UP(sizeof(struct b3d_hiz));
+    size_t table = B3D_ALIGN_UP(count * sizeof(b3d_scalar_t));
+    if (hiz->size < header || table > hiz->size - header ||
+        count > hiz->size - header - table)
+        return false;
+
+    hiz->tiles_x = tx;
+    hiz->tiles_y = ty;
+    hiz->max = (b3d_scalar_t *) ((unsigned char *) hiz + header);
+    hiz->dirty = (uint8_t *) hiz + header + table;
+    memset(hiz->dirty, 1, count);
+    return true;
+}
+
+/* Reset all blocks to the cleared depth */
+static void b3d_hiz_reset(struct b3d_hiz *hiz)
+{
+    size_t count = (size_t) hiz->tiles_x * (size_t) hiz->tiles_y;
+    b3d_scalar_t far = b3d_depth_load(B3D_DEPTH_CLEAR);
+    for (size_t i = 0; i < count; ++i)
+        hiz->max[i] = far;
+    memset(hiz->dirty, 0, count);
+}
+
+/* Account for the depth of pixels in @r being reset to the cleared value:
+ * that is as far as depth goes, so it bounds every block @r touches.
+ */
+static void b3d_hiz_clear_rect(struct b3d_hiz *hiz, const raster_clip_t *r)
+{
+    b3d_scalar_t far = b3d_depth_load(B3D_DEPTH_CLEAR);
+    int tx0 = r->x0 / B3D_HIZ_TILE, tx1 = (r->x1 - 1) / B3D_HIZ_TILE;
+    int ty0 = r->y0 / B3D_HIZ_TILE, ty1 = (r->y1 - 1) / B3D_HIZ_TILE;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx)
+            hiz->max[(size_t) ty * (size_t) hiz->tiles_x + tx] = far;
+    }
+}
+
+/* Pixels [x0, x1) x [y0, y1) inside @clip that either rasterizer may write
+ * for triangle @v. Returns false if there are none.
+ */
+static bool raster_bounds(const raster_vertex_t v[3],
+                          const raster_clip_t *clip,
+                          raster_clip_t *out)
+{
+    b3d_scalar_t min_x = b3d_fp_min(b3d_fp_min(v[0].x, v[1].x), v[2].x);
+    b3d_scalar_t max_x = b3d_fp_max(b3d_fp_max(v[0].x, v[1].x), v[2].x);
+    b3d_scalar_t min_y = b3d_fp_min(b3d_fp_min(v[0].y, v[1].y), v[2].y);
+    b3d_scalar_t max_y = b3d_fp_max(b3d_fp_max(v[0].y, v[1].y), v[2].y);
+
+    /* Spans may start a pixel left of the bounding box due to rounding */
+    int x0 = B3D_FP_TO_INT(B3D_FP_FLOOR(min_x)) - 1;
+    int x1 = B3D_FP_TO_INT(B3D_FP_FLOOR(max_x)) + 1;
+    int y0 = B3D_FP_TO_INT(B3D_FP_FLOOR(min_y));
+    int y1 = B3D_FP_TO_INT(B3D_FP_FLOOR(max_y)) + 1;
+    out->x0 = x0 > clip->x0 ? x0 : clip->x0;
+    out->y0 = y0 > clip->y0 ? y0 : clip->y0;
+    out->x1 = x1 < clip->x1 ? x1 : clip->x1;
+    out->y1 = y1 < clip->y1 ? y1 : clip->y1;
+    return out->x0 < out->x1 && out->y0 < out->y1;
+}
+
+/* Farthest depth stored in block (@tx, @ty), re-scanned if flagged */
+static b3d_scalar_t b3d_hiz_max(const b3d_context_t *ctx, int tx, int ty)
+{
+    struct b3d_hiz *hiz = ctx->hiz;
+    size_t i = (size_t) ty * (size_t) hiz->tiles_x + (size_t) tx;
+    if (hiz->dirty[i]) {
+        int x0 = tx * B3D_HIZ_TILE, y0 = ty * B3D_HIZ_TILE;
+        int x1 = b3d_clamp_int(x0 + B3D_HIZ_TILE, 0, ctx->width);
+        int y1 = b3d_clamp_int(y0 + B3D_HIZ_TILE, 0, ctx->height);
+        b3d_depth_t far = ctx->depth[(size_t) y0 * ctx->width + x0];
+        for (int y = y0; y < y1; ++y) {
+            const b3d_depth_t *row = ctx->depth + (size_t) y * ctx->width;
+            for (int x = x0; x < x1; ++x)
+                far = row[x] > far ? row[x] : far;
+        }
+        hiz->max[i] = b3d_depth_load(far);
+        hiz->dirty[i] = 0;
+    }
+    return hiz->max[i];
+}
+
+/* Shrink @clip to the blocks in which triangle @v may pass the depth test.
+ * Returns false if it passes nowhere inside @clip.
+ */
+static bool b3d_hiz_test(const b3d_context_t *ctx,
+                         raster_clip_t *clip,
+                         const raster_vertex_t v[3])
+{
+    /* The depth buffer bounds nothing the depth test does not compare */
+    const int func = b3d_depth_func(ctx->raster_state);
+    if (func == B3D_DEPTH_ALWAYS)
+        return true;
+
+    raster_clip_t r;
+    if (!raster_bounds(v, clip, &r))
+        return true; /* Nothing to draw, not an occlusion */
+
+    /* Interpolated depth may round below the nearest vertex by about an ulp
+     * per pixel walked
+     */
+    b3d_scalar_t z = b3d_fp_min(b3d_fp_min(v[0].z, v[1].z), v[2].z);
+    b3d_scalar_t ext_x = b3d_fp_max(b3d_fp_max(v[0].x, v[1].x), v[2].x) -
+                         b3d_fp_min(b3d_fp_min(v[0].x, v[1].x), v[2].x);
+    b3d_scalar_t ext_y = b3d_fp_max(b3d_fp_max(v[0].y, v[1].y), v[2].y) -
+                         b3d_fp_min(b3d_fp_min(v[0].y, v[1].y), v[2].y);
+    int walk = B3D_FP_TO_INT(ext_x) + B3D_FP_TO_INT(ext_y) + 2;
+#ifdef B3D_FLOAT_POINT
+    z -= (float) walk * 2.4e-7f;
+#else
+    z -= 2 * walk;
+#endif
+
+    int tx0 = r.x0 / B3D_HIZ_TILE, tx1 = (r.x1 - 1) / B3D_HIZ_TILE;
+    int ty0 = r.y0 / B3D_HIZ_TILE, ty1 = (r.y1 - 1) / B3D_HIZ_TILE;
+    int vx0 = tx1 + 1, vx1 = tx0 - 1, vy0 = ty1 + 1, vy1 = ty0 - 1;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            b3d_scalar_t max = b3d_hiz_max(ctx, tx, ty);
+            if (!(z < max || (func == B3D_DEPTH_EQUAL && z == max)))
+                continue;
+            vx0 = tx < vx0 ? tx : vx0;
+            vx1 = tx > vx1 ? tx : vx1;
+            vy0 = ty < vy0 ? ty : vy0;
+            vy1 = ty > vy1 ? ty : vy1;
+        }
+    }
+    if (vx0 > vx1)
+        return false;
+
+    /* Leave out the rows and columns of blocks it is hidden in */
+    clip->x0 = b3d_clamp_int(vx0 * B3D_HIZ_TILE, r.x0, r.x1);
+    clip->x1 = b3d_clamp_int((vx1 + 1) * B3D_HIZ_TILE, r.x0, r.x1);
+    clip->y0 = b3d_clamp_int(vy0 * B3D_HIZ_TILE, r.y0, r.y1);
+    clip->y1 = b3d_clamp_int((vy1 + 1) * B3D_HIZ_TILE, r.y0, r.y1);
+    return true;
+}
+
+/* Flag the blocks triangle @v may write inside @clip */
+static void b3d_hiz_touch(struct b3d_hiz *hiz,
+                          const raster_clip_t *clip,
+                          const raster_vertex_t v[3])
+{
+    raster_clip_t r;
+    if (!raster_bounds(v, clip, &r))
+        return;
+    int tx0 = r.x0 / B3D_HIZ_TILE, tx1 = (r.x1 - 1) / B3D_HIZ_TILE;
+    int ty0 = r.y0 / B3D_HIZ_TILE, ty1 = (r.y1 - 1) / B3D_HIZ_TILE;
+    for (int ty = ty0; ty <= ty1; ++ty)
+        memset(hiz->dirty + (size_t) ty * (size_t) hiz->tiles_x + tx0, 1,
+               (size_t) (tx1 - tx0 + 1));
+}
+
+/* Internal rasterization function */
+static void b3d_rasterize(b3d_context_t *ctx,
+                          const raster_clip_t *clip,
+                          const raster_vertex_t v[3],
+                          uint32_t c,
+                          const raster_attr_t *attr)
+{
+    B3D_STAT(clip->stats, triangles_rasterized, 1);
+    if (ctx->hiz && !(ctx->raster_state & B3D_STATE_NO_DEPTH_WRITE))
+        b3d_hiz_touch(ctx->hiz, clip, v);
+    /* Depth only: attributes never change depth, so skip interpolating them
+     * and take the flat kernels
+     */
+    if (ctx->raster_state & B3D_STATE_NO_COLOR_WRITE)
+        attr = NULL;
+    if (ctx->rasterizer == B3D_RASTER_EDGE &&
+        b3d_rasterize_edge(ctx, clip, v, c, attr))
+        return;
+    /* Copy and floor vertices */
+    raster_vertex_t a = {B3D_FP_FLOOR(v[0].x), B3D_FP_FLOOR(v[0].y), v[0].z};
+    raster_vertex_t b = {B3D_FP_FLOOR(v[1].x), B3D_FP_FLOOR(v[1].y), v[1].z};
+    raster_vertex_t cv = {B3D_FP_FLOOR(v[2].x), B3D_FP_FLOOR(v[2].y), v[2].z};
+
+    /* Screen-space AABB early-out */
+    b3d_scalar_t min_x = b3d_fp_min(b3d_fp_min(a.x, b.x), cv.x);
+    b3d_scalar_t max_x = b3d_fp_max(b3d_fp_max(a.x, b.x), cv.x);
+    b3d_scalar_t min_y = b3d_fp_min(b3d_fp_min(a.y, b.y), cv.y);
+    b3d_scalar_t max_y = b3d_fp_max(b3d_fp_max(a.y, b.y), cv.y);
+    if (max_x < 0 || min_x >= B3D_INT_TO_FP(ctx->width) || max_y < 0 ||
+        min_y >= B3D_INT_TO_FP(ctx->height)) {
+        B3D_STAT(clip->stats, triangles_aabb_rejected, 1);
+        return;
+    }
+    /* Only guard-band triangles reach past the screen edges */
+    bool exact = min_x < 0 || min_y < 0 ||
+                 max_x > B3D_INT_TO_FP(ctx->width) ||
+                 max_y > B3D_INT_TO_FP(ctx->height);
 
     /* Sort vertices by Y coordinate (bubble sort for 3 elements) */
     raster_vertex_t tmp;
@@ -300,487 +2267,3477 @@ static void b3d_rasterize(const raster_vertex_t v[3], uint32_t c)
         a = b;
         b = tmp;
     }
-    if (a.y > cv.y) {
-        tmp = a;
-        a = cv;
-        cv = tmp;
+    if (a.y > cv.y) {
+        tmp = a;
+        a = cv;
+        cv = tmp;
+    }
+    if (b.y > cv.y) {
+        tmp = b;
+        b = cv;
+        cv = tmp;
+    }
+
+    /* Guard against degenerate triangles (division by zero) */
+    b3d_scalar_t dy_total = cv.y - a.y;
+    b3d_scalar_t dy_top = b.y - a.y;
+    if (dy_total < B3D_FP_DEGEN_THRESHOLD)
+        return;
+
+    /* Depth gradient, the only 64-bit divide of a fixed-point triangle
+     * unless it reaches past the screen
+     */
+    int64_t fine;
+    b3d_scalar_t dzdx = b3d_plane_dzdx(&a, &b, &cv, &fine);
+
+    /* Setup left edge (A to C, spans entire triangle) */
+    raster_edge_t left = {
+        .x = a.x,
+        .z = a.z,
+        .dx = cv.x - a.x,
+        .dz = cv.z - a.z,
+        .t = 0,
+        .t_step = b3d_edge_step(dy_total),
+        .t_fine = exact ? b3d_edge_fine(dy_total) : 0,
+        .row = B3D_FP_TO_INT(a.y),
+    };
+
+    /* Setup right edge for top half (A to B) */
+    bool top = dy_top > B3D_FP_DEGEN_THRESHOLD;
+    raster_edge_t right = {
+        .x = a.x,
+        .z = a.z,
+        .dx = b.x - a.x,
+        .dz = b.z - a.z,
+        .t = 0,
+        .t_step = top ? b3d_edge_step(dy_top) : 0,
+        .t_fine = top && exact ? b3d_edge_fine(dy_top) : 0,
+        .row = B3D_FP_TO_INT(a.y),
+    };
+
+    /* Rasterize top half: right edge from A toward B */
+    raster_half(ctx, clip, B3D_FP_TO_INT(a.y), B3D_FP_TO_INT(b.y), &left,
+                &right, dzdx, fine, c, attr, exact);
+
+    /* Setup right edge for bottom half (B to C) */
+    b3d_scalar_t dy_bot = cv.y - b.y;
+    bool bot = dy_bot > B3D_FP_DEGEN_THRESHOLD;
+    right = (raster_edge_t) {
+        .x = b.x,
+        .z = b.z,
+        .dx = cv.x - b.x,
+        .dz = cv.z - b.z,
+        .t = 0,
+        .t_step = bot ? b3d_edge_step(dy_bot) : 0,
+        .t_fine = bot && exact ? b3d_edge_fine(dy_bot) : 0,
+        .row = B3D_FP_TO_INT(b.y),
+    };
+
+    /* Rasterize bottom half: right edge from B toward C */
+    raster_half(ctx, clip, B3D_FP_TO_INT(b.y), B3D_FP_TO_INT(cv.y), &left,
+                &right, dzdx, fine, c, attr, exact);
+}
+
+/* Store @n copies of the 32-bit pattern @v at @dst */
+static void b3d_fill32(void *dst, uint32_t v, size_t n)
+{
+    if (v == (v & 0xFF) * 0x01010101u)
+        memset(dst, (int) (v & 0xFF), n * 4);
+    else
+        b3d_kernels->fill32(dst, v, n);
+}
+
+/* Set @n depth values at @dst to B3D_DEPTH_CLEAR */
+static void b3d_fill_depth(b3d_depth_t *dst, size_t n)
+{
+#ifdef B3D_DEPTH_16BIT
+    memset(dst, 0xFF, n * sizeof(*dst)); /* B3D_DEPTH_CLEAR is 0xFFFF */
+#else
+    b3d_depth_t far = B3D_DEPTH_CLEAR;
+    uint32_t bits;
+    memcpy(&bits, &far, sizeof(bits));
+    b3d_fill32(dst, bits, n);
+#endif
+}
+
+/* Store @n copies of the 16-bit pattern @v at @dst, which is 2-aligned */
+static void b3d_fill16(void *dst, uint16_t v, size_t n)
+{
+    unsigned char *p = dst;
+    if (n > 0 && ((uintptr_t) p & 2)) {
+        memcpy(p, &v, 2);
+        p += 2, n--;
+    }
+    b3d_fill32(p, v * 0x10001u, n / 2);
+    if (n & 1)
+        memcpy(p + (n - 1) * 2, &v, 2);
+}
+
+/* Fill [x0, x1) x [y0, y1) of @r with @color in the pixel format of @ctx */
+static void b3d_fill_pixels(b3d_context_t *ctx,
+                            const raster_clip_t *r,
+                            uint32_t color)
+{
+    const int format = ctx->pixel_format;
+    const uint32_t v = b3d_pack_color(format, color);
+    size_t n = (size_t) (r->x1 - r->x0);
+    int rows = r->y1 - r->y0;
+    /* Whole rows without padding are one long row */
+    if (n * b3d_format_bytes(format) == ctx->pixel_stride) {
+        n *= (size_t) rows;
+        rows = 1;
+    }
+    for (int y = r->y0; y < r->y0 + rows; ++y) {
+        unsigned char *p = b3d_pixel_addr(ctx, r->x0, y);
+        if (format == B3D_FORMAT_RGB565)
+            b3d_fill16(p, (uint16_t) v, n);
+        else if (format == B3D_FORMAT_RGB332)
+            memset(p, (int) v, n);
+        else
+            b3d_fill32(p, v, n);
+    }
+}
+
+/* Fill [x0, x1) x [y0, y1) of @r with @color and the cleared depth */
+static void b3d_fill_rect(b3d_context_t *ctx,
+                          const raster_clip_t *r,
+                          uint32_t color)
+{
+    /* B3D_DEPTH_CLEAR is behind every epoch, no need to start a new one */
+    size_t n = (size_t) (r->x1 - r->x0);
+    b3d_fill_pixels(ctx, r, color);
+    for (int y = r->y0; y < r->y1; ++y) {
+        size_t row = (size_t) y * (size_t) ctx->width + (size_t) r->x0;
+        b3d_fill_depth(ctx->depth + row, n);
+    }
+    if (ctx->hiz)
+        b3d_hiz_clear_rect(ctx->hiz, r);
+}
+
+/* Tile diffing
+ *
+ * Binning already sorts each frame's input by tile. With a diff buffer set,
+ * every tile also hashes the set-up triangles queued into it since the last
+ * b3d_clear(). That clear leaves the framebuffer alone; the first flush
+ * after it clears and redraws only the tiles whose hash differs from the
+ * previous frame's, and keeps the rest as they are: the same triangles
+ * drawn onto the same cleared tile leave the same pixels and depth. Anything
+ * else that writes the framebuffer invalidates the kept tiles.
+ */
+
+#define B3D_HASH_SEED 0xcbf29ce484222325ull  /* FNV-1a offset basis */
+#define B3D_HASH_PRIME 0x100000001b3ull      /* FNV-1a prime */
+
+struct b3d_diff {
+    size_t size; /* bytes of caller memory from the start of this struct */
+    int tiles_x, tiles_y;
+    uint64_t *hash; /* input of every tile since the last clear */
+    uint64_t *prev; /* @hash as of the last flush */
+    uint8_t *dirty; /* tile redrawn since the last clear */
+    bool pending;   /* cleared, tiles not yet cleared or kept */
+    bool valid;     /* the framebuffer shows what @prev describes */
+};
+
+/* Lay out the tables for a @w x @h framebuffer, all tiles to be redrawn.
+ * Returns false if they do not fit.
+ */
+static bool b3d_diff_layout(struct b3d_diff *diff, int w, int h)
+{
+    int tx = (w + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE;
+    int ty = (h + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE;
+    size_t count = (size_t) tx * (size_t) ty;
+    size_t header = B3D_ALIGN_UP(sizeof(struct b3d_diff));
+    size_t table = B3D_ALIGN_UP(count * sizeof(uint64_t));
+    if (diff->size < header || table > (diff->size - header) / 2 ||
+        count > diff->size - header - 2 * table)
+        return false;
+
+    unsigned char *p = (unsigned char *) diff + header;
+    diff->tiles_x = tx;
+    diff->tiles_y = ty;
+    diff->hash = (uint64_t *) p;
+    diff->prev = (uint64_t *) (p + table);
+    diff->dirty = p + 2 * table;
+    for (size_t i = 0; i < count; ++i)
+        diff->hash[i] = diff->prev[i] = B3D_HASH_SEED;
+    memset(diff->dirty, 0, count);
+    diff->pending = false;
+    diff->valid = false;
+    return true;
+}
+
+/* Make the next cleared frame redraw every tile */
+static void b3d_diff_invalidate(b3d_context_t *ctx)
+{
+    if (ctx->diff)
+        ctx->diff->valid = false;
+}
+
+/* FNV-1a over the @n bytes at @p, @n a multiple of four, a word at a time */
+static uint64_t b3d_hash_words(uint64_t h, const void *p, size_t n)
+{
+    const unsigned char *b = p;
+    for (size_t i = 0; i + 4 <= n; i += 4) {
+        uint32_t w;
+        memcpy(&w, b + i, 4);
+        h = (h ^ w) * B3D_HASH_PRIME;
+    }
+    return h;
+}
+
+/* Append triangle hash @t to tile hash @h (splitmix64 finalizer) */
+static uint64_t b3d_hash_append(uint64_t h, uint64_t t)
+{
+    h ^= t;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+/* Hash everything that decides the pixels a set-up triangle draws */
+static uint64_t b3d_hash_tri(const b3d_context_t *ctx,
+                             const raster_vertex_t v[3],
+                             uint32_t c,
+                             const raster_attr_t *attr)
+{
+    uint32_t mode[3] = {c, (uint32_t) ctx->rasterizer, ctx->raster_state};
+    uint64_t h = b3d_hash_words(B3D_HASH_SEED, v, 3 * sizeof(*v));
+    h = b3d_hash_words(h, mode, sizeof(mode));
+    if (attr) {
+        /* Texels are identified by address, see b3d_invalidate_tiles() */
+        uint64_t texels = (uint64_t) (uintptr_t) attr->tex.texels;
+        int32_t tex[4] = {attr->tex.width, attr->tex.height, attr->tex.levels,
+                          attr->tex.filter};
+        h = b3d_hash_words(h, attr->q, sizeof(attr->q));
+        h = b3d_hash_words(h, attr->dx, sizeof(attr->dx));
+        h = b3d_hash_words(h, attr->dy, sizeof(attr->dy));
+        h = b3d_hash_words(h, &texels, sizeof(texels));
+        h = b3d_hash_words(h, tex, sizeof(tex));
+    }
+    return h;
+}
+
+/* Tile binning
+ *
+ * The arena starts with struct b3d_bins and the per-tile list heads; the rest
+ * is a bump allocator for set-up triangles and the chunks of triangle
+ * pointers that make up each tile's list. Lists are appended in submission
+ * order. Flushing rasterizes every tile clipped to its rectangle, then resets
+ * the allocator.
+ */
+
+#define B3D_BIN_CHUNK 30 /* triangle pointers per chunk */
+
+/* A triangle after clipping and fixed-point conversion */
+typedef struct {
+    raster_vertex_t v[3];
+    uint32_t c;
+    const raster_attr_t *attr; /* copied into the arena, NULL if flat */
+} b3d_bin_tri_t;
+
+typedef struct b3d_bin_chunk {
+    struct b3d_bin_chunk *next;
+    int count;
+    const b3d_bin_tri_t *tri[B3D_BIN_CHUNK];
+} b3d_bin_chunk_t;
+
+typedef struct {
+    b3d_bin_chunk_t *head, *tail;
+} b3d_bin_tile_t;
+
+struct b3d_bins {
+    unsigned char *arena; /* caller memory, struct b3d_bins lives here */
+    size_t arena_size;
+    b3d_bin_tile_t *tiles;
+    int tiles_x, tiles_y;
+    unsigned char *base, *cur, *end; /* bump allocator */
+    int threads;
+#ifdef B3D_THREADS
+    b3d_context_t *ctx;
+    pthread_t workers[B3D_MAX_THREADS];
+    int nworkers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    unsigned job;  /* bumped to start a flush */
+    int next_tile; /* next tile to hand out */
+    int busy;      /* workers still rasterizing */
+    bool quit;
+#endif
+};
+
+/* Lay out the tile table for a @w x @h framebuffer.
+ * Returns false if the arena cannot hold the table plus one chunk.
+ */
+static bool b3d_bins_layout(struct b3d_bins *bins, int w, int h)
+{
+    int tx = (w + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE;
+    int ty = (h + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE;
+    size_t header = B3D_ALIGN_UP(sizeof(struct b3d_bins));
+    size_t table = B3D_ALIGN_UP((size_t) tx * (size_t) ty *
+                                sizeof(b3d_bin_tile_t));
+    size_t min_pool = sizeof(b3d_bin_tri_t) + sizeof(b3d_bin_chunk_t);
+    if (bins->arena_size < header || table > bins->arena_size - header ||
+        min_pool > bins->arena_size - header - table)
+        return false;
+
+    bins->tiles = (b3d_bin_tile_t *) (bins->arena + header);
+    bins->tiles_x = tx;
+    bins->tiles_y = ty;
+    bins->base = bins->arena + header + table;
+    bins->end = bins->arena + bins->arena_size;
+    bins->cur = bins->base;
+    memset(bins->tiles, 0, (size_t) tx * (size_t) ty * sizeof(b3d_bin_tile_t));
+    return true;
+}
+
+/* True if an empty arena holds a triangle with attributes that covers every
+ * tile, so binning never has to fall back to drawing it directly
+ */
+static bool b3d_bins_fit_screen(const struct b3d_bins *bins)
+{
+    size_t need = B3D_ALIGN_UP(sizeof(b3d_bin_tri_t)) +
+                  B3D_ALIGN_UP(sizeof(raster_attr_t)) +
+                  (size_t) bins->tiles_x * (size_t) bins->tiles_y *
+                      B3D_ALIGN_UP(sizeof(b3d_bin_chunk_t));
+    return need <= (size_t) (bins->end - bins->base);
+}
+
+/* Drop all queued triangles */
+static void b3d_bins_reset(struct b3d_bins *bins)
+{
+    if (bins->cur == bins->base)
+        return;
+    memset(bins->tiles, 0,
+           (size_t) bins->tiles_x * (size_t) bins->tiles_y *
+               sizeof(b3d_bin_tile_t));
+    bins->cur = bins->base;
+}
+
+static void *b3d_bins_alloc(struct b3d_bins *bins, size_t size)
+{
+    size = B3D_ALIGN_UP(size);
+    if (size > (size_t) (bins->end - bins->cur))
+        return NULL;
+    void *p = bins->cur;
+    bins->cur += size;
+    return p;
+}
+
+/* Rasterize the queued triangles of tile @i, counting into @stats */
+static void b3d_bins_raster_tile(b3d_context_t *ctx,
+                                 int i,
+                                 b3d_stats_t *stats)
+{
+    const struct b3d_bins *bins = ctx->bins;
+    int tx = i % bins->tiles_x, ty = i / bins->tiles_x;
+    raster_clip_t clip = {
+        .x0 = tx * B3D_TILE_SIZE,
+        .y0 = ty * B3D_TILE_SIZE,
+        .x1 = b3d_clamp_int((tx + 1) * B3D_TILE_SIZE, 0, ctx->width),
+        .y1 = b3d_clamp_int((ty + 1) * B3D_TILE_SIZE, 0, ctx->height),
+    };
+#ifdef B3D_STATS
+    clip.stats = stats;
+#else
+    (void) stats;
+#endif
+    struct b3d_diff *diff = ctx->diff;
+    if (diff) {
+        if (diff->pending) {
+            /* Same input as last frame onto the same cleared tile */
+            if (diff->valid && diff->hash[i] == diff->prev[i])
+                return;
+            b3d_fill_rect(ctx, &clip, 0);
+            diff->dirty[i] = 1;
+        } else if (bins->tiles[i].head) {
+            diff->dirty[i] = 1;
+        }
+        diff->prev[i] = diff->hash[i];
+    }
+    for (const b3d_bin_chunk_t *ch = bins->tiles[i].head; ch; ch = ch->next) {
+        for (int k = 0; k < ch->count; ++k) {
+            const b3d_bin_tri_t *t = ch->tri[k];
+            raster_clip_t r = clip;
+            /* Earlier triangles of this tile may hide it by now */
+            if (ctx->hiz && !b3d_hiz_test(ctx, &r, t->v)) {
+                B3D_STAT(stats, triangles_hiz_rejected, 1);
+                continue;
+            }
+            b3d_rasterize(ctx, &r, t->v, t->c, t->attr);
+        }
+    }
+}
+
+#ifdef B3D_STATS
+/* Add the rasterizer counters of @src to @dst */
+static void b3d_stats_merge(b3d_stats_t *dst, const b3d_stats_t *src)
+{
+    dst->triangles_hiz_rejected += src->triangles_hiz_rejected;
+    dst->triangles_rasterized += src->triangles_rasterized;
+    dst->triangles_aabb_rejected += src->triangles_aabb_rejected;
+    dst->spans += src->spans;
+    dst->pixels_tested += src->pixels_tested;
+    dst->pixels_written += src->pixels_written;
+}
+#endif
+
+#ifdef B3D_THREADS
+/* Rasterize tiles until none are left; shared by workers and the caller */
+static void b3d_bins_work(struct b3d_bins *bins)
+{
+    const int count = bins->tiles_x * bins->tiles_y;
+    b3d_stats_t stats = {0};
+    for (;;) {
+        pthread_mutex_lock(&bins->lock);
+        int i = bins->next_tile++;
+        pthread_mutex_unlock(&bins->lock);
+        if (i >= count)
+            break;
+        b3d_bins_raster_tile(bins->ctx, i, &stats);
+    }
+#ifdef B3D_STATS
+    pthread_mutex_lock(&bins->lock);
+    b3d_stats_merge(&bins->ctx->stats, &stats);
+    pthread_mutex_unlock(&bins->lock);
+#endif
+}
+
+static void *b3d_bins_worker(void *arg)
+{
+    struct b3d_bins *bins = arg;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&bins->lock);
+        while (!bins->quit && bins->job == seen)
+            pthread_cond_wait(&bins->wake, &bins->lock);
+        if (bins->quit) {
+            pthread_mutex_unlock(&bins->lock);
+            break;
+        }
+        seen = bins->job;
+        pthread_mutex_unlock(&bins->lock);
+
+        b3d_bins_work(bins);
+
+        pthread_mutex_lock(&bins->lock);
+        if (--bins->busy == 0)
+            pthread_cond_signal(&bins->done);
+        pthread_mutex_unlock(&bins->lock);
+    }
+    return NULL;
+}
+
+static void b3d_bins_start_workers(struct b3d_bins *bins)
+{
+    bins->nworkers = 0;
+    bins->job = 0;
+    bins->quit = false;
+    if (bins->threads <= 1)
+        return;
+    pthread_mutex_init(&bins->lock, NULL);
+    pthread_cond_init(&bins->wake, NULL);
+    pthread_cond_init(&bins->done, NULL);
+    /* Fewer workers than requested is fine, the caller always helps out */
+    while (bins->nworkers < bins->threads - 1 &&
+           pthread_create(&bins->workers[bins->nworkers], NULL,
+                          b3d_bins_worker, bins) == 0)
+        bins->nworkers++;
+}
+
+static void b3d_bins_stop_workers(struct b3d_bins *bins)
+{
+    if (bins->threads <= 1)
+        return;
+    pthread_mutex_lock(&bins->lock);
+    bins->quit = true;
+    pthread_cond_broadcast(&bins->wake);
+    pthread_mutex_unlock(&bins->lock);
+    for (int i = 0; i < bins->nworkers; ++i)
+        pthread_join(bins->workers[i], NULL);
+    pthread_cond_destroy(&bins->done);
+    pthread_cond_destroy(&bins->wake);
+    pthread_mutex_destroy(&bins->lock);
+    bins->nworkers = 0;
+}
+#endif
+
+/* Done with the first flush after a cleared frame */
+static void b3d_diff_flushed(struct b3d_diff *diff)
+{
+    if (diff && diff->pending) {
+        diff->pending = false;
+        diff->valid = true;
+    }
+}
+
+static void b3d_frames_sync(b3d_context_t *ctx);
+
+/* Rasterize and drop all queued triangles */
+static void b3d_bins_flush(b3d_context_t *ctx)
+{
+    struct b3d_bins *bins = ctx->bins;
+    /* A cleared frame still has to clear its changed tiles */
+    if (bins->cur == bins->base && !(ctx->diff && ctx->diff->pending))
+        return;
+    if (ctx->frames)
+        b3d_frames_sync(ctx);
+
+    B3D_STAT_TIMER(&ctx->stats, tm);
+#ifdef B3D_THREADS
+    if (bins->nworkers > 0) {
+        pthread_mutex_lock(&bins->lock);
+        bins->ctx = ctx;
+        bins->next_tile = 0;
+        bins->busy = bins->nworkers;
+        bins->job++;
+        pthread_cond_broadcast(&bins->wake);
+        pthread_mutex_unlock(&bins->lock);
+
+        b3d_bins_work(bins);
+
+        pthread_mutex_lock(&bins->lock);
+        while (bins->busy > 0)
+            pthread_cond_wait(&bins->done, &bins->lock);
+        pthread_mutex_unlock(&bins->lock);
+        b3d_bins_reset(bins);
+        b3d_diff_flushed(ctx->diff);
+        B3D_STAT_LAP(&ctx->stats, raster_ns, tm);
+        return;
+    }
+#endif
+    b3d_stats_t *stats = NULL;
+#ifdef B3D_STATS
+    stats = &ctx->stats;
+#endif
+    for (int i = 0; i < bins->tiles_x * bins->tiles_y; ++i)
+        b3d_bins_raster_tile(ctx, i, stats);
+    b3d_bins_reset(bins);
+    b3d_diff_flushed(ctx->diff);
+    B3D_STAT_LAP(&ctx->stats, raster_ns, tm);
+}
+
+/* Queue a set-up triangle into every tile its bounding box touches.
+ * Returns false if it cannot be queued even into an empty arena.
+ */
+static bool b3d_bins_add(b3d_context_t *ctx,
+                         const raster_vertex_t v[3],
+                         uint32_t c,
+                         const raster_attr_t *attr)
+{
+    struct b3d_bins *bins = ctx->bins;
+    raster_clip_t r;
+    raster_clip_t screen = {.x1 = ctx->width, .y1 = ctx->height};
+    if (!raster_bounds(v, &screen, &r))
+        return true;
+    int tx0 = r.x0 / B3D_TILE_SIZE, tx1 = (r.x1 - 1) / B3D_TILE_SIZE;
+    int ty0 = r.y0 / B3D_TILE_SIZE, ty1 = (r.y1 - 1) / B3D_TILE_SIZE;
+
+    /* Reserve the worst case up front so a triangle is never half-queued */
+    size_t need = B3D_ALIGN_UP(sizeof(b3d_bin_tri_t)) +
+                  (attr ? B3D_ALIGN_UP(sizeof(raster_attr_t)) : 0) +
+                  (size_t) (tx1 - tx0 + 1) * (size_t) (ty1 - ty0 + 1) *
+                      B3D_ALIGN_UP(sizeof(b3d_bin_chunk_t));
+    if (need > (size_t) (bins->end - bins->cur)) {
+        b3d_bins_flush(ctx);
+        if (need > (size_t) (bins->end - bins->cur))
+            return false;
+    }
+
+    b3d_bin_tri_t *t = b3d_bins_alloc(bins, sizeof(*t));
+    memcpy(t->v, v, sizeof(t->v));
+    t->c = c;
+    t->attr = NULL;
+    if (attr) {
+        raster_attr_t *a = b3d_bins_alloc(bins, sizeof(*a));
+        *a = *attr;
+        t->attr = a;
+    }
+    struct b3d_diff *diff = ctx->diff;
+    uint64_t hash = diff ? b3d_hash_tri(ctx, v, c, attr) : 0;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            int i = ty * bins->tiles_x + tx;
+            b3d_bin_tile_t *tile = &bins->tiles[i];
+            if (diff)
+                diff->hash[i] = b3d_hash_append(diff->hash[i], hash);
+            b3d_bin_chunk_t *ch = tile->tail;
+            if (!ch || ch->count == B3D_BIN_CHUNK) {
+                ch = b3d_bins_alloc(bins, sizeof(*ch));
+                ch->next = NULL;
+                ch->count = 0;
+                if (tile->tail)
+                    tile->tail->next = ch;
+                else
+                    tile->head = ch;
+                tile->tail = ch;
+            }
+            ch->tri[ch->count++] = t;
+        }
+    }
+    return true;
+}
+
+/* Frame pipeline
+ *
+ * Two frame packets, each a tile arena and a framebuffer, take turns being
+ * recorded and rasterized. A submitted packet is rasterized from a copy of
+ * the context taken at submission, by the rasterizer thread with
+ * B3D_THREADS or right away otherwise. The depth buffer and HiZ are shared:
+ * packets are rasterized one after the other, and recording leaves both
+ * alone until the rasterizer is idle, so clears are deferred to it as well.
+ */
+
+#define B3D_FRAME_QUEUED 1 /* submitted, not rasterized yet */
+#define B3D_FRAME_DONE 2   /* rasterized */
+
+struct b3d_frame {
+    struct b3d_bins *bins;
+    void *pixels;
+    int state;         /* B3D_FRAME_*, 0 before the first submission */
+    bool clear;        /* clear before rasterizing */
+    bool clear_depth;  /* fill the depth buffer with that clear */
+    b3d_context_t ctx; /* what the rasterizer works on */
+};
+
+struct b3d_frames {
+    struct b3d_frame frame[2];
+    int next;      /* packet the next frame records into */
+    int recording; /* packet being recorded, -1 outside a frame */
+    int oldest;    /* oldest packet not returned by frame_wait */
+    int pending;   /* packets submitted and not returned */
+#ifdef B3D_THREADS
+    pthread_t thread;
+    pthread_mutex_t lock; /* guards the packet states */
+    pthread_cond_t wake, done;
+    bool running; /* false if the thread could not be started */
+    bool quit;
+#endif
+};
+
+/* Clear the framebuffer of @ctx for a frame, see b3d_ctx_clear() */
+static void b3d_frame_clear(b3d_context_t *ctx, bool depth)
+{
+    b3d_fill_pixels(
+        ctx, &(raster_clip_t) {.x1 = ctx->width, .y1 = ctx->height}, 0);
+    if (depth)
+        b3d_fill_depth(ctx->depth, (size_t) ctx->width * (size_t) ctx->height);
+    if (ctx->hiz)
+        b3d_hiz_reset(ctx->hiz);
+}
+
+static void b3d_frame_raster(struct b3d_frame *f)
+{
+    if (f->clear)
+        b3d_frame_clear(&f->ctx, f->clear_depth);
+    b3d_bins_flush(&f->ctx);
+}
+
+#ifdef B3D_THREADS
+/* Rasterize packets in submission order, which alternates between the two */
+static void *b3d_frames_thread(void *arg)
+{
+    struct b3d_frames *frames = arg;
+    int i = 0;
+    pthread_mutex_lock(&frames->lock);
+    for (;;) {
+        while (!frames->quit && frames->frame[i].state != B3D_FRAME_QUEUED)
+            pthread_cond_wait(&frames->wake, &frames->lock);
+        if (frames->quit)
+            break;
+        pthread_mutex_unlock(&frames->lock);
+
+        b3d_frame_raster(&frames->frame[i]);
+
+        pthread_mutex_lock(&frames->lock);
+        frames->frame[i].state = B3D_FRAME_DONE;
+        pthread_cond_broadcast(&frames->done);
+        i ^= 1;
+    }
+    pthread_mutex_unlock(&frames->lock);
+    return NULL;
+}
+
+/* Wait until no submitted packet is left to rasterize */
+static void b3d_frames_idle(struct b3d_frames *frames)
+{
+    if (!frames->running)
+        return;
+    pthread_mutex_lock(&frames->lock);
+    while (frames->frame[0].state == B3D_FRAME_QUEUED ||
+           frames->frame[1].state == B3D_FRAME_QUEUED)
+        pthread_cond_wait(&frames->done, &frames->lock);
+    pthread_mutex_unlock(&frames->lock);
+}
+#endif
+
+/* Make the framebuffer of the frame being recorded safe to use directly:
+ * wait for the submitted frames, then apply a deferred clear
+ */
+static void b3d_frames_sync(b3d_context_t *ctx)
+{
+    struct b3d_frames *frames = ctx->frames;
+#ifdef B3D_THREADS
+    b3d_frames_idle(frames);
+#endif
+    if (frames->recording < 0)
+        return;
+    struct b3d_frame *f = &frames->frame[frames->recording];
+    if (f->clear)
+        b3d_frame_clear(ctx, f->clear_depth);
+    f->clear = f->clear_depth = false;
+}
+
+/* Flush, then wait until the framebuffer is no longer rasterized into */
+static void b3d_ctx_finish(b3d_context_t *ctx)
+{
+    b3d_ctx_flush(ctx);
+    if (ctx->frames)
+        b3d_frames_sync(ctx);
+}
+
+/* Context API */
+
+b3d_context_t *b3d_get_default_context(void)
+{
+    return &b3d_default_ctx;
+}
+
+/* Convert a clipped screen-space triangle to fixed-point and rasterize it */
+static void b3d_raster_screen_tri(b3d_context_t *ctx,
+                                  const b3d_triangle_t *t,
+                                  uint32_t c,
+                                  const raster_attr_t *attr)
+{
+    /* Outside a frame there is no framebuffer to draw into */
+    if (ctx->frames && ctx->frames->recording < 0)
+        return;
+    raster_vertex_t rv[3] = {
+        {B3D_FLOAT_TO_FP(t->p[0].x), B3D_FLOAT_TO_FP(t->p[0].y),
+         b3d_ctx_depth(ctx, t->p[0].z)},
+        {B3D_FLOAT_TO_FP(t->p[1].x), B3D_FLOAT_TO_FP(t->p[1].y),
+         b3d_ctx_depth(ctx, t->p[1].z)},
+        {B3D_FLOAT_TO_FP(t->p[2].x), B3D_FLOAT_TO_FP(t->p[2].y),
+         b3d_ctx_depth(ctx, t->p[2].z)},
+    };
+    B3D_STAT_TIMER(&ctx->stats, tm);
+    raster_clip_t clip = {.x1 = ctx->width, .y1 = ctx->height};
+#ifdef B3D_STATS
+    clip.stats = &ctx->stats;
+#endif
+    /* With frames pipelined, HiZ belongs to the rasterizer thread */
+    if (ctx->hiz && !ctx->frames && !b3d_hiz_test(ctx, &clip, rv)) {
+        ++ctx->hiz_reject_count;
+        B3D_STAT(&ctx->stats, triangles_hiz_rejected, 1);
+    } else if (!ctx->bins || !b3d_bins_add(ctx, rv, c, attr)) {
+        /* Drawn outside the hashed tile input */
+        b3d_diff_invalidate(ctx);
+        b3d_rasterize(ctx, &clip, rv, c, attr);
+    }
+    B3D_STAT_LAP(&ctx->stats, raster_ns, tm);
+}
+
+/* True if all vertices lie inside the four screen clipping planes, in which
+ * case clipping would return the triangle unchanged.
+ */
+static inline bool b3d_inside_screen(const b3d_context_t *ctx,
+                                     const b3d_triangle_t *t)
+{
+    const float x0 = ctx->screen_planes[2][0].x;
+    const float x1 = ctx->screen_planes[3][0].x;
+    const float y0 = ctx->screen_planes[0][0].y;
+    const float y1 = ctx->screen_planes[1][0].y;
+    for (int i = 0; i < 3; ++i) {
+        const b3d_vec_t *p = &t->p[i];
+        if (p->x < x0 || p->x > x1 || p->y < y0 || p->y > y1)
+            return false;
+    }
+    return true;
+}
+
+/* True if all vertices lie beyond the same screen edge, in which case the
+ * triangle covers no pixel center, guard band or not.
+ */
+static inline bool b3d_outside_screen(const b3d_context_t *ctx,
+                                      const b3d_triangle_t *t)
+{
+    const float w = (float) ctx->width, h = (float) ctx->height;
+    const b3d_vec_t *a = &t->p[0], *b = &t->p[1], *c = &t->p[2];
+    return (a->x < 0.5f && b->x < 0.5f && c->x < 0.5f) ||
+           (a->x > w && b->x > w && c->x > w) ||
+           (a->y < 0.5f && b->y < 0.5f && c->y < 0.5f) ||
+           (a->y > h && b->y > h && c->y > h);
+}
+
+/* Clip screen-space triangles against the screen edges and rasterize them.
+ * @src: @src_count input triangles, also used as scratch
+ * @dst: scratch buffer; both hold B3D_CLIP_BUFFER_SIZE triangles
+ * @attr: attribute planes shared by all pieces, NULL for flat @c
+ *
+ * Returns true if anything survived clipping.
+ */
+static bool b3d_clip_screen(b3d_context_t *ctx,
+                            b3d_triangle_t *src,
+                            b3d_triangle_t *dst,
+                            int src_count,
+                            uint32_t c,
+                            const raster_attr_t *attr)
+{
+    /* Common cases: nothing to draw, or nothing to clip */
+    if (src_count == 1 && b3d_outside_screen(ctx, &src[0]))
+        return false;
+    if (src_count == 1 && b3d_inside_screen(ctx, &src[0])) {
+        b3d_raster_screen_tri(ctx, &src[0], c, attr);
+        return true;
+    }
+
+    B3D_STAT(&ctx->stats, triangles_screen_clipped, src_count);
+    b3d_triangle_t clipped[2];
+    for (int p = 0; p < 4; ++p) {
+        int dst_count = 0;
+        for (int i = 0; i < src_count; ++i) {
+            int n = b3d_clip_against_plane(ctx->screen_planes[p][0],
+                                           ctx->screen_planes[p][1], src[i],
+                                           clipped);
+            for (int w = 0; w < n; ++w) {
+                if (dst_count < B3D_CLIP_BUFFER_SIZE)
+                    dst[dst_count++] = clipped[w];
+                else
+                    ++ctx->clip_drop_count;
+            }
+        }
+
+        b3d_triangle_t *tmp = src;
+        src = dst;
+        dst = tmp;
+        src_count = dst_count;
+    }
+    B3D_STAT(&ctx->stats, screen_clip_outputs, src_count);
+    if (src_count == 0)
+        return false;
+
+    for (int i = 0; i < src_count; ++i)
+        b3d_raster_screen_tri(ctx, &src[i], c, attr);
+    return true;
+}
+
+/* Back-face test on a clip-space triangle. The determinant of the (x, y, w)
+ * rows is the signed screen area times w0 * w1 * w2, so its sign is right
+ * even for vertices behind the eye and no near clipping is needed first.
+ * The projection only scales x and y and puts view-space z into w, so the
+ * determinant is proj[0][0] * proj[1][1] times the view-space normal . p0,
+ * and the threshold is scaled to match that test exactly.
+ */
+static inline bool b3d_backfacing(const b3d_context_t *ctx,
+                                  const b3d_triangle_t *t)
+{
+    const b3d_vec_t *a = &t->p[0], *b = &t->p[1], *c = &t->p[2];
+    float det = a->x * (b->y * c->w - c->y * b->w) -
+                a->y * (b->x * c->w - c->x * b->w) +
+                a->w * (b->x * c->y - c->x * b->y);
+    return det > B3D_CULL_THRESHOLD * ctx->proj.m[0][0] * ctx->proj.m[1][1];
+}
+
+/* Clip a clip-space triangle against the near plane, project it to screen
+ * space and pass the result on to b3d_clip_screen(). The projection puts
+ * view-space z into w, so w = B3D_NEAR_DISTANCE is the view-space near plane.
+ */
+static bool b3d_clip_near(b3d_context_t *ctx,
+                          b3d_triangle_t t,
+                          uint32_t c,
+                          const raster_attr_t *attr)
+{
+    b3d_triangle_t buf_a[B3D_CLIP_BUFFER_SIZE], buf_b[B3D_CLIP_BUFFER_SIZE];
+    int count = 1;
+    if (t.p[0].w < B3D_NEAR_DISTANCE || t.p[1].w < B3D_NEAR_DISTANCE ||
+        t.p[2].w < B3D_NEAR_DISTANCE) {
+        B3D_STAT(&ctx->stats, triangles_near_clipped, 1);
+        count = b3d_clip_near_w(B3D_NEAR_DISTANCE, t, buf_a);
+        if (count == 0)
+            return false;
+    } else {
+        buf_a[0] = t;
+    }
+
+    /* w >= B3D_NEAR_DISTANCE from here on, so the divide is safe */
+    float xs = ctx->width * 0.5f;
+    float ys = ctx->height * 0.5f;
+    for (int n = 0; n < count; ++n) {
+        PERSPECTIVE_DIV(buf_a[n]);
+        NDC_TO_SCREEN(buf_a[n].p[0], xs, ys);
+        NDC_TO_SCREEN(buf_a[n].p[1], xs, ys);
+        NDC_TO_SCREEN(buf_a[n].p[2], xs, ys);
+    }
+    return b3d_clip_screen(ctx, buf_a, buf_b, count, c, attr);
+}
+
+/* Depth-sorted render queue
+ *
+ * With a queue set, flat triangles stop after transform and back-face
+ * culling: their clip-space vertices and color are appended to the queue
+ * together with a 16-bit sort key, the upper half of the float bits of
+ * their mean view depth. Positive floats order like their bit patterns, so
+ * the key keeps the exponent and 7 mantissa bits, about 1% of the depth.
+ * Flushing orders the queue with a stable two-pass LSD radix sort over the
+ * keys and runs the rest of the pipeline in that order.
+ */
+
+typedef struct {
+    b3d_triangle_t t; /* clip space */
+    uint32_t c;
+} b3d_queue_item_t;
+
+struct b3d_queue {
+    b3d_queue_item_t *items;
+    uint16_t *keys;
+    uint32_t *order, *tmp; /* sorted item indices, first radix pass */
+    size_t count, capacity;
+    int mode; /* B3D_QUEUE_* */
+};
+
+/* Arena bytes per queued triangle, and for the header and alignment */
+#define B3D_QUEUE_TRI_BYTES \
+    (sizeof(b3d_queue_item_t) + sizeof(uint16_t) + 2 * sizeof(uint32_t))
+#define B3D_QUEUE_FIXED_BYTES \
+    (5 * B3D_ARENA_ALIGN + B3D_ALIGN_UP(sizeof(struct b3d_queue)))
+
+/* Sort and draw everything queued */
+static void b3d_queue_run(b3d_context_t *ctx)
+{
+    struct b3d_queue *q = ctx->queue;
+    const size_t n = q->count;
+    if (n == 0)
+        return;
+    B3D_STAT_TIMER(&ctx->stats, tm);
+
+    /* Histograms of both key bytes in one sweep, then their prefix sums */
+    size_t lo[256] = {0}, hi[256] = {0};
+    for (size_t i = 0; i < n; ++i) {
+        lo[q->keys[i] & 0xFF]++;
+        hi[q->keys[i] >> 8]++;
+    }
+    size_t sum_lo = 0, sum_hi = 0;
+    for (int d = 0; d < 256; ++d) {
+        size_t a = lo[d], b = hi[d];
+        lo[d] = sum_lo, hi[d] = sum_hi;
+        sum_lo += a, sum_hi += b;
+    }
+    for (size_t i = 0; i < n; ++i)
+        q->tmp[lo[q->keys[i] & 0xFF]++] = (uint32_t) i;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t k = q->tmp[i];
+        q->order[hi[q->keys[k] >> 8]++] = k;
+    }
+
+    /* Drawing never queues, so the items stay valid until the end */
+    q->count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const b3d_queue_item_t *it = &q->items[q->order[i]];
+        b3d_clip_near(ctx, it->t, it->c, NULL);
+    }
+    B3D_STAT_LAP(&ctx->stats, clip_ns, tm);
+}
+
+/* Queue clip-space triangle @t in color @c, flushing first if full */
+static void b3d_queue_add(b3d_context_t *ctx,
+                          const b3d_triangle_t *t,
+                          uint32_t c)
+{
+    struct b3d_queue *q = ctx->queue;
+    if (q->count == q->capacity)
+        b3d_queue_run(ctx);
+
+    float depth = (t->p[0].w + t->p[1].w + t->p[2].w) * (1.0f / 3.0f);
+    if (!(depth > 0.0f))
+        depth = 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    uint16_t key = (uint16_t) (bits >> 16);
+    q->keys[q->count] = q->mode == B3D_QUEUE_BACK_TO_FRONT
+                            ? (uint16_t) (0xFFFF - key)
+                            : key;
+    q->items[q->count++] = (b3d_queue_item_t) {*t, c};
+}
+
+/* Display lists
+ *
+ * A list keeps the vertices of its triangles as separate x, y and z arrays,
+ * three entries per triangle, which b3d_mat_mul_vec_soa() transforms in
+ * batches. It transforms bit-identically to TRANSFORM_TRI, so listed
+ * triangles reach clipping exactly as submitted ones would.
+ *
+ * Every face also keeps its plane n . p = d, n = (p1 - p0) x (p2 - p0). The
+ * clip-space culling determinant of b3d_backfacing() is linear in the plane:
+ * by the Cauchy-Binet formula it equals n . e + d * e_w, where e and e_w
+ * are the 3x3 minors of the x, y and w columns of model_view_proj, i.e. the
+ * eye in object space. Faces clearly past the culling threshold this way are
+ * dropped before their vertices are transformed; the others still take
+ * b3d_backfacing(), so only faces within rounding of the threshold may be
+ * decided differently from b3d_triangle().
+ */
+
+typedef struct {
+    float n[3], d; /* plane n . p = d */
+    float scale;   /* |p1 - p0| * |p2 - p0|, bounds rounding in |n| */
+} b3d_list_face_t;
+
+struct b3d_list {
+    float *x, *y, *z; /* vertices, 3 per triangle */
+    b3d_list_face_t *faces;
+    uint32_t *colors;
+    size_t count, capacity;
+    float min[3], max[3];    /* bounds of the vertices so far */
+    float center[3], radius; /* bounding sphere, set by b3d_list_end() */
+    bool overflow;           /* a triangle did not fit */
+};
+
+/* Triangles transformed per batch by b3d_ctx_list_draw() */
+#define B3D_LIST_BATCH 32
+
+/* Arena bytes per listed triangle, and for the header and alignment */
+#define B3D_LIST_TRI_BYTES \
+    (9 * sizeof(float) + sizeof(b3d_list_face_t) + sizeof(uint32_t))
+#define B3D_LIST_FIXED_BYTES \
+    (6 * B3D_ARENA_ALIGN + B3D_ALIGN_UP(sizeof(struct b3d_list)))
+
+/* Append @tri in color @c to @list; false once it is full */
+static bool b3d_list_add(struct b3d_list *list,
+                         const b3d_tri_t *tri,
+                         uint32_t c)
+{
+    if (list->count == list->capacity) {
+        list->overflow = true;
+        return false;
+    }
+    size_t i = list->count++;
+    for (int k = 0; k < 3; ++k) {
+        const float p[3] = {tri->v[k].x, tri->v[k].y, tri->v[k].z};
+        list->x[3 * i + k] = p[0];
+        list->y[3 * i + k] = p[1];
+        list->z[3 * i + k] = p[2];
+        for (int a = 0; a < 3; ++a) {
+            if (i == 0 && k == 0) {
+                list->min[a] = list->max[a] = p[a];
+            } else {
+                list->min[a] = fminf(list->min[a], p[a]);
+                list->max[a] = fmaxf(list->max[a], p[a]);
+            }
+        }
+    }
+
+    b3d_vec_t p0 = {tri->v[0].x, tri->v[0].y, tri->v[0].z, 1};
+    b3d_vec_t e1 = {tri->v[1].x - p0.x, tri->v[1].y - p0.y,
+                    tri->v[1].z - p0.z, 0};
+    b3d_vec_t e2 = {tri->v[2].x - p0.x, tri->v[2].y - p0.y,
+                    tri->v[2].z - p0.z, 0};
+    b3d_vec_t n = b3d_vec_cross(e1, e2);
+    list->faces[i] = (b3d_list_face_t) {
+        {n.x, n.y, n.z},
+        b3d_vec_dot(n, p0),
+        sqrtf(b3d_vec_dot(e1, e1) * b3d_vec_dot(e2, e2)),
+    };
+    list->colors[i] = c;
+    return true;
+}
+
+/* Whether the bounding sphere of @list under model-view @m may reach into
+ * the view frustum
+ */
+static bool b3d_list_visible(const b3d_context_t *ctx,
+                             const struct b3d_list *list,
+                             const b3d_mat_t *m)
+{
+    b3d_vec_t c = b3d_mat_mul_vec(
+        *m, (b3d_vec_t) {list->center[0], list->center[1], list->center[2], 1});
+
+    /* Largest stretch of the model-view rotation and scale: the square root
+     * of a Gershgorin bound on the largest eigenvalue of A * A^T
+     */
+    float g = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float sum = 0.0f;
+        for (int j = 0; j < 3; ++j)
+            sum += fabsf(m->m[i][0] * m->m[j][0] + m->m[i][1] * m->m[j][1] +
+                         m->m[i][2] * m->m[j][2]);
+        g = fmaxf(g, sum);
+    }
+    float r = list->radius * sqrtf(g);
+
+    /* Near plane, then the side planes x * m00 = +-z and y * m11 = +-z */
+    if (c.z + r < B3D_NEAR_DISTANCE)
+        return false;
+    float sx = ctx->proj.m[0][0], sy = ctx->proj.m[1][1];
+    float rx = r * sqrtf(sx * sx + 1.0f), ry = r * sqrtf(sy * sy + 1.0f);
+    return c.z + sx * c.x >= -rx && c.z - sx * c.x >= -rx &&
+           c.z + sy * c.y >= -ry && c.z - sy * c.y >= -ry;
+}
+
+/* Draw the triangles of @list with model-view @mv and model-view-projection
+ * @mvp, see b3d_list_draw()
+ */
+static int b3d_list_run(b3d_context_t *ctx,
+                        const struct b3d_list *list,
+                        const b3d_mat_t *mv,
+                        const b3d_mat_t *mvp)
+{
+    B3D_STAT(&ctx->stats, triangles_submitted, list->count);
+    B3D_STAT_TIMER(&ctx->stats, tm);
+    if (list->count == 0 || !b3d_list_visible(ctx, list, mv)) {
+        B3D_STAT(&ctx->stats, triangles_frustum_culled, list->count);
+        return 0;
+    }
+
+#ifndef B3D_NO_CULLING
+    /* Object-space eye: signed 3x3 minors of the x, y, w columns */
+    const b3d_mat_t *m = mvp;
+    float e[4];
+    for (int k = 0; k < 4; ++k) {
+        int r[3], n = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (i != k)
+                r[n++] = i;
+        }
+        const float *a = m->m[r[0]], *b = m->m[r[1]], *c = m->m[r[2]];
+        e[k] = a[0] * (b[1] * c[3] - c[1] * b[3]) -
+               a[1] * (b[0] * c[3] - c[0] * b[3]) +
+               a[3] * (b[0] * c[1] - c[0] * b[1]);
+    }
+    const float ex = e[0], ey = -e[1], ez = e[2], ew = e[3];
+    const float elen = sqrtf(ex * ex + ey * ey + ez * ez);
+    const float threshold =
+        B3D_CULL_THRESHOLD * ctx->proj.m[0][0] * ctx->proj.m[1][1];
+#endif
+
+    float xs[3 * B3D_LIST_BATCH], ys[3 * B3D_LIST_BATCH];
+    float zs[3 * B3D_LIST_BATCH];
+    b3d_vec_t clip[3 * B3D_LIST_BATCH];
+    uint32_t colors[B3D_LIST_BATCH];
+    int drawn = 0;
+    for (size_t i = 0; i < list->count;) {
+        /* Gather the faces that may be front-facing, then transform them */
+        int n = 0;
+        for (; i < list->count && n < B3D_LIST_BATCH; ++i) {
+#ifndef B3D_NO_CULLING
+            const b3d_list_face_t *f = &list->faces[i];
+            float det = f->n[0] * ex + f->n[1] * ey + f->n[2] * ez + f->d * ew;
+            float err = 1e-3f * (f->scale * elen + fabsf(f->d * ew));
+            if (det > threshold + err) {
+                B3D_STAT(&ctx->stats, triangles_culled, 1);
+                continue;
+            }
+#endif
+            memcpy(&xs[3 * n], &list->x[3 * i], 3 * sizeof(float));
+            memcpy(&ys[3 * n], &list->y[3 * i], 3 * sizeof(float));
+            memcpy(&zs[3 * n], &list->z[3 * i], 3 * sizeof(float));
+            colors[n++] = list->colors[i];
+        }
+        b3d_mat_mul_vec_soa(mvp, xs, ys, zs, 3 * n, clip);
+        B3D_STAT_LAP(&ctx->stats, transform_ns, tm);
+
+        for (int k = 0; k < n; ++k) {
+            const b3d_vec_t *v = &clip[3 * k];
+            b3d_triangle_t t = {{v[0], v[1], v[2]}};
+#ifndef B3D_NO_CULLING
+            if (b3d_backfacing(ctx, &t)) {
+                B3D_STAT(&ctx->stats, triangles_culled, 1);
+                continue;
+            }
+#endif
+            if (ctx->queue) {
+                b3d_queue_add(ctx, &t, colors[k]);
+                drawn++;
+            } else {
+                drawn += b3d_clip_near(ctx, t, colors[k], NULL);
+            }
+        }
+        B3D_STAT_LAP(&ctx->stats, clip_ns, tm);
+    }
+    return drawn;
+}
+
+/* Draw @tri in color @c, or with the attributes @attr and texture @tex when
+ * @attr is not NULL
+ */
+static bool b3d_submit_triangle(b3d_context_t *ctx,
+                                const b3d_tri_t *tri,
+                                uint32_t c,
+                                const b3d_attr_t *attr,
+                                const b3d_texture_t *tex)
+{
+    if (ctx->list)
+        return !attr && b3d_list_add(ctx->list, tri, c);
+    B3D_STAT(&ctx->stats, triangles_submitted, 1);
+    B3D_STAT_TIMER(&ctx->stats, tm);
+    b3d_triangle_t t =
+        (b3d_triangle_t) {{{tri->v[0].x, tri->v[0].y, tri->v[0].z, 1},
+                           {tri->v[1].x, tri->v[1].y, tri->v[1].z, 1},
+                           {tri->v[2].x, tri->v[2].y, tri->v[2].z, 1}}};
+    /* One cached model*view*proj multiply per vertex, culling in clip space */
+    b3d_update_model_view(ctx);
+    TRANSFORM_TRI(t, ctx->model_view_proj);
+#ifndef B3D_NO_CULLING
+    if (b3d_backfacing(ctx, &t)) {
+        B3D_STAT(&ctx->stats, triangles_culled, 1);
+        B3D_STAT_LAP(&ctx->stats, transform_ns, tm);
+        return false;
+    }
+#endif
+    if (ctx->queue && !attr) {
+        b3d_queue_add(ctx, &t, c);
+        B3D_STAT_LAP(&ctx->stats, transform_ns, tm);
+        return true;
+    }
+    raster_attr_t planes;
+    bool shaded = attr && b3d_attr_setup(ctx, &t, attr, tex, &planes);
+
+    B3D_STAT_LAP(&ctx->stats, transform_ns, tm);
+    bool drawn = b3d_clip_near(ctx, t, c, shaded ? &planes : NULL);
+    B3D_STAT_LAP(&ctx->stats, clip_ns, tm);
+    return drawn;
+}
+
+bool b3d_ctx_triangle(b3d_context_t *ctx, const b3d_tri_t *tri, uint32_t c)
+{
+    if (!ctx || !tri || !ctx->pixels || !ctx->depth)
+        return false;
+    return b3d_submit_triangle(ctx, tri, c, NULL, NULL);
+}
+
+bool b3d_ctx_triangle_ex(b3d_context_t *ctx,
+                         const b3d_tri_t *tri,
+                         const b3d_attr_t *attr)
+{
+    if (!ctx || !tri || !attr || !ctx->pixels || !ctx->depth)
+        return false;
+
+    const b3d_texture_t *tex = ctx->texture.texels ? &ctx->texture : NULL;
+    /* Nothing varies: take the flat path */
+    if (!tex && attr->color[0] == attr->color[1] &&
+        attr->color[0] == attr->color[2])
+        return b3d_submit_triangle(ctx, tri, attr->color[0], NULL, NULL);
+    return b3d_submit_triangle(ctx, tri, attr->color[0], attr, tex);
+}
+
+/* log2 of a texture size @n, -1 if @n is not a power of two up to 16384 */
+static int b3d_texture_bits(int n)
+{
+    for (int bits = 0; bits <= 14; ++bits) {
+        if (n == 1 << bits)
+            return bits;
+    }
+    return -1;
+}
+
+bool b3d_ctx_set_texture(b3d_context_t *ctx, const b3d_texture_t *tex)
+{
+    if (!tex) {
+        ctx->texture = (b3d_texture_t) {0};
+        return true;
+    }
+    int wbits = b3d_texture_bits(tex->width);
+    int hbits = b3d_texture_bits(tex->height);
+    if (!tex->texels || wbits < 0 || hbits < 0 || tex->levels < 0 ||
+        tex->levels > (wbits < hbits ? wbits : hbits) + 1 ||
+        (tex->filter != B3D_FILTER_NEAREST &&
+         tex->filter != B3D_FILTER_BILINEAR))
+        return false;
+    ctx->texture = *tex;
+    return true;
+}
+
+/* Average each 4 consecutive texels of @src, @n times, rounding to nearest:
+ * the 2x2 children of a Morton-ordered texel are 4 consecutive texels of
+ * the level above.
+ */
+static void b3d_mip_reduce(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    size_t i = 0;
+#ifdef B3D_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    for (; i + 4 <= n; i += 4) {
+        /* Sum each half of a 16-byte group as 16-bit channels */
+        __m128i sum[4];
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128((const void *) (src + 4 * (i + k)));
+            sum[k] = _mm_add_epi16(_mm_unpacklo_epi8(v, zero),
+                                   _mm_unpackhi_epi8(v, zero));
+        }
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(sum[0], sum[1]),
+                                   _mm_unpackhi_epi64(sum[0], sum[1]));
+        __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(sum[2], sum[3]),
+                                   _mm_unpackhi_epi64(sum[2], sum[3]));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        _mm_storeu_si128((void *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(B3D_SIMD_NEON)
+    for (; i + 4 <= n; i += 4) {
+        /* One channel of 16 texels per vector, summed in groups of 4 */
+        uint8x16x4_t v = vld4q_u8((const uint8_t *) (src + 4 * i));
+        uint32x4_t out = vdupq_n_u32(0);
+        for (int k = 0; k < 4; ++k) {
+            uint32x4_t c = vpaddlq_u16(vpaddlq_u8(v.val[k]));
+            out = vorrq_u32(out, vshlq_u32(vrshrq_n_u32(c, 2),
+                                           vdupq_n_s32(8 * k)));
+        }
+        vst1q_u32(dst + i, out);
+    }
+#endif
+    for (; i < n; ++i) {
+        const uint32_t *p = src + 4 * i;
+        uint32_t rb = 0x00020002, ag = 0x00020002;
+        for (int k = 0; k < 4; ++k) {
+            rb += p[k] & 0x00FF00FF;
+            ag += p[k] >> 8 & 0x00FF00FF;
+        }
+        dst[i] = (rb >> 2 & 0x00FF00FF) | (ag << 6 & 0xFF00FF00);
+    }
+}
+
+size_t b3d_texture_size(int w, int h)
+{
+    int wbits = b3d_texture_bits(w), hbits = b3d_texture_bits(h);
+    if (wbits < 0 || hbits < 0)
+        return 0;
+    /* Levels down to a side of 1, as laid out by b3d_sampler_select(), plus
+     * alignment
+     */
+    int last = wbits < hbits ? wbits : hbits;
+    size_t n0 = (size_t) w * (size_t) h, n = n0 >> (2 * last);
+    return ((n0 - n) / 3 * 4 + n) * sizeof(uint32_t) + sizeof(uint32_t) - 1;
+}
+
+bool b3d_texture_init(b3d_texture_t *tex,
+                      void *buf,
+                      size_t size,
+                      const uint32_t *image,
+                      int w,
+                      int h,
+                      int filter)
+{
+    size_t need = b3d_texture_size(w, h);
+    if (!tex || !buf || !image || !need || size < need ||
+        (filter != B3D_FILTER_NEAREST && filter != B3D_FILTER_BILINEAR))
+        return false;
+
+    uintptr_t addr = (uintptr_t) buf;
+    uint32_t *texels = (uint32_t *) (void *) ((unsigned char *) buf +
+                                              (-addr & (sizeof(uint32_t) - 1)));
+    int wbits = b3d_texture_bits(w), hbits = b3d_texture_bits(h);
+    int bbits = wbits < hbits ? wbits : hbits;
+    for (int y = 0; y < h; ++y) {
+        const uint32_t *row = image + (size_t) y * (size_t) w;
+        for (int x = 0; x < w; ++x)
+            texels[b3d_morton_index((uint32_t) x, (uint32_t) y, bbits)] =
+                row[x];
+    }
+
+    /* Halving both sides keeps the Morton order of every level */
+    uint32_t *level = texels;
+    size_t n = (size_t) w * (size_t) h;
+    for (int i = 1; i <= bbits; ++i) {
+        b3d_mip_reduce(level + n, level, n / 4);
+        level += n;
+        n /= 4;
+    }
+
+    *tex = (b3d_texture_t) {texels, w, h, bbits + 1, filter};
+    return true;
+}
+
+/* Fill cache entry @e for vertex @index, at clip-space position @v */
+static inline void b3d_cache_vertex(const b3d_context_t *ctx,
+                                    b3d_cached_vertex_t *e,
+                                    uint32_t index,
+                                    b3d_vec_t v)
+{
+    e->cx = v.x, e->cy = v.y, e->cz = v.z, e->cw = v.w;
+    if (v.w >= B3D_NEAR_DISTANCE) {
+        v = b3d_vec_div(v, v.w);
+        NDC_TO_SCREEN(v, ctx->width * 0.5f, ctx->height * 0.5f);
+        e->sx = v.x, e->sy = v.y, e->sz = v.z;
+    }
+    e->index = index;
+    e->gen = ctx->vertex_cache_gen;
+}
+
+/* Fetch vertex @index of the current mesh from the post-transform cache,
+ * transforming it on a miss. Meshes that fit the cache are transformed up
+ * front by b3d_ctx_draw_mesh() and always hit.
+ */
+static inline const b3d_cached_vertex_t *b3d_fetch_vertex(
+    b3d_context_t *ctx,
+    const float *positions,
+    uint32_t index)
+{
+    b3d_cached_vertex_t *e =
+        &ctx->vertex_cache[index & (B3D_VERTEX_CACHE_SIZE - 1)];
+    if (e->index == index && e->gen == ctx->vertex_cache_gen)
+        return e;
+
+    b3d_vec_t v;
+    b3d_kernels->transform(&ctx->model_view_proj,
+                           &positions[(size_t) index * 3], 1, &v);
+    b3d_cache_vertex(ctx, e, index, v);
+    return e;
+}
+
+/* Face lighting for b3d_ctx_draw_mesh_lit(). The lights are prescaled so
+ * that ambient plus the sum of |N.L| over the lights is directly an index
+ * into the 256 shades of the base color.
+ */
+typedef struct {
+    const float *normals;
+    int count;
+#ifdef B3D_FLOAT_POINT
+    float dir[B3D_MAX_LIGHTS][3];
+    float ambient;
+#else
+    int32_t dir[B3D_MAX_LIGHTS][3]; /* Q8 */
+    uint32_t ambient;               /* Q20, plus a half for rounding */
+#endif
+    uint32_t shade[256];
+} b3d_mesh_light_t;
+
+static void b3d_mesh_light_init(const b3d_context_t *ctx,
+                                b3d_mesh_light_t *lit,
+                                const float *normals,
+                                uint32_t c)
+{
+    float scale = (1.0f - ctx->ambient) * 255.0f;
+    lit->normals = normals;
+    lit->count = 0;
+    for (int i = 0; i < B3D_MAX_LIGHTS; ++i) {
+        float k = ctx->light_intensity[i] * scale;
+        if (k <= 0.0f)
+            continue;
+        const b3d_vec_t *l = &ctx->light_dir[i];
+#ifdef B3D_FLOAT_POINT
+        lit->dir[lit->count][0] = l->x * k;
+        lit->dir[lit->count][1] = l->y * k;
+        lit->dir[lit->count][2] = l->z * k;
+#else
+        lit->dir[lit->count][0] = (int32_t) floorf(l->x * k * 256.0f + 0.5f);
+        lit->dir[lit->count][1] = (int32_t) floorf(l->y * k * 256.0f + 0.5f);
+        lit->dir[lit->count][2] = (int32_t) floorf(l->z * k * 256.0f + 0.5f);
+#endif
+        lit->count++;
+    }
+#ifdef B3D_FLOAT_POINT
+    lit->ambient = ctx->ambient * 255.0f + 0.5f;
+#else
+    lit->ambient =
+        (uint32_t) (ctx->ambient * 255.0f * 1048576.0f + 0.5f) + (1u << 19);
+#endif
+
+    uint32_t r = c >> 16 & 0xFF, g = c >> 8 & 0xFF, b = c & 0xFF;
+    for (uint32_t i = 0; i < 256; ++i)
+        lit->shade[i] = (r * i / 255) << 16 | (g * i / 255) << 8 | b * i / 255;
+}
+
+#ifndef B3D_FLOAT_POINT
+/* Unit vector component @f in Q12, taken apart bit by bit so that lighting
+ * needs no FPU. Magnitudes of 1 or more saturate.
+ */
+static inline int32_t b3d_unit_to_q12(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    /* f = mantissa * 2^(exponent - 150), so Q12 = mantissa >> shift */
+    int shift = 138 - (int) (u >> 23 & 0xFF);
+    int32_t q;
+    if (shift >= 24)
+        q = 0;
+    else if (shift <= 11)
+        q = 4096;
+    else
+        q = (int32_t) (((u & 0x7FFFFF) | 0x800000) >> shift);
+    return u >> 31 ? -q : q;
+}
+#endif
+
+/* Color of triangle @t under @lit */
+static inline uint32_t b3d_mesh_light_color(const b3d_mesh_light_t *lit,
+                                            int t)
+{
+    const float *n = &lit->normals[(size_t) t * 3];
+#ifdef B3D_FLOAT_POINT
+    float acc = lit->ambient;
+    for (int i = 0; i < lit->count; ++i) {
+        const float *l = lit->dir[i];
+        float dot = n[0] * l[0] + n[1] * l[1] + n[2] * l[2];
+        acc += dot < 0.0f ? -dot : dot;
+    }
+    int level = acc >= 255.0f ? 255 : (int) acc;
+#else
+    int32_t nx = b3d_unit_to_q12(n[0]), ny = b3d_unit_to_q12(n[1]),
+            nz = b3d_unit_to_q12(n[2]);
+    /* Q12 * Q8 products; at most 4 lights keep the sum within 32 bits */
+    uint32_t acc = lit->ambient;
+    for (int i = 0; i < lit->count; ++i) {
+        const int32_t *l = lit->dir[i];
+        int32_t dot = nx * l[0] + ny * l[1] + nz * l[2];
+        acc += (uint32_t) (dot < 0 ? -dot : dot);
+    }
+    uint32_t level = acc >> 20 > 255 ? 255 : acc >> 20;
+#endif
+    return lit->shade[level];
+}
+
+/* Record a mesh into the display list being recorded, colored as
+ * b3d_draw_mesh_shaded() would. Returns the number of triangles appended.
+ */
+static int b3d_list_add_mesh(b3d_context_t *ctx,
+                             const float *positions,
+                             int vcount,
+                             const uint32_t *indices,
+                             int icount,
+                             const uint32_t *colors,
+                             const b3d_mesh_light_t *lit)
+{
+    int added = 0;
+    for (int i = 0; i + 2 < icount; i += 3) {
+        b3d_tri_t tri;
+        bool valid = true;
+        for (int k = 0; k < 3 && valid; ++k) {
+            uint32_t v = indices[i + k];
+            valid = v < (uint32_t) vcount;
+            if (valid) {
+                const float *p = &positions[(size_t) v * 3];
+                tri.v[k] = (b3d_point_t) {p[0], p[1], p[2]};
+            }
+        }
+        if (!valid)
+            continue;
+        uint32_t c = lit      ? b3d_mesh_light_color(lit, i / 3)
+                     : colors ? colors[i / 3]
+                              : 0xFFFFFF;
+        added += b3d_list_add(ctx->list, &tri, c);
+    }
+    return added;
+}
+
+/* Draw a mesh in per-triangle @colors, or lit by @lit if not NULL */
+static int b3d_draw_mesh_shaded(b3d_context_t *ctx,
+                                const float *positions,
+                                int vcount,
+                                const uint32_t *indices,
+                                int icount,
+                                const uint32_t *colors,
+                                const b3d_mesh_light_t *lit)
+{
+    if (ctx->list)
+        return b3d_list_add_mesh(ctx, positions, vcount, indices, icount,
+                                 colors, lit);
+    B3D_STAT_TIMER(&ctx->stats, tm);
+    /* New generation invalidates every cached vertex of the previous call */
+    if (++ctx->vertex_cache_gen == 0) {
+        memset(ctx->vertex_cache, 0, sizeof(ctx->vertex_cache));
+        ctx->vertex_cache_gen = 1;
+    }
+    b3d_update_model_view(ctx);
+    if (vcount <= B3D_VERTEX_CACHE_SIZE) {
+        /* Vertex i lands in entry i: transform them in batches */
+        b3d_vec_t clip[64];
+        for (int i = 0; i < vcount; i += 64) {
+            int n = vcount - i < 64 ? vcount - i : 64;
+            b3d_kernels->transform(&ctx->model_view_proj,
+                                   &positions[(size_t) i * 3], n, clip);
+            for (int j = 0; j < n; ++j)
+                b3d_cache_vertex(ctx, &ctx->vertex_cache[i + j],
+                                 (uint32_t) (i + j), clip[j]);
+        }
+    }
+
+    b3d_triangle_t buf_a[B3D_CLIP_BUFFER_SIZE], buf_b[B3D_CLIP_BUFFER_SIZE];
+    int drawn = 0;
+    for (int i = 0; i + 2 < icount; i += 3) {
+        uint32_t i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+        if (i0 >= (uint32_t) vcount || i1 >= (uint32_t) vcount ||
+            i2 >= (uint32_t) vcount)
+            continue;
+        B3D_STAT(&ctx->stats, triangles_submitted, 1);
+
+        const b3d_cached_vertex_t *v0 = b3d_fetch_vertex(ctx, positions, i0);
+        const b3d_cached_vertex_t *v1 = b3d_fetch_vertex(ctx, positions, i1);
+        const b3d_cached_vertex_t *v2 = b3d_fetch_vertex(ctx, positions, i2);
+        b3d_triangle_t t = {{{v0->cx, v0->cy, v0->cz, v0->cw},
+                             {v1->cx, v1->cy, v1->cz, v1->cw},
+                             {v2->cx, v2->cy, v2->cz, v2->cw}}};
+#ifndef B3D_NO_CULLING
+        if (b3d_backfacing(ctx, &t)) {
+            B3D_STAT(&ctx->stats, triangles_culled, 1);
+            continue;
+        }
+#endif
+        uint32_t c = lit      ? b3d_mesh_light_color(lit, i / 3)
+                     : colors ? colors[i / 3]
+                              : 0xFFFFFF;
+        B3D_STAT_LAP(&ctx->stats, transform_ns, tm);
+        if (ctx->queue) {
+            b3d_queue_add(ctx, &t, c);
+            drawn++;
+        } else if (v0->cw < B3D_NEAR_DISTANCE || v1->cw < B3D_NEAR_DISTANCE ||
+                   v2->cw < B3D_NEAR_DISTANCE) {
+            /* Crosses the near plane: take the full clipping path */
+            drawn += b3d_clip_near(ctx, t, c, NULL);
+        } else {
+            buf_a[0] = (b3d_triangle_t) {{{v0->sx, v0->sy, v0->sz, 1},
+                                          {v1->sx, v1->sy, v1->sz, 1},
+                                          {v2->sx, v2->sy, v2->sz, 1}}};
+            drawn += b3d_clip_screen(ctx, buf_a, buf_b, 1, c, NULL);
+        }
+        B3D_STAT_LAP(&ctx->stats, clip_ns, tm);
+    }
+    B3D_STAT_LAP(&ctx->stats, transform_ns, tm);
+    return drawn;
+}
+
+int b3d_ctx_draw_mesh(b3d_context_t *ctx,
+                      const float *positions,
+                      int vcount,
+                      const uint32_t *indices,
+                      int icount,
+                      const uint32_t *colors)
+{
+    if (!ctx || !positions || !indices || vcount <= 0 || icount < 3 ||
+        !ctx->pixels || !ctx->depth)
+        return 0;
+    return b3d_draw_mesh_shaded(ctx, positions, vcount, indices, icount,
+                                colors, NULL);
+}
+
+int b3d_ctx_draw_mesh_lit(b3d_context_t *ctx,
+                          const float *positions,
+                          int vcount,
+                          const uint32_t *indices,
+                          int icount,
+                          const float *normals,
+                          uint32_t base_color)
+{
+    if (!ctx || !positions || !indices || !normals || vcount <= 0 ||
+        icount < 3 || !ctx->pixels || !ctx->depth)
+        return 0;
+    b3d_mesh_light_t lit;
+    b3d_mesh_light_init(ctx, &lit, normals, base_color);
+    return b3d_draw_mesh_shaded(ctx, positions, vcount, indices, icount, NULL,
+                                &lit);
+}
+
+void b3d_ctx_reset(b3d_context_t *ctx)
+{
+    ctx->model = b3d_mat_ident();
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_rotate_x(b3d_context_t *ctx, float angle)
+{
+    ctx->model = b3d_mat_mul(ctx->model, b3d_mat_rot_x(angle));
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_rotate_y(b3d_context_t *ctx, float angle)
+{
+    ctx->model = b3d_mat_mul(ctx->model, b3d_mat_rot_y(angle));
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_rotate_z(b3d_context_t *ctx, float angle)
+{
+    ctx->model = b3d_mat_mul(ctx->model, b3d_mat_rot_z(angle));
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_translate(b3d_context_t *ctx, float x, float y, float z)
+{
+    ctx->model = b3d_mat_mul(ctx->model, b3d_mat_trans(x, y, z));
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_scale(b3d_context_t *ctx, float x, float y, float z)
+{
+    ctx->model = b3d_mat_mul(ctx->model, b3d_mat_scale(x, y, z));
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_set_fov(b3d_context_t *ctx, float fov_in_degrees)
+{
+    if (ctx->width <= 0 || ctx->height <= 0)
+        return;
+
+    ctx->fov_degrees = fov_in_degrees;
+    ctx->proj = b3d_mat_proj(fov_in_degrees, ctx->height / (float) ctx->width,
+                             B3D_NEAR_DISTANCE, B3D_FAR_DISTANCE);
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_set_camera(b3d_context_t *ctx, const b3d_camera_t *cam)
+{
+    if (!cam)
+        return;
+
+    ctx->camera_params = *cam;
+    ctx->camera = (b3d_vec_t) {cam->x, cam->y, cam->z, 1};
+    b3d_vec_t up = {0, 1, 0, 1};
+    b3d_vec_t target = {0, 0, 1, 1};
+    up = b3d_mat_mul_vec(b3d_mat_rot_z(cam->roll), up);
+    target = b3d_mat_mul_vec(b3d_mat_rot_x(cam->pitch), target);
+    target = b3d_mat_mul_vec(b3d_mat_rot_y(cam->yaw), target);
+    target = b3d_vec_add(ctx->camera, target);
+    ctx->view = b3d_mat_qinv(b3d_mat_point_at(ctx->camera, target, up));
+    ctx->model_view_dirty = true;
+}
+
+void b3d_ctx_look_at(b3d_context_t *ctx, float x, float y, float z)
+{
+    b3d_vec_t up = {0, 1, 0, 1};
+    ctx->view = b3d_mat_qinv(
+        b3d_mat_point_at(ctx->camera, (b3d_vec_t) {x, y, z, 1}, up));
+    ctx->model_view_dirty = true;
+}
+
+bool b3d_ctx_to_screen(const b3d_context_t *ctx,
+                       float x,
+                       float y,
+                       float z,
+                       int *sx,
+                       int *sy)
+{
+    if (!sx || !sy)
+        return false;
+
+    b3d_vec_t p = {x, y, z, 1};
+    p = b3d_mat_mul_vec(ctx->model, p);
+    p = b3d_mat_mul_vec(ctx->view, p);
+    p = b3d_mat_mul_vec(ctx->proj, p);
+    if (p.w < B3D_EPSILON)
+        return false;
+
+    p = b3d_vec_div(p, p.w);
+    float mid_x = ctx->width / 2.0f;
+    float mid_y = ctx->height / 2.0f;
+    p.x = (p.x + 1.0f) * mid_x;
+    p.y = (-p.y + 1.0f) * mid_y;
+    *sx = (int) (p.x + 0.5f);
+    *sy = (int) (p.y + 0.5f);
+    return true;
+}
+
+/* True if a fragment at depth @z would pass the depth test anywhere in @r */
+static bool b3d_depth_visible(const b3d_context_t *ctx,
+                              const raster_clip_t *r,
+                              b3d_scalar_t z)
+{
+    for (int y = r->y0; y < r->y1; ++y) {
+        const b3d_depth_t *row = ctx->depth + (size_t) y * (size_t) ctx->width;
+        for (int x = r->x0; x < r->x1; ++x) {
+            if (z < b3d_depth_load(row[x]))
+                return true;
+        }
+    }
+    return false;
+}
+
+/* b3d_depth_visible() that skips hierarchical Z blocks nearer than @z */
+static bool b3d_hiz_visible(const b3d_context_t *ctx,
+                            const raster_clip_t *r,
+                            b3d_scalar_t z)
+{
+    int tx0 = r->x0 / B3D_HIZ_TILE, tx1 = (r->x1 - 1) / B3D_HIZ_TILE;
+    int ty0 = r->y0 / B3D_HIZ_TILE, ty1 = (r->y1 - 1) / B3D_HIZ_TILE;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            if (!(z < b3d_hiz_max(ctx, tx, ty)))
+                continue;
+            raster_clip_t block = {
+                .x0 = b3d_clamp_int(tx * B3D_HIZ_TILE, r->x0, r->x1),
+                .y0 = b3d_clamp_int(ty * B3D_HIZ_TILE, r->y0, r->y1),
+                .x1 = b3d_clamp_int((tx + 1) * B3D_HIZ_TILE, r->x0, r->x1),
+                .y1 = b3d_clamp_int((ty + 1) * B3D_HIZ_TILE, r->y0, r->y1),
+            };
+            /* The farthest depth of a block inside @r is farther than @z */
+            if (block.x1 - block.x0 == B3D_HIZ_TILE &&
+                block.y1 - block.y0 == B3D_HIZ_TILE)
+                return true;
+            if (b3d_depth_visible(ctx, &block, z))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool b3d_ctx_occlusion_test_rect(b3d_context_t *ctx,
+                                 int x0,
+                                 int y0,
+                                 int x1,
+                                 int y1,
+                                 float z)
+{
+    if (!b3d_ctx_is_initialized(ctx))
+        return false;
+    /* Queued triangles have not reached the depth buffer yet */
+    b3d_ctx_finish(ctx);
+
+    raster_clip_t r = {
+        .x0 = b3d_clamp_int(x0, 0, ctx->width),
+        .y0 = b3d_clamp_int(y0, 0, ctx->height),
+        .x1 = b3d_clamp_int(x1, 0, ctx->width),
+        .y1 = b3d_clamp_int(y1, 0, ctx->height),
+    };
+    if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        return false;
+    if (ctx->hiz)
+        return b3d_hiz_visible(ctx, &r, b3d_ctx_depth(ctx, z));
+    return b3d_depth_visible(ctx, &r, b3d_ctx_depth(ctx, z));
+}
+
+bool b3d_ctx_occlusion_test_box(b3d_context_t *ctx,
+                                const float min[3],
+                                const float max[3])
+{
+    if (!b3d_ctx_is_initialized(ctx) || !min || !max)
+        return false;
+
+    /* Screen rectangle and nearest depth of the eight projected corners */
+    b3d_update_model_view(ctx);
+    float xs = ctx->width * 0.5f, ys = ctx->height * 0.5f;
+    float sx0 = 0, sy0 = 0, sx1 = 0, sy1 = 0, sz = 0;
+    float cx[8], cy[8], cz[8];
+    b3d_vec_t corner[8];
+    for (int i = 0; i < 8; ++i) {
+        cx[i] = (i & 1) ? max[0] : min[0];
+        cy[i] = (i & 2) ? max[1] : min[1];
+        cz[i] = (i & 4) ? max[2] : min[2];
+    }
+    b3d_mat_mul_vec_soa(&ctx->model_view, cx, cy, cz, 8, corner);
+    for (int i = 0; i < 8; ++i) {
+        b3d_vec_t p = corner[i];
+        /* The box reaches the near plane: assume it is visible */
+        if (p.z < B3D_NEAR_DISTANCE)
+            return true;
+        p = b3d_mat_mul_vec(ctx->proj, p);
+        p = b3d_vec_div(p, p.w);
+        NDC_TO_SCREEN(p, xs, ys);
+        if (i == 0 || p.x < sx0)
+            sx0 = p.x;
+        if (i == 0 || p.x > sx1)
+            sx1 = p.x;
+        if (i == 0 || p.y < sy0)
+            sy0 = p.y;
+        if (i == 0 || p.y > sy1)
+            sy1 = p.y;
+        if (i == 0 || p.z < sz)
+            sz = p.z;
+    }
+
+    /* Cover every pixel the rasterizer could touch, see raster_bounds().
+     * Coordinates are clamped to [-2, size + 2], where (int) (v + 3) - 3
+     * is floor(v).
+     */
+    float w = (float) ctx->width + 2.0f, h = (float) ctx->height + 2.0f;
+    if (sx1 < -2.0f || sx0 > w || sy1 < -2.0f || sy0 > h)
+        return false;
+    sx0 = sx0 < -2.0f ? -2.0f : sx0;
+    sy0 = sy0 < -2.0f ? -2.0f : sy0;
+    sx1 = sx1 > w ? w : sx1;
+    sy1 = sy1 > h ? h : sy1;
+    return b3d_ctx_occlusion_test_rect(
+        ctx, (int) (sx0 + 3.0f) - 4, (int) (sy0 + 3.0f) - 3,
+        (int) (sx1 + 3.0f) - 2, (int) (sy1 + 3.0f) - 2, sz);
+}
+
+/* Whether @stride is a valid row stride for @w pixels of @format in a
+ * buffer at @pixels of @h rows, whose size fits a size_t
+ */
+static bool b3d_pixel_layout_ok(const void *pixels,
+                                int format,
+                                size_t stride,
+                                int w,
+                                int h)
+{
+    size_t bpp = b3d_format_bytes(format);
+    if (!pixels || (uintptr_t) pixels % bpp || stride % bpp ||
+        stride < (size_t) w * bpp)
+        return false;
+    return (size_t) (h - 1) <= (SIZE_MAX - (size_t) w * bpp) / stride;
+}
+
+bool b3d_ctx_init(b3d_context_t *ctx,
+                  uint32_t *pixel_buffer,
+                  b3d_depth_t *depth_buffer,
+                  int w,
+                  int h,
+                  float fov)
+{
+    return b3d_ctx_init_ex(ctx, pixel_buffer, B3D_FORMAT_XRGB8888, 0,
+                           depth_buffer, w, h, fov);
+}
+
+bool b3d_ctx_init_ex(b3d_context_t *ctx,
+                     void *pixel_buffer,
+                     int format,
+                     size_t stride,
+                     b3d_depth_t *depth_buffer,
+                     int w,
+                     int h,
+                     float fov)
+{
+    if (!ctx)
+        return false;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->light_dir[0] = (b3d_vec_t) {0.0f, 0.0f, 1.0f, 0.0f};
+    ctx->light_intensity[0] = 1.0f;
+    ctx->ambient = 0.2f;
+    ctx->model_view_dirty = true;
+
+    size_t depth_bytes = b3d_buffer_size(w, h, sizeof(b3d_depth_t));
+    if (format < B3D_FORMAT_XRGB8888 || format > B3D_FORMAT_RGB332)
+        return false;
+    if (stride == 0 && w > 0)
+        stride = (size_t) w * b3d_format_bytes(format);
+    if (!pixel_buffer || !depth_buffer || w <= 0 || h <= 0 || fov <= 0 ||
+        depth_bytes == 0 ||
+        !b3d_pixel_layout_ok(pixel_buffer, format, stride, w, h))
+        return false;
+
+    ctx->width = w;
+    ctx->height = h;
+    ctx->pixels = pixel_buffer;
+    ctx->pixel_format = format;
+    ctx->pixel_stride = stride;
+    ctx->depth = depth_buffer;
+    ctx->fov_degrees = fov;
+    b3d_update_screen_planes(ctx);
+    b3d_ctx_clear(ctx);
+    b3d_ctx_reset(ctx);
+    ctx->proj = b3d_mat_proj(fov, ctx->height / (float) ctx->width,
+                             B3D_NEAR_DISTANCE, B3D_FAR_DISTANCE);
+    b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, 0, 0, 0, 0});
+    return true;
+}
+
+/* Number of pixels of an initialized framebuffer, 0 if there is none */
+static size_t b3d_ctx_pixel_count(const b3d_context_t *ctx)
+{
+    if (!ctx || !ctx->depth || !ctx->pixels || ctx->width <= 0 ||
+        ctx->height <= 0)
+        return 0;
+    /* Check for integer overflow when calculating buffer size */
+    if ((size_t) ctx->width > SIZE_MAX / (size_t) ctx->height)
+        return 0;
+    size_t count = (size_t) ctx->width * (size_t) ctx->height;
+    /* Also check for overflow in the depth buffer size calculation */
+    if (count > SIZE_MAX / sizeof(ctx->depth[0]))
+        return 0;
+    return count;
+}
+
+bool b3d_ctx_set_pixel_buffer(b3d_context_t *ctx,
+                              void *pixel_buffer,
+                              size_t stride)
+{
+    /* The frame pipeline picks the framebuffer */
+    if (b3d_ctx_pixel_count(ctx) == 0 || ctx->frames)
+        return false;
+    if (stride == 0)
+        stride = (size_t) ctx->width * b3d_format_bytes(ctx->pixel_format);
+    if (!b3d_pixel_layout_ok(pixel_buffer, ctx->pixel_format, stride,
+                             ctx->width, ctx->height))
+        return false;
+
+    /* Binned triangles belong to the old buffer, kept tiles are not in the
+     * new one
+     */
+    b3d_ctx_flush(ctx);
+    b3d_diff_invalidate(ctx);
+    ctx->pixels = pixel_buffer;
+    ctx->pixel_stride = stride;
+    return true;
+}
+
+/* Switch to a new depth epoch where possible.
+ * Returns true if the depth buffer has to be filled instead.
+ */
+static bool b3d_ctx_next_epoch(b3d_context_t *ctx)
+{
+#ifdef B3D_DEPTH_EPOCHS
+    if (ctx->depth_epochs && ctx->depth_epoch > 0) {
+        --ctx->depth_epoch;
+        return false;
+    }
+    ctx->depth_epoch = ctx->depth_epochs ? B3D_EPOCH_MAX : 0;
+#else
+    (void) ctx;
+#endif
+    return true;
+}
+
+/* Reset all depth values, by switching to a new epoch where possible */
+static void b3d_ctx_reset_depth(b3d_context_t *ctx, size_t count)
+{
+    if (b3d_ctx_next_epoch(ctx))
+        b3d_fill_depth(ctx->depth, count);
+    if (ctx->hiz)
+        b3d_hiz_reset(ctx->hiz);
+}
+
+void b3d_ctx_clear(b3d_context_t *ctx)
+{
+    size_t count = b3d_ctx_pixel_count(ctx);
+    if (count == 0)
+        return;
+
+    ctx->clip_drop_count = 0;
+    ctx->hiz_reject_count = 0;
+    b3d_ctx_reset_stats(ctx);
+    /* Queued triangles would be drawn over the cleared frame */
+    if (ctx->queue)
+        ctx->queue->count = 0;
+    if (ctx->bins)
+        b3d_bins_reset(ctx->bins);
+
+    /* A frame is cleared once the rasterizer is done with the previous one */
+    struct b3d_frames *frames = ctx->frames;
+    if (frames) {
+        if (frames->recording >= 0) {
+            struct b3d_frame *f = &frames->frame[frames->recording];
+            f->clear = true;
+            if (b3d_ctx_next_epoch(ctx))
+                f->clear_depth = true;
+        }
+        return;
+    }
+
+    /* Tile diffing clears tiles at the flush, and only those that change.
+     * Kept tiles still hold depth, so HiZ takes the cleared value as the
+     * farthest: that is as far as depth goes.
+     */
+    struct b3d_diff *diff = ctx->diff;
+    if (diff && ctx->bins) {
+        size_t tiles = (size_t) diff->tiles_x * (size_t) diff->tiles_y;
+        for (size_t i = 0; i < tiles; ++i)
+            diff->hash[i] = B3D_HASH_SEED;
+        memset(diff->dirty, 0, tiles);
+        diff->pending = true;
+        if (ctx->hiz)
+            b3d_hiz_reset(ctx->hiz);
+        return;
+    }
+    b3d_diff_invalidate(ctx);
+    b3d_fill_pixels(
+        ctx, &(raster_clip_t) {.x1 = ctx->width, .y1 = ctx->height}, 0);
+    b3d_ctx_reset_depth(ctx, count);
+}
+
+/* Partial clears keep what was drawn before: flush it first */
+
+void b3d_ctx_clear_color(b3d_context_t *ctx, uint32_t color)
+{
+    size_t count = b3d_ctx_pixel_count(ctx);
+    if (count == 0)
+        return;
+    b3d_ctx_finish(ctx);
+    b3d_diff_invalidate(ctx);
+    b3d_fill_pixels(
+        ctx, &(raster_clip_t) {.x1 = ctx->width, .y1 = ctx->height}, color);
+}
+
+void b3d_ctx_clear_depth(b3d_context_t *ctx)
+{
+    size_t count = b3d_ctx_pixel_count(ctx);
+    if (count == 0)
+        return;
+    b3d_ctx_finish(ctx);
+    b3d_diff_invalidate(ctx);
+    b3d_ctx_reset_depth(ctx, count);
+}
+
+void b3d_ctx_clear_rect(b3d_context_t *ctx,
+                        int x0,
+                        int y0,
+                        int x1,
+                        int y1,
+                        uint32_t color)
+{
+    if (b3d_ctx_pixel_count(ctx) == 0)
+        return;
+    raster_clip_t r = {
+        .x0 = b3d_clamp_int(x0, 0, ctx->width),
+        .y0 = b3d_clamp_int(y0, 0, ctx->height),
+        .x1 = b3d_clamp_int(x1, 0, ctx->width),
+        .y1 = b3d_clamp_int(y1, 0, ctx->height),
+    };
+    if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        return;
+    b3d_ctx_finish(ctx);
+    b3d_diff_invalidate(ctx);
+    b3d_fill_rect(ctx, &r, color);
+}
+
+bool b3d_ctx_set_depth_epochs(b3d_context_t *ctx, bool enable)
+{
+#ifdef B3D_DEPTH_EPOCHS
+    size_t count = b3d_ctx_pixel_count(ctx);
+    if (count == 0)
+        return false;
+    b3d_ctx_finish(ctx);
+    b3d_diff_invalidate(ctx);
+    /* Values of the old encoding cannot be compared with the new one */
+    ctx->depth_epochs = enable;
+    ctx->depth_epoch = 0;
+    b3d_ctx_reset_depth(ctx, count);
+    return true;
+#else
+    (void) ctx;
+    (void) enable;
+    return false;
+#endif
+}
+
+size_t b3d_buffer_size(int w, int h, size_t elem_size)
+{
+    if (w <= 0 || h <= 0 || elem_size == 0)
+        return 0;
+
+    /* Check for overflow: w * h * elem_size */
+    size_t sw = (size_t) w;
+    size_t sh = (size_t) h;
+    if (sw > SIZE_MAX / sh)
+        return 0;
+
+    size_t count = sw * sh;
+    if (count > SIZE_MAX / elem_size)
+        return 0;
+    return count * elem_size;
+}
+
+bool b3d_ctx_set_rasterizer(b3d_context_t *ctx, int mode)
+{
+    if (!ctx || (mode != B3D_RASTER_SCANLINE && mode != B3D_RASTER_EDGE))
+        return false;
+
+    /* Queued triangles are drawn with the rasterizer they were queued for */
+    b3d_ctx_flush(ctx);
+    ctx->rasterizer = mode;
+    return true;
+}
+
+void b3d_ctx_set_guard_band(b3d_context_t *ctx, bool enable)
+{
+    if (!ctx)
+        return;
+    /* Queued triangles are clipped as they would have been right away */
+    if (ctx->queue)
+        b3d_queue_run(ctx);
+    ctx->guard_band = enable;
+    ctx->planes_cached_w = ctx->planes_cached_h = 0;
+    b3d_update_screen_planes(ctx);
+}
+
+bool b3d_ctx_get_guard_band(const b3d_context_t *ctx)
+{
+    return ctx && ctx->guard_band;
+}
+
+int b3d_ctx_get_rasterizer(const b3d_context_t *ctx)
+{
+    return ctx->rasterizer;
+}
+
+bool b3d_ctx_set_depth_func(b3d_context_t *ctx, int func)
+{
+    if (!ctx || func < B3D_DEPTH_LESS || func > B3D_DEPTH_EQUAL)
+        return false;
+
+    /* Queued triangles are drawn with the state they were queued for */
+    b3d_ctx_flush(ctx);
+    ctx->raster_state =
+        (ctx->raster_state & ~(uint32_t) B3D_STATE_FUNC) | (uint32_t) func;
+    return true;
+}
+
+int b3d_ctx_get_depth_func(const b3d_context_t *ctx)
+{
+    return (int) (ctx->raster_state & B3D_STATE_FUNC);
+}
+
+void b3d_ctx_set_depth_write(b3d_context_t *ctx, bool enable)
+{
+    if (!ctx)
+        return;
+    b3d_ctx_flush(ctx);
+    if (enable)
+        ctx->raster_state &= ~(uint32_t) B3D_STATE_NO_DEPTH_WRITE;
+    else
+        ctx->raster_state |= B3D_STATE_NO_DEPTH_WRITE;
+}
+
+bool b3d_ctx_get_depth_write(const b3d_context_t *ctx)
+{
+    return ctx && !(ctx->raster_state & B3D_STATE_NO_DEPTH_WRITE);
+}
+
+void b3d_ctx_set_color_write(b3d_context_t *ctx, bool enable)
+{
+    if (!ctx)
+        return;
+    b3d_ctx_flush(ctx);
+    if (enable)
+        ctx->raster_state &= ~(uint32_t) B3D_STATE_NO_COLOR_WRITE;
+    else
+        ctx->raster_state |= B3D_STATE_NO_COLOR_WRITE;
+}
+
+bool b3d_ctx_get_color_write(const b3d_context_t *ctx)
+{
+    return ctx && !(ctx->raster_state & B3D_STATE_NO_COLOR_WRITE);
+}
+
+bool b3d_ctx_set_binning(b3d_context_t *ctx,
+                         void *arena,
+                         size_t size,
+                         int threads)
+{
+    if (!ctx)
+        return false;
+
+    /* The pipeline records into the binning arena */
+    b3d_ctx_set_frames(ctx, NULL, NULL, 0);
+    /* Queued triangles go where binning pointed when they were queued */
+    if (ctx->queue)
+        b3d_queue_run(ctx);
+    if (ctx->bins) {
+        b3d_bins_flush(ctx);
+#ifdef B3D_THREADS
+        b3d_bins_stop_workers(ctx->bins);
+#endif
+        ctx->bins = NULL;
+    }
+    /* Drawing in between would bypass the tile hashes */
+    b3d_diff_invalidate(ctx);
+    if (!arena)
+        return true;
+    if (!b3d_ctx_is_initialized(ctx))
+        return false;
+
+    /* Align the start of the arena for the structures placed in it */
+    uintptr_t addr = (uintptr_t) arena;
+    size_t pad = (size_t) (B3D_ALIGN_UP(addr) - addr);
+    if (size < pad + sizeof(struct b3d_bins))
+        return false;
+
+    struct b3d_bins *bins = (struct b3d_bins *) ((unsigned char *) arena + pad);
+    memset(bins, 0, sizeof(*bins));
+    bins->arena = (unsigned char *) bins;
+    bins->arena_size = size - pad;
+    if (!b3d_bins_layout(bins, ctx->width, ctx->height))
+        return false;
+    bins->threads = b3d_clamp_int(threads, 1, B3D_MAX_THREADS);
+#ifdef B3D_THREADS
+    b3d_bins_start_workers(bins);
+#endif
+    ctx->bins = bins;
+    return true;
+}
+
+void b3d_ctx_flush(b3d_context_t *ctx)
+{
+    if (ctx && ctx->queue)
+        b3d_queue_run(ctx);
+    if (ctx && ctx->bins)
+        b3d_bins_flush(ctx);
+}
+
+/* Stop the rasterizer thread after the submitted frames */
+static void b3d_frames_stop(struct b3d_frames *frames)
+{
+#ifdef B3D_THREADS
+    b3d_frames_idle(frames);
+    if (frames->running) {
+        pthread_mutex_lock(&frames->lock);
+        frames->quit = true;
+        pthread_cond_signal(&frames->wake);
+        pthread_mutex_unlock(&frames->lock);
+        pthread_join(frames->thread, NULL);
+    }
+    pthread_cond_destroy(&frames->done);
+    pthread_cond_destroy(&frames->wake);
+    pthread_mutex_destroy(&frames->lock);
+    b3d_bins_stop_workers(frames->frame[1].bins);
+#else
+    (void) frames;
+#endif
+}
+
+bool b3d_ctx_set_frames(b3d_context_t *ctx,
+                        void *pixel_buffer,
+                        void *arena,
+                        size_t size)
+{
+    if (!ctx)
+        return false;
+
+    struct b3d_frames *frames = ctx->frames;
+    if (frames) {
+        if (frames->recording >= 0) {
+            b3d_bins_reset(frames->frame[frames->recording].bins);
+            if (ctx->queue)
+                ctx->queue->count = 0;
+        }
+        b3d_frames_stop(frames);
+        ctx->bins = frames->frame[0].bins;
+        ctx->pixels = frames->frame[0].pixels;
+        ctx->frames = NULL;
+    }
+    if (!pixel_buffer)
+        return true;
+    if (!ctx->bins || ctx->diff || !arena ||
+        !b3d_pixel_layout_ok(pixel_buffer, ctx->pixel_format,
+                             ctx->pixel_stride, ctx->width, ctx->height))
+        return false;
+
+    /* The frame state, then the tile arena of the second buffer */
+    uintptr_t addr = (uintptr_t) arena;
+    size_t pad = (size_t) (B3D_ALIGN_UP(addr) - addr);
+    size_t header = B3D_ALIGN_UP(sizeof(struct b3d_frames));
+    if (size < pad + header + sizeof(struct b3d_bins))
+        return false;
+
+    frames = (struct b3d_frames *) ((unsigned char *) arena + pad);
+    struct b3d_bins *bins =
+        (struct b3d_bins *) ((unsigned char *) frames + header);
+    memset(bins, 0, sizeof(*bins));
+    bins->arena = (unsigned char *) bins;
+    bins->arena_size = size - pad - header;
+    /* A recorded frame cannot draw around its arena, see
+     * b3d_raster_screen_tri()
+     */
+    if (!b3d_bins_layout(bins, ctx->width, ctx->height) ||
+        !b3d_bins_fit_screen(bins) || !b3d_bins_fit_screen(ctx->bins))
+        return false;
+
+    /* Triangles binned so far go to the first buffer */
+    b3d_ctx_flush(ctx);
+    memset(frames, 0, sizeof(*frames));
+    frames->frame[0].bins = ctx->bins;
+    frames->frame[0].pixels = ctx->pixels;
+    frames->frame[1].bins = bins;
+    frames->frame[1].pixels = pixel_buffer;
+    frames->recording = -1;
+    bins->threads = ctx->bins->threads;
+#ifdef B3D_THREADS
+    b3d_bins_start_workers(bins);
+    pthread_mutex_init(&frames->lock, NULL);
+    pthread_cond_init(&frames->wake, NULL);
+    pthread_cond_init(&frames->done, NULL);
+    /* Without the thread, frames are rasterized as they are submitted */
+    frames->running =
+        pthread_create(&frames->thread, NULL, b3d_frames_thread, frames) == 0;
+#endif
+    ctx->bins = NULL;
+    ctx->frames = frames;
+    return true;
+}
+
+bool b3d_ctx_frame_begin(b3d_context_t *ctx)
+{
+    struct b3d_frames *frames = ctx ? ctx->frames : NULL;
+    /* Packets alternate, so the next one is busy only if both are */
+    if (!frames || frames->recording >= 0 || frames->pending == 2)
+        return false;
+
+    struct b3d_frame *f = &frames->frame[frames->next];
+    f->clear = f->clear_depth = false;
+    /* Triangles queued outside a frame are ignored like drawn ones */
+    if (ctx->queue)
+        ctx->queue->count = 0;
+    ctx->bins = f->bins;
+    ctx->pixels = f->pixels;
+    frames->recording = frames->next;
+    frames->next ^= 1;
+    return true;
+}
+
+bool b3d_ctx_frame_submit(b3d_context_t *ctx)
+{
+    struct b3d_frames *frames = ctx ? ctx->frames : NULL;
+    if (!frames || frames->recording < 0)
+        return false;
+
+    if (ctx->queue)
+        b3d_queue_run(ctx);
+    struct b3d_frame *f = &frames->frame[frames->recording];
+    f->ctx = *ctx;
+    f->ctx.queue = NULL;
+    f->ctx.list = NULL;
+    f->ctx.frames = NULL;
+#ifdef B3D_STATS
+    memset(&f->ctx.stats, 0, sizeof(f->ctx.stats));
+#endif
+    frames->recording = -1;
+    frames->pending++;
+    ctx->bins = NULL;
+#ifdef B3D_THREADS
+    if (frames->running) {
+        pthread_mutex_lock(&frames->lock);
+        f->state = B3D_FRAME_QUEUED;
+        pthread_cond_signal(&frames->wake);
+        pthread_mutex_unlock(&frames->lock);
+        return true;
+    }
+#endif
+    b3d_frame_raster(f);
+    f->state = B3D_FRAME_DONE;
+    return true;
+}
+
+void *b3d_ctx_frame_wait(b3d_context_t *ctx)
+{
+    struct b3d_frames *frames = ctx ? ctx->frames : NULL;
+    if (!frames || frames->pending == 0)
+        return NULL;
+
+    struct b3d_frame *f = &frames->frame[frames->oldest];
+#ifdef B3D_THREADS
+    if (frames->running) {
+        pthread_mutex_lock(&frames->lock);
+        while (f->state != B3D_FRAME_DONE)
+            pthread_cond_wait(&frames->done, &frames->lock);
+        pthread_mutex_unlock(&frames->lock);
+    }
+#endif
+#ifdef B3D_STATS
+    b3d_stats_merge(&ctx->stats, &f->ctx.stats);
+    ctx->stats.raster_ns += f->ctx.stats.raster_ns;
+#endif
+    frames->oldest ^= 1;
+    frames->pending--;
+    return f->pixels;
+}
+
+bool b3d_ctx_set_queue(b3d_context_t *ctx, void *arena, size_t size, int order)
+{
+    if (!ctx)
+        return false;
+
+    if (ctx->queue) {
+        b3d_queue_run(ctx);
+        ctx->queue = NULL;
+    }
+    if (!arena)
+        return true;
+    if (!b3d_ctx_is_initialized(ctx) ||
+        (order != B3D_QUEUE_FRONT_TO_BACK && order != B3D_QUEUE_BACK_TO_FRONT))
+        return false;
+
+    uintptr_t addr = (uintptr_t) arena;
+    size_t pad = (size_t) (B3D_ALIGN_UP(addr) - addr);
+    if (size < pad + B3D_QUEUE_FIXED_BYTES + B3D_QUEUE_TRI_BYTES)
+        return false;
+
+    /* Item indices are 32-bit */
+    size_t n = (size - pad - B3D_QUEUE_FIXED_BYTES) / B3D_QUEUE_TRI_BYTES;
+    if (n > UINT32_MAX)
+        n = UINT32_MAX;
+    unsigned char *p = (unsigned char *) arena + pad;
+    struct b3d_queue *q = (struct b3d_queue *) p;
+    p += B3D_ALIGN_UP(sizeof(*q));
+    q->items = (b3d_queue_item_t *) p;
+    p += B3D_ALIGN_UP(n * sizeof(b3d_queue_item_t));
+    q->keys = (uint16_t *) p;
+    p += B3D_ALIGN_UP(n * sizeof(uint16_t));
+    q->order = (uint32_t *) p;
+    p += B3D_ALIGN_UP(n * sizeof(uint32_t));
+    q->tmp = (uint32_t *) p;
+    q->count = 0;
+    q->capacity = n;
+    q->mode = order;
+    ctx->queue = q;
+    return true;
+}
+
+size_t b3d_queue_arena_size(int max_tris)
+{
+    if (max_tris <= 0 ||
+        (size_t) max_tris > (SIZE_MAX - B3D_QUEUE_FIXED_BYTES) /
+                                B3D_QUEUE_TRI_BYTES)
+        return 0;
+    return B3D_QUEUE_FIXED_BYTES + (size_t) max_tris * B3D_QUEUE_TRI_BYTES;
+}
+
+void b3d_ctx_queue_flush(b3d_context_t *ctx)
+{
+    if (ctx && ctx->queue)
+        b3d_queue_run(ctx);
+}
+
+bool b3d_ctx_list_begin(b3d_context_t *ctx, void *arena, size_t size)
+{
+    if (!ctx || !arena || ctx->list || !b3d_ctx_is_initialized(ctx))
+        return false;
+
+    uintptr_t addr = (uintptr_t) arena;
+    size_t pad = (size_t) (B3D_ALIGN_UP(addr) - addr);
+    if (size < pad + B3D_LIST_FIXED_BYTES + B3D_LIST_TRI_BYTES)
+        return false;
+
+    size_t n = (size - pad - B3D_LIST_FIXED_BYTES) / B3D_LIST_TRI_BYTES;
+    unsigned char *p = (unsigned char *) arena + pad;
+    struct b3d_list *list = (struct b3d_list *) p;
+    memset(list, 0, sizeof(*list));
+    p += B3D_ALIGN_UP(sizeof(*list));
+    list->x = (float *) p;
+    p += B3D_ALIGN_UP(3 * n * sizeof(float));
+    list->y = (float *) p;
+    p += B3D_ALIGN_UP(3 * n * sizeof(float));
+    list->z = (float *) p;
+    p += B3D_ALIGN_UP(3 * n * sizeof(float));
+    list->faces = (b3d_list_face_t *) p;
+    p += B3D_ALIGN_UP(n * sizeof(b3d_list_face_t));
+    list->colors = (uint32_t *) p;
+    list->capacity = n;
+    ctx->list = list;
+    return true;
+}
+
+b3d_list_t *b3d_ctx_list_end(b3d_context_t *ctx)
+{
+    if (!ctx || !ctx->list)
+        return NULL;
+    struct b3d_list *list = ctx->list;
+    ctx->list = NULL;
+    if (list->overflow)
+        return NULL;
+
+    /* Sphere around the center of the bounds, grown by a little rounding */
+    float r2 = 0.0f;
+    for (int a = 0; a < 3; ++a)
+        list->center[a] = (list->min[a] + list->max[a]) * 0.5f;
+    for (size_t i = 0; i < 3 * list->count; ++i) {
+        float dx = list->x[i] - list->center[0];
+        float dy = list->y[i] - list->center[1];
+        float dz = list->z[i] - list->center[2];
+        r2 = fmaxf(r2, dx * dx + dy * dy + dz * dz);
+    }
+    list->radius = sqrtf(r2) * 1.0001f;
+    return list;
+}
+
+size_t b3d_list_arena_size(int max_tris)
+{
+    if (max_tris <= 0 ||
+        (size_t) max_tris >
+            (SIZE_MAX - B3D_LIST_FIXED_BYTES) / B3D_LIST_TRI_BYTES)
+        return 0;
+    return B3D_LIST_FIXED_BYTES + (size_t) max_tris * B3D_LIST_TRI_BYTES;
+}
+
+int b3d_ctx_list_draw(b3d_context_t *ctx, const b3d_list_t *list)
+{
+    if (!ctx || !list || ctx->list || !ctx->pixels || !ctx->depth)
+        return 0;
+    b3d_update_model_view(ctx);
+    return b3d_list_run(ctx, list, &ctx->model_view, &ctx->model_view_proj);
+}
+
+int b3d_ctx_draw_instanced(b3d_context_t *ctx,
+                           const b3d_list_t *list,
+                           const float *instance_matrices,
+                           int count)
+{
+    if (!ctx || !list || !instance_matrices || count <= 0 || ctx->list ||
+        !ctx->pixels || !ctx->depth)
+        return 0;
+
+    /* Each instance costs three matrix products, then culls and transforms
+     * like a display list of its own
+     */
+    int drawn = 0;
+    for (int i = 0; i < count; ++i) {
+        b3d_mat_t inst;
+        memcpy(inst.m, &instance_matrices[(size_t) i * 16], sizeof(inst.m));
+        b3d_mat_t mv = b3d_mat_mul(b3d_mat_mul(ctx->model, inst), ctx->view);
+        b3d_mat_t mvp = b3d_mat_mul(mv, ctx->proj);
+        drawn += b3d_list_run(ctx, list, &mv, &mvp);
+    }
+    return drawn;
+}
+
+bool b3d_ctx_set_tile_diff(b3d_context_t *ctx, void *buf, size_t size)
+{
+    if (!ctx)
+        return false;
+
+    /* A cleared frame is finished with the old tables */
+    b3d_ctx_flush(ctx);
+    ctx->diff = NULL;
+    if (!buf)
+        return true;
+    /* Kept tiles would be in the other framebuffer */
+    if (!b3d_ctx_is_initialized(ctx) || ctx->frames)
+        return false;
+
+    uintptr_t addr = (uintptr_t) buf;
+    size_t pad = (size_t) (B3D_ALIGN_UP(addr) - addr);
+    if (size < pad + sizeof(struct b3d_diff))
+        return false;
+
+    struct b3d_diff *diff = (struct b3d_diff *) ((unsigned char *) buf + pad);
+    diff->size = size - pad;
+    if (!b3d_diff_layout(diff, ctx->width, ctx->height))
+        return false;
+    ctx->diff = diff;
+    return true;
+}
+
+size_t b3d_tile_diff_size(int w, int h)
+{
+    if (w <= 0 || h <= 0)
+        return 0;
+
+    /* Header, two hashes and a dirty flag per tile */
+    size_t count = (size_t) ((w + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE) *
+                   (size_t) ((h + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE);
+    size_t fixed = 3 * B3D_ARENA_ALIGN + B3D_ALIGN_UP(sizeof(struct b3d_diff));
+    if (count > (SIZE_MAX - fixed) / (2 * sizeof(uint64_t) + 1))
+        return 0;
+    return fixed + count * (2 * sizeof(uint64_t) + 1);
+}
+
+int b3d_ctx_get_dirty_rects(const b3d_context_t *ctx,
+                            b3d_rect_t *rects,
+                            int max)
+{
+    if (!ctx || !ctx->diff)
+        return 0;
+
+    /* Merge runs of dirty tiles along each tile row */
+    const struct b3d_diff *diff = ctx->diff;
+    int n = 0;
+    for (int ty = 0; ty < diff->tiles_y; ++ty) {
+        const uint8_t *row = diff->dirty + (size_t) ty * diff->tiles_x;
+        for (int tx = 0; tx < diff->tiles_x; ++tx) {
+            if (!row[tx])
+                continue;
+            int end = tx + 1;
+            while (end < diff->tiles_x && row[end])
+                ++end;
+            if (rects && n < max) {
+                rects[n] = (b3d_rect_t) {
+                    .x0 = tx * B3D_TILE_SIZE,
+                    .y0 = ty * B3D_TILE_SIZE,
+                    .x1 = b3d_clamp_int(end * B3D_TILE_SIZE, 0, ctx->width),
+                    .y1 = b3d_clamp_int((ty + 1) * B3D_TILE_SIZE, 0,
+                                        ctx->height),
+                };
+            }
+            ++n;
+            tx = end;
+        }
+    }
+    return n;
+}
+
+void b3d_ctx_invalidate_tiles(b3d_context_t *ctx)
+{
+    if (ctx)
+        b3d_diff_invalidate(ctx);
+}
+
+bool b3d_ctx_set_hiz(b3d_context_t *ctx, void *buf, size_t size)
+{
+    if (!ctx)
+        return false;
+
+    /* The rasterizer thread may still be using the old buffer */
+    if (ctx->frames)
+        b3d_frames_sync(ctx);
+    ctx->hiz = NULL;
+    if (!buf)
+        return true;
+    if (!b3d_ctx_is_initialized(ctx))
+        return false;
+
+    uintptr_t addr = (uintptr_t) buf;
+    size_t pad = (size_t) (B3D_ALIGN_UP(addr) - addr);
+    if (size < pad + sizeof(struct b3d_hiz))
+        return false;
+
+    struct b3d_hiz *hiz = (struct b3d_hiz *) ((unsigned char *) buf + pad);
+    hiz->size = size - pad;
+    /* Blocks start flagged, so the current depth buffer is picked up */
+    if (!b3d_hiz_layout(hiz, ctx->width, ctx->height))
+        return false;
+    ctx->hiz = hiz;
+    return true;
+}
+
+size_t b3d_hiz_size(int w, int h)
+{
+    if (w <= 0 || h <= 0)
+        return 0;
+
+    /* Header, farthest depth and dirty flag per block */
+    size_t count = (size_t) ((w - 1) / B3D_HIZ_TILE + 1) *
+                   (size_t) ((h - 1) / B3D_HIZ_TILE + 1);
+    size_t fixed = 2 * B3D_ARENA_ALIGN + B3D_ALIGN_UP(sizeof(struct b3d_hiz));
+    if (count > (SIZE_MAX - fixed) / (sizeof(b3d_scalar_t) + 1))
+        return 0;
+    return fixed + count * (sizeof(b3d_scalar_t) + 1);
+}
+
+size_t b3d_frame_arena_size(int w, int h, int max_tris)
+{
+    /* Frame state, then a tile arena */
+    size_t header = B3D_ALIGN_UP(sizeof(struct b3d_frames));
+    size_t bins = b3d_bin_arena_size(w, h, max_tris);
+    if (bins == 0 || bins > SIZE_MAX - header)
+        return 0;
+    return header + bins;
+}
+
+size_t b3d_bin_arena_size(int w, int h, int max_tris)
+{
+    if (w <= 0 || h <= 0 || max_tris < 0)
+        return 0;
+
+    /* Header, tile table, triangles, four tile references per triangle, one
+     * partly filled chunk per tile and one triangle covering all tiles
+     */
+    size_t tiles = (size_t) ((w + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE) *
+                   (size_t) ((h + B3D_TILE_SIZE - 1) / B3D_TILE_SIZE);
+    size_t chunk = B3D_ALIGN_UP(sizeof(b3d_bin_chunk_t));
+    size_t tri = B3D_ALIGN_UP(sizeof(b3d_bin_tri_t)) +
+                 4 * chunk / B3D_BIN_CHUNK + 1;
+    size_t fixed = B3D_ARENA_ALIGN + B3D_ALIGN_UP(sizeof(struct b3d_bins)) +
+                   B3D_ALIGN_UP(tiles * sizeof(b3d_bin_tile_t)) +
+                   tiles * chunk + B3D_ALIGN_UP(sizeof(b3d_bin_tri_t)) +
+                   B3D_ALIGN_UP(sizeof(raster_attr_t));
+    if ((size_t) max_tris > (SIZE_MAX - fixed) / tri)
+        return 0;
+    return fixed + (size_t) max_tris * tri;
+}
+
+bool b3d_ctx_push_matrix(b3d_context_t *ctx)
+{
+    if (ctx->matrix_stack_top >= B3D_MATRIX_STACK_SIZE)
+        return false;
+    ctx->matrix_stack[ctx->matrix_stack_top++] = ctx->model;
+    return true;
+}
+
+bool b3d_ctx_pop_matrix(b3d_context_t *ctx)
+{
+    if (ctx->matrix_stack_top <= 0)
+        return false;
+    ctx->model = ctx->matrix_stack[--ctx->matrix_stack_top];
+    ctx->model_view_dirty = true;
+    return true;
+}
+
+/* Copy a matrix to a flat row-major array */
+static void b3d_mat_store(const b3d_mat_t *m, float out[16])
+{
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c)
+            out[r * 4 + c] = m->m[r][c];
+    }
+}
+
+void b3d_ctx_get_model_matrix(const b3d_context_t *ctx, float out[16])
+{
+    if (!out)
+        return;
+    b3d_mat_store(&ctx->model, out);
+}
+
+void b3d_ctx_set_model_matrix(b3d_context_t *ctx, const float m[16])
+{
+    if (!m)
+        return;
+
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c)
+            ctx->model.m[r][c] = m[r * 4 + c];
     }
-    if (b.y > cv.y) {
-        tmp = b;
-        b = cv;
-        cv = tmp;
+    ctx->model_view_dirty = true;
+}
+
+size_t b3d_ctx_get_clip_drop_count(const b3d_context_t *ctx)
+{
+    return ctx->clip_drop_count;
+}
+
+size_t b3d_ctx_get_hiz_reject_count(const b3d_context_t *ctx)
+{
+    return ctx->hiz_reject_count;
+}
+
+bool b3d_ctx_get_stats(const b3d_context_t *ctx, b3d_stats_t *out)
+{
+    if (!out)
+        return false;
+#ifdef B3D_STATS
+    if (ctx) {
+        *out = ctx->stats;
+        return true;
     }
+#else
+    (void) ctx;
+#endif
+    memset(out, 0, sizeof(*out));
+    return false;
+}
 
-    /* Guard against degenerate triangles (division by zero) */
-    b3d_scalar_t dy_total = cv.y - a.y;
-    b3d_scalar_t dy_top = b.y - a.y;
-    if (dy_total < B3D_FP_DEGEN_THRESHOLD)
+void b3d_ctx_reset_stats(b3d_context_t *ctx)
+{
+#ifdef B3D_STATS
+    if (ctx)
+        memset(&ctx->stats, 0, sizeof(ctx->stats));
+#else
+    (void) ctx;
+#endif
+}
+
+void b3d_ctx_get_camera(const b3d_context_t *ctx, b3d_camera_t *out)
+{
+    if (!out)
         return;
+    *out = ctx->camera_params;
+}
 
-    /* Setup left edge (A to C, spans entire triangle) */
-    raster_edge_t left = {
-        .x = a.x,
-        .z = a.z,
-        .dx = cv.x - a.x,
-        .dz = cv.z - a.z,
-        .t = 0,
-        .t_step = B3D_FP_DIV(B3D_FP_ONE, dy_total),
-    };
+float b3d_ctx_get_fov(const b3d_context_t *ctx)
+{
+    return ctx->fov_degrees;
+}
 
-    /* Setup right edge for top half (A to B) */
-    raster_edge_t right = {
-        .x = a.x,
-        .z = a.z,
-        .dx = b.x - a.x,
-        .dz = b.z - a.z,
-        .t = 0,
-        .t_step = (dy_top > B3D_FP_DEGEN_THRESHOLD)
-                      ? B3D_FP_DIV(B3D_FP_ONE, dy_top)
-                      : 0,
-    };
+void b3d_ctx_get_view_matrix(const b3d_context_t *ctx, float out[16])
+{
+    if (!out)
+        return;
+    b3d_mat_store(&ctx->view, out);
+}
 
-    /* Rasterize top half: right edge from A toward B */
-    raster_half(B3D_FP_TO_INT(a.y), B3D_FP_TO_INT(b.y), &left, &right, c);
+void b3d_ctx_get_proj_matrix(const b3d_context_t *ctx, float out[16])
+{
+    if (!out)
+        return;
+    b3d_mat_store(&ctx->proj, out);
+}
 
-    /* Setup right edge for bottom half (B to C) */
-    b3d_scalar_t dy_bot = cv.y - b.y;
-    right = (raster_edge_t) {
-        .x = b.x,
-        .z = b.z,
-        .dx = cv.x - b.x,
-        .dz = cv.z - b.z,
-        .t = 0,
-        .t_step = (dy_bot > B3D_FP_DEGEN_THRESHOLD)
-                      ? B3D_FP_DIV(B3D_FP_ONE, dy_bot)
-                      : 0,
-    };
+bool b3d_ctx_is_initialized(const b3d_context_t *ctx)
+{
+    return ctx && ctx->pixels != NULL && ctx->depth != NULL &&
+           ctx->width > 0 && ctx->height > 0;
+}
+
+int b3d_ctx_get_width(const b3d_context_t *ctx)
+{
+    return ctx->width;
+}
+
+int b3d_ctx_get_height(const b3d_context_t *ctx)
+{
+    return ctx->height;
+}
+
+bool b3d_ctx_set_light(b3d_context_t *ctx,
+                       int index,
+                       float x,
+                       float y,
+                       float z,
+                       float intensity)
+{
+    if (!ctx || index < 0 || index >= B3D_MAX_LIGHTS)
+        return false;
+    /* Reject NaN/INF inputs */
+    if (!isfinite(x) || !isfinite(y) || !isfinite(z) || !isfinite(intensity))
+        return false;
+    float len_sq = x * x + y * y + z * z;
+    if (len_sq < B3D_EPSILON)
+        return false; /* Reject zero-length, keep previous direction */
+    float inv_len = 1.0f / b3d_sqrtf(len_sq);
+    ctx->light_dir[index] =
+        (b3d_vec_t) {x * inv_len, y * inv_len, z * inv_len, 0.0f};
+    ctx->light_intensity[index] =
+        intensity < 0.0f ? 0.0f : intensity > 1.0f ? 1.0f : intensity;
+    return true;
+}
+
+bool b3d_ctx_get_light(const b3d_context_t *ctx,
+                       int index,
+                       float *x,
+                       float *y,
+                       float *z,
+                       float *intensity)
+{
+    if (!ctx || index < 0 || index >= B3D_MAX_LIGHTS)
+        return false;
+    if (x)
+        *x = ctx->light_dir[index].x;
+    if (y)
+        *y = ctx->light_dir[index].y;
+    if (z)
+        *z = ctx->light_dir[index].z;
+    if (intensity)
+        *intensity = ctx->light_intensity[index];
+    return true;
+}
+
+void b3d_ctx_set_light_direction(b3d_context_t *ctx, float x, float y, float z)
+{
+    b3d_ctx_set_light(ctx, 0, x, y, z, ctx->light_intensity[0]);
+}
+
+void b3d_ctx_get_light_direction(const b3d_context_t *ctx,
+                                 float *x,
+                                 float *y,
+                                 float *z)
+{
+    b3d_ctx_get_light(ctx, 0, x, y, z, NULL);
+}
+
+float b3d_ctx_get_ambient(const b3d_context_t *ctx)
+{
+    return ctx->ambient;
+}
+
+void b3d_ctx_set_ambient(b3d_context_t *ctx, float ambient)
+{
+    /* Reject NaN/INF inputs */
+    if (!isfinite(ambient))
+        return;
+    if (ambient < 0.0f)
+        ambient = 0.0f;
+    if (ambient > 1.0f)
+        ambient = 1.0f;
+    ctx->ambient = ambient;
+}
+
+static inline uint32_t b3d_shade_color(uint32_t c, float intensity)
+{
+    if (intensity < 0.0f)
+        intensity = 0.0f;
+    if (intensity > 1.0f)
+        intensity = 1.0f;
+    int r = (int) (((c >> 16) & 0xFF) * intensity);
+    int g = (int) (((c >> 8) & 0xFF) * intensity);
+    int b = (int) ((c & 0xFF) * intensity);
+    return (uint32_t) ((r << 16) | (g << 8) | b);
+}
+
+/* @c lit from a surface of normal (@nx, @ny, @nz) */
+static uint32_t b3d_light_color(const b3d_context_t *ctx,
+                                float nx,
+                                float ny,
+                                float nz,
+                                uint32_t c)
+{
+    /* Normalize the surface normal */
+    b3d_vec_t n = {nx, ny, nz, 0.0f};
+    n = b3d_vec_norm(n);
+
+    /* Diffuse lighting with two-sided shading (abs of dot product) */
+    float diffuse = 0.0f;
+    for (int i = 0; i < B3D_MAX_LIGHTS; ++i) {
+        if (ctx->light_intensity[i] <= 0.0f)
+            continue;
+        float dot = b3d_vec_dot(n, ctx->light_dir[i]);
+        if (dot < 0.0f)
+            dot = -dot;
+        diffuse += ctx->light_intensity[i] * dot;
+    }
+
+    float intensity = ctx->ambient + (1.0f - ctx->ambient) * diffuse;
+    return b3d_shade_color(c, intensity);
+}
+
+bool b3d_ctx_triangle_lit(b3d_context_t *ctx,
+                          const b3d_tri_t *tri,
+                          float nx,
+                          float ny,
+                          float nz,
+                          uint32_t base_color)
+{
+    uint32_t shaded = b3d_light_color(ctx, nx, ny, nz, base_color);
+    return b3d_ctx_triangle(ctx, tri, shaded);
+}
+
+bool b3d_ctx_triangle_lit_ex(b3d_context_t *ctx,
+                             const b3d_tri_t *tri,
+                             const b3d_point_t normals[3],
+                             uint32_t base_color)
+{
+    if (!ctx || !tri || !normals || !ctx->pixels || !ctx->depth)
+        return false;
+
+    b3d_attr_t attr = {.color = {0}};
+    for (int i = 0; i < 3; ++i)
+        attr.color[i] = b3d_light_color(ctx, normals[i].x, normals[i].y,
+                                        normals[i].z, base_color);
+    if (attr.color[0] == attr.color[1] && attr.color[0] == attr.color[2])
+        return b3d_submit_triangle(ctx, tri, attr.color[0], NULL, NULL);
+    return b3d_submit_triangle(ctx, tri, attr.color[0], &attr, NULL);
+}
+
+/* Global API: thin wrappers over the default context */
+
+bool b3d_init(uint32_t *pixel_buffer,
+              b3d_depth_t *depth_buffer,
+              int w,
+              int h,
+              float fov)
+{
+    return b3d_init_ex(pixel_buffer, B3D_FORMAT_XRGB8888, 0, depth_buffer, w,
+                       h, fov);
+}
+
+bool b3d_init_ex(void *pixel_buffer,
+                 int format,
+                 size_t stride,
+                 b3d_depth_t *depth_buffer,
+                 int w,
+                 int h,
+                 float fov)
+{
+    /* Lighting, rasterizer, depth state and depth epochs configured before
+     * b3d_init() survive re-initialization
+     */
+    b3d_vec_t light_dir[B3D_MAX_LIGHTS];
+    float light_intensity[B3D_MAX_LIGHTS];
+    memcpy(light_dir, b3d_default_ctx.light_dir, sizeof(light_dir));
+    memcpy(light_intensity, b3d_default_ctx.light_intensity,
+           sizeof(light_intensity));
+    float ambient = b3d_default_ctx.ambient;
+    int rasterizer = b3d_default_ctx.rasterizer;
+    uint32_t raster_state = b3d_default_ctx.raster_state;
+    bool guard_band = b3d_default_ctx.guard_band;
+    bool depth_epochs = b3d_default_ctx.depth_epochs;
+
+    /* So do the render queue, binning, hierarchical Z and tile diffing,
+     * the latter three re-laid out for the new size. The frame pipeline
+     * does not, its second framebuffer has the old size.
+     */
+    b3d_ctx_set_frames(&b3d_default_ctx, NULL, NULL, 0);
+    struct b3d_queue *queue = b3d_default_ctx.queue;
+    struct b3d_bins *bins = b3d_default_ctx.bins;
+    struct b3d_hiz *hiz = b3d_default_ctx.hiz;
+    struct b3d_diff *diff = b3d_default_ctx.diff;
+    b3d_ctx_flush(&b3d_default_ctx);
+
+    bool ok = b3d_ctx_init_ex(&b3d_default_ctx, pixel_buffer, format, stride,
+                              depth_buffer, w, h, fov);
+    memcpy(b3d_default_ctx.light_dir, light_dir, sizeof(light_dir));
+    memcpy(b3d_default_ctx.light_intensity, light_intensity,
+           sizeof(light_intensity));
+    b3d_default_ctx.ambient = ambient;
+    b3d_default_ctx.rasterizer = rasterizer;
+    b3d_default_ctx.raster_state = raster_state;
+    b3d_ctx_set_guard_band(&b3d_default_ctx, guard_band);
+    if (ok && depth_epochs)
+        b3d_ctx_set_depth_epochs(&b3d_default_ctx, true);
+    if (bins) {
+        b3d_default_ctx.bins = bins;
+        if (!ok || !b3d_bins_layout(bins, w, h))
+            b3d_ctx_set_binning(&b3d_default_ctx, NULL, 0, 0);
+    }
+    if (hiz && ok && b3d_hiz_layout(hiz, w, h))
+        b3d_default_ctx.hiz = hiz;
+    if (diff && ok && b3d_diff_layout(diff, w, h))
+        b3d_default_ctx.diff = diff;
+    if (ok)
+        b3d_default_ctx.queue = queue;
+    return ok;
+}
+
+bool b3d_set_pixel_buffer(void *pixel_buffer, size_t stride)
+{
+    return b3d_ctx_set_pixel_buffer(&b3d_default_ctx, pixel_buffer, stride);
+}
+
+void b3d_clear(void)
+{
+    b3d_ctx_clear(&b3d_default_ctx);
+}
+
+void b3d_clear_color(uint32_t color)
+{
+    b3d_ctx_clear_color(&b3d_default_ctx, color);
+}
+
+void b3d_clear_depth(void)
+{
+    b3d_ctx_clear_depth(&b3d_default_ctx);
+}
+
+void b3d_clear_rect(int x0, int y0, int x1, int y1, uint32_t color)
+{
+    b3d_ctx_clear_rect(&b3d_default_ctx, x0, y0, x1, y1, color);
+}
+
+bool b3d_set_depth_epochs(bool enable)
+{
+    return b3d_ctx_set_depth_epochs(&b3d_default_ctx, enable);
+}
+
+void b3d_reset(void)
+{
+    b3d_ctx_reset(&b3d_default_ctx);
+}
+
+void b3d_translate(float x, float y, float z)
+{
+    b3d_ctx_translate(&b3d_default_ctx, x, y, z);
+}
+
+void b3d_rotate_x(float angle)
+{
+    b3d_ctx_rotate_x(&b3d_default_ctx, angle);
+}
+
+void b3d_rotate_y(float angle)
+{
+    b3d_ctx_rotate_y(&b3d_default_ctx, angle);
+}
+
+void b3d_rotate_z(float angle)
+{
+    b3d_ctx_rotate_z(&b3d_default_ctx, angle);
+}
+
+void b3d_scale(float x, float y, float z)
+{
+    b3d_ctx_scale(&b3d_default_ctx, x, y, z);
+}
 
-    /* Rasterize bottom half: right edge from B toward C */
-    raster_half(B3D_FP_TO_INT(b.y), B3D_FP_TO_INT(cv.y), &left, &right, c);
+bool b3d_push_matrix(void)
+{
+    return b3d_ctx_push_matrix(&b3d_default_ctx);
 }
 
-#undef PUT_PIXEL
+bool b3d_pop_matrix(void)
+{
+    return b3d_ctx_pop_matrix(&b3d_default_ctx);
+}
 
-/* Public API */
+void b3d_get_model_matrix(float out[16])
+{
+    b3d_ctx_get_model_matrix(&b3d_default_ctx, out);
+}
 
-bool b3d_triangle(const b3d_tri_t *tri, uint32_t c)
+void b3d_set_model_matrix(const float m[16])
 {
-    if (!tri || !b3d_pixels || !b3d_depth)
-        return false;
+    b3d_ctx_set_model_matrix(&b3d_default_ctx, m);
+}
 
-    b3d_triangle_t t =
-        (b3d_triangle_t) {{{tri->v[0].x, tri->v[0].y, tri->v[0].z, 1},
-                           {tri->v[1].x, tri->v[1].y, tri->v[1].z, 1},
-                           {tri->v[2].x, tri->v[2].y, tri->v[2].z, 1}}};
-#ifdef B3D_NO_CULLING
-    /* Lazy matrix computation: use cached model*view when culling disabled */
-    b3d_update_model_view();
-    TRANSFORM_TRI(t, b3d_model_view);
-#else
-    /* Standard path: separate transforms for world-space culling */
-    TRANSFORM_TRI(t, b3d_model);
-    b3d_vec_t line_a = b3d_vec_sub(t.p[1], t.p[0]);
-    b3d_vec_t line_b = b3d_vec_sub(t.p[2], t.p[0]);
-    b3d_vec_t normal = b3d_vec_cross(line_a, line_b);
-    b3d_vec_t cam_ray = b3d_vec_sub(t.p[0], b3d_camera);
-    if (b3d_vec_dot(normal, cam_ray) > B3D_CULL_THRESHOLD)
-        return false;
-    TRANSFORM_TRI(t, b3d_view);
-#endif
+void b3d_set_camera(const b3d_camera_t *cam)
+{
+    b3d_ctx_set_camera(&b3d_default_ctx, cam);
+}
 
-    b3d_triangle_t clipped[2];
-    int count = b3d_clip_against_plane((b3d_vec_t) {0, 0, B3D_NEAR_DISTANCE, 1},
-                                       (b3d_vec_t) {0, 0, 1, 1}, t, clipped);
-    if (count == 0)
-        return false;
+void b3d_look_at(float x, float y, float z)
+{
+    b3d_ctx_look_at(&b3d_default_ctx, x, y, z);
+}
 
-    b3d_triangle_t buf_a[B3D_CLIP_BUFFER_SIZE], buf_b[B3D_CLIP_BUFFER_SIZE];
-    b3d_triangle_t *src = buf_a, *dst = buf_b;
-    int src_count = 0;
-    for (int n = 0; n < count; ++n) {
-        t = clipped[n];
-        TRANSFORM_TRI(t, b3d_proj);
-        if (fabsf(t.p[0].w) < B3D_EPSILON || fabsf(t.p[1].w) < B3D_EPSILON ||
-            fabsf(t.p[2].w) < B3D_EPSILON)
-            continue;
+void b3d_set_fov(float fov_in_degrees)
+{
+    b3d_ctx_set_fov(&b3d_default_ctx, fov_in_degrees);
+}
 
-        PERSPECTIVE_DIV(t);
-        float xs = b3d_width * 0.5f;
-        float ys = b3d_height * 0.5f;
-        NDC_TO_SCREEN(t.p[0], xs, ys);
-        NDC_TO_SCREEN(t.p[1], xs, ys);
-        NDC_TO_SCREEN(t.p[2], xs, ys);
-        if (src_count < B3D_CLIP_BUFFER_SIZE)
-            src[src_count++] = t;
-        else
-            ++b3d_clip_drop_count;
-    }
+void b3d_get_camera(b3d_camera_t *out)
+{
+    b3d_ctx_get_camera(&b3d_default_ctx, out);
+}
 
-    for (int p = 0; p < 4; ++p) {
-        int dst_count = 0;
-        for (int i = 0; i < src_count; ++i) {
-            int n = b3d_clip_against_plane(b3d_screen_planes[p][0],
-                                           b3d_screen_planes[p][1], src[i],
-                                           clipped);
-            for (int w = 0; w < n; ++w) {
-                if (dst_count < B3D_CLIP_BUFFER_SIZE)
-                    dst[dst_count++] = clipped[w];
-                else
-                    ++b3d_clip_drop_count;
-            }
-        }
+float b3d_get_fov(void)
+{
+    return b3d_ctx_get_fov(&b3d_default_ctx);
+}
 
-        b3d_triangle_t *tmp = src;
-        src = dst;
-        dst = tmp;
-        src_count = dst_count;
-    }
-    if (src_count == 0)
-        return false;
+void b3d_get_view_matrix(float out[16])
+{
+    b3d_ctx_get_view_matrix(&b3d_default_ctx, out);
+}
 
-    for (int i = 0; i < src_count; ++i) {
-        raster_vertex_t rv[3] = {
-            {B3D_FLOAT_TO_FP(src[i].p[0].x), B3D_FLOAT_TO_FP(src[i].p[0].y),
-             B3D_FLOAT_TO_FP(src[i].p[0].z)},
-            {B3D_FLOAT_TO_FP(src[i].p[1].x), B3D_FLOAT_TO_FP(src[i].p[1].y),
-             B3D_FLOAT_TO_FP(src[i].p[1].z)},
-            {B3D_FLOAT_TO_FP(src[i].p[2].x), B3D_FLOAT_TO_FP(src[i].p[2].y),
-             B3D_FLOAT_TO_FP(src[i].p[2].z)},
-        };
-        b3d_rasterize(rv, c);
-    }
-    return true;
+void b3d_get_proj_matrix(float out[16])
+{
+    b3d_ctx_get_proj_matrix(&b3d_default_ctx, out);
 }
 
-void b3d_reset(void)
+void b3d_set_light_direction(float x, float y, float z)
 {
-    b3d_model = b3d_mat_ident();
-    b3d_model_view_dirty = true;
+    b3d_ctx_set_light_direction(&b3d_default_ctx, x, y, z);
 }
 
-void b3d_rotate_x(float angle)
+void b3d_get_light_direction(float *x, float *y, float *z)
 {
-    b3d_model = b3d_mat_mul(b3d_model, b3d_mat_rot_x(angle));
-    b3d_model_view_dirty = true;
+    b3d_ctx_get_light_direction(&b3d_default_ctx, x, y, z);
 }
 
-void b3d_rotate_y(float angle)
+bool b3d_set_light(int index, float x, float y, float z, float intensity)
 {
-    b3d_model = b3d_mat_mul(b3d_model, b3d_mat_rot_y(angle));
-    b3d_model_view_dirty = true;
+    return b3d_ctx_set_light(&b3d_default_ctx, index, x, y, z, intensity);
 }
 
-void b3d_rotate_z(float angle)
+bool b3d_get_light(int index, float *x, float *y, float *z, float *intensity)
 {
-    b3d_model = b3d_mat_mul(b3d_model, b3d_mat_rot_z(angle));
-    b3d_model_view_dirty = true;
+    return b3d_ctx_get_light(&b3d_default_ctx, index, x, y, z, intensity);
 }
 
-void b3d_translate(float x, float y, float z)
+void b3d_set_ambient(float ambient)
 {
-    b3d_model = b3d_mat_mul(b3d_model, b3d_mat_trans(x, y, z));
-    b3d_model_view_dirty = true;
+    b3d_ctx_set_ambient(&b3d_default_ctx, ambient);
 }
 
-void b3d_scale(float x, float y, float z)
+float b3d_get_ambient(void)
 {
-    b3d_model = b3d_mat_mul(b3d_model, b3d_mat_scale(x, y, z));
-    b3d_model_view_dirty = true;
+    return b3d_ctx_get_ambient(&b3d_default_ctx);
 }
 
-void b3d_set_fov(float fov_in_degrees)
+bool b3d_triangle(const b3d_tri_t *tri, uint32_t c)
 {
-    if (b3d_width <= 0 || b3d_height <= 0)
-        return;
+    return b3d_ctx_triangle(&b3d_default_ctx, tri, c);
+}
 
-    b3d_fov_degrees = fov_in_degrees;
-    b3d_proj = b3d_mat_proj(fov_in_degrees, b3d_height / (float) b3d_width,
-                            B3D_NEAR_DISTANCE, B3D_FAR_DISTANCE);
+bool b3d_triangle_lit(const b3d_tri_t *tri,
+                      float nx,
+                      float ny,
+                      float nz,
+                      uint32_t base_color)
+{
+    return b3d_ctx_triangle_lit(&b3d_default_ctx, tri, nx, ny, nz, base_color);
 }
 
-void b3d_set_camera(const b3d_camera_t *cam)
+bool b3d_triangle_ex(const b3d_tri_t *tri, const b3d_attr_t *attr)
 {
-    if (!cam)
-        return;
+    return b3d_ctx_triangle_ex(&b3d_default_ctx, tri, attr);
+}
 
-    b3d_camera_params = *cam;
-    b3d_camera = (b3d_vec_t) {cam->x, cam->y, cam->z, 1};
-    b3d_vec_t up = {0, 1, 0, 1};
-    b3d_vec_t target = {0, 0, 1, 1};
-    up = b3d_mat_mul_vec(b3d_mat_rot_z(cam->roll), up);
-    target = b3d_mat_mul_vec(b3d_mat_rot_x(cam->pitch), target);
-    target = b3d_mat_mul_vec(b3d_mat_rot_y(cam->yaw), target);
-    target = b3d_vec_add(b3d_camera, target);
-    b3d_view = b3d_mat_qinv(b3d_mat_point_at(b3d_camera, target, up));
-    b3d_model_view_dirty = true;
+bool b3d_triangle_lit_ex(const b3d_tri_t *tri,
+                         const b3d_point_t normals[3],
+                         uint32_t base_color)
+{
+    return b3d_ctx_triangle_lit_ex(&b3d_default_ctx, tri, normals, base_color);
 }
 
-void b3d_look_at(float x, float y, float z)
+bool b3d_set_texture(const b3d_texture_t *tex)
 {
-    b3d_vec_t up = {0, 1, 0, 1};
-    b3d_view = b3d_mat_qinv(
-        b3d_mat_point_at(b3d_camera, (b3d_vec_t) {x, y, z, 1}, up));
-    b3d_model_view_dirty = true;
+    return b3d_ctx_set_texture(&b3d_default_ctx, tex);
 }
 
-bool b3d_to_screen(float x, float y, float z, int *sx, int *sy)
+int b3d_draw_mesh(const float *positions,
+                  int vcount,
+                  const uint32_t *indices,
+                  int icount,
+                  const uint32_t *colors)
 {
-    if (!sx || !sy)
-        return false;
+    return b3d_ctx_draw_mesh(&b3d_default_ctx, positions, vcount, indices,
+                             icount, colors);
+}
 
-    b3d_vec_t p = {x, y, z, 1};
-    p = b3d_mat_mul_vec(b3d_model, p);
-    p = b3d_mat_mul_vec(b3d_view, p);
-    p = b3d_mat_mul_vec(b3d_proj, p);
-    if (p.w < B3D_EPSILON)
-        return false;
+int b3d_draw_mesh_lit(const float *positions,
+                      int vcount,
+                      const uint32_t *indices,
+                      int icount,
+                      const float *normals,
+                      uint32_t base_color)
+{
+    return b3d_ctx_draw_mesh_lit(&b3d_default_ctx, positions, vcount, indices,
+                                 icount, normals, base_color);
+}
 
-    p = b3d_vec_div(p, p.w);
-    float mid_x = b3d_width / 2.0f;
-    float mid_y = b3d_height / 2.0f;
-    p.x = (p.x + 1.0f) * mid_x;
-    p.y = (-p.y + 1.0f) * mid_y;
-    *sx = (int) (p.x + 0.5f);
-    *sy = (int) (p.y + 0.5f);
-    return true;
+void b3d_transform_points(const b3d_mat_t *m,
+                          const float *xs,
+                          const float *ys,
+                          const float *zs,
+                          int n,
+                          b3d_vec_t *out)
+{
+    if (!m || !xs || !ys || !zs || !out || n <= 0)
+        return;
+    b3d_mat_mul_vec_soa(m, xs, ys, zs, n, out);
 }
 
-bool b3d_init(uint32_t *pixel_buffer,
-              b3d_depth_t *depth_buffer,
-              int w,
-              int h,
-              float fov)
+bool b3d_set_rasterizer(int mode)
 {
-    size_t depth_bytes = b3d_buffer_size(w, h, sizeof(b3d_depth_t));
-    size_t pixel_bytes = b3d_buffer_size(w, h, sizeof(uint32_t));
-    if (!pixel_buffer || !depth_buffer || w <= 0 || h <= 0 || fov <= 0 ||
-        depth_bytes == 0 || pixel_bytes == 0) {
-        b3d_width = 0;
-        b3d_height = 0;
-        b3d_pixels = NULL;
-        b3d_depth = NULL;
-        b3d_matrix_stack_top = 0;
-        b3d_clip_drop_count = 0;
-        b3d_model_view_dirty = true;
-        return false;
-    }
+    return b3d_ctx_set_rasterizer(&b3d_default_ctx, mode);
+}
 
-    b3d_width = w;
-    b3d_height = h;
-    b3d_pixels = pixel_buffer;
-    b3d_depth = depth_buffer;
-    b3d_matrix_stack_top = 0;
-    b3d_model_view_dirty = true;
-    b3d_fov_degrees = fov;
-    b3d_update_screen_planes();
-    b3d_clear();
-    b3d_reset();
-    b3d_proj = b3d_mat_proj(fov, b3d_height / (float) b3d_width,
-                            B3D_NEAR_DISTANCE, B3D_FAR_DISTANCE);
-    b3d_set_camera(&(b3d_camera_t) {0, 0, 0, 0, 0, 0});
-    return true;
+int b3d_get_rasterizer(void)
+{
+    return b3d_ctx_get_rasterizer(&b3d_default_ctx);
 }
 
-void b3d_clear(void)
+bool b3d_set_depth_func(int func)
 {
-    if (!b3d_depth || !b3d_pixels || b3d_width <= 0 || b3d_height <= 0)
-        return;
+    return b3d_ctx_set_depth_func(&b3d_default_ctx, func);
+}
 
-    b3d_clip_drop_count = 0;
-    /* Check for integer overflow when calculating buffer size */
-    if ((size_t) b3d_width > SIZE_MAX / (size_t) b3d_height)
-        return; /* Prevent overflow */
+int b3d_get_depth_func(void)
+{
+    return b3d_ctx_get_depth_func(&b3d_default_ctx);
+}
 
-    size_t count = (size_t) b3d_width * (size_t) b3d_height;
-    /* Also check for overflow in the pixel buffer size calculation */
-    if (count > SIZE_MAX / sizeof(b3d_pixels[0]))
-        return; /* Prevent overflow */
+void b3d_set_depth_write(bool enable)
+{
+    b3d_ctx_set_depth_write(&b3d_default_ctx, enable);
+}
 
-    for (size_t i = 0; i < count; ++i)
-        b3d_depth[i] = B3D_DEPTH_CLEAR;
-    memset(b3d_pixels, 0, count * sizeof(b3d_pixels[0]));
+bool b3d_get_depth_write(void)
+{
+    return b3d_ctx_get_depth_write(&b3d_default_ctx);
 }
 
-size_t b3d_buffer_size(int w, int h, size_t elem_size)
+void b3d_set_color_write(bool enable)
 {
-    if (w <= 0 || h <= 0 || elem_size == 0)
-        return 0;
+    b3d_ctx_set_color_write(&b3d_default_ctx, enable);
+}
 
-    /* Check for overflow: w * h * elem_size */
-    size_t sw = (size_t) w;
-    size_t sh = (size_t) h;
-    if (sw > SIZE_MAX / sh)
-        return 0;
+bool b3d_get_color_write(void)
+{
+    return b3d_ctx_get_color_write(&b3d_default_ctx);
+}
 
-    size_t count = sw * sh;
-    if (count > SIZE_MAX / elem_size)
-        return 0;
-    return count * elem_size;
+void b3d_set_guard_band(bool enable)
+{
+    b3d_ctx_set_guard_band(&b3d_default_ctx, enable);
 }
 
-bool b3d_push_matrix(void)
+bool b3d_get_guard_band(void)
 {
-    if (b3d_matrix_stack_top >= B3D_MATRIX_STACK_SIZE)
-        return false;
-    b3d_matrix_stack[b3d_matrix_stack_top++] = b3d_model;
-    return true;
+    return b3d_ctx_get_guard_band(&b3d_default_ctx);
 }
 
-bool b3d_pop_matrix(void)
+bool b3d_set_binning(void *arena, size_t size, int threads)
 {
-    if (b3d_matrix_stack_top <= 0)
-        return false;
-    b3d_model = b3d_matrix_stack[--b3d_matrix_stack_top];
-    b3d_model_view_dirty = true;
-    return true;
+    return b3d_ctx_set_binning(&b3d_default_ctx, arena, size, threads);
 }
 
-void b3d_get_model_matrix(float out[16])
+bool b3d_set_hiz(void *buf, size_t size)
 {
-    if (!out)
-        return;
+    return b3d_ctx_set_hiz(&b3d_default_ctx, buf, size);
+}
 
-    for (int r = 0; r < 4; ++r) {
-        for (int c = 0; c < 4; ++c)
-            out[r * 4 + c] = b3d_model.m[r][c];
-    }
+bool b3d_occlusion_test_box(const float min[3], const float max[3])
+{
+    return b3d_ctx_occlusion_test_box(&b3d_default_ctx, min, max);
 }
 
-void b3d_set_model_matrix(const float m[16])
+bool b3d_occlusion_test_rect(int x0, int y0, int x1, int y1, float z)
 {
-    if (!m)
-        return;
+    return b3d_ctx_occlusion_test_rect(&b3d_default_ctx, x0, y0, x1, y1, z);
+}
 
-    for (int r = 0; r < 4; ++r) {
-        for (int c = 0; c < 4; ++c)
-            b3d_model.m[r][c] = m[r * 4 + c];
-    }
-    b3d_model_view_dirty = true;
+void b3d_flush(void)
+{
+    b3d_ctx_flush(&b3d_default_ctx);
 }
 
-size_t b3d_get_clip_drop_count(void)
+bool b3d_set_frames(void *pixel_buffer, void *arena, size_t size)
 {
-    return b3d_clip_drop_count;
+    return b3d_ctx_set_frames(&b3d_default_ctx, pixel_buffer, arena, size);
 }
 
-void b3d_get_camera(b3d_camera_t *out)
+bool b3d_frame_begin(void)
 {
-    if (!out)
-        return;
-    *out = b3d_camera_params;
+    return b3d_ctx_frame_begin(&b3d_default_ctx);
 }
 
-float b3d_get_fov(void)
+bool b3d_frame_submit(void)
 {
-    return b3d_fov_degrees;
+    return b3d_ctx_frame_submit(&b3d_default_ctx);
 }
 
-void b3d_get_view_matrix(float out[16])
+void *b3d_frame_wait(void)
 {
-    if (!out)
-        return;
+    return b3d_ctx_frame_wait(&b3d_default_ctx);
+}
 
-    for (int r = 0; r < 4; ++r) {
-        for (int c = 0; c < 4; ++c)
-            out[r * 4 + c] = b3d_view.m[r][c];
-    }
+bool b3d_set_queue(void *arena, size_t size, int order)
+{
+    return b3d_ctx_set_queue(&b3d_default_ctx, arena, size, order);
 }
 
-void b3d_get_proj_matrix(float out[16])
+void b3d_queue_flush(void)
 {
-    if (!out)
-        return;
+    b3d_ctx_queue_flush(&b3d_default_ctx);
+}
 
-    for (int r = 0; r < 4; ++r) {
-        for (int c = 0; c < 4; ++c)
-            out[r * 4 + c] = b3d_proj.m[r][c];
-    }
+bool b3d_list_begin(void *arena, size_t size)
+{
+    return b3d_ctx_list_begin(&b3d_default_ctx, arena, size);
 }
 
-bool b3d_is_initialized(void)
+b3d_list_t *b3d_list_end(void)
 {
-    return b3d_pixels != NULL && b3d_depth != NULL && b3d_width > 0 &&
-           b3d_height > 0;
+    return b3d_ctx_list_end(&b3d_default_ctx);
 }
 
-int b3d_get_width(void)
+int b3d_list_draw(const b3d_list_t *list)
 {
-    return b3d_width;
+    return b3d_ctx_list_draw(&b3d_default_ctx, list);
 }
 
-int b3d_get_height(void)
+int b3d_draw_instanced(const b3d_list_t *list,
+                       const float *instance_matrices,
+                       int count)
 {
-    return b3d_height;
+    return b3d_ctx_draw_instanced(&b3d_default_ctx, list, instance_matrices,
+                                  count);
 }
 
-void b3d_set_light_direction(float x, float y, float z)
+bool b3d_set_tile_diff(void *buf, size_t size)
 {
-    /* Reject NaN/INF inputs */
-    if (!isfinite(x) || !isfinite(y) || !isfinite(z))
-        return;
-    float len_sq = x * x + y * y + z * z;
-    if (len_sq < B3D_EPSILON)
-        return; /* Reject zero-length, keep previous direction */
-    float inv_len = 1.0f / b3d_sqrtf(len_sq);
-    b3d_light_dir = (b3d_vec_t) {x * inv_len, y * inv_len, z * inv_len, 0.0f};
+    return b3d_ctx_set_tile_diff(&b3d_default_ctx, buf, size);
 }
 
-void b3d_get_light_direction(float *x, float *y, float *z)
+int b3d_get_dirty_rects(b3d_rect_t *rects, int max)
 {
-    if (x)
-        *x = b3d_light_dir.x;
-    if (y)
-        *y = b3d_light_dir.y;
-    if (z)
-        *z = b3d_light_dir.z;
+    return b3d_ctx_get_dirty_rects(&b3d_default_ctx, rects, max);
 }
 
-float b3d_get_ambient(void)
+void b3d_invalidate_tiles(void)
 {
-    return b3d_ambient;
+    b3d_ctx_invalidate_tiles(&b3d_default_ctx);
 }
 
-void b3d_set_ambient(float ambient)
+bool b3d_to_screen(float x, float y, float z, int *sx, int *sy)
 {
-    /* Reject NaN/INF inputs */
-    if (!isfinite(ambient))
-        return;
-    if (ambient < 0.0f)
-        ambient = 0.0f;
-    if (ambient > 1.0f)
-        ambient = 1.0f;
-    b3d_ambient = ambient;
+    return b3d_ctx_to_screen(&b3d_default_ctx, x, y, z, sx, sy);
 }
 
-static inline uint32_t b3d_shade_color(uint32_t c, float intensity)
+size_t b3d_get_clip_drop_count(void)
 {
-    if (intensity < 0.0f)
-        intensity = 0.0f;
-    if (intensity > 1.0f)
-        intensity = 1.0f;
-    int r = (int) (((c >> 16) & 0xFF) * intensity);
-    int g = (int) (((c >> 8) & 0xFF) * intensity);
-    int b = (int) ((c & 0xFF) * intensity);
-    return (uint32_t) ((r << 16) | (g << 8) | b);
+    return b3d_ctx_get_clip_drop_count(&b3d_default_ctx);
 }
 
-bool b3d_triangle_lit(const b3d_tri_t *tri,
-                      float nx,
-                      float ny,
-                      float nz,
-                      uint32_t base_color)
+size_t b3d_get_hiz_reject_count(void)
 {
-    /* Normalize the surface normal */
-    b3d_vec_t n = {nx, ny, nz, 0.0f};
-    n = b3d_vec_norm(n);
+    return b3d_ctx_get_hiz_reject_count(&b3d_default_ctx);
+}
 
-    /* Diffuse lighting with two-sided shading (abs of dot product) */
-    float dot = b3d_vec_dot(n, b3d_light_dir);
-    if (dot < 0.0f)
-        dot = -dot;
+bool b3d_get_stats(b3d_stats_t *out)
+{
+    return b3d_ctx_get_stats(&b3d_default_ctx, out);
+}
+
+void b3d_reset_stats(void)
+{
+    b3d_ctx_reset_stats(&b3d_default_ctx);
+}
+
+bool b3d_is_initialized(void)
+{
+    return b3d_ctx_is_initialized(&b3d_default_ctx);
+}
 
-    float intensity = b3d_ambient + (1.0f - b3d_ambient) * dot;
-    uint32_t shaded = b3d_shade_color(base_color, intensity);
+int b3d_get_width(void)
+{
+    return b3d_ctx_get_width(&b3d_default_ctx);
+}
 
-    return b3d_triangle(tri, shaded);
+int b3d_get_height(void)
+{
+    return b3d_ctx_get_height(&b3d_default_ctx);
 }
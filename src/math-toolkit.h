@@ -351,6 +351,10 @@ static inline void b3d_sincosf(float x, float *sinp, float *cosp)
 #define B3D_DEPTH_FAR 1e30f      /* Depth buffer clear value (far plane) */
 #define B3D_PI 3.1415926536f     /* Pi constant for angle conversions */
 #define B3D_CLIP_BUFFER_SIZE 32  /* Maximum triangles in clipping buffer */
+/* Guard band half-extent around the screen center, in pixels: any two
+ * vertices inside it are less than 2^15 pixels apart, within Q15.16 range
+ */
+#define B3D_GUARD_BAND 16000.0f
 
 /*
  * Depth buffer type (shared with public header)
@@ -405,6 +409,7 @@ static inline float b3d_depth_to_float(b3d_depth_t d)
 /*
  * Internal vector/matrix types
  */
+#ifndef B3D_MATH_TYPES_DEFINED
 typedef struct {
     float x, y, z, w;
 } b3d_vec_t;
@@ -412,6 +417,8 @@ typedef struct {
 typedef struct {
     float m[4][4];
 } b3d_mat_t;
+#define B3D_MATH_TYPES_DEFINED
+#endif
 
 typedef struct {
     b3d_vec_t p[3];
@@ -479,4 +486,43 @@ static inline int b3d_clip_against_plane(b3d_vec_t plane,
     return 0;
 }
 
+/* Clip a clip-space triangle against the plane w = @near, keeping w >= @near.
+ * All four components are interpolated, which is exact since clip space is
+ * a linear image of view space. Returns the number of triangles in @out.
+ */
+static inline int b3d_clip_near_w(float near,
+                                  b3d_triangle_t in,
+                                  b3d_triangle_t out[2])
+{
+    const b3d_vec_t *inside[3], *outside[3];
+    int inside_count = 0, outside_count = 0;
+    for (int i = 0; i < 3; ++i) {
+        if (in.p[i].w >= near)
+            inside[inside_count++] = &in.p[i];
+        else
+            outside[outside_count++] = &in.p[i];
+    }
+
+#define B3D_NEAR_LERP(a, b) b3d_vec_lerp(a, b, (near - (a).w) / ((b).w - (a).w))
+    if (inside_count == 3) {
+        out[0] = in;
+        return 1;
+    } else if (inside_count == 1) {
+        out[0].p[0] = *inside[0];
+        out[0].p[1] = B3D_NEAR_LERP(*inside[0], *outside[0]);
+        out[0].p[2] = B3D_NEAR_LERP(*inside[0], *outside[1]);
+        return 1;
+    } else if (inside_count == 2) {
+        out[0].p[0] = *inside[0];
+        out[0].p[1] = *inside[1];
+        out[0].p[2] = B3D_NEAR_LERP(*inside[0], *outside[0]);
+        out[1].p[0] = *inside[1];
+        out[1].p[1] = out[0].p[2];
+        out[1].p[2] = B3D_NEAR_LERP(*inside[1], *outside[0]);
+        return 2;
+    }
+#undef B3D_NEAR_LERP
+    return 0;
+}
+
 #endif /* B3D_MATH_H */
@@ -0,0 +1,324 @@
+/*
+ * B3D Scene Benchmark
+ * Renders a configurable scene for a fixed number of frames and reports
+ * frame time percentiles and throughput, as text or JSON.
+ *
+ * Usage: bench-scene [--size=WxH] [--tris=N] [--overdraw=K] [--mesh=PATH]
+ *                    [--frames=N] [--raster=scanline|edge] [--bin=THREADS]
+ *                    [--backend=NAME] [--name=LABEL] [--json]
+ *
+ * Without --mesh, each frame draws @overdraw screen-filling layers of a
+ * triangle grid, farthest first so that every layer passes the depth test,
+ * totalling about @tris triangles. With --mesh, the OBJ model is drawn
+ * @overdraw times, spinning, at increasing distance. --backend forces a
+ * kernel set, see b3d_set_backend().
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/b3d.h"
+#include "../include/b3d_obj.h"
+
+/* Frames rendered before timing starts */
+#define WARMUP_FRAMES 10
+
+/* Name of the compile-time configuration, for comparing like with like */
+#if defined(B3D_FLOAT_POINT)
+#define VARIANT_MATH "float"
+#else
+#define VARIANT_MATH "fixed"
+#endif
+#if defined(B3D_DEPTH_16BIT)
+#define VARIANT_DEPTH 16
+#else
+#define VARIANT_DEPTH 32
+#endif
+#if defined(B3D_NO_CULLING)
+#define VARIANT_CULLING false
+#else
+#define VARIANT_CULLING true
+#endif
+
+typedef struct {
+    int width, height;
+    int tris; /* triangles per frame, synthetic scene */
+    int overdraw;
+    const char *mesh;
+    int frames;
+    int raster;
+    int bin_threads;     /* 0: immediate mode */
+    const char *backend; /* NULL: detected */
+    const char *name;
+    bool json;
+} options_t;
+
+static double get_time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Value of @sorted[0..n) at fraction @p, nearest rank */
+static double percentile(const double *sorted, int n, double p)
+{
+    int i = (int) (p * (double) n + 0.999999) - 1;
+    if (i < 0)
+        i = 0;
+    if (i >= n)
+        i = n - 1;
+    return sorted[i];
+}
+
+/* Parse the integer after "@prefix" in @arg into @out. Returns false if
+ * @arg does not start with @prefix; exits on a malformed value.
+ */
+static bool parse_int(const char *arg, const char *prefix, int min, int *out)
+{
+    size_t n = strlen(prefix);
+    if (strncmp(arg, prefix, n) != 0)
+        return false;
+    char *end;
+    long v = strtol(arg + n, &end, 10);
+    if (end == arg + n || *end || v < min || v > 1 << 24) {
+        fprintf(stderr, "bench-scene: invalid value in '%s'\n", arg);
+        exit(2);
+    }
+    *out = (int) v;
+    return true;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: bench-scene [--size=WxH] [--tris=N] [--overdraw=K] "
+            "[--mesh=PATH]\n"
+            "                   [--frames=N] [--raster=scanline|edge] "
+            "[--bin=THREADS]\n"
+            "                   [--backend=NAME] [--name=LABEL] [--json]\n");
+    exit(2);
+}
+
+static void parse_options(int argc, char **argv, options_t *opt)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strncmp(a, "--size=", 7)) {
+            char *end;
+            opt->width = (int) strtol(a + 7, &end, 10);
+            if (*end != 'x')
+                usage();
+            opt->height = (int) strtol(end + 1, &end, 10);
+            if (*end || opt->width <= 0 || opt->height <= 0)
+                usage();
+        } else if (parse_int(a, "--tris=", 2, &opt->tris) ||
+                   parse_int(a, "--overdraw=", 1, &opt->overdraw) ||
+                   parse_int(a, "--frames=", 1, &opt->frames) ||
+                   parse_int(a, "--bin=", 0, &opt->bin_threads)) {
+            continue;
+        } else if (!strncmp(a, "--mesh=", 7)) {
+            opt->mesh = a + 7;
+        } else if (!strcmp(a, "--raster=scanline")) {
+            opt->raster = B3D_RASTER_SCANLINE;
+        } else if (!strcmp(a, "--raster=edge")) {
+            opt->raster = B3D_RASTER_EDGE;
+        } else if (!strncmp(a, "--backend=", 10)) {
+            opt->backend = a + 10;
+        } else if (!strncmp(a, "--name=", 7)) {
+            opt->name = a + 7;
+        } else if (!strcmp(a, "--json")) {
+            opt->json = true;
+        } else {
+            usage();
+        }
+    }
+}
+
+/* Draw @overdraw layers of an @cols x @rows quad grid, back to front.
+ * Returns the number of triangles submitted.
+ */
+static long draw_grid(int cols, int rows, int overdraw)
+{
+    long submitted = 0;
+    b3d_reset();
+    for (int layer = overdraw - 1; layer >= 0; layer--) {
+        float z = 2.0f + (float) layer * 0.25f;
+        /* Cover the 65 degree view at this depth, with some margin */
+        float half = z * 0.7f, step_x = 2.0f * half / (float) cols,
+              step_y = 2.0f * half / (float) rows;
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                float x0 = -half + (float) c * step_x, x1 = x0 + step_x;
+                float y0 = -half + (float) r * step_y, y1 = y0 + step_y;
+                uint32_t col = 0x102030u * (uint32_t) (layer + 1) +
+                               0x010101u * (uint32_t) ((r + c) & 7);
+                b3d_triangle(&(b3d_tri_t) {{{x0, y0, z}, {x0, y1, z},
+                                            {x1, y1, z}}},
+                             col);
+                b3d_triangle(&(b3d_tri_t) {{{x0, y0, z}, {x1, y1, z},
+                                            {x1, y0, z}}},
+                             col);
+                submitted += 2;
+            }
+        }
+    }
+    return submitted;
+}
+
+/* Draw @mesh @overdraw times, fitted to the view by its bounding radius */
+static long draw_mesh(const b3d_indexed_mesh_t *mesh,
+                      const float center[3],
+                      float radius,
+                      int overdraw,
+                      int frame)
+{
+    long submitted = 0;
+    for (int k = overdraw - 1; k >= 0; k--) {
+        b3d_reset();
+        b3d_translate(-center[0], -center[1], -center[2]);
+        b3d_scale(1.0f / radius, 1.0f / radius, 1.0f / radius);
+        b3d_rotate_y((float) frame * 0.02f + (float) k * 0.3f);
+        b3d_translate(0.0f, 0.0f, 2.5f + (float) k * 0.5f);
+        b3d_draw_mesh(mesh->positions, mesh->vertex_count, mesh->indices,
+                      mesh->index_count, NULL);
+        submitted += mesh->index_count / 3;
+    }
+    return submitted;
+}
+
+int main(int argc, char **argv)
+{
+    options_t opt = {
+        .width = 640,
+        .height = 480,
+        .tris = 10000,
+        .overdraw = 1,
+        .frames = 200,
+        .raster = B3D_RASTER_SCANLINE,
+        .name = "scene",
+    };
+    parse_options(argc, argv, &opt);
+
+    b3d_indexed_mesh_t mesh = {0};
+    float center[3] = {0}, radius = 1.0f;
+    if (opt.mesh) {
+        if (b3d_load_obj_indexed(opt.mesh, &mesh, NULL, 0) != 0 ||
+            mesh.vertex_count == 0) {
+            fprintf(stderr, "bench-scene: cannot load '%s'\n", opt.mesh);
+            return 1;
+        }
+        float lo[3], hi[3];
+        for (int a = 0; a < 3; a++)
+            lo[a] = hi[a] = mesh.positions[a];
+        for (int v = 1; v < mesh.vertex_count; v++) {
+            for (int a = 0; a < 3; a++) {
+                float p = mesh.positions[v * 3 + a];
+                lo[a] = p < lo[a] ? p : lo[a];
+                hi[a] = p > hi[a] ? p : hi[a];
+            }
+        }
+        radius = 0.0f;
+        for (int a = 0; a < 3; a++) {
+            center[a] = 0.5f * (lo[a] + hi[a]);
+            float e = hi[a] - lo[a];
+            radius = e > radius ? e : radius;
+        }
+        radius = radius > 0.0f ? radius * 0.5f : 1.0f;
+    }
+
+    /* Grid cells per layer, as square as the aspect ratio allows */
+    int cells = opt.tris / (2 * opt.overdraw);
+    if (cells < 1)
+        cells = 1;
+    int cols = 1;
+    while ((cols + 1) * (cols + 1) <= cells)
+        cols++;
+    int rows = cells / cols;
+
+    size_t pixel_bytes = b3d_buffer_size(opt.width, opt.height, 4);
+    size_t depth_bytes =
+        b3d_buffer_size(opt.width, opt.height, sizeof(b3d_depth_t));
+    uint32_t *pixels = pixel_bytes ? malloc(pixel_bytes) : NULL;
+    b3d_depth_t *depth = depth_bytes ? malloc(depth_bytes) : NULL;
+    double *times = malloc((size_t) opt.frames * sizeof(double));
+    size_t arena_size =
+        b3d_bin_arena_size(opt.width, opt.height,
+                           opt.mesh ? 4096 : cols * rows * 2 * opt.overdraw);
+    void *arena = opt.bin_threads ? malloc(arena_size) : NULL;
+    if (!pixels || !depth || !times || (opt.bin_threads && !arena) ||
+        !b3d_init(pixels, depth, opt.width, opt.height, 65.0f) ||
+        !b3d_set_rasterizer(opt.raster) ||
+        (opt.backend && !b3d_set_backend(opt.backend)) ||
+        (arena && !b3d_set_binning(arena, arena_size, opt.bin_threads))) {
+        fprintf(stderr, "bench-scene: set-up failed\n");
+        return 1;
+    }
+
+    long tris = 0;
+    for (int f = -WARMUP_FRAMES; f < opt.frames; f++) {
+        double start = get_time_ms();
+        b3d_clear();
+        tris = opt.mesh ? draw_mesh(&mesh, center, radius, opt.overdraw, f)
+                        : draw_grid(cols, rows, opt.overdraw);
+        b3d_flush();
+        if (f >= 0)
+            times[f] = get_time_ms() - start;
+    }
+
+    double total = 0.0;
+    for (int f = 0; f < opt.frames; f++)
+        total += times[f];
+    qsort(times, (size_t) opt.frames, sizeof(double), compare_double);
+    double median = percentile(times, opt.frames, 0.5);
+    double p99 = percentile(times, opt.frames, 0.99);
+    double mean = total / (double) opt.frames;
+    /* Rates at the median frame time; pixels are framebuffer pixels */
+    double tris_per_sec = (double) tris * 1000.0 / median;
+    double pixels_per_sec =
+        (double) opt.width * (double) opt.height * 1000.0 / median;
+
+    if (opt.json) {
+        printf("{\"name\": \"%s\", \"math\": \"%s\", \"depth_bits\": %d, "
+               "\"culling\": %s, \"width\": %d, \"height\": %d, "
+               "\"triangles\": %ld, \"overdraw\": %d, \"mesh\": %s%s%s, "
+               "\"raster\": \"%s\", \"backend\": \"%s\", "
+               "\"bin_threads\": %d, \"frames\": %d, \"median_ms\": %.4f, "
+               "\"p99_ms\": %.4f, \"mean_ms\": %.4f, \"tris_per_sec\": %.0f, "
+               "\"pixels_per_sec\": %.0f}\n",
+               opt.name, VARIANT_MATH, VARIANT_DEPTH,
+               VARIANT_CULLING ? "true" : "false", opt.width, opt.height,
+               tris, opt.overdraw, opt.mesh ? "\"" : "",
+               opt.mesh ? opt.mesh : "null", opt.mesh ? "\"" : "",
+               opt.raster == B3D_RASTER_EDGE ? "edge" : "scanline",
+               b3d_get_backend_name(), opt.bin_threads, opt.frames, median,
+               p99, mean, tris_per_sec, pixels_per_sec);
+    } else {
+        printf("%s (%s, %d-bit depth%s, %s): %dx%d, %ld triangles, "
+               "overdraw %d\n",
+               opt.name, VARIANT_MATH, VARIANT_DEPTH,
+               VARIANT_CULLING ? "" : ", no culling", b3d_get_backend_name(),
+               opt.width, opt.height, tris, opt.overdraw);
+        printf("  median %.3f ms  p99 %.3f ms  mean %.3f ms\n", median, p99,
+               mean);
+        printf("  %.0f triangles/s  %.0f pixels/s\n", tris_per_sec,
+               pixels_per_sec);
+    }
+
+    b3d_set_binning(NULL, 0, 0);
+    b3d_free_indexed_mesh(&mesh);
+    free(arena);
+    free(times);
+    free(pixels);
+    free(depth);
+    return 0;
+}
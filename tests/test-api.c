@@ -9,7 +9,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef B3D_THREADS
+#include <pthread.h>
+#endif
+
 #include "../include/b3d.h"
+#include "../include/b3d_adapt.h"
+#include "../include/b3d_image.h"
+#include "../include/b3d_mesh.h"
+#include "../include/b3d_obj.h"
+#include "../include/b3d_scene.h"
 
 /* ANSI color codes for terminal output */
 #define ANSI_GREEN "\033[32m"
@@ -706,6 +715,77 @@ TEST(api_degenerate_triangles)
     return 1;
 }
 
+/* Count pixels that differ from the clear color */
+static size_t count_drawn(const uint32_t *pixels, size_t count)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++)
+        n += pixels[i] != 0;
+    return n;
+}
+
+/* Test clip-space back-face culling and the cached model-view-projection */
+TEST(api_backface_cull)
+{
+    const int width = 64, height = 64;
+    const size_t pixel_count = (size_t) width * (size_t) height;
+    uint32_t *pixels = malloc(pixel_count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(pixel_count * sizeof(b3d_depth_t));
+    ASSERT(pixels);
+    ASSERT(depth);
+    ASSERT(b3d_init(pixels, depth, width, height, 65.0f));
+
+    const b3d_tri_t front = {
+        {{-0.5f, -0.5f, 1.0f}, {0.0f, 0.5f, 1.0f}, {0.5f, -0.5f, 1.0f}}};
+    const b3d_tri_t back = {
+        {{-0.5f, -0.5f, 1.0f}, {0.5f, -0.5f, 1.0f}, {0.0f, 0.5f, 1.0f}}};
+    /* Same orientation with a vertex behind the eye, so w changes sign */
+    const b3d_tri_t front_near = {
+        {{-0.5f, -0.5f, -1.0f}, {0.0f, 0.5f, 1.0f}, {0.5f, -0.5f, 1.0f}}};
+    const b3d_tri_t back_near = {
+        {{-0.5f, -0.5f, -1.0f}, {0.5f, -0.5f, 1.0f}, {0.0f, 0.5f, 1.0f}}};
+#ifdef B3D_NO_CULLING
+    const bool culls = false;
+#else
+    const bool culls = true;
+#endif
+
+    b3d_clear();
+    ASSERT(b3d_triangle(&front, 0xffffff));
+    size_t front_pixels = count_drawn(pixels, pixel_count);
+    ASSERT(front_pixels > 0);
+    b3d_clear();
+    ASSERT(b3d_triangle(&back, 0xffffff) == !culls);
+    ASSERT((count_drawn(pixels, pixel_count) == 0) == culls);
+
+    b3d_clear();
+    ASSERT(b3d_triangle(&front_near, 0xffffff));
+    ASSERT(count_drawn(pixels, pixel_count) > 0);
+    b3d_clear();
+    ASSERT(b3d_triangle(&back_near, 0xffffff) == !culls);
+
+    /* Changing the field of view refreshes the cached matrix */
+    b3d_set_fov(100.0f);
+    b3d_clear();
+    ASSERT(b3d_triangle(&front, 0xffffff));
+    size_t wide_pixels = count_drawn(pixels, pixel_count);
+    ASSERT(wide_pixels > 0 && wide_pixels < front_pixels);
+    ASSERT(b3d_init(pixels, depth, width, height, 100.0f));
+    ASSERT(b3d_triangle(&front, 0xffffff));
+    ASSERT(count_drawn(pixels, pixel_count) == wide_pixels);
+
+    /* Model changes flip the winding seen by the camera */
+    b3d_clear();
+    b3d_rotate_y(3.14159265f);
+    b3d_translate(0.0f, 0.0f, 2.0f);
+    ASSERT(b3d_triangle(&back, 0xffffff));
+    ASSERT(b3d_triangle(&front, 0xffffff) == !culls);
+
+    free(pixels);
+    free(depth);
+    return 1;
+}
+
 /* Test near plane clipping */
 TEST(api_near_plane_clip)
 {
@@ -1038,6 +1118,131 @@ TEST(api_triangle_lit)
     return 1;
 }
 
+/* Test several lights and the quantized b3d_draw_mesh_lit() path against
+ * b3d_triangle_lit()
+ */
+TEST(api_lights)
+{
+    const int width = 64, height = 48, cols = 6, rows = 4;
+    const size_t count = (size_t) width * (size_t) height;
+    const int vcount = (cols + 1) * (rows + 1), tris = cols * rows * 2;
+    uint32_t *pixels_a = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_b = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    float *positions = malloc((size_t) vcount * 3 * sizeof(float));
+    float *normals = malloc((size_t) tris * 3 * sizeof(float));
+    uint32_t *indices = malloc((size_t) tris * 3 * sizeof(uint32_t));
+    int ok = pixels_a && pixels_b && depth && ctx && positions && normals &&
+             indices;
+    ok = ok && b3d_ctx_init(ctx, pixels_a, depth, width, height, 65.0f);
+
+    /* Only light 0 is on by default; bad lights are refused */
+    float x, y, z, k;
+    ok = ok && b3d_ctx_get_light(ctx, 0, &x, &y, &z, &k) && z == 1.0f &&
+         k == 1.0f;
+    ok = ok && b3d_ctx_get_light(ctx, 1, NULL, NULL, NULL, &k) && k == 0.0f;
+    ok = ok && !b3d_ctx_set_light(ctx, -1, 0, 0, 1, 1) &&
+         !b3d_ctx_set_light(ctx, B3D_MAX_LIGHTS, 0, 0, 1, 1) &&
+         !b3d_ctx_set_light(ctx, 1, 0, 0, 0, 1) &&
+         !b3d_ctx_set_light(ctx, 1, NAN, 0, 1, 1) &&
+         !b3d_ctx_get_light(ctx, B3D_MAX_LIGHTS, &x, &y, &z, &k);
+    ok = ok && b3d_ctx_set_light(ctx, 1, 2, 0, 0, 3.0f) &&
+         b3d_ctx_get_light(ctx, 1, &x, &y, &z, &k) && x == 1.0f &&
+         k == 1.0f;
+
+    /* Lights add up: half from +Z plus half from +X, without ambient */
+    const b3d_tri_t tri = {{{-0.5f, -0.5f, 0}, {0, 0.5f, 0}, {0.5f, -0.5f, 0}}};
+    const size_t center = (size_t) (height / 2) * width + width / 2;
+    b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, -2.0f, 0, 0, 0});
+    b3d_ctx_set_ambient(ctx, 0.0f);
+    ok = ok && b3d_ctx_set_light(ctx, 0, 0, 0, 1, 0.5f) &&
+         b3d_ctx_set_light(ctx, 1, 1, 0, 0, 0.5f);
+    b3d_ctx_clear(ctx);
+    b3d_ctx_triangle_lit(ctx, &tri, 0, 0, -1, 0xFFFFFF);
+    ok = ok && pixels_a[center] == 0x7F7F7F;
+    b3d_ctx_clear(ctx);
+    b3d_ctx_triangle_lit(ctx, &tri, 1, 0, -1, 0xFFFFFF);
+    ok = ok && pixels_a[center] == 0xB4B4B4;
+    b3d_ctx_set_light_direction(ctx, 0, 1, 0);
+    ok = ok && b3d_ctx_get_light(ctx, 0, &x, &y, &z, &k) && y == 1.0f &&
+         k == 0.5f;
+
+    /* A grid facing the camera with unit normals in every direction */
+    for (int j = 0; j <= rows; j++) {
+        for (int i = 0; i <= cols; i++) {
+            float *p = &positions[(size_t) (j * (cols + 1) + i) * 3];
+            p[0] = -1.2f + 2.4f * (float) i / (float) cols;
+            p[1] = -0.8f + 1.6f * (float) j / (float) rows;
+            p[2] = 0.05f * (float) ((i * 7 + j * 3) % 5);
+        }
+    }
+    for (int t = 0, n = 0; t < tris; t++) {
+        int cell = t / 2, i = cell % cols, j = cell / cols;
+        uint32_t v = (uint32_t) (j * (cols + 1) + i), w = (uint32_t) cols + 1;
+        uint32_t *idx = &indices[t * 3];
+        if (t & 1)
+            idx[0] = v + 1, idx[1] = v + w, idx[2] = v + w + 1;
+        else
+            idx[0] = v, idx[1] = v + w, idx[2] = v + 1;
+        float a = 0.7f * (float) t, b = 0.37f * (float) t - 1.5f;
+        normals[n++] = cosf(b) * cosf(a);
+        normals[n++] = sinf(b);
+        normals[n++] = cosf(b) * sinf(a);
+    }
+
+    b3d_ctx_set_ambient(ctx, 0.15f);
+    ok = ok && b3d_ctx_set_light(ctx, 0, 0.3f, 0.2f, 1, 0.8f) &&
+         b3d_ctx_set_light(ctx, 1, 1, 0, 0, 0.4f) &&
+         b3d_ctx_set_light(ctx, 2, 0, 1, 0.5f, 0.3f) &&
+         b3d_ctx_set_light(ctx, 3, -1, 1, 0, 0.6f);
+    const uint32_t base = 0xF0A040;
+    for (int pass = 0; ok && pass < 2; pass++) {
+        b3d_ctx_clear(ctx);
+        if (pass == 0) {
+            ok = b3d_ctx_draw_mesh_lit(ctx, positions, vcount, indices,
+                                       tris * 3, normals, base) == tris;
+            memcpy(pixels_b, pixels_a, count * sizeof(uint32_t));
+            continue;
+        }
+        for (int t = 0; t < tris; t++) {
+            b3d_tri_t tt;
+            for (int k2 = 0; k2 < 3; k2++) {
+                const float *p = &positions[indices[t * 3 + k2] * 3];
+                tt.v[k2] = (b3d_point_t) {p[0], p[1], p[2]};
+            }
+            const float *n = &normals[t * 3];
+            b3d_ctx_triangle_lit(ctx, &tt, n[0], n[1], n[2], base);
+        }
+    }
+
+    /* Same coverage, colors within one step per channel, both saturated
+     * and partly lit triangles present
+     */
+    int saturated = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        uint32_t a = pixels_a[i], b = pixels_b[i];
+        for (int sh = 0; sh < 24; sh += 8) {
+            int d = (int) (a >> sh & 0xFF) - (int) (b >> sh & 0xFF);
+            ok = ok && d >= -1 && d <= 1;
+        }
+        ok = ok && (a == 0) == (b == 0);
+        saturated += b == base;
+    }
+    ok = ok && saturated > 0 && saturated < (int) count / 2;
+
+    ok = ok && b3d_ctx_draw_mesh_lit(ctx, positions, vcount, indices,
+                                     tris * 3, NULL, base) == 0;
+    free(pixels_a);
+    free(pixels_b);
+    free(depth);
+    free(ctx);
+    free(positions);
+    free(normals);
+    free(indices);
+    return ok;
+}
+
 /* Test depth buffer functionality */
 TEST(api_depth_buffer)
 {
@@ -1118,6 +1323,3060 @@ TEST(api_depth_buffer)
     return 1;
 }
 
+/* Cube used by the context tests (same geometry as api_render_ascii) */
+static const b3d_tri_t test_cube[12] = {
+    {{{-0.5f, -0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}}},
+    {{{-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}}},
+    {{{0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}}},
+    {{{0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}}},
+    {{{0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}}},
+    {{{0.5f, -0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}, {-0.5f, -0.5f, 0.5f}}},
+    {{{-0.5f, -0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, -0.5f}}},
+    {{{-0.5f, -0.5f, 0.5f}, {-0.5f, 0.5f, -0.5f}, {-0.5f, -0.5f, -0.5f}}},
+    {{{-0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}}},
+    {{{-0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, -0.5f}}},
+    {{{0.5f, -0.5f, 0.5f}, {-0.5f, -0.5f, 0.5f}, {-0.5f, -0.5f, -0.5f}}},
+    {{{0.5f, -0.5f, 0.5f}, {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}}},
+};
+
+/* Render the test cube rotated by @angle into @ctx */
+static void render_test_cube(b3d_context_t *ctx, float angle)
+{
+    b3d_ctx_clear(ctx);
+    b3d_ctx_reset(ctx);
+    b3d_ctx_rotate_y(ctx, angle);
+    b3d_ctx_rotate_x(ctx, angle * 0.6f);
+    for (int i = 0; i < 12; i++)
+        b3d_ctx_triangle(ctx, &test_cube[i], 0x203040u * (uint32_t) (i + 1));
+}
+
+/* Test independent contexts: interleaved calls must not interfere */
+TEST(api_context_isolation)
+{
+    const int width = 48, height = 32;
+    const size_t count = (size_t) width * (size_t) height;
+    uint32_t *pixels_a = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_b = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth_a = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_b = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *a = malloc(sizeof(b3d_context_t));
+    b3d_context_t *b = malloc(sizeof(b3d_context_t));
+    int ok = pixels_a && pixels_b && pixels_ref && depth_a && depth_b &&
+             depth_ref && a && b;
+
+    if (ok) {
+        ok = b3d_ctx_init(a, pixels_a, depth_a, width, height, 65.0f) &&
+             b3d_ctx_init(b, pixels_b, depth_b, width, height, 65.0f);
+    }
+    if (ok) {
+        /* Fresh contexts start with default lighting */
+        ok = fabsf(b3d_ctx_get_ambient(a) - 0.2f) < 0.0001f;
+
+        /* Interleave state changes between the two contexts */
+        b3d_ctx_set_camera(a, &(b3d_camera_t) {0, 0, -2.5f, 0, 0, 0});
+        b3d_ctx_set_camera(b, &(b3d_camera_t) {0.3f, 0, -3.0f, 0, 0, 0});
+        b3d_ctx_push_matrix(b);
+        render_test_cube(a, 0.4f);
+        render_test_cube(b, 1.1f);
+        ok = ok && b3d_ctx_pop_matrix(b) && !b3d_ctx_pop_matrix(a);
+
+        /* Same scenes through the global API must match exactly */
+        b3d_init(pixels_ref, depth_ref, width, height, 65.0f);
+        b3d_set_camera(&(b3d_camera_t) {0, 0, -2.5f, 0, 0, 0});
+        render_test_cube(b3d_get_default_context(), 0.4f);
+        ok = ok && !memcmp(pixels_a, pixels_ref, count * sizeof(uint32_t));
+
+        b3d_set_camera(&(b3d_camera_t) {0.3f, 0, -3.0f, 0, 0, 0});
+        render_test_cube(b3d_get_default_context(), 1.1f);
+        ok = ok && !memcmp(pixels_b, pixels_ref, count * sizeof(uint32_t));
+        ok = ok && memcmp(pixels_a, pixels_b, count * sizeof(uint32_t));
+    }
+
+    free(pixels_a);
+    free(pixels_b);
+    free(pixels_ref);
+    free(depth_a);
+    free(depth_b);
+    free(depth_ref);
+    free(a);
+    free(b);
+    return ok;
+}
+
+#ifdef B3D_THREADS
+#define CONTEXT_THREADS 4
+#define CONTEXT_FRAMES 8
+
+/* Frames rendered by one context, see render_context_frames() */
+typedef struct {
+    int id;
+    int width, height;
+    uint32_t *pixels; /* CONTEXT_FRAMES frames */
+    b3d_depth_t *depth;
+    void *arena;
+    int ok;
+} context_frames_t;
+
+/* Render CONTEXT_FRAMES frames of a lit, spinning cube into a context of
+ * its own, with a size, camera and lights that depend on @f->id. Odd ids
+ * bin their triangles onto worker threads.
+ */
+static void *render_context_frames(void *arg)
+{
+    context_frames_t *f = arg;
+    const size_t count = (size_t) f->width * (size_t) f->height;
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    int ok = ctx && b3d_ctx_init(ctx, f->pixels, f->depth, f->width,
+                                 f->height, 60.0f + 5.0f * (float) f->id);
+    if (ok) {
+        b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0.1f * (float) f->id, 0,
+                                                 -2.5f, 0, 0, 0});
+        ok = b3d_ctx_set_light(ctx, 1, 0.6f, -0.8f, 0, 0.5f);
+        b3d_ctx_set_ambient(ctx, 0.1f * (float) f->id);
+        if (f->id & 1)
+            ok = ok && b3d_ctx_set_binning(
+                           ctx, f->arena,
+                           b3d_bin_arena_size(f->width, f->height, 64), 2);
+    }
+    for (int i = 0; ok && i < CONTEXT_FRAMES; i++) {
+        ok = b3d_ctx_set_pixel_buffer(ctx, f->pixels + (size_t) i * count, 0);
+        render_test_cube(ctx, 0.3f * (float) i + (float) f->id);
+        for (int t = 0; t < 12; t += 3) {
+            b3d_tri_t tri = test_cube[t];
+            for (int k = 0; k < 3; k++)
+                tri.v[k].z -= 0.5f;
+            b3d_ctx_triangle_lit(ctx, &tri, 0, 0.6f, -0.8f, 0xC08040u);
+        }
+        b3d_ctx_flush(ctx);
+    }
+    if (ctx && (f->id & 1))
+        b3d_ctx_set_binning(ctx, NULL, 0, 0);
+    free(ctx);
+    f->ok = ok;
+    return NULL;
+}
+
+/* Test contexts on concurrent threads: every thread renders the same frames
+ * as its context does alone on the main thread
+ */
+TEST(api_context_threads)
+{
+    context_frames_t ref[CONTEXT_THREADS], run[CONTEXT_THREADS];
+    pthread_t threads[CONTEXT_THREADS];
+    int started = 0;
+    int ok = 1;
+
+    for (int i = 0; i < CONTEXT_THREADS; i++) {
+        context_frames_t *pair[2] = {&ref[i], &run[i]};
+        for (int j = 0; j < 2; j++) {
+            context_frames_t *f = pair[j];
+            f->id = i;
+            f->width = 40 + 8 * i;
+            f->height = 30 + 4 * i;
+            size_t count = (size_t) f->width * (size_t) f->height;
+            f->pixels = malloc(CONTEXT_FRAMES * count * sizeof(uint32_t));
+            f->depth = malloc(count * sizeof(b3d_depth_t));
+            f->arena = malloc(b3d_bin_arena_size(f->width, f->height, 64));
+            f->ok = 0;
+            ok = ok && f->pixels && f->depth && f->arena;
+        }
+    }
+
+    for (int i = 0; ok && i < CONTEXT_THREADS; i++) {
+        render_context_frames(&ref[i]);
+        ok = ref[i].ok;
+    }
+    for (; ok && started < CONTEXT_THREADS; started++)
+        ok = !pthread_create(&threads[started], NULL, render_context_frames,
+                             &run[started]);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; ok && i < CONTEXT_THREADS; i++) {
+        size_t count = (size_t) ref[i].width * (size_t) ref[i].height;
+        ok = run[i].ok && count_drawn(ref[i].pixels, count) > 0 &&
+             !memcmp(run[i].pixels, ref[i].pixels,
+                     CONTEXT_FRAMES * count * sizeof(uint32_t)) &&
+             !memcmp(run[i].depth, ref[i].depth,
+                     count * sizeof(b3d_depth_t));
+    }
+
+    for (int i = 0; i < CONTEXT_THREADS; i++) {
+        free(ref[i].pixels);
+        free(ref[i].depth);
+        free(ref[i].arena);
+        free(run[i].pixels);
+        free(run[i].depth);
+        free(run[i].arena);
+    }
+    return ok;
+}
+#endif
+
+/* Test indexed mesh submission against per-triangle rendering */
+TEST(api_draw_mesh)
+{
+    const int width = 48, height = 32;
+    const size_t count = (size_t) width * (size_t) height;
+    /* Padding pushes the vertex count past the post-transform cache */
+    const int pad = B3D_VERTEX_CACHE_SIZE + 100;
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    float *positions = calloc((size_t) (pad + 36) * 3, sizeof(float));
+    uint32_t indices[39], colors[13];
+    int ok = pixels && pixels_ref && depth && positions;
+
+    if (ok) {
+        for (int i = 0; i < 12; i++) {
+            for (int j = 0; j < 3; j++) {
+                float *p = &positions[(pad + i * 3 + j) * 3];
+                p[0] = test_cube[i].v[j].x;
+                p[1] = test_cube[i].v[j].y;
+                p[2] = test_cube[i].v[j].z;
+                indices[i * 3 + j] = (uint32_t) (i * 3 + j);
+            }
+            colors[i] = 0x203040u * (uint32_t) (i + 1);
+        }
+        /* Trailing triangle with an out-of-range index is skipped */
+        indices[36] = 0, indices[37] = 1, indices[38] = 9999;
+        colors[12] = 0xFFFFFF;
+
+        b3d_context_t *ctx = b3d_get_default_context();
+        b3d_init(pixels_ref, depth, width, height, 65.0f);
+        b3d_set_camera(&(b3d_camera_t) {0, 0, -2.5f, 0, 0, 0});
+        render_test_cube(ctx, 0.4f);
+
+        /* Compact mesh: every vertex transformed up front */
+        b3d_init(pixels, depth, width, height, 65.0f);
+        b3d_set_camera(&(b3d_camera_t) {0, 0, -2.5f, 0, 0, 0});
+        b3d_clear();
+        b3d_rotate_y(0.4f);
+        b3d_rotate_x(0.4f * 0.6f);
+        int drawn =
+            b3d_draw_mesh(&positions[pad * 3], 36, indices, 39, colors);
+        ok = drawn > 0 && drawn <= 12 &&
+             !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+
+        /* Large mesh: vertices fetched lazily through the cache */
+        for (int i = 0; i < 36; i++)
+            indices[i] += (uint32_t) pad;
+        b3d_clear();
+        ok = ok && b3d_draw_mesh(positions, pad + 36, indices, 39, colors) ==
+                       drawn;
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+
+        /* Invalid arguments draw nothing */
+        ok = ok && b3d_draw_mesh(NULL, 36, indices, 36, colors) == 0;
+        ok = ok && b3d_draw_mesh(positions, 0, indices, 36, colors) == 0;
+        ok = ok && b3d_draw_mesh(positions, pad + 36, indices, 2, NULL) == 0;
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(positions);
+    return ok;
+}
+
+/* Draw the test cube plus overlapping, screen-crossing triangles */
+static void render_binning_scene(b3d_context_t *ctx)
+{
+    render_test_cube(ctx, 0.7f);
+    b3d_ctx_reset(ctx);
+    for (int i = 0; i < 24; i++) {
+        float a = (float) i * 0.9f, r = 0.4f + (float) (i % 5) * 0.5f;
+        b3d_tri_t tri = {{{-r + sinf(a), -r, 0.5f - (float) i * 0.05f},
+                          {r, cosf(a) * r, (float) (i % 3) * 0.3f},
+                          {0, r + sinf(a * 2), 0.2f}}};
+        b3d_ctx_triangle(ctx, &tri, 0x0F1E2Du * (uint32_t) (i + 1));
+    }
+}
+
+/* Test tile binning: flushed output must match immediate mode exactly */
+TEST(api_binning)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && arena &&
+             arena_size > 0;
+
+    if (ok) {
+        b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+        ok = b3d_ctx_init(ctx, pixels_ref, depth_ref, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = ok && !b3d_ctx_set_binning(ctx, arena, 16, 1);
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 4);
+
+        /* Nothing reaches the framebuffer before the flush */
+        render_binning_scene(ctx);
+        ok = ok && pixels[(height / 2) * width + width / 2] == 0;
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t)) &&
+             !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+
+        /* Clearing discards queued triangles */
+        render_binning_scene(ctx);
+        b3d_ctx_clear(ctx);
+        b3d_ctx_flush(ctx);
+        for (size_t i = 0; ok && i < count; i++)
+            ok = pixels[i] == 0;
+
+        /* A tiny arena flushes early but still matches */
+        ok = ok && b3d_ctx_set_binning(ctx, arena, 2048, 2);
+        render_binning_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+
+        /* Disabling flushes pending work and returns to immediate mode */
+        b3d_ctx_clear(ctx);
+        render_binning_scene(ctx);
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(depth_ref);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Test the frame pipeline: frames come back in order, each matching what
+ * immediate mode draws
+ */
+TEST(api_frames)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t bytes = count * sizeof(uint32_t);
+    const size_t bin_size = b3d_bin_arena_size(width, height, 256);
+    const size_t frame_size = b3d_frame_arena_size(width, height, 256);
+    uint32_t *front = malloc(bytes);
+    uint32_t *back = malloc(bytes);
+    uint32_t *ref_a = malloc(bytes);
+    uint32_t *ref_b = malloc(bytes);
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *bin_arena = malloc(bin_size);
+    void *frame_arena = malloc(frame_size);
+    int ok = front && back && ref_a && ref_b && depth && ctx && bin_arena &&
+             frame_arena && frame_size > bin_size;
+
+    if (ok) {
+        b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+        ok = b3d_ctx_init(ctx, ref_a, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+        ok = ok && b3d_ctx_set_pixel_buffer(ctx, ref_b, 0);
+        render_test_cube(ctx, 1.9f);
+
+        ok = ok && b3d_ctx_init(ctx, front, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = ok && !b3d_ctx_set_frames(ctx, back, frame_arena, frame_size);
+        ok = ok && b3d_ctx_set_binning(ctx, bin_arena, bin_size, 2);
+        ok = ok && !b3d_ctx_set_frames(ctx, back, frame_arena, 64);
+        ok = ok && b3d_ctx_set_frames(ctx, back, frame_arena, frame_size);
+        ok = ok && !b3d_ctx_set_pixel_buffer(ctx, back, 0);
+        ok = ok && !b3d_ctx_frame_submit(ctx) && !b3d_ctx_frame_wait(ctx);
+
+        /* Drawing outside a frame is ignored */
+        memset(front, 0x55, bytes);
+        render_binning_scene(ctx);
+        ok = ok && front[(height / 2) * width + width / 2] == 0x55555555u;
+
+        /* Each frame returns while the next one is recorded */
+        ok = ok && b3d_ctx_frame_begin(ctx) && !b3d_ctx_frame_begin(ctx);
+        render_binning_scene(ctx);
+        ok = ok && b3d_ctx_frame_submit(ctx);
+        ok = ok && b3d_ctx_frame_begin(ctx);
+        render_test_cube(ctx, 1.9f);
+        ok = ok && b3d_ctx_frame_wait(ctx) == front;
+        ok = ok && !memcmp(front, ref_a, bytes);
+        ok = ok && b3d_ctx_frame_submit(ctx);
+
+        /* Two frames in flight leave no buffer to record into */
+        ok = ok && b3d_ctx_frame_begin(ctx);
+        render_binning_scene(ctx);
+        ok = ok && b3d_ctx_frame_submit(ctx) && !b3d_ctx_frame_begin(ctx);
+        ok = ok && b3d_ctx_frame_wait(ctx) == back;
+        ok = ok && !memcmp(back, ref_b, bytes);
+        ok = ok && b3d_ctx_frame_wait(ctx) == front;
+        ok = ok && !memcmp(front, ref_a, bytes);
+        ok = ok && !b3d_ctx_frame_wait(ctx);
+
+        /* State changes and direct writes inside a frame keep their order */
+        ok = ok && b3d_ctx_frame_begin(ctx);
+        render_test_cube(ctx, 1.9f);
+        b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+        b3d_ctx_clear_rect(ctx, 0, 0, 10, 10, 0xFF0000);
+        ok = ok && b3d_ctx_frame_submit(ctx);
+        ok = ok && b3d_ctx_frame_wait(ctx) == back;
+        ok = ok && back[0] == 0xFF0000 && back[9 * width + 9] == 0xFF0000;
+        for (int y = 10; ok && y < height; y++)
+            ok = !memcmp(back + y * width, ref_b + y * width,
+                         (size_t) width * sizeof(uint32_t));
+
+        /* Disabling returns to drawing into the first buffer */
+        ok = ok && b3d_ctx_set_frames(ctx, NULL, NULL, 0);
+        render_binning_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(front, ref_a, bytes);
+        b3d_ctx_set_binning(ctx, NULL, 0, 0);
+    }
+
+    free(front);
+    free(back);
+    free(ref_a);
+    free(ref_b);
+    free(depth);
+    free(ctx);
+    free(bin_arena);
+    free(frame_arena);
+    return ok;
+}
+
+/* Test that the smallest frame arenas still hold a screen-covering triangle,
+ * which must not be drawn around the recorded frame
+ */
+TEST(api_frames_arena)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t bytes = count * sizeof(uint32_t);
+    const size_t bin_size = b3d_bin_arena_size(width, height, 0);
+    const size_t frame_size = b3d_frame_arena_size(width, height, 0);
+    uint32_t *front = malloc(bytes);
+    uint32_t *back = malloc(bytes);
+    uint32_t *ref = malloc(bytes);
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *bin_arena = malloc(bin_size);
+    void *frame_arena = malloc(frame_size);
+    int ok = front && back && ref && depth && ctx && bin_arena && frame_arena;
+    const b3d_tri_t tri = {{{-20, -20, 0}, {0, 20, 0}, {20, -20, 0}}};
+    b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+
+    if (ok) {
+        ok = b3d_ctx_init(ctx, ref, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        b3d_ctx_clear(ctx);
+        ok = ok && b3d_ctx_triangle(ctx, &tri, 0x336699u);
+        for (size_t i = 0; ok && i < count; i++)
+            ok = ref[i] == 0x336699u;
+
+        ok = ok && b3d_ctx_init(ctx, front, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = ok && b3d_ctx_set_binning(ctx, bin_arena, bin_size / 2, 1);
+        ok = ok && !b3d_ctx_set_frames(ctx, back, frame_arena, frame_size);
+        ok = ok && b3d_ctx_set_binning(ctx, bin_arena, bin_size, 1);
+        ok = ok && !b3d_ctx_set_frames(ctx, back, frame_arena, frame_size / 2);
+        ok = ok && b3d_ctx_set_frames(ctx, back, frame_arena, frame_size);
+
+        for (int i = 0; ok && i < 2; i++) {
+            memset(i ? back : front, 0, bytes);
+            ok = b3d_ctx_frame_begin(ctx);
+            b3d_ctx_clear(ctx);
+            ok = ok && b3d_ctx_triangle(ctx, &tri, 0x336699u);
+            ok = ok && b3d_ctx_frame_submit(ctx);
+            uint32_t *done = b3d_ctx_frame_wait(ctx);
+            ok = ok && done == (i ? back : front) && !memcmp(done, ref, bytes);
+        }
+        ok = ok && b3d_ctx_set_frames(ctx, NULL, NULL, 0);
+        b3d_ctx_set_binning(ctx, NULL, 0, 0);
+    }
+
+    free(front);
+    free(back);
+    free(ref);
+    free(depth);
+    free(ctx);
+    free(bin_arena);
+    free(frame_arena);
+    return ok;
+}
+
+/* Test the edge-function rasterizer against scanline and its fill rule */
+TEST(api_edge_rasterizer)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    int ok = pixels && pixels_ref && depth && ctx && arena && arena_size > 0;
+
+    if (ok) {
+        b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+        ok = b3d_ctx_init(ctx, pixels_ref, depth, width, height, 70.0f);
+        ok = ok && b3d_ctx_get_rasterizer(ctx) == B3D_RASTER_SCANLINE;
+        ok = ok && !b3d_ctx_set_rasterizer(ctx, -1);
+        ok = ok && !b3d_ctx_set_rasterizer(ctx, 2);
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+        size_t scanline = count_drawn(pixels_ref, count);
+
+        /* Same coverage as scanline up to edge pixels */
+        ok = ok && b3d_ctx_init(ctx, pixels_ref, depth, width, height, 70.0f);
+        ok = ok && b3d_ctx_set_rasterizer(ctx, B3D_RASTER_EDGE);
+        ok = ok && b3d_ctx_get_rasterizer(ctx) == B3D_RASTER_EDGE;
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+        size_t edge = count_drawn(pixels_ref, count);
+        ok = ok && scanline > 0 && edge + scanline / 20 >= scanline &&
+             edge <= scanline + scanline / 20;
+
+        /* Binned tiles reproduce the immediate edge output exactly */
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        ok = ok && b3d_ctx_set_rasterizer(ctx, B3D_RASTER_EDGE);
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+
+        /* Top-left rule: a fan of coplanar triangles covers each shared
+         * edge pixel exactly once, so the union is the sum of its parts
+         */
+        b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, -2.0f, 0, 0, 0});
+        b3d_ctx_reset(ctx);
+        b3d_point_t fan[7] = {{0, 0, 0}};
+        for (int i = 0; i < 6; i++) {
+            float a = (float) i * 1.047198f + 0.3f;
+            fan[i + 1] = (b3d_point_t) {cosf(a) * 0.9f, sinf(a) * 0.9f, 0};
+        }
+        size_t parts = 0;
+        for (int i = 0; i < 6; i++) {
+            b3d_tri_t tri = {{fan[0], fan[1 + (i + 1) % 6], fan[1 + i]}};
+            b3d_ctx_clear(ctx);
+            b3d_ctx_triangle(ctx, &tri, 0xFFFFFF);
+            parts += count_drawn(pixels, count);
+        }
+        b3d_ctx_clear(ctx);
+        for (int i = 0; i < 6; i++) {
+            b3d_tri_t tri = {{fan[0], fan[1 + (i + 1) % 6], fan[1 + i]}};
+            b3d_ctx_triangle(ctx, &tri, 0x000010u * (uint32_t) (i + 1));
+        }
+        ok = ok && parts > 0 && count_drawn(pixels, count) == parts;
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Draw render_binning_scene() with the edge rasterizer over a clear color
+ * that takes the fill kernel, and the test cube as a mesh
+ */
+static void render_backend_scene(b3d_context_t *ctx,
+                                 const float *positions,
+                                 const uint32_t *indices)
+{
+    b3d_ctx_set_rasterizer(ctx, B3D_RASTER_EDGE);
+    b3d_ctx_clear_color(ctx, 0x123456);
+    render_binning_scene(ctx);
+    b3d_ctx_reset(ctx);
+    b3d_ctx_translate(ctx, 0.5f, -0.3f, -0.5f);
+    b3d_ctx_rotate_y(ctx, 0.3f);
+    b3d_ctx_draw_mesh(ctx, positions, 36, indices, 36, NULL);
+}
+
+/* Test that every kernel set draws what the scalar one does */
+TEST(api_backend)
+{
+    static const char *const names[] = {"avx2", "sse2", "neon", "scalar"};
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    float positions[36 * 3];
+    uint32_t indices[36];
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx;
+
+    if (ok) {
+        const b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+        for (int i = 0; i < 36; i++) {
+            const b3d_point_t *v = &test_cube[i / 3].v[i % 3];
+            positions[i * 3] = v->x;
+            positions[i * 3 + 1] = v->y;
+            positions[i * 3 + 2] = v->z;
+            indices[i] = (uint32_t) i;
+        }
+
+        ok = b3d_ctx_init(ctx, pixels_ref, depth_ref, width, height, 70.0f);
+        const char *active = b3d_get_backend_name();
+        ok = ok && active && !b3d_set_backend("mmx") && !b3d_set_backend(NULL);
+        ok = ok && b3d_set_backend("scalar");
+        ok = ok && !strcmp(b3d_get_backend_name(), "scalar");
+        b3d_ctx_set_camera(ctx, &cam);
+        render_backend_scene(ctx, positions, indices);
+
+        int sets = 0;
+        for (int i = 0; ok && i < 4; i++) {
+            if (!b3d_set_backend(names[i]))
+                continue;
+            sets++;
+            ok = ok && !strcmp(b3d_get_backend_name(), names[i]);
+            ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+            b3d_ctx_set_camera(ctx, &cam);
+            render_backend_scene(ctx, positions, indices);
+            ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+            ok = ok && !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+        }
+        ok = ok && sets >= 1;
+
+        /* The choice survives b3d_init() */
+        ok = ok && b3d_set_backend(active);
+        ok = ok && b3d_init(pixels, depth, width, height, 70.0f);
+        ok = ok && !strcmp(b3d_get_backend_name(), active);
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(depth_ref);
+    free(ctx);
+    return ok;
+}
+
+/* Textured floor running from z = 1 to z = 9 below the camera, u along
+ * depth, and a Gouraud triangle above it crossing the near plane
+ */
+static void render_attr_scene(b3d_context_t *ctx, const b3d_texture_t *tex)
+{
+    const b3d_attr_t white = {{0xFFFFFF, 0xFFFFFF, 0xFFFFFF},
+                              {{0, 0}, {1, 0}, {1, 1}}};
+    const b3d_attr_t white2 = {{0xFFFFFF, 0xFFFFFF, 0xFFFFFF},
+                               {{0, 0}, {1, 1}, {0, 1}}};
+    const b3d_attr_t rgb = {{0xFF0000, 0x00FF00, 0x0000FF}, {{0}}};
+    b3d_ctx_set_texture(ctx, tex);
+    b3d_ctx_triangle_ex(ctx,
+                        &(b3d_tri_t) {{{-1, -1, 1}, {-1, -1, 9}, {1, -1, 9}}},
+                        &white);
+    b3d_ctx_triangle_ex(ctx,
+                        &(b3d_tri_t) {{{-1, -1, 1}, {1, -1, 9}, {1, -1, 1}}},
+                        &white2);
+    b3d_ctx_set_texture(ctx, NULL);
+    b3d_ctx_triangle_ex(
+        ctx, &(b3d_tri_t) {{{-1.5f, 0, -1}, {0, 1, 3}, {1.5f, 0, 3}}}, &rgb);
+}
+
+/* Test perspective-correct vertex attributes and textures */
+TEST(api_triangle_ex)
+{
+    const int width = 96, height = 96;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 64);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    /* Two texels: u < 0.5 is blue, u >= 0.5 red */
+    const uint32_t texels[2] = {0x0000FF, 0xFF0000};
+    const b3d_texture_t tex = {texels, 2, 1, 0, B3D_FILTER_NEAREST};
+    int ok = pixels && pixels_ref && depth && ctx && arena && arena_size > 0;
+
+    if (ok) {
+        const b3d_tri_t tri = {
+            {{-0.5f, -0.5f, 1}, {0, 0.5f, 1}, {0.5f, -0.5f, 1}}};
+        ok = b3d_ctx_init(ctx, pixels_ref, depth, width, height, 70.0f);
+
+        /* Texture sizes must be powers of two */
+        ok = ok && !b3d_ctx_set_texture(
+                       ctx, &(b3d_texture_t) {texels, 3, 1, 0,
+                                              B3D_FILTER_NEAREST});
+        ok = ok && !b3d_ctx_set_texture(
+                       ctx, &(b3d_texture_t) {NULL, 2, 1, 0,
+                                              B3D_FILTER_NEAREST});
+        ok = ok && b3d_ctx_set_texture(ctx, NULL);
+        ok = ok && !b3d_ctx_triangle_ex(ctx, &tri, NULL);
+
+        /* Uniform colors are drawn exactly like b3d_triangle() */
+        b3d_ctx_triangle(ctx, &tri, 0x336699);
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        ok = ok && b3d_ctx_triangle_ex(
+                       ctx, &tri,
+                       &(b3d_attr_t) {{0x336699, 0x336699, 0x336699}, {{0}}});
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+
+        /* Gouraud: each corner leans towards its vertex color */
+        b3d_ctx_clear(ctx);
+        ok = ok && b3d_ctx_triangle_ex(
+                       ctx, &tri,
+                       &(b3d_attr_t) {{0xFF0000, 0x00FF00, 0x0000FF}, {{0}}});
+        for (int i = 0; i < 3 && ok; i++) {
+            int sx, sy;
+            float x = tri.v[i].x * 0.8f;
+            float y = tri.v[i].y * 0.8f - (i == 1 ? 0.1f : 0.0f);
+            ok = b3d_ctx_to_screen(ctx, x, y, 1, &sx, &sy);
+            uint32_t c = pixels[sy * width + sx];
+            uint32_t mine = (c >> (16 - 8 * i)) & 0xFF;
+            ok = ok && mine > 160 && mine > ((c >> 16) & 0xFF) / 2 &&
+                 mine > ((c >> 8) & 0xFF) / 2 && mine > (c & 0xFF) / 2;
+        }
+
+        /* Perspective: the texture switches where the floor crosses z = 5,
+         * far above the screen-space midpoint of its near and far edges
+         */
+        int sx, sy, sy_near, sy_far;
+        b3d_ctx_clear(ctx);
+        render_attr_scene(ctx, &tex);
+        ok = ok && b3d_ctx_to_screen(ctx, 0, -1, 5, &sx, &sy);
+        ok = ok && b3d_ctx_to_screen(ctx, 0, -1, 1.5f, &sx, &sy_near);
+        ok = ok && b3d_ctx_to_screen(ctx, 0, -1, 9, &sx, &sy_far);
+        ok = ok && sy_near - sy > 8 && (sy_near + sy_far) / 2 - sy > 4;
+        ok = ok && pixels[(sy + 2) * width + sx] == 0x0000FF;
+        ok = ok && pixels[(sy - 2) * width + sx] == 0xFF0000;
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+
+        /* Binned tiles sample the same planes */
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+        b3d_ctx_clear(ctx);
+        render_attr_scene(ctx, &tex);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+
+        /* The edge rasterizer shades the pixels both cover alike */
+        ok = ok && b3d_ctx_set_rasterizer(ctx, B3D_RASTER_EDGE);
+        b3d_ctx_clear(ctx);
+        render_attr_scene(ctx, &tex);
+        size_t both = 0, same = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!pixels[i] || !pixels_ref[i])
+                continue;
+            bool close = true;
+            for (int k = 0; k < 24; k += 8) {
+                int d = (int) ((pixels[i] >> k) & 0xFF) -
+                        (int) ((pixels_ref[i] >> k) & 0xFF);
+                close = close && d >= -1 && d <= 1;
+            }
+            both++;
+            same += close;
+        }
+        ok = ok && both > count / 4 && same == both;
+
+        /* Per-vertex lighting with equal normals matches flat lighting */
+        const b3d_point_t n[3] = {{0, 0, -1}, {0, 0, -1}, {0, 0, -1}};
+        b3d_ctx_clear(ctx);
+        ok = ok && b3d_ctx_triangle_lit(ctx, &tri, 0, 0, -1, 0xC08040);
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+        b3d_ctx_clear(ctx);
+        ok = ok && b3d_ctx_triangle_lit_ex(ctx, &tri, n, 0xC08040);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Screen-filling quad at z = 1 for a 90 degree field of view, textured
+ * @reps times in each direction
+ */
+static void render_tex_quad(b3d_context_t *ctx,
+                            const b3d_texture_t *tex,
+                            float reps)
+{
+    const float r = reps;
+    const b3d_attr_t a = {{0xFFFFFF, 0xFFFFFF, 0xFFFFFF},
+                          {{0, r}, {0, 0}, {r, 0}}};
+    const b3d_attr_t b = {{0xFFFFFF, 0xFFFFFF, 0xFFFFFF},
+                          {{0, r}, {r, 0}, {r, r}}};
+    b3d_ctx_set_texture(ctx, tex);
+    b3d_ctx_triangle_ex(ctx, &(b3d_tri_t) {{{-1, -1, 1}, {-1, 1, 1}, {1, 1, 1}}},
+                        &a);
+    b3d_ctx_triangle_ex(ctx, &(b3d_tri_t) {{{-1, -1, 1}, {1, 1, 1}, {1, -1, 1}}},
+                        &b);
+}
+
+/* Test mipmapped textures and filtering */
+TEST(api_texture_mips)
+{
+    const int width = 64, height = 64, tw = 64;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t tex_size = b3d_texture_size(tw, tw);
+    const size_t arena_size = b3d_bin_arena_size(width, height, 64);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    uint32_t *image = malloc((size_t) tw * tw * sizeof(uint32_t));
+    void *buf = malloc(tex_size);
+    void *arena = malloc(arena_size);
+    int ok = pixels && pixels_ref && depth && ctx && image && buf && arena;
+
+    if (ok) {
+        b3d_texture_t tex, plain;
+
+        /* Sizes and arguments are validated; the chain takes 4/3 of level 0
+         * and keeps going while both sides can be halved
+         */
+        ok = b3d_texture_size(3, 4) == 0 && b3d_texture_size(0, 4) == 0;
+        ok = ok && tex_size >= (size_t) tw * tw * 4 / 3 * sizeof(uint32_t);
+        for (int i = 0; i < tw * tw; i++)
+            image[i] = (uint32_t) i * 0x010203u | 0x010101u;
+        ok = ok && !b3d_texture_init(&tex, buf, tex_size - 4, image, tw, tw,
+                                     B3D_FILTER_NEAREST);
+        ok = ok && !b3d_texture_init(&tex, buf, tex_size, image, tw, tw, 2);
+        ok = ok && b3d_texture_init(&tex, buf, tex_size, image, 8, 2,
+                                    B3D_FILTER_NEAREST);
+        ok = ok && tex.levels == 2;
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 90.0f);
+        ok = ok && b3d_ctx_set_texture(ctx, &tex);
+        tex.levels = 3;
+        ok = ok && !b3d_ctx_set_texture(ctx, &tex);
+
+        /* Magnified, the tiled level 0 samples exactly like the plain image,
+         * for both filters
+         */
+        for (int f = B3D_FILTER_NEAREST; f <= B3D_FILTER_BILINEAR && ok; f++) {
+            ok = b3d_texture_init(&tex, buf, tex_size, image, tw, tw, f);
+            ok = ok && tex.levels == 7;
+            plain = (b3d_texture_t) {image, tw, tw, 0, f};
+            b3d_ctx_clear(ctx);
+            render_tex_quad(ctx, &plain, 0.5f);
+            memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+            b3d_ctx_clear(ctx);
+            render_tex_quad(ctx, &tex, 0.5f);
+            ok = ok && count_drawn(pixels, count) == count;
+            ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+        }
+
+        /* Minified 8 times, a one-texel checkerboard averages to exact grey
+         * where the plain image aliases
+         */
+        for (int i = 0; i < tw * tw; i++)
+            image[i] = ((i ^ i / tw) & 1) ? 0xFFFFFF : 0x000000;
+        ok = ok && b3d_texture_init(&tex, buf, tex_size, image, tw, tw,
+                                    B3D_FILTER_NEAREST);
+        b3d_ctx_clear(ctx);
+        render_tex_quad(ctx, &tex, 8);
+        for (size_t i = 0; i < count && ok; i++)
+            ok = pixels[i] == 0x808080;
+        plain = (b3d_texture_t) {image, tw, tw, 0, B3D_FILTER_NEAREST};
+        b3d_ctx_clear(ctx);
+        render_tex_quad(ctx, &plain, 8);
+        ok = ok && pixels[0] != 0x808080;
+
+        /* Bilinear: halfway between a blue and a red texel is purple */
+        const uint32_t pair[2] = {0x0000FF, 0xFF0000};
+        plain = (b3d_texture_t) {pair, 2, 1, 0, B3D_FILTER_BILINEAR};
+        b3d_ctx_clear(ctx);
+        render_tex_quad(ctx, &plain, 1);
+        uint32_t mid = pixels[32 * width + 32], left = pixels[32 * width + 16];
+        ok = ok && (mid >> 16) >= 120 && (mid >> 16) <= 136;
+        ok = ok && (mid & 0xFF) >= 120 && (mid & 0xFF) <= 136;
+        ok = ok && (left & 0xFF) > 240 && (left >> 16) < 16;
+
+        /* Levels are chosen per aligned run, so binning changes nothing on
+         * a floor whose texel density varies across every row
+         */
+        ok = ok && b3d_texture_init(&tex, buf, tex_size, image, tw, tw,
+                                    B3D_FILTER_BILINEAR);
+        b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, 0, 0.5f, 0, 0});
+        b3d_ctx_clear(ctx);
+        render_attr_scene(ctx, &tex);
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+        b3d_ctx_clear(ctx);
+        render_attr_scene(ctx, &tex);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(ctx);
+    free(image);
+    free(buf);
+    free(arena);
+    return ok;
+}
+
+/* Add a wall at z = 0 and a grid of cubes hidden behind it */
+static void render_hiz_scene(b3d_context_t *ctx)
+{
+    b3d_tri_t wall[2] = {
+        {{{-3, -3, 0}, {-3, 3, 0}, {3, 3, 0}}},
+        {{{-3, -3, 0}, {3, 3, 0}, {3, -3, 0}}},
+    };
+    b3d_ctx_reset(ctx);
+    b3d_ctx_triangle(ctx, &wall[0], 0x808080);
+    b3d_ctx_triangle(ctx, &wall[1], 0x808080);
+    for (int i = 0; i < 9; i++) {
+        b3d_ctx_reset(ctx);
+        b3d_ctx_rotate_y(ctx, (float) i * 0.4f);
+        b3d_ctx_translate(ctx, (float) (i % 3) - 1.0f, (float) (i / 3) - 1.0f,
+                          2.0f);
+        for (int k = 0; k < 12; k++)
+            b3d_ctx_triangle(ctx, &test_cube[k],
+                             0x102030u * (uint32_t) (k + 1));
+    }
+}
+
+/* Test hierarchical Z: hidden triangles are rejected, the image is not */
+TEST(api_hiz)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t hiz_size = b3d_hiz_size(width, height);
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *hiz = malloc(hiz_size);
+    void *arena = malloc(arena_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && hiz &&
+             arena && hiz_size > 0 && b3d_hiz_size(0, 10) == 0;
+
+    if (ok) {
+        b3d_camera_t cam = {0, 0, -3.0f, 0, 0, 0};
+        ok = b3d_ctx_init(ctx, pixels_ref, depth_ref, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+        render_hiz_scene(ctx);
+        ok = ok && b3d_ctx_get_hiz_reject_count(ctx) == 0;
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = ok && !b3d_ctx_set_hiz(ctx, hiz, 16);
+        ok = ok && b3d_ctx_set_hiz(ctx, hiz, hiz_size);
+        render_binning_scene(ctx);
+        render_hiz_scene(ctx);
+        ok = ok && b3d_ctx_get_hiz_reject_count(ctx) > 0;
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t)) &&
+             !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+
+        /* Triangles in front of the wall are still drawn */
+        size_t rejected = b3d_ctx_get_hiz_reject_count(ctx);
+        b3d_tri_t front = {
+            {{-0.5f, -0.5f, -1}, {0, 0.5f, -1}, {0.5f, -0.5f, -1}}};
+        b3d_ctx_reset(ctx);
+        ok = ok && b3d_ctx_triangle(ctx, &front, 0xFF0000);
+        ok = ok && b3d_ctx_get_hiz_reject_count(ctx) == rejected;
+        ok = ok && pixels[(height / 2) * width + width / 2] == 0xFF0000;
+
+        /* Clearing resets blocks and counter; binning gives the same image */
+        b3d_ctx_clear(ctx);
+        ok = ok && b3d_ctx_get_hiz_reject_count(ctx) == 0;
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+        render_binning_scene(ctx);
+        render_hiz_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t)) &&
+             !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+        ok = ok && b3d_ctx_set_hiz(ctx, NULL, 0);
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(depth_ref);
+    free(ctx);
+    free(hiz);
+    free(arena);
+    return ok;
+}
+
+/* Test occlusion queries against a wall at z = 0 */
+TEST(api_occlusion_query)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t hiz_size = b3d_hiz_size(width, height);
+    const size_t arena_size = b3d_bin_arena_size(width, height, 64);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *hiz = malloc(hiz_size);
+    void *arena = malloc(arena_size);
+    int ok = pixels && depth && ctx && hiz && arena;
+
+    const float behind[2][3] = {{-0.5f, -0.5f, 1}, {0.5f, 0.5f, 2}};
+    const float front[2][3] = {{-0.5f, -0.5f, -1}, {0.5f, 0.5f, -0.5f}};
+    const float beside[2][3] = {{2.5f, -0.5f, 1}, {3.5f, 0.5f, 2}};
+    const float offscreen[2][3] = {{-0.5f, 20, 1}, {0.5f, 21, 2}};
+    const float around[2][3] = {{-1, -1, -4}, {1, 1, -2}};
+    b3d_tri_t wall[2] = {
+        {{{-2, -2, 0}, {-2, 2, 0}, {2, 2, 0}}},
+        {{{-2, -2, 0}, {2, 2, 0}, {2, -2, 0}}},
+    };
+
+    for (int pass = 0; ok && pass < 3; pass++) {
+        ok = b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, -3.0f, 0, 0, 0});
+        /* Plain depth buffer, hierarchical Z, queued binned triangles */
+        if (pass == 1)
+            ok = ok && b3d_ctx_set_hiz(ctx, hiz, hiz_size);
+        if (pass == 2)
+            ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 1);
+
+        ok = ok && b3d_ctx_occlusion_test_box(ctx, behind[0], behind[1]);
+        b3d_ctx_triangle(ctx, &wall[0], 0x808080);
+        b3d_ctx_triangle(ctx, &wall[1], 0x808080);
+        ok = ok && !b3d_ctx_occlusion_test_box(ctx, behind[0], behind[1]);
+        ok = ok && b3d_ctx_occlusion_test_box(ctx, front[0], front[1]);
+        ok = ok && b3d_ctx_occlusion_test_box(ctx, beside[0], beside[1]);
+        ok = ok && !b3d_ctx_occlusion_test_box(ctx, offscreen[0],
+                                               offscreen[1]);
+        ok = ok && b3d_ctx_occlusion_test_box(ctx, around[0], around[1]);
+
+        /* The model matrix applies: moving the box aside uncovers it */
+        b3d_ctx_translate(ctx, 3.0f, 0, 0);
+        ok = ok && b3d_ctx_occlusion_test_box(ctx, behind[0], behind[1]);
+        b3d_ctx_reset(ctx);
+
+        int cx = width / 2, cy = height / 2;
+        ok = ok && !b3d_ctx_occlusion_test_rect(ctx, cx - 5, cy - 5, cx + 5,
+                                                cy + 5, 0.99f);
+        ok = ok && b3d_ctx_occlusion_test_rect(ctx, cx - 5, cy - 5, cx + 5,
+                                               cy + 5, 0.5f);
+        ok = ok && b3d_ctx_occlusion_test_rect(ctx, 0, 0, 4, 4, 0.99f);
+        ok = ok && !b3d_ctx_occlusion_test_rect(ctx, -10, 0, 0, 4, 0.5f);
+        ok = ok && !b3d_ctx_occlusion_test_rect(ctx, cx, cy, cx, cy + 5, 0.5f);
+        ok = ok && !b3d_ctx_occlusion_test_box(NULL, behind[0], behind[1]);
+        ok = ok && !b3d_ctx_occlusion_test_box(ctx, NULL, behind[1]);
+
+        /* Queries never draw */
+        ok = ok && pixels[0] == 0;
+        b3d_ctx_set_binning(ctx, NULL, 0, 0);
+        b3d_ctx_set_hiz(ctx, NULL, 0);
+    }
+
+    free(pixels);
+    free(depth);
+    free(ctx);
+    free(hiz);
+    free(arena);
+    return ok;
+}
+
+TEST(api_clear)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t hiz_size = b3d_hiz_size(width, height);
+    const size_t arena_size = b3d_bin_arena_size(width, height, 64);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    uint32_t *ref_pixels = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *ref_depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    b3d_context_t *ref = malloc(sizeof(b3d_context_t));
+    void *hiz = malloc(hiz_size);
+    void *arena = malloc(arena_size);
+    int ok = pixels && depth && ref_pixels && ref_depth && ctx && ref &&
+             hiz && arena;
+
+    b3d_tri_t near_wall[2] = {
+        {{{-4, -4, 0}, {-4, 4, 0}, {4, 4, 0}}},
+        {{{-4, -4, 0}, {4, 4, 0}, {4, -4, 0}}},
+    };
+    b3d_tri_t far_wall[2] = {
+        {{{-9, -9, 5}, {-9, 9, 5}, {9, 9, 5}}},
+        {{{-9, -9, 5}, {9, 9, 5}, {9, -9, 5}}},
+    };
+    const size_t center = (size_t) (height / 2) * (size_t) width + width / 2;
+    const b3d_camera_t cam = {0, 0, -3.0f, 0, 0, 0};
+
+    ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+    b3d_ctx_set_camera(ctx, &cam);
+
+    /* Color and depth clear independently */
+    b3d_ctx_clear_color(ctx, 0x123456);
+    for (size_t i = 0; ok && i < count; i++)
+        ok = pixels[i] == 0x123456;
+    b3d_ctx_clear_depth(ctx);
+    b3d_ctx_triangle(ctx, &near_wall[0], 0x808080);
+    b3d_ctx_triangle(ctx, &near_wall[1], 0x808080);
+    b3d_ctx_clear_color(ctx, 0);
+    b3d_ctx_triangle(ctx, &far_wall[0], 0x0000FF);
+    b3d_ctx_triangle(ctx, &far_wall[1], 0x0000FF);
+    ok = ok && pixels[center] == 0;
+    b3d_ctx_clear_depth(ctx);
+    ok = ok && pixels[center] == 0;
+    b3d_ctx_triangle(ctx, &far_wall[0], 0x0000FF);
+    b3d_ctx_triangle(ctx, &far_wall[1], 0x0000FF);
+    ok = ok && pixels[center] == 0x0000FF;
+
+    /* Rectangles are clipped and reset depth, including hierarchical Z */
+    ok = ok && b3d_ctx_set_hiz(ctx, hiz, hiz_size);
+    b3d_ctx_clear(ctx);
+    b3d_ctx_triangle(ctx, &near_wall[0], 0x808080);
+    b3d_ctx_triangle(ctx, &near_wall[1], 0x808080);
+    b3d_ctx_clear_rect(ctx, -20, -20, 10, 10, 0x00FF00);
+    b3d_ctx_clear_rect(ctx, 40, 40, 40, 60, 0x00FF00);
+    b3d_ctx_clear_rect(ctx, -10, -10, 0, 0, 0x00FF00);
+    ok = ok && pixels[0] == 0x00FF00 && pixels[9 * width + 9] == 0x00FF00;
+    ok = ok && pixels[10] == 0x808080 && pixels[10 * width] == 0x808080;
+    ok = ok && pixels[40 * width + 40] == 0x808080;
+    ok = ok && b3d_ctx_occlusion_test_rect(ctx, 0, 0, 10, 10, 0.99f);
+    ok = ok && !b3d_ctx_occlusion_test_rect(ctx, 12, 12, 20, 20, 0.99f);
+    b3d_ctx_triangle(ctx, &far_wall[0], 0x0000FF);
+    b3d_ctx_triangle(ctx, &far_wall[1], 0x0000FF);
+    ok = ok && pixels[0] == 0x0000FF && pixels[10] == 0x808080;
+    b3d_ctx_set_hiz(ctx, NULL, 0);
+
+    /* Partial clears apply after the triangles queued before them */
+    ok = ok && b3d_ctx_init(ref, ref_pixels, ref_depth, width, height, 70.0f);
+    b3d_ctx_set_camera(ref, &cam);
+    ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 1);
+    for (int pass = 0; ok && pass < 2; pass++) {
+        b3d_context_t *c = pass ? ref : ctx;
+        b3d_ctx_clear(c);
+        b3d_ctx_triangle(c, &near_wall[0], 0x808080);
+        b3d_ctx_triangle(c, &near_wall[1], 0x808080);
+        b3d_ctx_clear_rect(c, 20, 20, 90, 70, 0xFF0000);
+        b3d_ctx_triangle(c, &far_wall[0], 0x0000FF);
+        b3d_ctx_triangle(c, &far_wall[1], 0x0000FF);
+        b3d_ctx_flush(c);
+    }
+    ok = ok && memcmp(pixels, ref_pixels, count * sizeof(uint32_t)) == 0;
+    b3d_ctx_triangle(ctx, &near_wall[0], 0x808080);
+    b3d_ctx_clear_color(ctx, 0x000001);
+    b3d_ctx_flush(ctx);
+    ok = ok && pixels[center] == 0x000001;
+    b3d_ctx_set_binning(ctx, NULL, 0, 0);
+
+#if defined(B3D_FLOAT_POINT) || defined(B3D_DEPTH_16BIT)
+    ok = ok && !b3d_ctx_set_depth_epochs(ctx, true);
+#else
+    /* Epochs render the same frames as full clears, across a wrap-around of
+     * the counter; every other frame only draws the far wall, which stale
+     * depth of the near one would hide.
+     */
+    ok = ok && b3d_ctx_set_depth_epochs(ctx, true);
+    ok = ok && !b3d_ctx_set_depth_epochs(NULL, true);
+    int drawn = 0;
+    for (int f = 0; ok && f < 2100; f++) {
+        b3d_ctx_clear(ctx);
+        if (!(f < 2 || (f > 2040 && f < 2052) || f % 500 == 0))
+            continue;
+        b3d_ctx_clear(ref);
+        for (int pass = 0; pass < 2; pass++) {
+            b3d_context_t *c = pass ? ref : ctx;
+            if (drawn & 1) {
+                b3d_ctx_triangle(c, &far_wall[0], 0x0000FF);
+                b3d_ctx_triangle(c, &far_wall[1], 0x0000FF);
+            } else {
+                render_hiz_scene(c);
+                b3d_ctx_clear_rect(c, 30, 20, 60, 50, 0xFF0000);
+                b3d_ctx_reset(c);
+                b3d_ctx_triangle(c, &far_wall[0], 0x0000FF);
+                b3d_ctx_triangle(c, &far_wall[1], 0x0000FF);
+            }
+        }
+        ok = memcmp(pixels, ref_pixels, count * sizeof(uint32_t)) == 0;
+        ok = ok && pixels[center] != 0;
+        drawn++;
+    }
+    ok = ok && b3d_ctx_set_depth_epochs(ctx, false);
+#endif
+
+    free(pixels);
+    free(depth);
+    free(ref_pixels);
+    free(ref_depth);
+    free(ctx);
+    free(ref);
+    free(hiz);
+    free(arena);
+    return ok;
+}
+
+/* Compare a queued frame with one drawn in submission order. Without
+ * culling, back faces tie in depth with front faces along cube edges and
+ * either may win there, so only coverage has to match.
+ */
+static bool queue_image_matches(const uint32_t *pixels,
+                                const uint32_t *ref,
+                                size_t count)
+{
+#ifdef B3D_NO_CULLING
+    return count_drawn(pixels, count) == count_drawn(ref, count);
+#else
+    return !memcmp(pixels, ref, count * sizeof(uint32_t));
+#endif
+}
+
+/* Add the hidden cubes of render_hiz_scene() first and their wall last */
+static void render_wall_last_scene(b3d_context_t *ctx)
+{
+    b3d_tri_t wall[2] = {
+        {{{-3, -3, 0}, {-3, 3, 0}, {3, 3, 0}}},
+        {{{-3, -3, 0}, {3, 3, 0}, {3, -3, 0}}},
+    };
+    for (int i = 0; i < 9; i++) {
+        b3d_ctx_reset(ctx);
+        b3d_ctx_rotate_y(ctx, (float) i * 0.4f);
+        b3d_ctx_translate(ctx, (float) (i % 3) - 1.0f, (float) (i / 3) - 1.0f,
+                          2.0f);
+        for (int k = 0; k < 12; k++)
+            b3d_ctx_triangle(ctx, &test_cube[k],
+                             0x102030u * (uint32_t) (k + 1));
+    }
+    b3d_ctx_reset(ctx);
+    b3d_ctx_triangle(ctx, &wall[0], 0x808080);
+    b3d_ctx_triangle(ctx, &wall[1], 0x808080);
+}
+
+/* Test the render queue: same image, drawn nearest first */
+TEST(api_render_queue)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t queue_size = b3d_queue_arena_size(256);
+    const size_t small_size = b3d_queue_arena_size(8);
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    const size_t hiz_size = b3d_hiz_size(width, height);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *queue = malloc(queue_size);
+    void *arena = malloc(arena_size);
+    void *hiz = malloc(hiz_size);
+    int ok = pixels && pixels_ref && depth && ctx && queue && arena && hiz &&
+             queue_size > small_size && b3d_queue_arena_size(0) == 0;
+
+    if (ok) {
+        b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+        /* Like a static context: zeroed, not yet initialized */
+        memset(ctx, 0, sizeof(*ctx));
+        ok = !b3d_ctx_set_queue(ctx, queue, queue_size,
+                                B3D_QUEUE_FRONT_TO_BACK);
+        ok = ok && b3d_ctx_init(ctx, pixels_ref, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        render_binning_scene(ctx);
+
+        /* Arguments are checked; NULL just leaves queueing off */
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = ok && !b3d_ctx_set_queue(ctx, queue, queue_size, 2);
+        ok = ok && !b3d_ctx_set_queue(ctx, queue, b3d_queue_arena_size(1) - 1,
+                                      B3D_QUEUE_FRONT_TO_BACK);
+        ok = ok && b3d_ctx_set_queue(ctx, NULL, 0, 0);
+
+        /* Nothing is drawn before the flush, and then the same image */
+        ok = ok && b3d_ctx_set_queue(ctx, queue, queue_size,
+                                     B3D_QUEUE_FRONT_TO_BACK);
+        render_binning_scene(ctx);
+        ok = ok && count_drawn(pixels, count) == 0;
+        b3d_ctx_queue_flush(ctx);
+        ok = ok && queue_image_matches(pixels, pixels_ref, count);
+
+        /* Clearing discards queued triangles */
+        render_binning_scene(ctx);
+        b3d_ctx_clear(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && count_drawn(pixels, count) == 0;
+
+        /* Back to front, flushed early through a small arena into bins */
+        ok = ok && b3d_ctx_set_queue(ctx, queue, small_size,
+                                     B3D_QUEUE_BACK_TO_FRONT);
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+        render_binning_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && queue_image_matches(pixels, pixels_ref, count);
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+
+        /* Submitted last, the wall still goes first and hides the cubes
+         * from hierarchical Z
+         */
+        b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, -3.0f, 0, 0, 0});
+        ok = ok && b3d_ctx_set_hiz(ctx, hiz, hiz_size);
+        ok = ok && b3d_ctx_set_queue(ctx, NULL, 0, 0);
+        b3d_ctx_clear(ctx);
+        render_wall_last_scene(ctx);
+        ok = ok && b3d_ctx_get_hiz_reject_count(ctx) == 0;
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+#ifdef B3D_STATS
+        b3d_stats_t st;
+        ok = ok && b3d_ctx_get_stats(ctx, &st);
+        uint64_t written = st.pixels_written;
+#endif
+        ok = ok && b3d_ctx_set_queue(ctx, queue, queue_size,
+                                     B3D_QUEUE_FRONT_TO_BACK);
+        b3d_ctx_clear(ctx);
+        render_wall_last_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && b3d_ctx_get_hiz_reject_count(ctx) > 0;
+        ok = ok && queue_image_matches(pixels, pixels_ref, count);
+#ifdef B3D_STATS
+        ok = ok && b3d_ctx_get_stats(ctx, &st);
+        ok = ok && st.pixels_written < written;
+#endif
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(ctx);
+    free(queue);
+    free(arena);
+    free(hiz);
+    return ok;
+}
+
+/* A far wall with a small cube in front of it at @x */
+static void render_diff_scene(b3d_context_t *ctx, float x)
+{
+    b3d_tri_t wall[2] = {
+        {{{-4, -4, 4}, {-4, 4, 4}, {4, 4, 4}}},
+        {{{-4, -4, 4}, {4, 4, 4}, {4, -4, 4}}},
+    };
+    b3d_ctx_clear(ctx);
+    b3d_ctx_reset(ctx);
+    b3d_ctx_triangle(ctx, &wall[0], 0x405060);
+    b3d_ctx_triangle(ctx, &wall[1], 0x605040);
+    b3d_ctx_rotate_y(ctx, 0.5f);
+    b3d_ctx_translate(ctx, x, 0.3f, 2.0f);
+    for (int i = 0; i < 12; i++)
+        b3d_ctx_triangle(ctx, &test_cube[i], 0x203040u * (uint32_t) (i + 1));
+}
+
+/* Total area of @n dirty rectangles; false if any leaves the screen */
+static bool dirty_area(const b3d_rect_t *r, int n, int w, int h, size_t *area)
+{
+    *area = 0;
+    for (int i = 0; i < n; i++) {
+        if (r[i].x0 < 0 || r[i].y0 < 0 || r[i].x1 > w || r[i].y1 > h ||
+            r[i].x0 >= r[i].x1 || r[i].y0 >= r[i].y1)
+            return false;
+        *area += (size_t) (r[i].x1 - r[i].x0) * (size_t) (r[i].y1 - r[i].y0);
+    }
+    return true;
+}
+
+/* Draw a square of half-size @r at depth @z in shades of @mask, through
+ * the attribute path if @attr
+ */
+static void render_depth_quad(b3d_context_t *ctx,
+                              float r,
+                              float z,
+                              uint32_t mask,
+                              bool attr)
+{
+    const b3d_tri_t a = {{{-r, -r, z}, {-r, r, z}, {r, r, z}}};
+    const b3d_tri_t b = {{{-r, -r, z}, {r, r, z}, {r, -r, z}}};
+    const uint32_t c0 = mask, c1 = mask & 0xC0C0C0u, c2 = mask & 0x808080u;
+    if (attr) {
+        b3d_ctx_triangle_ex(ctx, &a, &(b3d_attr_t) {{c0, c1, c2}, {{0}}});
+        b3d_ctx_triangle_ex(ctx, &b, &(b3d_attr_t) {{c0, c2, c1}, {{0}}});
+    } else {
+        b3d_ctx_triangle(ctx, &a, c1);
+        b3d_ctx_triangle(ctx, &b, c1);
+    }
+}
+
+/* Whether @pixel was drawn by a render_depth_quad() of @mask */
+static bool pixel_in(uint32_t pixel, uint32_t mask)
+{
+    return pixel && !(pixel & ~mask);
+}
+
+/* Near red, then far green drawn over it regardless of depth, then blue in
+ * between tested but not written, and a smaller far white one last
+ */
+static void render_depth_state_scene(b3d_context_t *ctx, bool attr)
+{
+    b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+    b3d_ctx_set_depth_write(ctx, true);
+    render_depth_quad(ctx, 0.6f, 1.0f, 0xFF0000, attr);
+    b3d_ctx_set_depth_func(ctx, B3D_DEPTH_ALWAYS);
+    render_depth_quad(ctx, 0.8f, 3.0f, 0x00FF00, attr);
+    b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+    b3d_ctx_set_depth_write(ctx, false);
+    render_depth_quad(ctx, 0.3f, 2.0f, 0x0000FF, attr);
+    b3d_ctx_set_depth_write(ctx, true);
+    render_depth_quad(ctx, 0.4f, 2.5f, 0xFFFFFF, attr);
+}
+
+/* Test depth comparison and depth write state on every rasterizer path */
+TEST(api_depth_state)
+{
+    const int width = 64, height = 64;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t center = (size_t) (height / 2) * width + width / 2;
+    const size_t corner = (size_t) (height / 2 + 10) * width + width / 2 + 10;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 64);
+    const size_t hiz_size = b3d_hiz_size(width, height);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    void *hiz = malloc(hiz_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && arena && hiz;
+
+    if (ok) {
+        ok = b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+
+        /* Depth test on and writes enabled by default, @func is checked */
+        ok = ok && b3d_ctx_get_depth_func(ctx) == B3D_DEPTH_LESS &&
+             b3d_ctx_get_depth_write(ctx);
+        ok = ok && !b3d_ctx_set_depth_func(ctx, 3) &&
+             !b3d_ctx_set_depth_func(NULL, B3D_DEPTH_ALWAYS);
+        ok = ok && b3d_ctx_get_depth_func(ctx) == B3D_DEPTH_LESS;
+
+        for (int mode = 0; mode < 4; mode++) {
+            bool attr = mode & 1;
+            b3d_ctx_set_rasterizer(ctx, mode < 2 ? B3D_RASTER_SCANLINE
+                                                 : B3D_RASTER_EDGE);
+
+            /* Writes off: the depth buffer is untouched, farther wins */
+            b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+            b3d_ctx_clear(ctx);
+            memcpy(depth_ref, depth, count * sizeof(b3d_depth_t));
+            b3d_ctx_set_depth_write(ctx, false);
+            ok = ok && !b3d_ctx_get_depth_write(ctx);
+            render_depth_quad(ctx, 0.6f, 1.0f, 0xFF0000, attr);
+            ok = ok && pixel_in(pixels[center], 0xFF0000);
+            ok = ok && !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+            b3d_ctx_set_depth_write(ctx, true);
+            render_depth_quad(ctx, 0.6f, 2.0f, 0x00FF00, attr);
+            ok = ok && pixel_in(pixels[center], 0x00FF00);
+
+            /* Always: far overwrites near, and its depth is what later
+             * triangles test against
+             */
+            b3d_ctx_clear(ctx);
+            b3d_ctx_set_depth_func(ctx, B3D_DEPTH_ALWAYS);
+            ok = ok && b3d_ctx_get_depth_func(ctx) == B3D_DEPTH_ALWAYS;
+            render_depth_quad(ctx, 0.6f, 1.0f, 0xFF0000, attr);
+            render_depth_quad(ctx, 0.6f, 3.0f, 0x00FF00, attr);
+            ok = ok && pixel_in(pixels[center], 0x00FF00);
+            b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+            render_depth_quad(ctx, 0.6f, 2.0f, 0x0000FF, attr);
+            ok = ok && pixel_in(pixels[center], 0x0000FF);
+            render_depth_quad(ctx, 0.6f, 2.5f, 0xFFFFFF, attr);
+            ok = ok && pixel_in(pixels[center], 0x0000FF);
+
+            /* Mixed states give the same image binned, with hierarchical
+             * Z, which must not cull what always passes
+             */
+            ok = ok && b3d_ctx_init(ctx, pixels_ref, depth, width, height,
+                                    70.0f);
+            b3d_ctx_set_rasterizer(ctx, mode < 2 ? B3D_RASTER_SCANLINE
+                                                 : B3D_RASTER_EDGE);
+            render_depth_state_scene(ctx, attr);
+            ok = ok && pixel_in(pixels_ref[center], 0xFFFFFF) &&
+                 pixel_in(pixels_ref[corner], 0x00FF00);
+            ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+            b3d_ctx_set_rasterizer(ctx, mode < 2 ? B3D_RASTER_SCANLINE
+                                                 : B3D_RASTER_EDGE);
+            ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 1);
+            ok = ok && b3d_ctx_set_hiz(ctx, hiz, hiz_size);
+            b3d_ctx_clear(ctx);
+            render_depth_state_scene(ctx, attr);
+            b3d_ctx_flush(ctx);
+            ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+            ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+            b3d_ctx_set_hiz(ctx, NULL, 0);
+        }
+
+        /* The state survives b3d_init() */
+        b3d_set_depth_func(B3D_DEPTH_ALWAYS);
+        b3d_set_depth_write(false);
+        ok = ok && b3d_init(pixels, depth, width, height, 70.0f);
+        ok = ok && b3d_get_depth_func() == B3D_DEPTH_ALWAYS &&
+             !b3d_get_depth_write();
+        b3d_set_depth_func(B3D_DEPTH_LESS);
+        b3d_set_depth_write(true);
+    }
+
+    free(hiz);
+    free(arena);
+    free(ctx);
+    free(depth_ref);
+    free(depth);
+    free(pixels_ref);
+    free(pixels);
+    return ok;
+}
+
+/* Draw render_hiz_scene(), or render_attr_scene() if @attr, as a depth
+ * prepass followed by a color pass that only shades the visible pixels
+ */
+static void render_prepass_scene(b3d_context_t *ctx, bool attr)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        b3d_ctx_set_color_write(ctx, pass == 1);
+        b3d_ctx_set_depth_write(ctx, pass == 0);
+        b3d_ctx_set_depth_func(ctx, pass ? B3D_DEPTH_EQUAL : B3D_DEPTH_LESS);
+        if (attr)
+            render_attr_scene(ctx, NULL);
+        else
+            render_hiz_scene(ctx);
+    }
+    b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+    b3d_ctx_set_depth_write(ctx, true);
+}
+
+/* Test a depth prepass with color writes off, then an equal-depth pass */
+TEST(api_depth_prepass)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    const size_t hiz_size = b3d_hiz_size(width, height);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    void *hiz = malloc(hiz_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && arena && hiz;
+
+    if (ok) {
+        const b3d_camera_t cam = {0.2f, 0.1f, -3.0f, 0, 0, 0};
+        ok = b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        ok = ok && b3d_ctx_get_color_write(ctx);
+        ok = ok && b3d_ctx_set_depth_func(ctx, B3D_DEPTH_EQUAL);
+        ok = ok && b3d_ctx_get_depth_func(ctx) == B3D_DEPTH_EQUAL;
+        b3d_ctx_set_depth_func(ctx, B3D_DEPTH_LESS);
+
+        for (int mode = 0; mode < 4; mode++) {
+            bool attr = mode & 1;
+            int raster = mode < 2 ? B3D_RASTER_SCANLINE : B3D_RASTER_EDGE;
+
+            /* Reference: one pass */
+            ok = ok && b3d_ctx_init(ctx, pixels_ref, depth_ref, width, height,
+                                    70.0f);
+            b3d_ctx_set_camera(ctx, &cam);
+            b3d_ctx_set_rasterizer(ctx, raster);
+            if (attr)
+                render_attr_scene(ctx, NULL);
+            else
+                render_hiz_scene(ctx);
+
+            /* The prepass writes the same depth and no color */
+            ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+            b3d_ctx_set_camera(ctx, &cam);
+            b3d_ctx_set_rasterizer(ctx, raster);
+            b3d_ctx_set_color_write(ctx, false);
+            ok = ok && !b3d_ctx_get_color_write(ctx);
+            if (attr)
+                render_attr_scene(ctx, NULL);
+            else
+                render_hiz_scene(ctx);
+            ok = ok && count_drawn(pixels, count) == 0;
+            ok = ok && !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+
+            /* Both passes together draw the one-pass image */
+            b3d_ctx_clear(ctx);
+            render_prepass_scene(ctx, attr);
+            ok = ok && b3d_ctx_get_color_write(ctx);
+            ok = ok && queue_image_matches(pixels, pixels_ref, count);
+            ok = ok && !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+
+            /* Likewise binned, with hierarchical Z, where equal depth has
+             * to survive the occlusion test
+             */
+            ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+            ok = ok && b3d_ctx_set_hiz(ctx, hiz, hiz_size);
+            b3d_ctx_clear(ctx);
+            render_prepass_scene(ctx, attr);
+            b3d_ctx_flush(ctx);
+            ok = ok && queue_image_matches(pixels, pixels_ref, count);
+            ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+            b3d_ctx_set_hiz(ctx, NULL, 0);
+        }
+
+        /* The state survives b3d_init() */
+        b3d_set_color_write(false);
+        ok = ok && b3d_init(pixels, depth, width, height, 70.0f);
+        ok = ok && !b3d_get_color_write();
+        b3d_set_color_write(true);
+    }
+
+    free(hiz);
+    free(arena);
+    free(ctx);
+    free(depth_ref);
+    free(depth);
+    free(pixels_ref);
+    free(pixels);
+    return ok;
+}
+
+/* Test tile diffing: unchanged tiles are kept, the frame matches a full
+ * redraw, and dirty rectangles cover every changed pixel
+ */
+TEST(api_tile_diff)
+{
+    const int width = 200, height = 150;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 64);
+    const size_t diff_size = b3d_tile_diff_size(width, height);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *ref_a = malloc(count * sizeof(uint32_t));
+    uint32_t *ref_b = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    void *diff = malloc(diff_size);
+    b3d_rect_t rects[16];
+    size_t area = 0;
+    int ok = pixels && ref_a && ref_b && depth && ctx && arena && diff &&
+             diff_size > 0 && b3d_tile_diff_size(0, 10) == 0;
+
+    if (ok) {
+        /* References drawn in immediate mode */
+        ok = b3d_ctx_init(ctx, ref_a, depth, width, height, 70.0f);
+        render_diff_scene(ctx, -1.0f);
+        ok = ok && b3d_ctx_init(ctx, ref_b, depth, width, height, 70.0f);
+        render_diff_scene(ctx, -0.8f);
+        ok = ok && memcmp(ref_a, ref_b, count * sizeof(uint32_t)) != 0;
+
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        ok = ok && !b3d_ctx_set_tile_diff(ctx, diff, 16);
+        ok = ok && b3d_ctx_get_dirty_rects(ctx, rects, 16) == 0;
+        ok = ok && b3d_ctx_set_tile_diff(ctx, diff, diff_size);
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+
+        /* The first frame redraws everything */
+        render_diff_scene(ctx, -1.0f);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, ref_a, count * sizeof(uint32_t));
+        int n = b3d_ctx_get_dirty_rects(ctx, rects, 16);
+        ok = ok && n > 0 && n <= 16 &&
+             dirty_area(rects, n, width, height, &area) && area == count;
+
+        /* The same frame again changes nothing */
+        render_diff_scene(ctx, -1.0f);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, ref_a, count * sizeof(uint32_t));
+        ok = ok && b3d_ctx_get_dirty_rects(ctx, rects, 16) == 0;
+#ifdef B3D_STATS
+        b3d_stats_t st;
+        ok = ok && b3d_ctx_get_stats(ctx, &st) && st.triangles_rasterized == 0;
+#endif
+
+        /* Moving the cube redraws the tiles around it only */
+        render_diff_scene(ctx, -0.8f);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, ref_b, count * sizeof(uint32_t));
+        n = b3d_ctx_get_dirty_rects(ctx, rects, 16);
+        ok = ok && n > 0 && n <= 16 &&
+             dirty_area(rects, n, width, height, &area) && area < count;
+        for (int y = 0; ok && y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = (size_t) y * (size_t) width + (size_t) x;
+                bool inside = false;
+                for (int k = 0; k < n; k++) {
+                    inside |= x >= rects[k].x0 && x < rects[k].x1 &&
+                              y >= rects[k].y0 && y < rects[k].y1;
+                }
+                ok = ok && (inside || ref_a[i] == ref_b[i]);
+            }
+        }
+        ok = ok && b3d_ctx_get_dirty_rects(ctx, NULL, 0) == n;
+
+        /* Writes outside the tile input force a full redraw */
+        b3d_ctx_clear_rect(ctx, 0, 0, 10, 10, 0xFFFFFF);
+        render_diff_scene(ctx, -0.8f);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, ref_b, count * sizeof(uint32_t));
+        n = b3d_ctx_get_dirty_rects(ctx, rects, 16);
+        ok = ok && dirty_area(rects, n, width, height, &area) && area == count;
+
+        pixels[0] = 0xFFFFFF;
+        b3d_ctx_invalidate_tiles(ctx);
+        render_diff_scene(ctx, -0.8f);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, ref_b, count * sizeof(uint32_t));
+
+        /* Without binning, clears are immediate again */
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+        render_diff_scene(ctx, -1.0f);
+        ok = ok && !memcmp(pixels, ref_a, count * sizeof(uint32_t));
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 1);
+        render_diff_scene(ctx, -1.0f);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, ref_a, count * sizeof(uint32_t));
+        ok = ok && b3d_ctx_set_tile_diff(ctx, NULL, 0) &&
+             b3d_ctx_get_dirty_rects(ctx, rects, 16) == 0;
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+    }
+
+    free(pixels);
+    free(ref_a);
+    free(ref_b);
+    free(depth);
+    free(ctx);
+    free(arena);
+    free(diff);
+    return ok;
+}
+
+/* Test the OBJ loader: parsing, triangulation, errors and arena storage */
+TEST(api_obj_loader)
+{
+    static const char text[] =
+        "# quad, fans and relative indices\r\n"
+        "o quad\n"
+        "v -1 -1 0\n"
+        "vt 0 0\n"
+        "v 1 -1 0\r\n"
+        "vn 0 0 -1\n"
+        "  v\t1 1 0\n"
+        "v -1 1 0 1.0\n"
+        "v bogus 0 0\n"
+        "f 1/1/1 4 3//1 2/1/1\n"
+        "v 2.5e-1 -.5 +1E1\n"
+        "f -1 -5 -3";
+    static const uint32_t expect[] = {0, 3, 2, 0, 2, 1, 4, 0, 2};
+    unsigned char arena[256];
+    b3d_indexed_mesh_t mesh, in_arena = {0};
+    int ok = b3d_parse_obj(text, strlen(text), &mesh, NULL, 0) == 0;
+    ok = ok && mesh.heap && mesh.vertex_count == 5 && mesh.index_count == 9;
+    ok = ok && memcmp(mesh.indices, expect, sizeof(expect)) == 0;
+    ok = ok && mesh.positions[3] == 1.0f && mesh.positions[7] == 1.0f;
+    ok = ok && mesh.positions[12] == 0.25f && mesh.positions[13] == -0.5f &&
+         mesh.positions[14] == 10.0f;
+
+    /* The same mesh in an unaligned arena, and an arena that is too small */
+    ok = ok && b3d_parse_obj(text, strlen(text), &in_arena, arena + 1,
+                             sizeof(arena) - 1) == 0;
+    ok = ok && !in_arena.heap && in_arena.index_count == 9;
+    ok = ok && memcmp(in_arena.indices, expect, sizeof(expect)) == 0;
+    ok = ok && memcmp(in_arena.positions, mesh.positions,
+                      15 * sizeof(float)) == 0;
+    ok = ok && b3d_parse_obj(text, strlen(text), &in_arena, arena, 64) == 2;
+    b3d_free_indexed_mesh(&in_arena);
+
+    /* Indices must name positions that exist, forward references included */
+    static const char *const bad_text[] = {
+        "v 0 0 0\nf 1 1 2\n",
+        "v 0 0 0\nf 0 1 1\n",
+        "v 0 0 0\nf -2 1 1\n",
+    };
+    static const char forward[] = "f 1 2 3\nv 0 0 0\nv 1 0 0\nv 0 1 0\n";
+    b3d_indexed_mesh_t bad = {0};
+    ok = ok && b3d_parse_obj(forward, strlen(forward), &bad, NULL, 0) == 0;
+    b3d_free_indexed_mesh(&bad);
+    for (int i = 0; ok && i < 3; i++) {
+        size_t len = strlen(bad_text[i]);
+        ok = b3d_parse_obj(bad_text[i], len, &bad, NULL, 0) == 3;
+    }
+    ok = ok && b3d_parse_obj("", 0, &bad, NULL, 0) == 0 &&
+         bad.index_count == 0;
+    b3d_free_indexed_mesh(&bad);
+
+    /* Files load to the same mesh, and the flat list expands the indices */
+    b3d_indexed_mesh_t moai = {0};
+    b3d_mesh_t flat = {0};
+    ok = ok && b3d_load_obj_indexed("assets/moai.obj", &moai, NULL, 0) == 0;
+    ok = ok && b3d_load_obj("assets/moai.obj", &flat) == 0;
+    ok = ok && moai.index_count > 0 &&
+         flat.triangle_count * 3 == moai.index_count;
+    for (int i = 0; ok && i < moai.index_count; i++)
+        ok = memcmp(&flat.triangles[i * 3],
+                    &moai.positions[moai.indices[i] * 3],
+                    3 * sizeof(float)) == 0;
+    b3d_free_mesh(&flat);
+    ok = ok && b3d_load_obj("assets/missing.obj", &flat) == 1;
+
+    /* The indexed mesh feeds b3d_draw_mesh() directly */
+    const int width = 64, height = 64;
+    uint32_t *pixels = malloc((size_t) width * height * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc((size_t) width * height * sizeof(*depth));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    ok = ok && pixels && depth && ctx &&
+         b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+    if (ok) {
+        b3d_ctx_set_camera(ctx, &(b3d_camera_t) {0, 0, -3.0f, 0, 0, 0});
+        b3d_ctx_clear(ctx);
+        ok = b3d_ctx_draw_mesh(ctx, mesh.positions, mesh.vertex_count,
+                               mesh.indices, 6, NULL) == 2;
+        ok = ok && pixels[(height / 2) * width + width / 2] == 0xFFFFFF;
+    }
+
+    free(pixels);
+    free(depth);
+    free(ctx);
+    b3d_free_indexed_mesh(&mesh);
+    b3d_free_indexed_mesh(&moai);
+    b3d_free_mesh(&flat);
+    return ok;
+}
+
+/* Test .b3dm caches: save, zero-copy map, validation */
+TEST(api_mesh_cache)
+{
+    static const float positions[] = {
+        -1, -1, 0, -1, 1, 0, 1, 1, 0, 1, -1, 2,
+    };
+    static const uint32_t indices[] = {0, 1, 2, 0, 2, 3};
+    static const uint32_t colors[] = {0xFF0000, 0x00FF00};
+    const char *path = "tests/test-mesh.b3dm";
+    b3d_mapped_mesh_t mesh = {0};
+
+    int ok = b3d_mesh_save(path, positions, 4, indices, 6, colors, true) == 0;
+    ok = ok && b3d_mesh_map(path, &mesh) == 0;
+    ok = ok && mesh.vertex_count == 4 && mesh.index_count == 6;
+    ok = ok && memcmp(mesh.positions, positions, sizeof(positions)) == 0;
+    ok = ok && memcmp(mesh.indices, indices, sizeof(indices)) == 0;
+    ok = ok && mesh.colors && memcmp(mesh.colors, colors, sizeof(colors)) == 0;
+    ok = ok && mesh.min[0] == -1 && mesh.max[1] == 1 && mesh.max[2] == 2;
+    ok = ok && ((uintptr_t) mesh.positions % B3D_MESH_ALIGN) == 0 &&
+         ((uintptr_t) mesh.indices % B3D_MESH_ALIGN) == 0;
+
+    /* Normals face the camera, which looks down +z at front faces */
+    ok = ok && mesh.normals && fabsf(mesh.normals[2] + 1.0f) < 1e-3f;
+    if (ok) {
+        const float *n = &mesh.normals[3];
+        float len = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+        ok = fabsf(len - 1.0f) < 1e-3f && n[2] < 0;
+    }
+    b3d_mesh_unmap(&mesh);
+    ok = ok && mesh.positions == NULL;
+
+    /* Without optional blobs; invalid meshes are not written */
+    ok = ok && b3d_mesh_save(path, positions, 4, indices, 6, NULL, false) == 0;
+    ok = ok && b3d_mesh_map(path, &mesh) == 0 && !mesh.colors &&
+         !mesh.normals && mesh.index_count == 6;
+    b3d_mesh_unmap(&mesh);
+    ok = ok && b3d_mesh_save(path, positions, 3, indices, 6, NULL, false) == 3;
+    ok = ok && b3d_mesh_save(path, positions, 4, indices, 5, NULL, false) == 3;
+
+    /* Truncated and foreign files are rejected */
+    FILE *file = fopen(path, "wb");
+    ok = ok && file;
+    if (file) {
+        b3d_mesh_header_t h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "B3DM", 4);
+        h.version = B3D_MESH_VERSION;
+        h.vertex_count = 1000;
+        h.positions = sizeof(h);
+        h.indices = sizeof(h);
+        fwrite(&h, sizeof(h), 1, file);
+        fclose(file);
+    }
+    ok = ok && b3d_mesh_map(path, &mesh) == 3 && mesh.positions == NULL;
+    ok = ok && b3d_mesh_map("assets/moai.obj", &mesh) == 3;
+    ok = ok && b3d_mesh_map("assets/missing.b3dm", &mesh) == 1;
+    remove(path);
+    return ok;
+}
+
+/* Test SoA point transform: exact results past the batch width, no-ops */
+TEST(api_transform_points)
+{
+    b3d_mat_t m = {{{2, 0, 0, 0}, {0, 3, 0, 0}, {0, 0, 1, 1}, {5, 6, 7, 0}}};
+    float xs[13], ys[13], zs[13];
+    b3d_vec_t out[13];
+    int ok = 1;
+
+    for (int i = 0; i < 13; ++i) {
+        xs[i] = (float) i;
+        ys[i] = (float) -i;
+        zs[i] = 0.5f * i;
+    }
+    b3d_transform_points(&m, xs, ys, zs, 13, out);
+    for (int i = 0; i < 13; ++i)
+        ok = ok && out[i].x == 2 * xs[i] + 5 && out[i].y == 3 * ys[i] + 6 &&
+             out[i].z == zs[i] + 7 && out[i].w == zs[i];
+
+    /* Nothing is written for empty or invalid calls */
+    out[0].x = -1;
+    b3d_transform_points(&m, xs, ys, zs, 0, out);
+    b3d_transform_points(NULL, xs, ys, zs, 1, out);
+    b3d_transform_points(&m, xs, NULL, zs, 1, out);
+    return ok && out[0].x == -1;
+}
+
+/* Set the transform of display list test view @i */
+static void list_test_view(b3d_context_t *ctx, int i)
+{
+    b3d_ctx_reset(ctx);
+    b3d_ctx_translate(ctx, 0.3f * (float) (i - 2), 0.1f * (float) i, 0);
+    b3d_ctx_rotate_y(ctx, 0.7f * (float) i);
+    b3d_ctx_rotate_x(ctx, 0.4f * (float) i);
+}
+
+/* Test display lists: same image as immediate drawing, culling, misuse */
+TEST(api_display_list)
+{
+    const int width = 64, height = 48;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t list_size = b3d_list_arena_size(12);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(list_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && arena &&
+             list_size > b3d_list_arena_size(1) &&
+             b3d_list_arena_size(0) == 0 && b3d_list_arena_size(-1) == 0;
+    b3d_list_t *list = NULL;
+    b3d_camera_t cam = {0, 0, -2.5f, 0, 0, 0};
+
+    if (ok) {
+        memset(ctx, 0, sizeof(*ctx));
+        ok = !b3d_ctx_list_begin(ctx, arena, list_size);
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+    }
+
+    /* Recording draws nothing and refuses varying attributes */
+    ok = ok && !b3d_ctx_list_begin(ctx, arena, b3d_list_arena_size(1) - 1);
+    ok = ok && b3d_ctx_list_begin(ctx, arena, list_size);
+    ok = ok && !b3d_ctx_list_begin(ctx, arena, list_size);
+    if (ok) {
+        b3d_attr_t attr = {{0xFF0000, 0x00FF00, 0x0000FF}, {{0}}};
+        b3d_ctx_clear(ctx);
+        for (int i = 0; i < 12; i++)
+            ok = ok && b3d_ctx_triangle(ctx, &test_cube[i],
+                                        0x203040u * (uint32_t) (i + 1));
+        ok = ok && !b3d_ctx_triangle_ex(ctx, &test_cube[0], &attr);
+        ok = ok && count_drawn(pixels, count) == 0;
+        ok = ok && b3d_ctx_list_draw(ctx, (const b3d_list_t *) arena) == 0;
+        list = b3d_ctx_list_end(ctx);
+        ok = ok && list && !b3d_ctx_list_end(ctx);
+    }
+
+    /* Every view matches drawing the triangles one by one */
+    for (int i = 0; ok && i < 5; i++) {
+        ok = b3d_ctx_init(ctx, pixels_ref, depth_ref, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        b3d_ctx_clear(ctx);
+        list_test_view(ctx, i);
+        for (int t = 0; t < 12; t++)
+            b3d_ctx_triangle(ctx, &test_cube[t],
+                             0x203040u * (uint32_t) (t + 1));
+
+        ok = ok && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        b3d_ctx_clear(ctx);
+        list_test_view(ctx, i);
+        int drawn = b3d_ctx_list_draw(ctx, list);
+        ok = ok && drawn > 0 && drawn <= 12 &&
+             count_drawn(pixels, count) > 0 &&
+             queue_image_matches(pixels, pixels_ref, count) &&
+             !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+    }
+
+    /* A list behind the camera is skipped as a whole */
+    if (ok) {
+        b3d_stats_t st;
+        b3d_ctx_clear(ctx);
+        b3d_ctx_reset(ctx);
+        b3d_ctx_translate(ctx, 0, 0, -10.0f);
+        ok = b3d_ctx_list_draw(ctx, list) == 0 &&
+             count_drawn(pixels, count) == 0;
+#ifdef B3D_STATS
+        ok = ok && b3d_ctx_get_stats(ctx, &st) &&
+             st.triangles_frustum_culled == 12;
+#else
+        (void) st;
+#endif
+    }
+
+    /* Meshes are recorded too, lit ones in the colors of the recording, and
+     * draw what drawing them directly does
+     */
+    for (int lit = 0; ok && lit < 2; lit++) {
+        float positions[36 * 3], normals[13 * 3];
+        uint32_t indices[39] = {[36] = 0, 1, 36}, colors[13];
+        for (int t = 0; t < 13; t++) {
+            colors[t] = 0x203040u * (uint32_t) (t + 1);
+            normals[t * 3] = 0.6f;
+            normals[t * 3 + 1] = 0;
+            normals[t * 3 + 2] = -0.8f;
+            for (int k = 0; t < 12 && k < 3; k++) {
+                float *p = &positions[(t * 3 + k) * 3];
+                p[0] = test_cube[t].v[k].x;
+                p[1] = test_cube[t].v[k].y;
+                p[2] = test_cube[t].v[k].z;
+                indices[t * 3 + k] = (uint32_t) (t * 3 + k);
+            }
+        }
+        for (int pass = 0; ok && pass < 2; pass++) {
+            uint32_t *out = pass ? pixels : pixels_ref;
+            ok = b3d_ctx_init(ctx, out, pass ? depth : depth_ref, width,
+                              height, 70.0f);
+            b3d_ctx_set_camera(ctx, &cam);
+            b3d_ctx_clear(ctx);
+            list_test_view(ctx, 1);
+            ok = ok && (!pass || b3d_ctx_list_begin(ctx, arena, list_size));
+            int n = lit ? b3d_ctx_draw_mesh_lit(ctx, positions, 36, indices,
+                                                39, normals, 0x80C0FFu)
+                        : b3d_ctx_draw_mesh(ctx, positions, 36, indices, 39,
+                                            colors);
+            ok = ok && n > 0 && (!pass || n == 12);
+            if (ok && pass) {
+                ok = count_drawn(out, count) == 0;
+                list = b3d_ctx_list_end(ctx);
+                ok = ok && list && b3d_ctx_list_draw(ctx, list) > 0;
+            }
+        }
+        ok = ok && count_drawn(pixels, count) > 0 &&
+             queue_image_matches(pixels, pixels_ref, count);
+    }
+
+    /* Triangles past the arena make the whole list fail */
+    ok = ok && b3d_ctx_list_begin(ctx, arena, b3d_list_arena_size(4));
+    for (int i = 0; ok && i < 12; i++)
+        b3d_ctx_triangle(ctx, &test_cube[i], 0xFFFFFFu);
+    ok = ok && !b3d_ctx_list_end(ctx) && !b3d_ctx_list_draw(ctx, NULL);
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(depth_ref);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Test instanced lists: same image as one list draw per instance */
+TEST(api_draw_instanced)
+{
+    const int width = 64, height = 48;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t list_size = b3d_list_arena_size(12);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(list_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && arena &&
+             b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+    b3d_list_t *list = NULL;
+    b3d_camera_t cam = {0, 0, -2.5f, 0, 0, 0};
+    float inst[6][16];
+
+    /* The views of api_display_list(), then one behind the camera */
+    for (int i = 0; ok && i < 5; i++) {
+        list_test_view(ctx, i);
+        b3d_ctx_scale(ctx, 0.5f, 0.5f, 0.5f);
+        b3d_ctx_get_model_matrix(ctx, inst[i]);
+    }
+    if (ok) {
+        b3d_ctx_reset(ctx);
+        b3d_ctx_translate(ctx, 0, 0, -10.0f);
+        b3d_ctx_get_model_matrix(ctx, inst[5]);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = b3d_ctx_list_begin(ctx, arena, list_size);
+        for (int i = 0; ok && i < 12; i++)
+            b3d_ctx_triangle(ctx, &test_cube[i],
+                             0x203040u * (uint32_t) (i + 1));
+        list = b3d_ctx_list_end(ctx);
+        ok = ok && list;
+    }
+
+    if (ok) {
+        int drawn_ref = 0;
+        b3d_ctx_clear(ctx);
+        for (int i = 0; i < 6; i++) {
+            b3d_ctx_set_model_matrix(ctx, inst[i]);
+            drawn_ref += b3d_ctx_list_draw(ctx, list);
+        }
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+        memcpy(depth_ref, depth, count * sizeof(b3d_depth_t));
+
+        b3d_stats_t st;
+        b3d_ctx_clear(ctx);
+        b3d_ctx_reset(ctx);
+        ok = b3d_ctx_draw_instanced(ctx, list, &inst[0][0], 6) == drawn_ref &&
+             drawn_ref > 0 && count_drawn(pixels, count) > 0 &&
+             !memcmp(pixels, pixels_ref, count * sizeof(uint32_t)) &&
+             !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+#ifdef B3D_STATS
+        ok = ok && b3d_ctx_get_stats(ctx, &st) &&
+             st.triangles_submitted == 72 &&
+             st.triangles_frustum_culled == 12;
+#else
+        (void) st;
+#endif
+    }
+
+    /* Instances follow the current model matrix */
+    if (ok) {
+        float shift[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0.5f, 0, 0, 1};
+        b3d_ctx_clear(ctx);
+        b3d_ctx_reset(ctx);
+        b3d_ctx_rotate_y(ctx, 0.3f);
+        b3d_ctx_translate(ctx, 0.5f, 0, 0);
+        b3d_ctx_list_draw(ctx, list);
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+
+        b3d_ctx_clear(ctx);
+        b3d_ctx_reset(ctx);
+        b3d_ctx_rotate_y(ctx, 0.3f);
+        ok = b3d_ctx_draw_instanced(ctx, list, shift, 1) > 0 &&
+             !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+    }
+
+    /* Invalid calls draw nothing */
+    ok = ok && !b3d_ctx_draw_instanced(ctx, list, &inst[0][0], 0) &&
+         !b3d_ctx_draw_instanced(ctx, list, NULL, 1) &&
+         !b3d_ctx_draw_instanced(ctx, NULL, &inst[0][0], 1);
+    ok = ok && b3d_ctx_list_begin(ctx, arena, list_size) &&
+         !b3d_ctx_draw_instanced(ctx, list, &inst[0][0], 1);
+    b3d_ctx_list_end(ctx);
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(depth_ref);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Draw every drawable, visible node of @scene with a world transform built
+ * from b3d_ctx_* calls: node translation, then its parent's rotation and
+ * translation. Returns the triangles drawn.
+ */
+static int draw_scene_ref(b3d_context_t *ctx,
+                          const b3d_scene_t *scene,
+                          const float *pos,
+                          const uint32_t *idx,
+                          float root_angle,
+                          float root_x)
+{
+    int drawn = 0;
+    for (int i = 0; i < scene->count; i++) {
+        const b3d_scene_node_t *n = &scene->nodes[i];
+        if (!n->positions || b3d_scene_hidden(scene, i))
+            continue;
+        const b3d_scene_node_t *p = &scene->nodes[n->parent];
+        b3d_ctx_reset(ctx);
+        b3d_ctx_translate(ctx, n->local[12], n->local[13], n->local[14]);
+        if (n->parent > 0)
+            b3d_ctx_translate(ctx, p->local[12], p->local[13], p->local[14]);
+        b3d_ctx_rotate_y(ctx, root_angle);
+        b3d_ctx_translate(ctx, root_x, 0, 0);
+        drawn += b3d_ctx_draw_mesh(ctx, pos, 36, idx, 36, NULL);
+    }
+    b3d_ctx_reset(ctx);
+    return drawn;
+}
+
+/* Test the scene graph: culled drawing matches drawing every node */
+TEST(api_scene)
+{
+    const int width = 64, height = 48, grid = 12;
+    const size_t count = (size_t) width * (size_t) height;
+    const int max_nodes = grid * grid + 8;
+    const size_t size = b3d_scene_size(max_nodes);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(size);
+    float pos[36 * 3];
+    uint32_t idx[36];
+    b3d_scene_t scene;
+    int ok = pixels && pixels_ref && depth && ctx && arena && size > 0 &&
+             b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f) &&
+             !b3d_scene_init(&scene, arena, size - 16, max_nodes) &&
+             b3d_scene_init(&scene, arena, size, max_nodes);
+
+    for (int i = 0; i < 36; i++) {
+        pos[i * 3] = test_cube[i / 3].v[i % 3].x;
+        pos[i * 3 + 1] = test_cube[i / 3].v[i % 3].y;
+        pos[i * 3 + 2] = test_cube[i / 3].v[i % 3].z;
+        idx[i] = (uint32_t) i;
+    }
+
+    /* Root turned and shifted, a static grid of cubes under it, and a
+     * dynamic group of two cubes
+     */
+    static const float ident[16] = {1, 0, 0, 0, 0, 1, 0, 0,
+                                    0, 0, 1, 0, 0, 0, 0, 1};
+    float m[16], angle = 0.3f, shift = 1.0f;
+    int dyn = -1, hidden = -1, drawable = 0;
+    if (ok) {
+        b3d_ctx_rotate_y(ctx, angle);
+        b3d_ctx_translate(ctx, shift, 0, 0);
+        b3d_ctx_get_model_matrix(ctx, m);
+        b3d_ctx_reset(ctx);
+        ok = b3d_scene_add(&scene, -1, m, B3D_SCENE_STATIC) == 0 &&
+             b3d_scene_add(&scene, 5, NULL, 0) < 0;
+    }
+    for (int z = 0; ok && z < grid; z++) {
+        for (int x = 0; ok && x < grid; x++) {
+            float t[16];
+            memcpy(t, ident, sizeof(t));
+            t[12] = 2.0f * (float) (x - grid / 2);
+            t[14] = 2.0f * (float) z;
+            int n = b3d_scene_add(&scene, 0, t, B3D_SCENE_STATIC);
+            ok = n > 0 &&
+                 b3d_scene_set_mesh(&scene, n, pos, 36, idx, 36, NULL);
+            drawable++;
+        }
+    }
+    if (ok) {
+        memcpy(m, ident, sizeof(m));
+        m[12] = 0.5f, m[13] = 0.5f, m[14] = 1.0f;
+        dyn = b3d_scene_add(&scene, 0, m, 0);
+        m[12] = 0, m[13] = 1.5f, m[14] = 0;
+        int a = b3d_scene_add(&scene, dyn, m, B3D_SCENE_STATIC);
+        m[13] = -1.5f;
+        int b = b3d_scene_add(&scene, dyn, m, 0);
+        m[12] = 3.0f, m[13] = 0;
+        hidden = b3d_scene_add(&scene, 0, m, B3D_SCENE_HIDDEN);
+        ok = dyn > 0 && !(scene.nodes[a].flags & B3D_SCENE_STATIC) &&
+             b3d_scene_set_mesh(&scene, a, pos, 36, idx, 36, NULL) &&
+             b3d_scene_set_mesh(&scene, b, pos, 36, idx, 36, NULL) &&
+             b3d_scene_set_mesh(&scene, hidden, pos, 36, idx, 36, NULL) &&
+             !b3d_scene_set_mesh(&scene, scene.count, pos, 36, idx, 36,
+                                 NULL);
+        drawable += 2;
+        b3d_scene_build(&scene);
+    }
+
+    /* Looking along the grid, across it, away from it and down onto it */
+    const b3d_camera_t cams[] = {
+        {0, 1.0f, -4.0f, 0, 0, 0},
+        {-6.0f, 1.0f, 8.0f, 1.2f, 0, 0},
+        {0, 1.0f, -4.0f, 3.14159f, 0, 0},
+        {2.0f, 12.0f, 10.0f, 0.2f, 1.3f, 0},
+    };
+    int culled = 0, all = 0;
+    for (int c = 0; ok && c < (int) (sizeof(cams) / sizeof(cams[0])); c++) {
+        for (int pass = 0; ok && pass < 2; pass++) {
+            b3d_ctx_set_camera(ctx, &cams[c]);
+            b3d_ctx_clear(ctx);
+            int drawn_ref = draw_scene_ref(ctx, &scene, pos, idx, angle, shift);
+            memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+
+            float before[16], after[16];
+            b3d_ctx_clear(ctx);
+            b3d_ctx_translate(ctx, 0, 7.0f, 0);
+            b3d_ctx_get_model_matrix(ctx, before);
+            int drawn = b3d_ctx_scene_draw(ctx, &scene);
+            b3d_ctx_get_model_matrix(ctx, after);
+            b3d_ctx_reset(ctx);
+            ok = drawn == drawn_ref &&
+                 !memcmp(pixels, pixels_ref, count * sizeof(uint32_t)) &&
+                 !memcmp(before, after, sizeof(before)) &&
+                 scene.visible <= drawable;
+            culled += drawable - scene.visible;
+            all += drawable;
+
+            /* Move the dynamic group for the second pass */
+            float t[16];
+            memcpy(t, scene.nodes[dyn].local, sizeof(t));
+            t[12] += pass ? -4.0f : 4.0f;
+            ok = ok && b3d_scene_set_transform(&scene, dyn, t);
+            b3d_scene_update(&scene);
+        }
+    }
+    /* Most of the grid is out of view most of the time */
+    ok = ok && culled > all / 2 && culled < all;
+
+    /* A draw distance drops the far end of the grid, and nothing else */
+    if (ok) {
+        b3d_ctx_set_camera(ctx, &cams[0]);
+        b3d_ctx_clear(ctx);
+        int drawn = b3d_ctx_scene_draw(ctx, &scene), visible = scene.visible;
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+        b3d_ctx_clear(ctx);
+        scene.far = 1000.0f;
+        ok = b3d_ctx_scene_draw(ctx, &scene) == drawn &&
+             scene.visible == visible &&
+             !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+        scene.far = 10.0f;
+        ok = ok && b3d_ctx_scene_draw(ctx, &scene) > 0 &&
+             scene.visible < visible;
+        scene.far = 0.0f;
+    }
+
+    /* Nothing drawn when everything is behind the camera */
+    if (ok) {
+        b3d_ctx_set_camera(ctx, &cams[2]);
+        b3d_ctx_clear(ctx);
+        ok = b3d_ctx_scene_draw(ctx, &scene) == 0 && scene.visible == 0 &&
+             count_drawn(pixels, count) == 0;
+    }
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Feed @a @n frames of @ms each; returns the number of changes */
+static int adapt_frames(b3d_adapt_t *a,
+                        int n,
+                        float ms,
+                        const b3d_stats_t *stats)
+{
+    int changes = 0;
+    for (int i = 0; i < n; i++)
+        changes += b3d_adapt_update(a, ms, stats);
+    return changes;
+}
+
+/* Draw the test cube, turned, with the camera of the adaptive tests */
+static void render_adapt_scene(void)
+{
+    b3d_clear();
+    b3d_set_camera(&(b3d_camera_t) {0, 0, -2.0f, 0, 0, 0});
+    b3d_rotate_y(0.6f);
+    b3d_rotate_x(0.4f);
+    for (int i = 0; i < 12; i++)
+        b3d_triangle(&test_cube[i], 0x203040u * (uint32_t) (i + 1));
+    b3d_reset();
+}
+
+/* Test the frame-time controller, integer upscale and LOD simplification */
+TEST(api_adapt)
+{
+    const int width = 40, height = 30;
+    const size_t count = (size_t) width * (size_t) height;
+    uint32_t *output = malloc(count * sizeof(uint32_t));
+    uint32_t *scratch = malloc(count * sizeof(uint32_t));
+    uint32_t *ref = malloc(count * sizeof(uint32_t));
+    uint32_t *small = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    unsigned char *src = malloc(16 * 16 * 4), *dst = malloc(48 * 40 * 4);
+    b3d_adapt_t a;
+    int ok = output && scratch && ref && small && depth && src && dst;
+
+    /* Upscale against a per-pixel reference, odd sizes and padded rows */
+    for (int format = 0; ok && format <= B3D_FORMAT_RGB332; format++) {
+        size_t bpp = format == 0 ? 4 : format == 1 ? 2 : 1;
+        for (int scale = 1; ok && scale <= 3; scale++) {
+            const int w = 13, h = 8;
+            size_t ss = 16 * bpp, ds = 40 * bpp;
+            for (size_t i = 0; i < 16 * 16 * 4; i++)
+                src[i] = (unsigned char) (i * 7 + 3);
+            memset(dst, 0xa5, 48 * 40 * 4);
+            b3d_adapt_upscale(dst, ds, src, ss, format, w, h, scale);
+            for (int y = 0; ok && y < h + 1; y++) {
+                for (int x = 0; ok && x < 40; x++) {
+                    const unsigned char *d = dst + y * ds + x * bpp;
+                    const unsigned char *s =
+                        src + (y / scale) * ss + (x / scale) * bpp;
+                    bool inside = x < w && y < h;
+                    for (size_t k = 0; ok && k < bpp; k++)
+                        ok = d[k] == (inside ? s[k] : 0xa5);
+                }
+            }
+        }
+    }
+
+    /* Without statistics: resolution first, then LOD, one step per settle
+     * period, and back again once the frame time drops
+     */
+    ok = ok && !b3d_adapt_init(&a, output, 0, 0, NULL, depth, width,
+                               height, 70.0f, 10.0f, 2, 1) &&
+         !b3d_adapt_init(&a, output, 0, 0, scratch, depth, width, height,
+                         70.0f, 0.0f, 2, 1) &&
+         b3d_adapt_init(&a, output, 0, 0, scratch, depth, width, height,
+                        70.0f, 10.0f, 3, 3);
+    ok = ok && adapt_frames(&a, B3D_ADAPT_SETTLE - 1, 20.0f, NULL) == 0 &&
+         adapt_frames(&a, 1, 20.0f, NULL) == 1 && a.scale == 2 &&
+         adapt_frames(&a, B3D_ADAPT_SETTLE, 20.0f, NULL) == 1 &&
+         a.scale == 3 && a.lod == 0 &&
+         adapt_frames(&a, 2 * B3D_ADAPT_SETTLE, 20.0f, NULL) == 2 &&
+         a.lod == 2 && adapt_frames(&a, 100, 20.0f, NULL) == 0;
+    ok = ok && adapt_frames(&a, 6 * B3D_ADAPT_SETTLE, 1.0f, NULL) == 4 &&
+         a.scale == 1 && a.lod == 0;
+
+    /* Within budget but without room to grow: no swinging */
+    ok = ok && b3d_adapt_init(&a, output, 0, 0, scratch, depth, width,
+                              height, 70.0f, 10.0f, 3, 3);
+    a.scale = 2;
+    ok = ok && adapt_frames(&a, 200, 5.0f, NULL) == 0 && a.scale == 2;
+
+    /* Statistics pick the knob: geometry-bound frames lower the LOD */
+    b3d_stats_t geo = {.transform_ns = 8000000, .raster_ns = 1000000};
+    b3d_stats_t ras = {.transform_ns = 1000000, .raster_ns = 8000000};
+    ok = ok && b3d_adapt_init(&a, output, 0, 0, scratch, depth, width,
+                              height, 70.0f, 10.0f, 3, 3);
+    ok = ok && adapt_frames(&a, B3D_ADAPT_SETTLE, 20.0f, &geo) == 1 &&
+         a.lod == 1 && a.scale == 1 &&
+         adapt_frames(&a, B3D_ADAPT_SETTLE, 20.0f, &ras) == 1 &&
+         a.lod == 1 && a.scale == 2;
+    /* ... and what is raised again is predicted from the shares: at 4 ms,
+     * four times the raster work would not fit but finer geometry would
+     */
+    ok = ok && adapt_frames(&a, 4 * B3D_ADAPT_SETTLE, 4.0f, &ras) == 1 &&
+         a.lod == 0 && a.scale == 2 &&
+         adapt_frames(&a, B3D_ADAPT_SETTLE, 4.0f, &geo) == 1 &&
+         a.scale == 1;
+
+    /* Full resolution draws straight into the output; half resolution
+     * matches a half-size frame enlarged by the reference above
+     */
+    if (ok) {
+        ok = b3d_init(ref, depth, width, height, 70.0f);
+        render_adapt_scene();
+        ok = ok && b3d_adapt_init(&a, output, 0, 0, scratch, depth, width,
+                                  height, 70.0f, 10.0f, 2, 1) &&
+             b3d_adapt_begin(&a);
+        render_adapt_scene();
+        ok = ok && !b3d_adapt_end(&a, 5.0f) &&
+             !memcmp(output, ref, count * sizeof(uint32_t)) &&
+             count_drawn(output, count) > 0;
+    }
+    if (ok) {
+        ok = b3d_init(small, depth, width / 2, height / 2, 70.0f);
+        render_adapt_scene();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                ref[y * width + x] = small[(y / 2) * (width / 2) + x / 2];
+        }
+        a.scale = 2;
+        memset(output, 0, count * sizeof(uint32_t));
+        ok = ok && b3d_adapt_begin(&a) && b3d_get_width() == width / 2;
+        render_adapt_scene();
+        ok = ok && !b3d_adapt_end(&a, 5.0f) &&
+             !memcmp(output, ref, count * sizeof(uint32_t));
+    }
+
+    /* Clustering: a triangle soup cube welds into 8 corners, repeated
+     * triangles are dropped, one cell swallows it, and a finely split quad
+     * loses triangles
+     */
+    float pos[36 * 3], spos[36 * 3];
+    uint32_t sidx[72], twice[72], colors[12], scolors[12];
+    int sv = 0;
+    for (int i = 0; i < 72; i++)
+        twice[i] = (uint32_t) (i % 36);
+    for (int i = 0; i < 36; i++) {
+        pos[i * 3] = test_cube[i / 3].v[i % 3].x;
+        pos[i * 3 + 1] = test_cube[i / 3].v[i % 3].y;
+        pos[i * 3 + 2] = test_cube[i / 3].v[i % 3].z;
+    }
+    for (int i = 0; i < 12; i++)
+        colors[i] = 0x010203u * (uint32_t) i;
+    ok = ok &&
+         b3d_lod_simplify(pos, 36, NULL, 36, colors, 4, spos, &sv, sidx,
+                          scolors) == 36 &&
+         sv == 8 && !memcmp(colors, scolors, sizeof(colors)) &&
+         b3d_lod_simplify(pos, 36, twice, 72, NULL, 4, spos, &sv, sidx,
+                          NULL) == 36 &&
+         b3d_lod_simplify(pos, 36, NULL, 36, NULL, 1, spos, &sv, sidx,
+                          NULL) == 0 &&
+         sv == 1 &&
+         b3d_lod_simplify(pos, 36, NULL, 33, NULL, 4, spos, &sv, sidx,
+                         NULL) < 0;
+
+    enum { N = 17 };
+    float *grid = malloc(N * N * 3 * sizeof(float));
+    float *coarse = malloc(N * N * 3 * sizeof(float));
+    uint32_t *gidx = malloc((N - 1) * (N - 1) * 6 * sizeof(uint32_t));
+    uint32_t *cidx = malloc((N - 1) * (N - 1) * 6 * sizeof(uint32_t));
+    int gi = 0, ci = -1, cv = 0;
+    ok = ok && grid && coarse && gidx && cidx;
+    for (int y = 0; ok && y < N; y++) {
+        for (int x = 0; x < N; x++) {
+            float *p = &grid[(y * N + x) * 3];
+            p[0] = (float) x / (N - 1) - 0.5f;
+            p[1] = (float) y / (N - 1) - 0.5f;
+            p[2] = 0.1f * sinf((float) (x + y));
+            if (x + 1 < N && y + 1 < N) {
+                uint32_t v = (uint32_t) (y * N + x);
+                uint32_t q[6] = {v, v + N, v + N + 1, v, v + N + 1, v + 1};
+                memcpy(&gidx[gi], q, sizeof(q));
+                gi += 6;
+            }
+        }
+    }
+    if (ok)
+        ci = b3d_lod_simplify(grid, N * N, gidx, gi, NULL, 4, coarse, &cv,
+                              cidx, NULL);
+    /* 4 x 4 cells across the quad, one through its depth: a 3 x 3 quad */
+    ok = ok && ci == 3 * 3 * 6 && cv == 4 * 4;
+    for (int i = 0; ok && i < ci; i++)
+        ok = cidx[i] < (uint32_t) cv;
+    for (int i = 0; ok && i < cv * 3; i++)
+        ok = coarse[i] >= -0.5f && coarse[i] <= 0.5f;
+
+    /* LOD sets draw the level asked for, or their coarsest */
+    b3d_lod_t lod = {0};
+    ok = ok && b3d_init(output, depth, width, height, 70.0f) &&
+         !b3d_lod_draw(&lod, 0) &&
+         b3d_lod_add(&lod, grid, N * N, gidx, gi, NULL) &&
+         b3d_lod_add(&lod, coarse, cv, cidx, ci, NULL) &&
+         !b3d_lod_add(&lod, coarse, cv, cidx, 0, NULL) && lod.count == 2;
+    if (ok) {
+        b3d_set_camera(&(b3d_camera_t) {0, 0, -1.5f, 0, 0, 0});
+        int fine = b3d_lod_draw(&lod, 0), coarsest = b3d_lod_draw(&lod, 1);
+        ok = fine == gi / 3 && coarsest > 0 && coarsest < fine &&
+             b3d_lod_draw(&lod, 5) == coarsest;
+    }
+
+    free(grid);
+    free(coarse);
+    free(gidx);
+    free(cidx);
+    free(output);
+    free(scratch);
+    free(ref);
+    free(small);
+    free(depth);
+    free(src);
+    free(dst);
+    return ok;
+}
+
+/* Color @c in B3D_FORMAT_* @format, computed independently of the library */
+static uint32_t test_pack_color(int format, uint32_t c)
+{
+    uint32_t r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+    if (format == B3D_FORMAT_RGB565)
+        return (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+    if (format == B3D_FORMAT_RGB332)
+        return (r >> 5) << 5 | (g >> 5) << 2 | b >> 6;
+    return c;
+}
+
+/* Pixel (@x, @y) of a @format buffer at @buf with rows @stride bytes apart */
+static uint32_t test_get_pixel(const unsigned char *buf,
+                               int format,
+                               size_t stride,
+                               int x,
+                               int y)
+{
+    const unsigned char *row = buf + (size_t) y * stride;
+    if (format == B3D_FORMAT_RGB565) {
+        uint16_t v;
+        memcpy(&v, row + 2 * x, 2);
+        return v;
+    }
+    if (format == B3D_FORMAT_RGB332)
+        return row[x];
+    uint32_t v;
+    memcpy(&v, row + 4 * x, 4);
+    return v;
+}
+
+/* render_binning_scene() and a triangle with vertex colors */
+static void render_format_scene(b3d_context_t *ctx)
+{
+    const b3d_tri_t tri = {{{-1, -1, 0.1f}, {0, 1, 0.1f}, {1, -0.5f, 0.1f}}};
+    const b3d_attr_t attr = {{0xFF8000, 0x00FF80, 0x8000FF}, {{0}}};
+    render_binning_scene(ctx);
+    b3d_ctx_reset(ctx);
+    b3d_ctx_triangle_ex(ctx, &tri, &attr);
+}
+
+/* Test external pixel formats: every rasterizer path writes the encoded
+ * colors of an XRGB8888 frame into padded rows and leaves the padding alone
+ */
+TEST(api_pixel_formats)
+{
+    const int width = 150, height = 100, pad = 7;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t buf_size = (size_t) (width + pad) * 4 * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    const b3d_camera_t cam = {0.2f, 0.1f, -2.0f, 0, 0, 0};
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    unsigned char *buf = malloc(buf_size);
+    unsigned char *buf2 = malloc(buf_size);
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    int ok = pixels_ref && buf && buf2 && depth && ctx && arena;
+
+    /* Unknown formats and strides or buffers that do not fit fail */
+    ok = ok && !b3d_ctx_init_ex(ctx, buf, 3, 0, depth, width, height, 70.0f);
+    ok = ok && !b3d_ctx_init_ex(ctx, buf, B3D_FORMAT_RGB565, 2 * width - 2,
+                                depth, width, height, 70.0f);
+    ok = ok && !b3d_ctx_init_ex(ctx, buf, B3D_FORMAT_XRGB8888, 4 * width + 2,
+                                depth, width, height, 70.0f);
+    ok = ok && !b3d_ctx_init_ex(ctx, buf + 1, B3D_FORMAT_RGB565, 0, depth,
+                                width, height, 70.0f);
+    ok = ok && b3d_ctx_init_ex(ctx, buf + 1, B3D_FORMAT_RGB332, 0, depth,
+                               width, height, 70.0f);
+
+    for (int mode = B3D_RASTER_SCANLINE; ok && mode <= B3D_RASTER_EDGE;
+         mode++) {
+        ok = b3d_ctx_init(ctx, pixels_ref, depth, width, height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        ok = ok && b3d_ctx_set_rasterizer(ctx, mode);
+        render_format_scene(ctx);
+
+        for (int format = B3D_FORMAT_XRGB8888;
+             ok && format <= B3D_FORMAT_RGB332; format++) {
+            for (int binned = 0; ok && binned < 2; binned++) {
+                const size_t bpp = format == B3D_FORMAT_RGB565   ? 2
+                                   : format == B3D_FORMAT_RGB332 ? 1
+                                                                 : 4;
+                const size_t stride = (size_t) (width + pad) * bpp;
+                memset(buf, 0xAB, buf_size);
+                ok = b3d_ctx_init_ex(ctx, buf, format, stride, depth, width,
+                                     height, 70.0f);
+                b3d_ctx_set_camera(ctx, &cam);
+                ok = ok && b3d_ctx_set_rasterizer(ctx, mode);
+                if (binned)
+                    ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+                render_format_scene(ctx);
+                b3d_ctx_flush(ctx);
+                b3d_ctx_set_binning(ctx, NULL, 0, 0);
+
+                for (int y = 0; ok && y < height; y++) {
+                    const unsigned char *row = buf + (size_t) y * stride;
+                    for (int x = 0; ok && x < width; x++)
+                        ok = test_get_pixel(buf, format, stride, x, y) ==
+                             test_pack_color(format,
+                                             pixels_ref[y * width + x]);
+                    for (size_t i = width * bpp; ok && i < stride; i++)
+                        ok = row[i] == 0xAB;
+                }
+            }
+        }
+    }
+
+    /* Clears encode their color too */
+    if (ok) {
+        b3d_ctx_clear_color(ctx, 0x406080);
+        b3d_ctx_clear_rect(ctx, 10, 20, 13, 22, 0xFFFFFF);
+        ok = test_get_pixel(buf, B3D_FORMAT_RGB332, width + pad, 9, 20) ==
+                 test_pack_color(B3D_FORMAT_RGB332, 0x406080) &&
+             test_get_pixel(buf, B3D_FORMAT_RGB332, width + pad, 12, 21) ==
+                 0xFF &&
+             buf[width] == 0xAB;
+    }
+
+    /* Switching buffers keeps the state and leaves the old one alone */
+    if (ok) {
+        const size_t stride = (size_t) width * 2;
+        ok = b3d_ctx_init_ex(ctx, buf, B3D_FORMAT_RGB565, 0, depth, width,
+                             height, 70.0f);
+        b3d_ctx_set_camera(ctx, &cam);
+        memset(buf2, 0, buf_size);
+        ok = ok && !b3d_ctx_set_pixel_buffer(ctx, buf2 + 1, 0) &&
+             !b3d_ctx_set_pixel_buffer(ctx, buf2, stride - 2) &&
+             b3d_ctx_set_pixel_buffer(ctx, buf2, 0);
+        b3d_ctx_clear(ctx);
+        render_test_cube(ctx, 0.3f);
+        size_t drawn = 0;
+        for (int y = 0; ok && y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                drawn += test_get_pixel(buf2, B3D_FORMAT_RGB565, stride, x,
+                                        y) != 0;
+                ok = ok && test_get_pixel(buf, B3D_FORMAT_RGB565, stride, x,
+                                          y) == 0;
+            }
+        }
+        ok = ok && drawn > 0;
+    }
+
+    free(pixels_ref);
+    free(buf);
+    free(buf2);
+    free(depth);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Read a whole file into a heap block; NULL if missing */
+static unsigned char *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    unsigned char *data = malloc(1 << 16);
+    *size = data ? fread(data, 1, 1 << 16, file) : 0;
+    fclose(file);
+    return data;
+}
+
+/* Bitwise CRC-32 and Adler-32, as references for the PNG writer */
+static uint32_t ref_crc(const unsigned char *p, size_t n)
+{
+    uint32_t c = ~0u;
+    for (size_t i = 0; i < n * 8; i++)
+        c = (c ^ (p[i / 8] >> (i % 8))) & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    return ~c;
+}
+
+static uint32_t be32(const unsigned char *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+           (uint32_t) p[2] << 8 | p[3];
+}
+
+/* Test frame output: exact PPM/RAW bytes in every pixel format, a valid
+ * stored-deflate PNG, Y4M streams and parameter checks
+ */
+TEST(api_write_frame)
+{
+    /* 3x2 with one pixel of row padding */
+    static const uint32_t xrgb[] = {
+        0xFF0000, 0x00FF00, 0x0000FF, 0xDEAD,
+        0xFFFFFF, 0x102030, 0x000000, 0xBEEF,
+    };
+    static const unsigned char rgb[] = {
+        255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255, 16, 32, 48, 0, 0, 0,
+    };
+    static const uint16_t rgb565[] = {0xF800, 0x07E0, 0x001F, 0xFFFF};
+    static const uint8_t rgb332[] = {0xE0, 0x1C, 0x03, 0xFF};
+    const char *path = "tests/test-frame.out";
+    size_t size = 0;
+    unsigned char *data;
+    int ok = 1;
+
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_PPM, xrgb, B3D_FORMAT_XRGB8888,
+                               16, 3, 2) == 0;
+    data = read_file(path, &size);
+    ok = ok && data && size == 11 + sizeof(rgb) &&
+         !memcmp(data, "P6\n3 2\n255\n", 11) &&
+         !memcmp(data + 11, rgb, sizeof(rgb));
+    free(data);
+
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_RAW, rgb565, B3D_FORMAT_RGB565,
+                               0, 4, 1) == 0;
+    data = read_file(path, &size);
+    ok = ok && data && size == 12 && !memcmp(data, rgb, 9) &&
+         !memcmp(data + 9, rgb + 9, 3);
+    free(data);
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_RAW, rgb332, B3D_FORMAT_RGB332,
+                               0, 4, 1) == 0;
+    data = read_file(path, &size);
+    ok = ok && data && size == 12 && !memcmp(data, rgb, 12);
+    free(data);
+
+    /* PNG: checked chunk by chunk, the rows stored verbatim after a filter
+     * byte in one stored deflate block
+     */
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_PNG, xrgb, B3D_FORMAT_XRGB8888,
+                               16, 3, 2) == 0;
+    data = read_file(path, &size);
+    ok = ok && data && size == b3d_image_size(B3D_IMAGE_PNG, 3, 2) &&
+         !memcmp(data, "\x89PNG\r\n\32\n", 8);
+    size_t at = 8;
+    int chunks = 0;
+    while (ok && at + 12 <= size) {
+        uint32_t len = be32(data + at);
+        const unsigned char *type = data + at + 4;
+        ok = at + 12 + len <= size &&
+             be32(type + 4 + len) == ref_crc(type, 4 + len);
+        if (ok && !memcmp(type, "IHDR", 4))
+            ok = len == 13 && be32(type + 4) == 3 && be32(type + 8) == 2 &&
+                 type[12] == 8 && type[13] == 2;
+        if (ok && !memcmp(type, "IDAT", 4)) {
+            const unsigned char *z = type + 4;
+            unsigned char rows[2 + 2 * 9] = {0};
+            memcpy(rows + 1, rgb, 9);
+            memcpy(rows + 11, rgb + 9, 9);
+            uint32_t a = 1, b = 0;
+            for (size_t i = 0; i < sizeof(rows); i++)
+                a = (a + rows[i]) % 65521, b = (b + a) % 65521;
+            ok = len == 2 + 5 + sizeof(rows) + 4 && z[0] == 0x78 &&
+                 (z[0] << 8 | z[1]) % 31 == 0 && z[2] == 1 && z[3] == 20 &&
+                 z[4] == 0 && z[5] == 0xEB && z[6] == 0xFF &&
+                 !memcmp(z + 7, rows, sizeof(rows)) &&
+                 be32(z + 7 + sizeof(rows)) == (b << 16 | a);
+        }
+        at += 12 + len;
+        chunks++;
+    }
+    ok = ok && chunks == 3 && at == size &&
+         !memcmp(data + size - 8, "IEND", 4);
+    free(data);
+
+    /* Y4M stream with an odd width: red, then white. Chroma is sampled
+     * from 2x2 blocks with the last column repeated.
+     */
+    static const uint32_t red[] = {0xFF0000, 0xFF0000, 0xFF0000,
+                                   0xFF0000, 0xFF0000, 0xFF0000};
+    static const uint32_t white[] = {0xFFFFFF, 0xFFFFFF, 0xFFFFFF,
+                                     0xFFFFFF, 0xFFFFFF, 0xFFFFFF};
+    static const char y4m[] = "YUV4MPEG2 W3 H2 F30:1 Ip A1:1 C420jpeg\n";
+    const size_t frame = 6 + 6 + 2 + 2, head = sizeof(y4m) - 1;
+    b3d_stream_t s;
+    ok = ok && b3d_stream_open(&s, path, B3D_IMAGE_Y4M, 3, 2, 30, 4) == 0;
+    ok = ok && b3d_stream_write(&s, red, B3D_FORMAT_XRGB8888, 0) == 0;
+    ok = ok && b3d_stream_write(&s, white, B3D_FORMAT_XRGB8888, 0) == 0;
+    ok = ok && s.frames == 2 && b3d_stream_close(&s) == 0;
+    data = read_file(path, &size);
+    ok = ok && data && size == head + 2 * frame && !memcmp(data, y4m, head);
+    if (ok) {
+        const unsigned char *f0 = data + head, *f1 = f0 + frame;
+        static const unsigned char yuv_red[] = {82, 82, 82, 82, 82, 82,
+                                                90, 90, 240, 240};
+        static const unsigned char yuv_white[] = {235, 235, 235, 235, 235,
+                                                  235, 128, 128, 128, 128};
+        ok = !memcmp(f0, "FRAME\n", 6) && !memcmp(f0 + 6, yuv_red, 10) &&
+             !memcmp(f1, "FRAME\n", 6) && !memcmp(f1 + 6, yuv_white, 10);
+    }
+    free(data);
+
+    /* RAW stream stops at max_frames; frames may come in any format */
+    ok = ok && b3d_stream_open(&s, path, B3D_IMAGE_RAW, 4, 1, 30, 2) == 0;
+    ok = ok && b3d_stream_write(&s, rgb565, B3D_FORMAT_RGB565, 0) == 0;
+    ok = ok && b3d_stream_write(&s, rgb332, B3D_FORMAT_RGB332, 0) == 0;
+    ok = ok && b3d_stream_write(&s, rgb332, B3D_FORMAT_RGB332, 0) == 3;
+    ok = ok && b3d_stream_close(&s) == 0;
+    data = read_file(path, &size);
+    ok = ok && data && size == 24 && !memcmp(data, rgb, 12) &&
+         !memcmp(data + 12, rgb, 12);
+    free(data);
+
+    /* Invalid parameters and unwritable paths */
+    ok = ok && b3d_write_frame(path, 9, xrgb, 0, 0, 3, 2) == 3;
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_PNG, xrgb, 7, 0, 3, 2) == 3;
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_PNG, xrgb, 0, 0, 0, 2) == 3;
+    ok = ok && b3d_write_frame(path, B3D_IMAGE_PPM, xrgb, 0, 8, 3, 2) == 3;
+    ok = ok && b3d_write_frame("tests/missing/x.ppm", B3D_IMAGE_PPM, xrgb, 0,
+                               0, 3, 2) == 1;
+    ok = ok && b3d_stream_open(&s, path, B3D_IMAGE_PNG, 3, 2, 30, 4) == 3;
+    ok = ok && b3d_stream_open(&s, "tests/missing/x.y4m", B3D_IMAGE_Y4M, 3, 2,
+                               30, 4) == 1;
+    remove(path);
+    return ok;
+}
+
+/* Test pipeline statistics: stage counters, frame reset, binned totals */
+TEST(api_stats)
+{
+    const int width = 150, height = 100;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    int ok = pixels && depth && ctx && arena &&
+             b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f);
+    b3d_stats_t st;
+
+#ifndef B3D_STATS
+    memset(&st, 0xFF, sizeof(st));
+    ok = ok && !b3d_ctx_get_stats(ctx, &st) && st.triangles_submitted == 0 &&
+         st.pixels_written == 0 && st.raster_ns == 0;
+#else
+    const b3d_tri_t front = {
+        {{-0.5f, -0.5f, -1}, {0, 0.5f, -1}, {0.5f, -0.5f, -1}}};
+    b3d_camera_t cam = {0, 0, -3.0f, 0, 0, 0};
+    if (ok)
+        b3d_ctx_set_camera(ctx, &cam);
+
+    for (int mode = B3D_RASTER_SCANLINE; ok && mode <= B3D_RASTER_EDGE;
+         mode++) {
+        ok = b3d_ctx_set_rasterizer(ctx, mode);
+        b3d_ctx_clear(ctx);
+        ok = ok && b3d_ctx_get_stats(ctx, &st) &&
+             st.triangles_submitted == 0 && st.transform_ns == 0;
+
+        /* Every write of a lone triangle lands on a distinct pixel */
+        ok = ok && b3d_ctx_triangle(ctx, &front, 0xFF0000);
+        ok = ok && b3d_ctx_get_stats(ctx, &st);
+        ok = ok && st.triangles_submitted == 1 && st.triangles_culled == 0 &&
+             st.triangles_near_clipped == 0 &&
+             st.triangles_screen_clipped == 0 &&
+             st.triangles_rasterized == 1 && st.spans > 0;
+        ok = ok && st.pixels_written > 0 &&
+             st.pixels_written == count_drawn(pixels, count) &&
+             st.pixels_tested == st.pixels_written;
+
+        /* Drawn again at the same depth it fails every test */
+        uint64_t tested = st.pixels_tested, written = st.pixels_written;
+        b3d_ctx_triangle(ctx, &front, 0x00FF00);
+        ok = ok && b3d_ctx_get_stats(ctx, &st);
+        ok = ok && st.pixels_tested == 2 * tested &&
+             st.pixels_written == written;
+        b3d_ctx_reset_stats(ctx);
+        ok = ok && b3d_ctx_get_stats(ctx, &st) &&
+             st.triangles_submitted == 0 && st.pixels_tested == 0;
+    }
+
+    if (ok) {
+        /* Back face, a triangle through the near plane, one past the edges */
+        const b3d_tri_t back = {
+            {{-0.5f, -0.5f, -1}, {0.5f, -0.5f, -1}, {0, 0.5f, -1}}};
+        const b3d_tri_t near = {{{-1, -1, -3.5f}, {0, 1, 0}, {1, -1, 0}}};
+        const b3d_tri_t wide = {{{-9, -9, 0}, {0, 9, 0}, {9, -9, 0}}};
+        b3d_ctx_clear(ctx);
+        b3d_ctx_triangle(ctx, &back, 0xFF0000);
+        b3d_ctx_triangle(ctx, &near, 0xFF0000);
+        b3d_ctx_triangle(ctx, &wide, 0xFF0000);
+        ok = b3d_ctx_get_stats(ctx, &st) && st.triangles_submitted == 3;
+        uint64_t unclipped = 0;
+#ifndef B3D_NO_CULLING
+        ok = ok && st.triangles_culled == 1;
+#else
+        unclipped = 1; /* the back face is drawn */
+#endif
+        ok = ok && st.triangles_near_clipped == 1 &&
+             st.triangles_screen_clipped >= 2 &&
+             st.screen_clip_outputs >= st.triangles_screen_clipped &&
+             st.triangles_rasterized == st.screen_clip_outputs + unclipped;
+        ok = ok && st.transform_ns + st.clip_ns + st.raster_ns > 0;
+    }
+
+    /* Binned tiles add up to the same per-pixel work as immediate mode */
+    for (int mode = B3D_RASTER_SCANLINE; ok && mode <= B3D_RASTER_EDGE;
+         mode++) {
+        b3d_stats_t ref;
+        ok = b3d_ctx_set_rasterizer(ctx, mode);
+        b3d_ctx_clear(ctx);
+        render_binning_scene(ctx);
+        ok = ok && b3d_ctx_get_stats(ctx, &ref);
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 3);
+        b3d_ctx_clear(ctx);
+        render_binning_scene(ctx);
+        ok = ok && b3d_ctx_get_stats(ctx, &st) && st.pixels_tested == 0;
+        b3d_ctx_flush(ctx);
+        ok = ok && b3d_ctx_get_stats(ctx, &st);
+        ok = ok && st.triangles_submitted == ref.triangles_submitted &&
+             st.triangles_rasterized >= ref.triangles_rasterized &&
+             st.pixels_tested == ref.pixels_tested &&
+             st.pixels_written == ref.pixels_written;
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+    }
+#endif
+
+    free(pixels);
+    free(depth);
+    free(ctx);
+    free(arena);
+    return ok;
+}
+
+/* Large floor and wall: heavy screen clipping without a guard band */
+static void render_guard_band_scene(b3d_context_t *ctx)
+{
+    const float s = 200.0f;
+    b3d_ctx_reset(ctx);
+    b3d_ctx_triangle(ctx, &(b3d_tri_t) {{{-s, -2, -s}, {-s, -2, s}, {s, -2, s}}},
+                     0x406080);
+    b3d_ctx_triangle(ctx, &(b3d_tri_t) {{{-s, -2, -s}, {s, -2, s}, {s, -2, -s}}},
+                     0x608040);
+    b3d_ctx_triangle(ctx, &(b3d_tri_t) {{{-30, -2, 5}, {0, 30, 5}, {30, -2, 5}}},
+                     0x804020);
+    b3d_ctx_triangle(ctx, &(b3d_tri_t) {{{-3, -1, 0}, {0, 3, 0}, {3, -1, 0}}},
+                     0x2040F0);
+}
+
+/* Test guard-band clipping against screen clipping and binning */
+TEST(api_guard_band)
+{
+    const int width = 160, height = 120;
+    const size_t count = (size_t) width * (size_t) height;
+    const size_t arena_size = b3d_bin_arena_size(width, height, 256);
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    uint32_t *pixels_ref = malloc(count * sizeof(uint32_t));
+    b3d_depth_t *depth = malloc(count * sizeof(b3d_depth_t));
+    b3d_depth_t *depth_ref = malloc(count * sizeof(b3d_depth_t));
+    b3d_context_t *ctx = malloc(sizeof(b3d_context_t));
+    b3d_context_t *ref = malloc(sizeof(b3d_context_t));
+    void *arena = malloc(arena_size);
+    int ok = pixels && pixels_ref && depth && depth_ref && ctx && ref &&
+             arena && b3d_ctx_init(ctx, pixels, depth, width, height, 70.0f) &&
+             b3d_ctx_init(ref, pixels_ref, depth_ref, width, height, 70.0f);
+
+    for (int mode = B3D_RASTER_SCANLINE; ok && mode <= B3D_RASTER_EDGE;
+         mode++) {
+        b3d_camera_t cam = {-1.5f, 1, -6, 0.25f, 0.3f, 0};
+        ok = b3d_ctx_set_rasterizer(ctx, mode) &&
+             b3d_ctx_set_rasterizer(ref, mode) &&
+             !b3d_ctx_get_guard_band(ctx);
+        b3d_ctx_set_guard_band(ctx, true);
+        ok = ok && b3d_ctx_get_guard_band(ctx);
+
+        /* Triangles wholly on screen are not affected */
+        b3d_camera_t far = {0, 0, -8, 0, 0, 0};
+        b3d_ctx_set_camera(ctx, &far);
+        b3d_ctx_set_camera(ref, &far);
+        b3d_ctx_clear(ctx);
+        b3d_ctx_clear(ref);
+        render_binning_scene(ctx);
+        render_binning_scene(ref);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t));
+        b3d_ctx_set_camera(ctx, &cam);
+        b3d_ctx_set_camera(ref, &cam);
+
+        /* Unsplit triangles only differ along their edges */
+        b3d_ctx_clear(ctx);
+        b3d_ctx_clear(ref);
+        render_guard_band_scene(ctx);
+        render_guard_band_scene(ref);
+        size_t diff = 0;
+        for (size_t i = 0; i < count; i++)
+            diff += pixels[i] != pixels_ref[i];
+        ok = ok && diff < count / 50 && b3d_ctx_get_clip_drop_count(ctx) == 0;
+        ok = ok && pixels[(height / 2) * width + width / 2] ==
+                       pixels_ref[(height / 2) * width + width / 2];
+#ifdef B3D_STATS
+        b3d_stats_t st, st_ref;
+        ok = ok && b3d_ctx_get_stats(ctx, &st) &&
+             b3d_ctx_get_stats(ref, &st_ref) &&
+             st.screen_clip_outputs < st_ref.screen_clip_outputs;
+#endif
+
+        /* Binning scissors each tile the same way */
+        memcpy(pixels_ref, pixels, count * sizeof(uint32_t));
+        memcpy(depth_ref, depth, count * sizeof(b3d_depth_t));
+        ok = ok && b3d_ctx_set_binning(ctx, arena, arena_size, 2);
+        b3d_ctx_clear(ctx);
+        render_guard_band_scene(ctx);
+        b3d_ctx_flush(ctx);
+        ok = ok && !memcmp(pixels, pixels_ref, count * sizeof(uint32_t)) &&
+             !memcmp(depth, depth_ref, count * sizeof(b3d_depth_t));
+        ok = ok && b3d_ctx_set_binning(ctx, NULL, 0, 0);
+        b3d_ctx_set_guard_band(ctx, false);
+    }
+
+    /* The global setting survives b3d_init() */
+    b3d_set_guard_band(true);
+    ok = ok && b3d_init(pixels, depth, width, height, 70.0f) &&
+         b3d_get_guard_band();
+    b3d_set_guard_band(false);
+    ok = ok && !b3d_get_guard_band();
+
+    free(pixels);
+    free(pixels_ref);
+    free(depth);
+    free(depth_ref);
+    free(ctx);
+    free(ref);
+    free(arena);
+    return ok;
+}
+
 int main(void)
 {
     printf(ANSI_BOLD "B3D API Validation Tests\n" ANSI_RESET);
@@ -1131,6 +4390,7 @@ int main(void)
     SECTION_BEGIN("API Transformations");
     RUN_TEST(api_transform);
     RUN_TEST(api_set_model_matrix);
+    RUN_TEST(api_transform_points);
     SECTION_END();
 
     SECTION_BEGIN("API Camera");
@@ -1149,18 +4409,31 @@ int main(void)
     RUN_TEST(api_render_ascii);
     RUN_TEST(api_triangle_return);
     RUN_TEST(api_degenerate_triangles);
+    RUN_TEST(api_backface_cull);
     RUN_TEST(api_depth_buffer);
+    RUN_TEST(api_draw_mesh);
     SECTION_END();
 
     SECTION_BEGIN("API Lighting");
     RUN_TEST(api_lighting_direction);
     RUN_TEST(api_lighting_ambient);
     RUN_TEST(api_triangle_lit);
+    RUN_TEST(api_lights);
+    SECTION_END();
+
+    SECTION_BEGIN("API Vertex Attributes");
+    RUN_TEST(api_triangle_ex);
+    RUN_TEST(api_texture_mips);
     SECTION_END();
 
     SECTION_BEGIN("API Clipping");
     RUN_TEST(api_near_plane_clip);
     RUN_TEST(api_clip_drop_count);
+    RUN_TEST(api_guard_band);
+    SECTION_END();
+
+    SECTION_BEGIN("API Statistics");
+    RUN_TEST(api_stats);
     SECTION_END();
 
     SECTION_BEGIN("API Screen Projection");
@@ -1172,6 +4445,75 @@ int main(void)
     RUN_TEST(api_buffer_size);
     SECTION_END();
 
+    SECTION_BEGIN("API Contexts");
+    RUN_TEST(api_context_isolation);
+#ifdef B3D_THREADS
+    RUN_TEST(api_context_threads);
+#endif
+    SECTION_END();
+
+    SECTION_BEGIN("API Tile Binning");
+    RUN_TEST(api_binning);
+    RUN_TEST(api_tile_diff);
+    SECTION_END();
+
+    SECTION_BEGIN("API Frames");
+    RUN_TEST(api_frames);
+    RUN_TEST(api_frames_arena);
+    SECTION_END();
+
+    SECTION_BEGIN("API Rasterizers");
+    RUN_TEST(api_edge_rasterizer);
+    SECTION_END();
+
+    SECTION_BEGIN("API Backends");
+    RUN_TEST(api_backend);
+    SECTION_END();
+
+    SECTION_BEGIN("API Depth");
+    RUN_TEST(api_hiz);
+    RUN_TEST(api_occlusion_query);
+    RUN_TEST(api_depth_state);
+    RUN_TEST(api_depth_prepass);
+    SECTION_END();
+
+    SECTION_BEGIN("API Clears");
+    RUN_TEST(api_clear);
+    SECTION_END();
+
+    SECTION_BEGIN("API Render Queue");
+    RUN_TEST(api_render_queue);
+    SECTION_END();
+
+    SECTION_BEGIN("API OBJ Loader");
+    RUN_TEST(api_obj_loader);
+    SECTION_END();
+
+    SECTION_BEGIN("API Mesh Cache");
+    RUN_TEST(api_mesh_cache);
+    SECTION_END();
+
+    SECTION_BEGIN("API Display Lists");
+    RUN_TEST(api_display_list);
+    RUN_TEST(api_draw_instanced);
+    SECTION_END();
+
+    SECTION_BEGIN("API Scene Graph");
+    RUN_TEST(api_scene);
+    SECTION_END();
+
+    SECTION_BEGIN("API Frame Budget");
+    RUN_TEST(api_adapt);
+    SECTION_END();
+
+    SECTION_BEGIN("API Pixel Formats");
+    RUN_TEST(api_pixel_formats);
+    SECTION_END();
+
+    SECTION_BEGIN("API Frame Output");
+    RUN_TEST(api_write_frame);
+    SECTION_END();
+
     printf("======================\n");
     if (tests_passed == tests_run)
         printf(ANSI_GREEN "All %d tests passed" ANSI_RESET "\n", tests_run);
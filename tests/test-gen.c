@@ -174,6 +174,28 @@ TEST(gen_vec_norm_zero)
     return 1;
 }
 
+/* Test SoA batch transform matches one point at a time, tail included */
+TEST(gen_mat_mul_vec_soa)
+{
+    b3d_mat_t m = b3d_mat_mul(b3d_mat_rot_y(0.7f), b3d_mat_trans(1, -2, 5));
+    float xs[11], ys[11], zs[11];
+    b3d_vec_t out[11];
+
+    for (int i = 0; i < 11; i++) {
+        xs[i] = 0.3f * i - 1.0f;
+        ys[i] = 2.0f - 0.7f * i;
+        zs[i] = 0.1f * i * i;
+    }
+    b3d_mat_mul_vec_soa_gen(&m, xs, ys, zs, 11, out);
+
+    for (int i = 0; i < 11; i++) {
+        b3d_vec_t p = b3d_mat_mul_vec(m, (b3d_vec_t) {xs[i], ys[i], zs[i], 1});
+        ASSERT(out[i].x == p.x && out[i].y == p.y);
+        ASSERT(out[i].z == p.z && out[i].w == p.w);
+    }
+    return 1;
+}
+
 int main(void)
 {
     printf(ANSI_BOLD "B3D Generated Code Tests (math_gen.h)\n" ANSI_RESET);
@@ -188,6 +210,7 @@ int main(void)
     RUN_TEST(gen_vec_mul);
     RUN_TEST(gen_vec_neg);
     RUN_TEST(gen_vec_norm_zero);
+    RUN_TEST(gen_mat_mul_vec_soa);
 
     printf("======================================\n");
     if (tests_passed == tests_run) {
@@ -11,6 +11,10 @@
 #include <time.h>
 
 #include "../include/b3d.h"
+#include "../include/b3d_adapt.h"
+#include "../include/b3d_image.h"
+#include "../include/b3d_obj.h"
+#include "../include/b3d_scene.h"
 
 /* ANSI color codes for terminal output */
 #define ANSI_GREEN "\033[32m"
@@ -98,12 +102,13 @@ static bool setup_benchmark(int width,
         px, py, pz, yaw, pitch, roll      \
     }
 
-/* Cube vertices for benchmarking */
-static void render_cube(float angle)
+/* Cube vertices for benchmarking, spun by @angle and moved to (x, y, z) */
+static void render_cube_at(float angle, float x, float y, float z)
 {
     b3d_reset();
     b3d_rotate_y(angle);
     b3d_rotate_x(angle * 0.7f);
+    b3d_translate(x, y, z);
 
     /* Front face */
     b3d_triangle(
@@ -142,6 +147,11 @@ static void render_cube(float angle)
         0x788bff);
 }
 
+static void render_cube(float angle)
+{
+    render_cube_at(angle, 0.0f, 0.0f, 0.0f);
+}
+
 /*
  * Benchmark: Triangle rendering throughput
  */
@@ -197,6 +207,58 @@ static bench_result_t bench_triangles(int width, int height)
     return result;
 }
 
+/*
+ * Benchmark: Tiny triangle throughput, where triangle setup dominates
+ * (a 40x30 grid of triangles about 3 pixels on a side)
+ */
+static bench_result_t bench_tiny_triangles(int width, int height)
+{
+    bench_result_t result = {
+        .name = strdup("Tiny triangles (1200 tris)"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    /* Count triangles, checking the time after each grid */
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_clear();
+        for (int j = 0; j < 30; j++) {
+            for (int i = 0; i < 40; i++) {
+                float x = -1.6f + (float) i * 0.08f;
+                float y = -1.2f + (float) j * 0.08f;
+                float z = 0.5f + (float) ((i + j) & 3) * 0.01f;
+                b3d_triangle(TRI(x, y, z, x + 0.03f, y + 0.06f, z + 0.01f,
+                                 x + 0.06f, y, z + 0.02f),
+                             0xffffff);
+            }
+        }
+        iterations += 1200;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
 /*
  * Benchmark: Cube rendering (12 triangles per frame)
  */
@@ -246,12 +308,12 @@ static bench_result_t bench_cubes(int width, int height)
 }
 
 /*
- * Benchmark: b3d_clear() performance
+ * Benchmark: b3d_clear() performance, optionally with depth epochs
  */
-static bench_result_t bench_clear(int width, int height)
+static bench_result_t bench_clear(int width, int height, bool epochs)
 {
     bench_result_t result = {
-        .name = strdup("Buffer clear"),
+        .name = strdup(epochs ? "Buffer clear, depth epochs" : "Buffer clear"),
         .ops_per_sec = 0.0,
         .avg_time_us = 0.0,
         .iterations = 0,
@@ -261,6 +323,11 @@ static bench_result_t bench_clear(int width, int height)
     b3d_depth_t *depth = NULL;
     if (!setup_benchmark(width, height, &pixels, &depth))
         return result;
+    if (epochs && !b3d_set_depth_epochs(true)) {
+        free(pixels);
+        free(depth);
+        return result;
+    }
 
     /* Warmup */
     for (int i = 0; i < WARMUP_ITERATIONS; i++)
@@ -276,6 +343,7 @@ static bench_result_t bench_clear(int width, int height)
     }
 
     double elapsed = get_time_ms() - start;
+    b3d_set_depth_epochs(false);
     free(pixels);
     free(depth);
 
@@ -288,6 +356,70 @@ static bench_result_t bench_clear(int width, int height)
     return result;
 }
 
+/*
+ * Benchmark: OBJ parsing of a 128x128 vertex grid into a reused arena
+ */
+static bench_result_t bench_obj_parse(void)
+{
+    enum { N = 128 };
+    bench_result_t result = {
+        .name = strdup("OBJ parse (32k tris)"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    size_t cap = (size_t) N * N * 96, len = 0;
+    size_t arena_size = (size_t) N * N * 3 * sizeof(float) +
+                        (size_t) (N - 1) * (N - 1) * 6 * sizeof(uint32_t);
+    char *text = malloc(cap);
+    void *arena = malloc(arena_size);
+    if (!text || !arena) {
+        free(text);
+        free(arena);
+        return result;
+    }
+    for (int z = 0; z < N; z++)
+        for (int x = 0; x < N; x++)
+            len += (size_t) snprintf(text + len, cap - len,
+                                     "v %.6f %.6f %.6f\n", x * 0.1f,
+                                     sinf(x * 0.2f) * cosf(z * 0.3f),
+                                     z * -0.1f);
+    for (int z = 0; z < N - 1; z++)
+        for (int x = 0; x < N - 1; x++) {
+            int i = z * N + x + 1;
+            len += (size_t) snprintf(text + len, cap - len,
+                                     "f %d/%d %d/%d %d/%d %d/%d\n", i, i,
+                                     i + 1, i + 1, i + N + 1, i + N + 1,
+                                     i + N, i + N);
+        }
+
+    b3d_indexed_mesh_t mesh;
+    for (int i = 0; i < 3; i++)
+        b3d_parse_obj(text, len, &mesh, arena, arena_size);
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        if (b3d_parse_obj(text, len, &mesh, arena, arena_size) != 0)
+            break;
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(text);
+    free(arena);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
 /*
  * Benchmark: Matrix operations
  */
@@ -439,8 +571,10 @@ static bench_result_t bench_to_screen(void)
 
 /*
  * Benchmark: Full frame (clear + render cube)
+ * @threads: 0 for immediate mode, otherwise tile binning with that many
+ *           rasterizer threads
  */
-static bench_result_t bench_full_frame(int width, int height)
+static bench_result_t bench_full_frame(int width, int height, int threads)
 {
     bench_result_t result = {
         .name = NULL,
@@ -456,12 +590,26 @@ static bench_result_t bench_full_frame(int width, int height)
         return result;
     }
 
+    void *arena = NULL;
+    if (threads > 0) {
+        size_t arena_size = b3d_bin_arena_size(width, height, 64);
+        arena = malloc(arena_size);
+        if (!arena || !b3d_set_binning(arena, arena_size, threads)) {
+            free(arena);
+            free(pixels);
+            free(depth);
+            result.name = strdup("Full frame (binning setup failed)");
+            return result;
+        }
+    }
+
     b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
 
     /* Warmup */
     for (int i = 0; i < WARMUP_ITERATIONS; i++) {
         b3d_clear();
         render_cube((float) i * 0.1f);
+        b3d_flush();
     }
 
     /* Benchmark - check time before each iteration for precision */
@@ -471,10 +619,13 @@ static bench_result_t bench_full_frame(int width, int height)
     while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
         b3d_clear();
         render_cube((float) iterations * 0.1f);
+        b3d_flush();
         iterations++;
     }
 
     double elapsed = get_time_ms() - start;
+    b3d_set_binning(NULL, 0, 0);
+    free(arena);
     free(pixels);
     free(depth);
 
@@ -487,8 +638,12 @@ static bench_result_t bench_full_frame(int width, int height)
 
     /* Dynamically allocate the name with resolution and FPS info */
     char name_buf[64];
-    snprintf(name_buf, sizeof(name_buf), "Full frame %dx%d (%.0f FPS)", width,
-             height, fps);
+    if (threads > 0)
+        snprintf(name_buf, sizeof(name_buf), "Binned %dT %dx%d (%.0f FPS)",
+                 threads, width, height, fps);
+    else
+        snprintf(name_buf, sizeof(name_buf), "Full frame %dx%d (%.0f FPS)",
+                 width, height, fps);
     result.name = strdup(name_buf);
 
     result.ops_per_sec = fps;
@@ -497,47 +652,1079 @@ static bench_result_t bench_full_frame(int width, int height)
     return result;
 }
 
-int main(void)
+/*
+ * Benchmark: Occluded scene (a wall in front of 100 cubes)
+ * @hiz: reject hidden triangles with hierarchical Z
+ */
+static bench_result_t bench_occluded(int width, int height, bool hiz)
 {
-    printf(ANSI_BOLD "B3D Performance Benchmarks\n" ANSI_RESET);
-    printf("===========================\n");
-    printf("Each benchmark runs for ~1 second\n\n");
+    bench_result_t result = {
+        .name = strdup(hiz ? "Occluded cubes, HiZ" : "Occluded cubes"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
 
-    bench_result_t results[16];
-    int num_results = 0;
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
 
-    printf(ANSI_BOLD "Primitive Operations:\n" ANSI_RESET);
-    results[num_results++] = bench_matrix_ops();
-    print_result(&results[num_results - 1]);
+    void *hiz_buf = NULL;
+    if (hiz) {
+        size_t size = b3d_hiz_size(width, height);
+        hiz_buf = malloc(size);
+        if (!hiz_buf || !b3d_set_hiz(hiz_buf, size)) {
+            free(hiz_buf);
+            free(pixels);
+            free(depth);
+            return result;
+        }
+    }
 
-    results[num_results++] = bench_matrix_stack();
-    print_result(&results[num_results - 1]);
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
 
-    results[num_results++] = bench_to_screen();
-    print_result(&results[num_results - 1]);
+    size_t iterations = 0;
+    double start = get_time_ms();
 
-    printf("\n" ANSI_BOLD "Buffer Operations:\n" ANSI_RESET);
-    results[num_results++] = bench_clear(320, 240);
-    print_result(&results[num_results - 1]);
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_clear();
+        b3d_reset();
+        b3d_triangle(TRI(-4.0f, -4.0f, 0.0f, -4.0f, 4.0f, 0.0f, 4.0f, 4.0f,
+                         0.0f),
+                     0x808080);
+        b3d_triangle(TRI(-4.0f, -4.0f, 0.0f, 4.0f, 4.0f, 0.0f, 4.0f, -4.0f,
+                         0.0f),
+                     0x808080);
+        for (int i = 0; i < 100; i++) {
+            render_cube_at((float) (iterations + i) * 0.1f,
+                           (float) (i % 10) * 0.6f - 2.7f,
+                           (float) (i / 10) * 0.6f - 2.7f, 3.0f);
+        }
+        iterations++;
+    }
 
-    results[num_results++] = bench_clear(640, 480);
-    print_result(&results[num_results - 1]);
+    double elapsed = get_time_ms() - start;
+    b3d_set_hiz(NULL, 0);
+    free(hiz_buf);
+    free(pixels);
+    free(depth);
 
-    printf("\n" ANSI_BOLD "Rendering Throughput:\n" ANSI_RESET);
-    results[num_results++] = bench_triangles(320, 240);
-    print_result(&results[num_results - 1]);
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
 
-    results[num_results++] = bench_cubes(320, 240);
-    print_result(&results[num_results - 1]);
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
 
-    printf("\n" ANSI_BOLD "Frame Rate (clear + render):\n" ANSI_RESET);
-    results[num_results++] = bench_full_frame(320, 240);
+/*
+ * Benchmark: 32 full-screen layers submitted back to front
+ * @queue: sort them front to back through the render queue first
+ */
+static bench_result_t bench_overdraw(int width, int height, bool queue)
+{
+    bench_result_t result = {
+        .name = strdup(queue ? "Overdraw, render queue" : "Overdraw"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    void *queue_buf = NULL;
+    if (queue) {
+        size_t size = b3d_queue_arena_size(64);
+        queue_buf = malloc(size);
+        if (!queue_buf ||
+            !b3d_set_queue(queue_buf, size, B3D_QUEUE_FRONT_TO_BACK)) {
+            free(queue_buf);
+            free(pixels);
+            free(depth);
+            return result;
+        }
+    }
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_clear();
+        b3d_reset();
+        for (int i = 31; i >= 0; i--) {
+            float z = (float) i * 0.1f;
+            uint32_t c = 0x040404u * (uint32_t) (i + 8);
+            b3d_triangle(TRI(-4.0f, -4.0f, z, -4.0f, 4.0f, z, 4.0f, 4.0f, z),
+                         c);
+            b3d_triangle(TRI(-4.0f, -4.0f, z, 4.0f, 4.0f, z, 4.0f, -4.0f, z),
+                         c);
+        }
+        b3d_flush();
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    b3d_set_queue(NULL, 0, 0);
+    free(queue_buf);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/* Draw 32 Gouraud-shaded screen-filling layers, farthest first */
+static void draw_shaded_layers(void)
+{
+    for (int i = 31; i >= 0; i--) {
+        float z = (float) i * 0.1f;
+        uint32_t c = 0x040404u * (uint32_t) (i + 8);
+        b3d_attr_t a = {.color = {c, 0xff4040, 0x40ff40}};
+        b3d_triangle_ex(TRI(-4.0f, -4.0f, z, -4.0f, 4.0f, z, 4.0f, 4.0f, z),
+                        &a);
+        b3d_triangle_ex(TRI(-4.0f, -4.0f, z, 4.0f, 4.0f, z, 4.0f, -4.0f, z),
+                        &a);
+    }
+}
+
+/*
+ * Benchmark: Shaded overdraw, submitted back to front
+ * @prepass: depth-only pass first, then shade with B3D_DEPTH_EQUAL
+ */
+static bench_result_t bench_prepass(int width, int height, bool prepass)
+{
+    bench_result_t result = {
+        .name = strdup(prepass ? "Shaded overdraw, depth prepass"
+                               : "Shaded overdraw"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_clear();
+        b3d_reset();
+        if (prepass) {
+            b3d_set_color_write(false);
+            draw_shaded_layers();
+            b3d_set_color_write(true);
+            b3d_set_depth_func(B3D_DEPTH_EQUAL);
+            b3d_set_depth_write(false);
+        }
+        draw_shaded_layers();
+        b3d_set_depth_func(B3D_DEPTH_LESS);
+        b3d_set_depth_write(true);
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: shaded overdraw through the frame-time controller, pinned to
+ * @scale: drawn at 1/@scale of the output size, then upscaled into it
+ */
+static bench_result_t bench_adapt(int width, int height, int scale)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "Shaded overdraw, 1/%d resolution", scale);
+    bench_result_t result = {
+        .name = strdup(name),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    /* An unreachable target keeps the controller at its largest scale */
+    b3d_adapt_t adapt;
+    uint32_t *scratch = malloc((size_t) width * height * sizeof(uint32_t));
+    if (!scratch ||
+        !b3d_adapt_init(&adapt, pixels, B3D_FORMAT_XRGB8888, 0, scratch,
+                        depth, width, height, 60.0f, 1e-6f, scale, 1)) {
+        free(scratch);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+    adapt.scale = scale;
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_adapt_begin(&adapt);
+        b3d_clear();
+        b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+        draw_shaded_layers();
+        b3d_adapt_end(&adapt, 0.0f);
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(scratch);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: 100 still cubes and a spinning one, binned
+ * @diff: only redraw the tiles that changed since the last frame
+ */
+static bench_result_t bench_static(int width, int height, bool diff)
+{
+    bench_result_t result = {
+        .name = strdup(diff ? "Mostly static, tile diff" : "Mostly static"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    size_t arena_size = b3d_bin_arena_size(width, height, 2048);
+    size_t diff_size = b3d_tile_diff_size(width, height);
+    void *arena = malloc(arena_size);
+    void *diff_buf = malloc(diff_size);
+    if (!arena || !diff_buf || !b3d_set_binning(arena, arena_size, 1) ||
+        (diff && !b3d_set_tile_diff(diff_buf, diff_size))) {
+        b3d_set_binning(NULL, 0, 0);
+        free(arena);
+        free(diff_buf);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_clear();
+        for (int i = 0; i < 100; i++) {
+            render_cube_at((float) i * 0.1f, (float) (i % 10) * 0.6f - 2.7f,
+                           (float) (i / 10) * 0.6f - 2.7f, 3.0f);
+        }
+        render_cube_at((float) iterations * 0.1f, 0.0f, 0.0f, 1.0f);
+        b3d_flush();
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    b3d_set_tile_diff(NULL, 0);
+    b3d_set_binning(NULL, 0, 0);
+    free(arena);
+    free(diff_buf);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: 20x20 grid of spinning cubes
+ * @instanced: record one cube and draw the grid with b3d_draw_instanced()
+ *             instead of transforming and submitting every cube
+ */
+static bench_result_t bench_instanced(int width, int height, bool instanced)
+{
+    bench_result_t result = {
+        .name = strdup(instanced ? "Cube grid (400 cubes), instanced"
+                                 : "Cube grid (400 cubes)"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    size_t list_size = b3d_list_arena_size(12);
+    void *arena = malloc(list_size);
+    float *matrices = malloc(400 * 16 * sizeof(float));
+    const b3d_list_t *cube = NULL;
+    if (arena && matrices && b3d_list_begin(arena, list_size)) {
+        render_cube(0.0f);
+        cube = b3d_list_end();
+    }
+    if (!cube) {
+        free(arena);
+        free(matrices);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+    for (int i = 0; i < 400; i++) {
+        b3d_reset();
+        b3d_translate((float) (i % 20) * 0.4f - 3.8f,
+                      (float) (i / 20) * 0.4f - 3.8f, 4.0f);
+        b3d_get_model_matrix(&matrices[i * 16]);
+    }
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        float angle = (float) iterations * 0.1f;
+        b3d_clear();
+        if (instanced) {
+            b3d_reset();
+            b3d_rotate_y(angle);
+            b3d_rotate_x(angle * 0.7f);
+            b3d_draw_instanced(cube, matrices, 400);
+        } else {
+            for (int i = 0; i < 400; i++) {
+                render_cube_at(angle, (float) (i % 20) * 0.4f - 3.8f,
+                               (float) (i / 20) * 0.4f - 3.8f, 4.0f);
+            }
+        }
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(arena);
+    free(matrices);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: world of 10000 cubes, of which a few hundred are within view
+ * @scene: cull through the b3d_scene BVH with a 60 unit draw distance
+ *         instead of submitting every cube with b3d_list_draw(), which
+ *         culls each one against the frustum on its own
+ */
+static bench_result_t bench_scene(int width, int height, bool scene)
+{
+    bench_result_t result = {
+        .name = strdup(scene ? "World (10000 cubes), scene graph"
+                             : "World (10000 cubes)"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    const int side = 100, n = side * side;
+    const float min[3] = {-0.5f, -0.5f, -0.5f}, max[3] = {0.5f, 0.5f, 0.5f};
+    size_t list_size = b3d_list_arena_size(12);
+    size_t scene_size = b3d_scene_size(n);
+    void *arena = malloc(list_size);
+    void *scene_arena = malloc(scene_size);
+    float *matrices = malloc((size_t) n * 16 * sizeof(float));
+    b3d_scene_t world;
+    const b3d_list_t *cube = NULL;
+    if (arena && scene_arena && matrices &&
+        b3d_scene_init(&world, scene_arena, scene_size, n) &&
+        b3d_list_begin(arena, list_size)) {
+        render_cube(0.0f);
+        cube = b3d_list_end();
+    }
+    for (int i = 0; cube && i < n; i++) {
+        b3d_reset();
+        b3d_rotate_y((float) i);
+        b3d_translate((float) (i % side - side / 2) * 3.0f, 0.0f,
+                      (float) (i / side - side / 2) * 3.0f);
+        b3d_get_model_matrix(&matrices[i * 16]);
+        int node = b3d_scene_add(&world, -1, &matrices[i * 16],
+                                 B3D_SCENE_STATIC);
+        b3d_scene_set_list(&world, node, cube, min, max);
+    }
+    if (!cube) {
+        free(arena);
+        free(scene_arena);
+        free(matrices);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+    b3d_scene_build(&world);
+    world.far = 60.0f;
+    b3d_reset();
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        float angle = (float) iterations * 0.01f;
+        b3d_set_camera(CAM(0.0f, 2.0f, 0.0f, angle, 0.2f, 0.0f));
+        b3d_clear();
+        if (scene) {
+            b3d_scene_draw(&world);
+        } else {
+            for (int i = 0; i < n; i++) {
+                b3d_set_model_matrix(&matrices[i * 16]);
+                b3d_list_draw(cube);
+            }
+            b3d_reset();
+        }
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(arena);
+    free(scene_arena);
+    free(matrices);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: lit torus of 9216 triangles under two lights
+ * @batch: b3d_draw_mesh_lit() with precomputed face normals instead of
+ *         b3d_triangle_lit() per triangle
+ */
+static bench_result_t bench_lit(int width, int height, bool batch)
+{
+    bench_result_t result = {
+        .name = strdup(batch ? "Lit torus (9216 tris), mesh batch"
+                             : "Lit torus (9216 tris), per triangle"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    enum { SEG = 96, RING = 48, TRIS = SEG * RING * 2 };
+    float *positions = malloc(SEG * RING * 3 * sizeof(float));
+    float *normals = malloc(TRIS * 3 * sizeof(float));
+    uint32_t *indices = malloc(TRIS * 3 * sizeof(uint32_t));
+    if (!positions || !normals || !indices) {
+        free(positions);
+        free(normals);
+        free(indices);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+    for (int i = 0; i < SEG; i++) {
+        for (int j = 0; j < RING; j++) {
+            float u = 6.2831853f * i / SEG, v = 6.2831853f * j / RING;
+            float *p = &positions[(i * RING + j) * 3];
+            p[0] = (1.0f + 0.4f * cosf(v)) * cosf(u);
+            p[1] = 0.4f * sinf(v);
+            p[2] = (1.0f + 0.4f * cosf(v)) * sinf(u);
+        }
+    }
+    for (int i = 0, t = 0; i < SEG; i++) {
+        for (int j = 0; j < RING; j++, t += 2) {
+            uint32_t a = i * RING + j, b = ((i + 1) % SEG) * RING + j;
+            uint32_t c = i * RING + (j + 1) % RING;
+            uint32_t d = ((i + 1) % SEG) * RING + (j + 1) % RING;
+            uint32_t quad[6] = {a, c, b, b, c, d};
+            memcpy(&indices[t * 3], quad, sizeof(quad));
+        }
+    }
+    for (int t = 0; t < TRIS; t++) {
+        const float *p0 = &positions[indices[t * 3] * 3];
+        const float *p1 = &positions[indices[t * 3 + 1] * 3];
+        const float *p2 = &positions[indices[t * 3 + 2] * 3];
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float *n = &normals[t * 3];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int k = 0; k < 3; k++)
+            n[k] = len > 0.0f ? n[k] / len : 0.0f;
+    }
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+    b3d_set_light(1, -1.0f, 1.0f, 0.0f, 0.5f);
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        float angle = (float) iterations * 0.05f;
+        b3d_clear();
+        b3d_reset();
+        b3d_rotate_x(angle);
+        b3d_rotate_y(angle * 0.7f);
+        if (batch) {
+            b3d_draw_mesh_lit(positions, SEG * RING, indices, TRIS * 3,
+                              normals, 0xE0A040);
+        } else {
+            for (int t = 0; t < TRIS; t++) {
+                b3d_tri_t tri;
+                for (int k = 0; k < 3; k++) {
+                    const float *p = &positions[indices[t * 3 + k] * 3];
+                    tri.v[k] = (b3d_point_t) {p[0], p[1], p[2]};
+                }
+                const float *n = &normals[t * 3];
+                b3d_triangle_lit(&tri, n[0], n[1], n[2], 0xE0A040);
+            }
+        }
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    b3d_set_light(1, 0.0f, 0.0f, 1.0f, 0.0f);
+    free(positions);
+    free(normals);
+    free(indices);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: RGB565 frame of 100 cubes for a 16-bit display
+ * @direct: rasterize into the RGB565 buffer instead of converting an
+ *          XRGB8888 frame into it
+ */
+static bench_result_t bench_rgb565(int width, int height, bool direct)
+{
+    bench_result_t result = {
+        .name = strdup(direct ? "RGB565 frame, direct" : "RGB565 frame, copy"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    const size_t count = (size_t) width * (size_t) height;
+    uint16_t *screen = malloc(count * sizeof(uint16_t));
+    if (!screen || (direct && !b3d_init_ex(screen, B3D_FORMAT_RGB565, 0,
+                                           depth, width, height, 65.0f))) {
+        free(screen);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_clear();
+        for (int i = 0; i < 100; i++) {
+            render_cube_at((float) (i + iterations) * 0.1f,
+                           (float) (i % 10) * 0.6f - 2.7f,
+                           (float) (i / 10) * 0.6f - 2.7f, 3.0f);
+        }
+        if (!direct) {
+            for (size_t i = 0; i < count; i++) {
+                uint32_t c = pixels[i];
+                screen[i] = (uint16_t) (((c >> 8) & 0xF800) |
+                                        ((c >> 5) & 0x07E0) | ((c >> 3) & 0x1F));
+            }
+        }
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(screen);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: Binned frames of 400 cubes, geometry and rasterization split
+ * @pipelined: set up each frame while the previous one is rasterized
+ */
+static bench_result_t bench_frames(int width, int height, bool pipelined)
+{
+    bench_result_t result = {
+        .name = strdup(pipelined ? "Binned frames, pipelined"
+                                 : "Binned frames, flushed"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    size_t bin_size = b3d_bin_arena_size(width, height, 8192);
+    size_t frame_size = b3d_frame_arena_size(width, height, 8192);
+    uint32_t *back = malloc((size_t) width * height * sizeof(uint32_t));
+    void *bin_arena = malloc(bin_size);
+    void *frame_arena = malloc(frame_size);
+    if (!back || !bin_arena || !frame_arena ||
+        !b3d_set_binning(bin_arena, bin_size, 1) ||
+        (pipelined && !b3d_set_frames(back, frame_arena, frame_size))) {
+        b3d_set_binning(NULL, 0, 0);
+        free(back);
+        free(bin_arena);
+        free(frame_arena);
+        free(pixels);
+        free(depth);
+        return result;
+    }
+
+    b3d_set_camera(CAM(0.0f, 0.0f, -3.0f, 0.0f, 0.0f, 0.0f));
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        if (pipelined)
+            b3d_frame_begin();
+        b3d_clear();
+        for (int i = 0; i < 400; i++) {
+            render_cube_at((float) (i + iterations) * 0.1f,
+                           (float) (i % 20) * 0.4f - 3.8f,
+                           (float) (i / 20) * 0.4f - 3.8f, 4.0f);
+        }
+        if (pipelined) {
+            b3d_frame_wait();
+            b3d_frame_submit();
+        } else {
+            b3d_flush();
+        }
+        iterations++;
+    }
+    b3d_frame_wait();
+
+    double elapsed = get_time_ms() - start;
+    b3d_set_frames(NULL, NULL, 0);
+    b3d_set_binning(NULL, 0, 0);
+    free(back);
+    free(bin_arena);
+    free(frame_arena);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: encoding a rendered frame for snapshots and video streams,
+ * into memory so that disk speed does not count
+ */
+static bench_result_t bench_encode(int width, int height, int type)
+{
+    static const char *const names[] = {
+        "Frame encode, PNG",
+        "Frame encode, PPM",
+        "Frame encode, RAW",
+        "Frame encode, Y4M",
+    };
+    bench_result_t result = {
+        .name = strdup(names[type]),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+    size_t size = b3d_image_size(type, width, height);
+    void *out = malloc(size);
+    if (!out) {
+        free(pixels);
+        free(depth);
+        return result;
+    }
+    b3d_clear();
+    for (int i = 0; i < 50; i++)
+        render_cube_at(i * 0.1f, (i % 10) * 0.4f - 2.0f,
+                       (i / 10) * 0.4f - 1.0f, 4.0f);
+
+    /* Warmup */
+    for (int i = 0; i < WARMUP_ITERATIONS / 10; i++)
+        b3d_image_encode(out, type, pixels, B3D_FORMAT_XRGB8888, 0, width,
+                         height);
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_image_encode(out, type, pixels, B3D_FORMAT_XRGB8888, 0, width,
+                         height);
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    free(out);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: Ground plane of large quads seen from eye height
+ * @guard: clip against the guard band instead of the screen edges
+ */
+static bench_result_t bench_ground(int width, int height, bool guard)
+{
+    bench_result_t result = {
+        .name = strdup(guard ? "Ground plane, guard band" : "Ground plane"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+    b3d_set_guard_band(guard);
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_set_camera(CAM(0.0f, 1.0f, 0.0f, (float) iterations * 0.01f,
+                           0.0f, 0.0f));
+        b3d_clear();
+        b3d_reset();
+        for (int i = -8; i < 8; i++) {
+            for (int j = -8; j < 8; j++) {
+                float x = (float) i * 10.0f, z = (float) j * 10.0f;
+                uint32_t c = (i + j) & 1 ? 0x406040 : 0x608060;
+                b3d_triangle(TRI(x, 0.0f, z, x, 0.0f, z + 10.0f, x + 10.0f,
+                                 0.0f, z + 10.0f),
+                             c);
+                b3d_triangle(TRI(x, 0.0f, z, x + 10.0f, 0.0f, z + 10.0f,
+                                 x + 10.0f, 0.0f, z),
+                             c);
+            }
+        }
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    b3d_set_guard_band(false);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+/*
+ * Benchmark: Ground plane with per-vertex colors, optionally textured
+ * @textured: modulate by a mipmapped, bilinear 64x64 checker texture
+ */
+static bench_result_t bench_shaded(int width, int height, bool textured)
+{
+    bench_result_t result = {
+        .name = strdup(textured ? "Ground plane, textured" :
+                                  "Ground plane, Gouraud"),
+        .ops_per_sec = 0.0,
+        .avg_time_us = 0.0,
+        .iterations = 0,
+    };
+
+    uint32_t *pixels = NULL;
+    b3d_depth_t *depth = NULL;
+    if (!setup_benchmark(width, height, &pixels, &depth))
+        return result;
+
+    static uint32_t image[64 * 64], texels[64 * 64 * 2];
+    for (int i = 0; i < 64 * 64; i++)
+        image[i] = ((i >> 3) ^ (i >> 9)) & 1 ? 0xffffff : 0x808080;
+    b3d_texture_t tex;
+    if (textured &&
+        b3d_texture_init(&tex, texels, sizeof(texels), image, 64, 64,
+                         B3D_FILTER_BILINEAR))
+        b3d_set_texture(&tex);
+
+    size_t iterations = 0;
+    double start = get_time_ms();
+
+    while (get_time_ms() - start < BENCHMARK_DURATION_MS) {
+        b3d_set_camera(CAM(0.0f, 1.0f, 0.0f, (float) iterations * 0.01f,
+                           0.0f, 0.0f));
+        b3d_clear();
+        b3d_reset();
+        for (int i = -8; i < 8; i++) {
+            for (int j = -8; j < 8; j++) {
+                float x = (float) i * 10.0f, z = (float) j * 10.0f;
+                b3d_attr_t a = {
+                    .color = {0xff4040, 0x40ff40, 0x4040ff},
+                    .uv = {{0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}},
+                };
+                b3d_attr_t b = {
+                    .color = {0xff4040, 0x4040ff, 0xffff40},
+                    .uv = {{0.0f, 0.0f}, {1.0f, 1.0f}, {1.0f, 0.0f}},
+                };
+                b3d_triangle_ex(TRI(x, 0.0f, z, x, 0.0f, z + 10.0f,
+                                    x + 10.0f, 0.0f, z + 10.0f),
+                                &a);
+                b3d_triangle_ex(TRI(x, 0.0f, z, x + 10.0f, 0.0f, z + 10.0f,
+                                    x + 10.0f, 0.0f, z),
+                                &b);
+            }
+        }
+        iterations++;
+    }
+
+    double elapsed = get_time_ms() - start;
+    b3d_set_texture(NULL);
+    free(pixels);
+    free(depth);
+
+    if (iterations == 0 || elapsed <= 0.0)
+        return result;
+
+    result.ops_per_sec = (double) iterations / (elapsed / 1000.0);
+    result.avg_time_us = (elapsed * 1000.0) / (double) iterations;
+    result.iterations = iterations;
+    return result;
+}
+
+int main(void)
+{
+    printf(ANSI_BOLD "B3D Performance Benchmarks\n" ANSI_RESET);
+    printf("===========================\n");
+    printf("Each benchmark runs for ~1 second\n\n");
+
+    bench_result_t results[48];
+    int num_results = 0;
+
+    printf(ANSI_BOLD "Primitive Operations:\n" ANSI_RESET);
+    results[num_results++] = bench_matrix_ops();
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_matrix_stack();
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_to_screen();
+    print_result(&results[num_results - 1]);
+
+    printf("\n" ANSI_BOLD "Buffer Operations:\n" ANSI_RESET);
+    results[num_results++] = bench_clear(320, 240, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_clear(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_clear(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_obj_parse();
+    print_result(&results[num_results - 1]);
+
+    printf("\n" ANSI_BOLD "Rendering Throughput:\n" ANSI_RESET);
+    results[num_results++] = bench_triangles(320, 240);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_cubes(320, 240);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_tiny_triangles(320, 240);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_occluded(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_occluded(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_overdraw(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_overdraw(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_prepass(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_prepass(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    for (int scale = 1; scale <= 2; scale++) {
+        results[num_results++] = bench_adapt(640, 480, scale);
+        print_result(&results[num_results - 1]);
+    }
+
+    results[num_results++] = bench_static(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_static(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_instanced(320, 240, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_instanced(320, 240, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_scene(320, 240, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_scene(320, 240, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_lit(320, 240, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_lit(320, 240, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_rgb565(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_rgb565(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_frames(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_frames(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_ground(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_ground(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_shaded(640, 480, false);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_shaded(640, 480, true);
+    print_result(&results[num_results - 1]);
+
+    for (int type = B3D_IMAGE_PNG; type <= B3D_IMAGE_Y4M; type++) {
+        results[num_results++] = bench_encode(640, 480, type);
+        print_result(&results[num_results - 1]);
+    }
+
+    printf("\n" ANSI_BOLD "Frame Rate (clear + render):\n" ANSI_RESET);
+    results[num_results++] = bench_full_frame(320, 240, 0);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_full_frame(640, 480, 0);
+    print_result(&results[num_results - 1]);
+
+    results[num_results++] = bench_full_frame(800, 600, 0);
     print_result(&results[num_results - 1]);
 
-    results[num_results++] = bench_full_frame(640, 480);
+    results[num_results++] = bench_full_frame(800, 600, 1);
     print_result(&results[num_results - 1]);
 
-    results[num_results++] = bench_full_frame(800, 600);
+    results[num_results++] = bench_full_frame(800, 600, 4);
     print_result(&results[num_results - 1]);
 
     printf("\n===========================\n");